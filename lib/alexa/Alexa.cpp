@@ -2,33 +2,91 @@
 
 AlexaClass Alexa;
 
-void AlexaClass::initAlexa(AsyncWebServer* server, std::function<void(bool)> onMessageFunc) {
+void AlexaClass::initAlexa(AsyncWebServer* server, std::function<void(uint8_t, bool)> onMessageFunc) {
+    // Called on every reconnect, but devices and handlers must only be added once
+    if (started) {
+        return;
+    }
+    started = true;
+
     // Use shared AsyncWebServer
     fauxmo.createServer(false);
     fauxmo.setPort(80);        // required for Alexa Gen3+ devices
     fauxmo.enable(true);
 
-    // Alexa device(s)
-    fauxmo.addDevice(ALEXA_DEVICE_NAME); 
+    // One Alexa device per power channel, named after it
+    for (uint8_t ch = 0; ch < Power.getChannelCount(); ch++) {
+        unsigned char id = fauxmo.addDevice(Power.getChannelName(ch));
+        if (id < PowerClass::MAX_CHANNELS) {
+            deviceChannel[id] = ch;
+        }
+    }
 
-    Serial.println("[FAUXMO] - Setup done via AsyncWebServer");
+    LOG_I("FAUXMO", "Setup done via AsyncWebServer");
 
     fauxmo.onSetState([=](unsigned char deviceId, const char* deviceName, bool state, unsigned char value) {
-        Serial.printf("[FAUXMO] - Device #%d (%s) state: %s value: %d\n",
-                     deviceId, deviceName, state ? "ON" : "OFF", value);
-        onMessageFunc(state);
+        LOG_I("FAUXMO", "Device #%d (%s) state: %s value: %d",
+              deviceId, deviceName, state ? "ON" : "OFF", value);
+        if (deviceId < Power.getChannelCount()) {
+            onMessageFunc(deviceChannel[deviceId], state);
+        }
     });
 
-    server->onNotFound([this](AsyncWebServerRequest *request){
-        String body = ""; 
-        if (fauxmo.process(request->client(), request->method() == HTTP_GET, request->url(), body)) {
-            return; 
+    // Hue control requests carry their JSON in the body; keep it for handleNotFound()
+    server->onRequestBody([](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if (index != 0 || len != total || total > MAX_BODY || !isHuePath(request->url().c_str())) {
+            return;
         }
-        
-        request->send(404, "text/plain", "Not found");
+        char* body = (char*)malloc(len + 1);
+        if (body != nullptr) {
+            memcpy(body, data, len);
+            body[len] = '\0';
+            request->_tempObject = body;    // freed with the request
+        }
+    });
+
+    server->onNotFound([this](AsyncWebServerRequest *request) {
+        handleNotFound(request);
     });
 }
 
+bool AlexaClass::isHuePath(const char* url) {
+    return (strncmp(url, "/api", 4) == 0 && (url[4] == '\0' || url[4] == '/')) ||
+           strcmp(url, "/description.xml") == 0;
+}
+
+// Scanners, favicon probes and typos get a 404 here without going through
+// the Hue emulation parser
+void AlexaClass::handleNotFound(AsyncWebServerRequest* request) {
+    const char* url = request->url().c_str();
+    if (!isHuePath(url)) {
+        stats.filtered++;
+        request->send(404, "text/plain", "Not found");
+        return;
+    }
+
+    bool isGet = request->method() == HTTP_GET;
+    if (isGet) {
+        stats.discovery++;
+    } else {
+        stats.control++;
+    }
+
+    unsigned long start = Hal.micros();
+    String body = request->_tempObject != nullptr ? (const char*)request->_tempObject : "";
+    bool handled = fauxmo.process(request->client(), isGet, request->url(), body);
+    stats.lastMicros = Hal.micros() - start;
+    if (stats.lastMicros > stats.maxMicros) {
+        stats.maxMicros = stats.lastMicros;
+    }
+
+    if (handled) {
+        return;
+    }
+    stats.unhandled++;
+    request->send(404, "text/plain", "Not found");
+}
+
 void AlexaClass::loopAlexa() {
     // Only handle if WiFi is connected
     if (WiFi.status() == WL_CONNECTED) {
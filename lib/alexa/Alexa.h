@@ -3,17 +3,40 @@
 
 #include <fauxmoESP.h>
 #include <ESPAsyncWebServer.h>
+#include <Hal.h>
+#include <Log.h>
+#include <Power.h>
 
 class AlexaClass {
     
     public:
+        static const size_t MAX_BODY = 128;                   // Hue control bodies are a few bytes of JSON
+
+        struct Stats {
+            unsigned long discovery;        // description and device list requests
+            unsigned long control;          // state changes
+            unsigned long filtered;         // not a Hue path, 404 without touching fauxmo
+            unsigned long unhandled;        // Hue path fauxmo did not answer
+            unsigned long lastMicros;       // time spent in fauxmo for the last request
+            unsigned long maxMicros;
+        };
+
         void
-            initAlexa(AsyncWebServer* server, std::function<void(bool)> onMessageFunc),
+            initAlexa(AsyncWebServer* server, std::function<void(uint8_t, bool)> onMessageFunc),
             loopAlexa();
+
+        const Stats& getStats() { return stats; }
+
+        // Hue API and UPnP description, the only URLs fauxmo answers
+        static bool isHuePath(const char* url);
     
     private:
-        const char* ALEXA_DEVICE_NAME = "Remote PC";
         fauxmoESP fauxmo;
+        bool started = false;
+        uint8_t deviceChannel[PowerClass::MAX_CHANNELS];     // fauxmo device id -> power channel
+        Stats stats = {};
+
+        void handleNotFound(AsyncWebServerRequest* request);
 };
 
 extern AlexaClass Alexa;
@@ -0,0 +1,154 @@
+#include <Assets.h>
+#include <WebAssets.h>
+
+AssetsClass Assets;
+
+void AssetsClass::initAssets() {
+    overrideCount = 0;
+
+    File file = LittleFS.open(manifestPath, "r");
+    if (!file) {
+        LOG_I("ASSETS", "%d embedded asset(s), no overrides", EMBEDDED_ASSET_COUNT);
+        return;
+    }
+
+    // One "<path> <hash>" pair per line, file stored as /www<path>[.gz]
+    char line[48];
+    while (file.available() && overrideCount < MAX_OVERRIDES) {
+        size_t n = file.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[n] = '\0';
+
+        char* space = strchr(line, ' ');
+        if (space == nullptr || (size_t)(space - line) >= sizeof(overrides[0].path) ||
+            strlen(space + 1) != sizeof(overrides[0].hash) - 1) {
+            continue;
+        }
+
+        Override& o = overrides[overrideCount++];
+        *space = '\0';
+        strcpy(o.path, line);
+        strcpy(o.hash, space + 1);
+    }
+    file.close();
+
+    LOG_I("ASSETS", "%d embedded asset(s), %d LittleFS override(s)", EMBEDDED_ASSET_COUNT, overrideCount);
+}
+
+const AssetsClass::Override* AssetsClass::findOverride(const char* path) const {
+    for (int i = 0; i < overrideCount; i++) {
+        if (strcmp(overrides[i].path, path) == 0) {
+            return &overrides[i];
+        }
+    }
+    return nullptr;
+}
+
+int AssetsClass::findEmbedded(const char* path) {
+    for (int i = 0; i < EMBEDDED_ASSET_COUNT; i++) {
+        if (strcmp(EMBEDDED_ASSETS[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* AssetsClass::contentType(const char* path) {
+    const char* ext = strrchr(path, '.');
+    if (ext == nullptr) return "application/octet-stream";
+    if (strcmp(ext, ".html") == 0) return "text/html";
+    if (strcmp(ext, ".css") == 0) return "text/css";
+    if (strcmp(ext, ".js") == 0) return "application/javascript";
+    if (strcmp(ext, ".json") == 0) return "application/json";
+    if (strcmp(ext, ".png") == 0) return "image/png";
+    if (strcmp(ext, ".ico") == 0) return "image/x-icon";
+    if (strcmp(ext, ".svg") == 0) return "image/svg+xml";
+    return "text/plain";
+}
+
+bool AssetsClass::notModified(AsyncWebServerRequest* request, const char* hash) {
+    if (!request->hasHeader("If-None-Match")) {
+        return false;
+    }
+    char etag[11];
+    snprintf(etag, sizeof(etag), "\"%s\"", hash);
+    return strstr(request->header("If-None-Match").c_str(), etag) != nullptr;
+}
+
+// Fingerprinted URLs never change content, everything else revalidates
+void AssetsClass::addCacheHeaders(AsyncWebServerRequest* request, AsyncWebServerResponse* response, const char* hash) {
+    char etag[11];
+    snprintf(etag, sizeof(etag), "\"%s\"", hash);
+
+    bool fingerprinted = request->hasParam("v") && request->getParam("v")->value() == hash;
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", fingerprinted ? "public, max-age=31536000, immutable" : "no-cache");
+}
+
+void AssetsClass::record(SourceStats& stats, unsigned long start) {
+    unsigned long elapsed = Hal.micros() - start;
+    if (elapsed > stats.maxHandlerMicros) {
+        stats.maxHandlerMicros = elapsed;
+    }
+    uint32_t freeHeap = Hal.freeHeap();
+    if (freeHeap < stats.minFreeHeap) {
+        stats.minFreeHeap = freeHeap;
+    }
+}
+
+void AssetsClass::send(AsyncWebServerRequest* request, const char* path) {
+    unsigned long start = Hal.micros();
+    AsyncWebServerResponse* response;
+
+    // LittleFS override
+    const Override* o = findOverride(path);
+    if (o != nullptr) {
+        fsStats.requests++;
+        if (notModified(request, o->hash)) {
+            fsStats.notModified++;
+            response = request->beginResponse(304);
+        } else {
+            // AsyncFileResponse falls back to <path>.gz and sets Content-Encoding
+            char fsPath[40];
+            snprintf(fsPath, sizeof(fsPath), "%s%s", overrideDir, path);
+            response = request->beginResponse(LittleFS, fsPath, contentType(path));
+        }
+        addCacheHeaders(request, response, o->hash);
+        request->send(response);
+        record(fsStats, start);
+        return;
+    }
+
+    // Embedded copy, streamed straight from flash
+    int i = findEmbedded(path);
+    if (i < 0) {
+        request->send(LittleFS, path, contentType(path));
+        return;
+    }
+
+    const EmbeddedAsset& a = EMBEDDED_ASSETS[i];
+    flashStats.requests++;
+    if (notModified(request, a.hash)) {
+        flashStats.notModified++;
+        response = request->beginResponse(304);
+    } else {
+        response = request->beginResponse(200, contentType(path), a.data, a.length);
+        if (a.gzipped) {
+            response->addHeader("Content-Encoding", "gzip");
+        }
+    }
+    addCacheHeaders(request, response, a.hash);
+    request->send(response);
+    record(flashStats, start);
+}
+
+bool AssetsClass::canHandle(AsyncWebServerRequest* request) const {
+    if (request->method() != HTTP_GET) {
+        return false;
+    }
+    const char* url = request->url().c_str();
+    return findOverride(url) != nullptr || findEmbedded(url) >= 0;
+}
+
+void AssetsClass::handleRequest(AsyncWebServerRequest* request) {
+    send(request, request->url().c_str());
+}
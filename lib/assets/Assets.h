@@ -0,0 +1,59 @@
+#ifndef ASSETS_H_
+#define ASSETS_H_
+
+#include <ESPAsyncWebServer.h>
+#include <Hal.h>
+#include <Filesys.h>
+
+// Serves the web UI compiled into flash by scripts/web_assets.py, with
+// optional LittleFS overrides under /www listed in /assets.txt. Both paths
+// send gzipped bodies with strong ETags, answer 304 on revalidation and
+// mark fingerprinted (?v=<hash>) URLs immutable.
+class AssetsClass : public AsyncWebHandler {
+
+    public:
+        static const int MAX_OVERRIDES = 16;
+
+        struct SourceStats {
+            unsigned long requests;
+            unsigned long notModified;
+            unsigned long maxHandlerMicros;    // time to build and queue the response
+            uint32_t minFreeHeap;              // heap low-water mark right after queueing
+        };
+
+        void initAssets();
+        void send(AsyncWebServerRequest* request, const char* path);
+
+        const SourceStats& getFlashStats() { return flashStats; }
+        const SourceStats& getFsStats() { return fsStats; }
+
+        bool canHandle(AsyncWebServerRequest* request) const override;
+        void handleRequest(AsyncWebServerRequest* request) override;
+        bool isRequestHandlerTrivial() const override { return true; }
+
+    private:
+        const char* manifestPath = "/assets.txt";
+        const char* overrideDir = "/www";
+
+        struct Override {
+            char path[32];
+            char hash[9];
+        };
+
+        Override overrides[MAX_OVERRIDES];
+        int overrideCount = 0;
+
+        SourceStats flashStats = {0, 0, 0, UINT32_MAX};
+        SourceStats fsStats = {0, 0, 0, UINT32_MAX};
+
+        const Override* findOverride(const char* path) const;
+        static int findEmbedded(const char* path);
+        static const char* contentType(const char* path);
+        static bool notModified(AsyncWebServerRequest* request, const char* hash);
+        static void addCacheHeaders(AsyncWebServerRequest* request, AsyncWebServerResponse* response, const char* hash);
+        static void record(SourceStats& stats, unsigned long start);
+};
+
+extern AssetsClass Assets;
+
+#endif
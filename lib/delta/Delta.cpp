@@ -0,0 +1,172 @@
+#include <Delta.h>
+#include <string.h>
+
+static const uint8_t OP_END = 0x00;
+static const uint8_t OP_COPY = 0x01;
+static const uint8_t OP_INSERT = 0x02;
+
+static inline uint32_t load32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void DeltaPatch::begin(HeaderCheck onHeader, Reader readOld, Writer writeNew) {
+    this->onHeader = onHeader;
+    this->readOld = readOld;
+    this->writeNew = writeNew;
+    state = ST_HEADER;
+    argsNeeded = HEADER_SIZE;
+    argsHave = 0;
+    remaining = 0;
+    written = 0;
+    windowFill = 0;
+    error = nullptr;
+}
+
+DeltaPatch::Result DeltaPatch::fail(const char* reason) {
+    state = ST_ERROR;
+    error = reason;
+    return DELTA_ERROR;
+}
+
+bool DeltaPatch::flush() {
+    if (windowFill == 0) {
+        return true;
+    }
+    bool ok = writeNew(window, windowFill);
+    windowFill = 0;
+    return ok;
+}
+
+// Output may never run past the size the header announced
+bool DeltaPatch::reserve(uint32_t len) {
+    if (len > header.newSize - written) {
+        return false;
+    }
+    written += len;
+    return true;
+}
+
+bool DeltaPatch::copy(uint32_t offset, uint32_t len) {
+    if (offset > header.oldSize || len > header.oldSize - offset || !reserve(len)) {
+        return false;
+    }
+    while (len > 0) {
+        size_t n = WINDOW_SIZE - windowFill;
+        if (n > len) {
+            n = len;
+        }
+        if (!readOld(offset, window + windowFill, n)) {
+            return false;
+        }
+        windowFill += n;
+        offset += n;
+        len -= n;
+        if (windowFill == WINDOW_SIZE && !flush()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+DeltaPatch::Result DeltaPatch::finishArgs() {
+    if (state == ST_HEADER) {
+        if (memcmp(args, "WWD1", 4) != 0) {
+            return fail("not a delta patch");
+        }
+        header.oldSize = load32(args + 4);
+        memcpy(header.oldMd5, args + 8, MD5_SIZE);
+        header.newSize = load32(args + 24);
+        memcpy(header.newMd5, args + 28, MD5_SIZE);
+        if (!onHeader(header)) {
+            return fail("patch does not apply to the running image");
+        }
+        state = ST_OP;
+        return DELTA_MORE;
+    }
+
+    if (op == OP_COPY) {
+        if (!copy(load32(args), load32(args + 4))) {
+            return fail("copy out of range or write failed");
+        }
+        state = ST_OP;
+        return DELTA_MORE;
+    }
+
+    remaining = load32(args);
+    if (!reserve(remaining)) {
+        return fail("insert past the new image size");
+    }
+    state = remaining > 0 ? ST_INSERT : ST_OP;
+    return DELTA_MORE;
+}
+
+DeltaPatch::Result DeltaPatch::feed(const uint8_t* data, size_t len) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        switch (state) {
+            case ST_HEADER:
+            case ST_ARGS: {
+                size_t n = argsNeeded - argsHave;
+                if (n > len - pos) {
+                    n = len - pos;
+                }
+                memcpy(args + argsHave, data + pos, n);
+                argsHave += n;
+                pos += n;
+                if (argsHave == argsNeeded && finishArgs() == DELTA_ERROR) {
+                    return DELTA_ERROR;
+                }
+                break;
+            }
+
+            case ST_OP:
+                op = data[pos++];
+                if (op == OP_END) {
+                    if (written != header.newSize) {
+                        return fail("patch ended before the new image was complete");
+                    }
+                    if (!flush()) {
+                        return fail("write failed");
+                    }
+                    state = ST_DONE;
+                } else if (op == OP_COPY || op == OP_INSERT) {
+                    state = ST_ARGS;
+                    argsNeeded = op == OP_COPY ? 8 : 4;
+                    argsHave = 0;
+                } else {
+                    return fail("unknown op");
+                }
+                break;
+
+            case ST_INSERT: {
+                size_t n = WINDOW_SIZE - windowFill;
+                if (n > remaining) {
+                    n = remaining;
+                }
+                if (n > len - pos) {
+                    n = len - pos;
+                }
+                memcpy(window + windowFill, data + pos, n);
+                windowFill += n;
+                pos += n;
+                remaining -= n;
+                if (windowFill == WINDOW_SIZE && !flush()) {
+                    return fail("write failed");
+                }
+                if (remaining == 0) {
+                    state = ST_OP;
+                }
+                break;
+            }
+
+            case ST_DONE:
+                return fail("data after the end of the patch");
+
+            case ST_ERROR:
+                return DELTA_ERROR;
+        }
+    }
+
+    return state == ST_DONE ? DELTA_DONE : state == ST_ERROR ? DELTA_ERROR : DELTA_MORE;
+}
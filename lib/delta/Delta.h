@@ -0,0 +1,74 @@
+#ifndef DELTA_H_
+#define DELTA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// Streaming applier for firmware delta patches (scripts/ota_delta.py). The
+// patch rebuilds the new image from ranges of the running one plus literal
+// bytes, so it can be fed in arbitrary chunks straight from an upload: the
+// output goes through one WINDOW_SIZE buffer to the writer and nothing else
+// is buffered. Hardware independent, builds in env:native.
+//
+//   header  = "WWD1" old size:u32 old md5[16] new size:u32 new md5[16]
+//   op      = 0x01 COPY    offset:u32 len:u32          bytes of the old image
+//             0x02 INSERT  len:u32 data[len]           literal bytes
+//             0x00 END                                 (all little endian)
+class DeltaPatch {
+
+    public:
+        static const size_t WINDOW_SIZE = 1024;
+        static const size_t HEADER_SIZE = 44;
+        static const size_t MD5_SIZE = 16;
+
+        enum Result { DELTA_MORE, DELTA_DONE, DELTA_ERROR };
+
+        struct Header {
+            uint32_t oldSize;
+            uint8_t oldMd5[MD5_SIZE];
+            uint32_t newSize;
+            uint8_t newMd5[MD5_SIZE];
+        };
+
+        typedef std::function<bool(const Header& header)> HeaderCheck;
+        typedef std::function<bool(uint32_t offset, uint8_t* out, size_t len)> Reader;
+        typedef std::function<bool(const uint8_t* data, size_t len)> Writer;
+
+        // onHeader decides whether the patch applies to the running image
+        // and prepares the writer; returning false aborts
+        void begin(HeaderCheck onHeader, Reader readOld, Writer writeNew);
+        Result feed(const uint8_t* data, size_t len);
+
+        const Header& getHeader() { return header; }
+        uint32_t getWritten() { return written; }
+        const char* getError() { return error; }
+
+    private:
+        enum State { ST_HEADER, ST_OP, ST_ARGS, ST_INSERT, ST_DONE, ST_ERROR };
+
+        HeaderCheck onHeader;
+        Reader readOld;
+        Writer writeNew;
+
+        State state = ST_ERROR;
+        Header header;
+        uint8_t op = 0;
+        uint8_t args[HEADER_SIZE];      // header, then the arguments of one op
+        size_t argsNeeded = 0;
+        size_t argsHave = 0;
+        uint32_t remaining = 0;         // literal bytes left in an INSERT
+        uint32_t written = 0;
+        const char* error = nullptr;
+
+        uint8_t window[WINDOW_SIZE];
+        size_t windowFill = 0;
+
+        Result fail(const char* reason);
+        bool flush();
+        bool reserve(uint32_t len);
+        bool copy(uint32_t offset, uint32_t len);
+        Result finishArgs();
+};
+
+#endif
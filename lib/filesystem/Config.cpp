@@ -0,0 +1,169 @@
+#include <Config.h>
+#include <stddef.h>
+
+ConfigClass Config;
+
+const ConfigClass::Field ConfigClass::SCHEMA[KEY_COUNT] = {
+    { offsetof(Record, ssid),        sizeof(Record::ssid),        "/ssid.txt" },
+    { offsetof(Record, pass),        sizeof(Record::pass),        "/pass.txt" },
+    { offsetof(Record, devName),     sizeof(Record::devName),     "/dev_name.txt" },
+    { offsetof(Record, probeTarget), sizeof(Record::probeTarget), "/probe_target.txt" },
+    { offsetof(Record, staticIp),    sizeof(Record::staticIp),    "/static_ip.txt" },
+    { offsetof(Record, timezone),    sizeof(Record::timezone),    nullptr },
+    { offsetof(Record, mqttBroker),  sizeof(Record::mqttBroker),  nullptr },
+    { offsetof(Record, mqttUser),    sizeof(Record::mqttUser),    nullptr },
+    { offsetof(Record, mqttPass),    sizeof(Record::mqttPass),    nullptr },
+    { offsetof(Record, mqttTopic),   sizeof(Record::mqttTopic),   nullptr },
+};
+
+uint32_t ConfigClass::recordCrc(const Record& r) {
+    return Filesys.crc32((const uint8_t*)&r + HEADER_SIZE, r.size);
+}
+
+void ConfigClass::reset() {
+    memset(&record, 0, sizeof(record));
+    record.magic = MAGIC;
+    record.version = VERSION;
+    record.size = sizeof(Record) - HEADER_SIZE;
+}
+
+void ConfigClass::load() {
+    unsigned long start = Hal.micros();
+
+    if (!readRecord()) {
+        reset();
+        if (migrateLegacy()) {
+            commit();
+        }
+    }
+
+    loadMicros = Hal.micros() - start;
+    LOG_I("CONFIG", "Loaded v%u in %lu us", record.version, loadMicros);
+}
+
+bool ConfigClass::readRecord() {
+    File file = LittleFS.open(configPath, "r");
+    if (!file) {
+        return false;
+    }
+
+    Record stored;
+    memset(&stored, 0, sizeof(stored));
+
+    // Older versions have a shorter body; newer ones are not understood
+    bool ok = file.read((uint8_t*)&stored, HEADER_SIZE) == HEADER_SIZE &&
+              stored.magic == MAGIC &&
+              stored.version <= VERSION &&
+              stored.size <= sizeof(Record) - HEADER_SIZE &&
+              file.size() == HEADER_SIZE + stored.size &&
+              file.read((uint8_t*)&stored + HEADER_SIZE, stored.size) == stored.size &&
+              stored.crc == recordCrc(stored);
+    file.close();
+
+    if (!ok) {
+        LOG_W("CONFIG", "%s invalid, ignoring", configPath);
+        return false;
+    }
+
+    record = stored;
+    if (record.version != VERSION) {
+        LOG_I("CONFIG", "Upgrading config v%u to v%u", record.version, VERSION);
+        record.version = VERSION;
+        record.size = sizeof(Record) - HEADER_SIZE;
+        dirty = true;
+        dirtySince = Hal.millis();
+    }
+    return true;
+}
+
+// One-time import of the per-setting text files used by older firmware
+bool ConfigClass::migrateLegacy() {
+    bool found = false;
+
+    for (int i = 0; i < KEY_COUNT; i++) {
+        if (SCHEMA[i].legacyPath == nullptr || !LittleFS.exists(SCHEMA[i].legacyPath)) {
+            continue;
+        }
+        String value = Filesys.readFirstLine(SCHEMA[i].legacyPath);
+        value.trim();
+        set((Key)i, value.c_str());
+        found = true;
+    }
+
+    if (found) {
+        LOG_I("CONFIG", "Migrated legacy settings files");
+    }
+    return found;
+}
+
+const char* ConfigClass::get(Key key) {
+    return (const char*)&record + SCHEMA[key].offset;
+}
+
+bool ConfigClass::set(Key key, const char* value) {
+    const Field& f = SCHEMA[key];
+    if (strlen(value) >= f.size) {
+        LOG_W("CONFIG", "Value too long for field %d", key);
+        return false;
+    }
+
+    char* dst = (char*)&record + f.offset;
+    if (strcmp(dst, value) == 0) {
+        return true;
+    }
+
+    memset(dst, 0, f.size);
+    strcpy(dst, value);
+
+    // Every change restarts the wait, so a burst is written once it settles
+    dirty = true;
+    dirtySince = Hal.millis();
+    return true;
+}
+
+bool ConfigClass::commit() {
+    if (!dirty) {
+        return true;
+    }
+
+    if (!Filesys.isMounted()) {
+        LOG_E("CONFIG", "Filesystem not mounted, keeping changes in RAM");
+        return false;
+    }
+
+    record.crc = recordCrc(record);
+
+    if (!Filesys.writeBinary(tempPath, &record, HEADER_SIZE + record.size) ||
+        !LittleFS.rename(tempPath, configPath)) {
+        LOG_E("CONFIG", "Failed to write %s", configPath);
+        return false;
+    }
+
+    writeCount++;
+    dirty = false;
+
+    // Settings now live in the record; drop the legacy files
+    for (int i = 0; i < KEY_COUNT; i++) {
+        if (SCHEMA[i].legacyPath != nullptr && LittleFS.exists(SCHEMA[i].legacyPath)) {
+            LittleFS.remove(SCHEMA[i].legacyPath);
+        }
+    }
+
+    LOG_I("CONFIG", "Saved (%lu writes since boot)", writeCount);
+    return true;
+}
+
+// A failed write is retried with a doubling delay rather than on every pass
+void ConfigClass::loopConfig() {
+    if (!dirty || Hal.millis() - dirtySince < retryDelay) {
+        return;
+    }
+
+    if (commit()) {
+        retryDelay = WRITE_DELAY;
+    } else {
+        dirtySince = Hal.millis();
+        retryDelay = retryDelay * 2 < MAX_RETRY_DELAY ? retryDelay * 2 : MAX_RETRY_DELAY;
+        LOG_W("CONFIG", "Next write attempt in %lu ms", retryDelay);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef Config_H_
+#define Config_H_
+
+#include <Filesys.h>
+#include <Hal.h>
+
+// All settings in one packed record, stored in /config.bin with a CRC32 and
+// replaced atomically (write temp file, then rename). The record is loaded
+// into RAM once at boot; setters only mark it dirty and the flash write is
+// deferred so that several changes coalesce into a single write.
+class ConfigClass {
+
+    public:
+        enum Key { SSID, PASS, DEV_NAME, PROBE_TARGET, STATIC_IP, TIMEZONE,
+                   MQTT_BROKER, MQTT_USER, MQTT_PASS, MQTT_TOPIC, KEY_COUNT };
+
+        static const uint32_t MAGIC = 0x57574346;               // "WWCF"
+        static const uint16_t VERSION = 3;
+        static const unsigned long WRITE_DELAY = 2000;          // ms to wait for more changes
+        static const unsigned long MAX_RETRY_DELAY = 60000;     // backoff cap after failed writes
+
+        void load();
+        void loopConfig();
+        bool commit();
+
+        const char* get(Key key);
+        bool set(Key key, const char* value);
+
+        bool isDirty() { return dirty; }
+        unsigned long getLoadMicros() { return loadMicros; }
+        unsigned long getWriteCount() { return writeCount; }
+
+    private:
+        const char* configPath = "/config.bin";
+        const char* tempPath = "/config.tmp";
+
+        struct __attribute__((packed)) Record {
+            uint32_t magic;
+            uint16_t version;
+            uint16_t size;          // bytes after the header, lets newer versions append fields
+            uint32_t crc;           // over everything after this field
+            char ssid[33];
+            char pass[65];
+            char devName[33];
+            char probeTarget[70];
+            char staticIp[64];
+            char timezone[48];      // v2, POSIX TZ string
+            char mqttBroker[70];    // v3, host:port, empty disables MQTT
+            char mqttUser[33];
+            char mqttPass[65];
+            char mqttTopic[48];     // v3, base topic
+        };
+
+        struct Field {
+            uint16_t offset;
+            uint16_t size;
+            const char* legacyPath; // per-setting text file this field replaces, if any
+        };
+
+        static const Field SCHEMA[KEY_COUNT];
+        static const size_t HEADER_SIZE = 12;
+
+        Record record;
+        bool dirty = false;
+        unsigned long dirtySince = 0;   // last change, or last failed write
+        unsigned long retryDelay = WRITE_DELAY;
+        unsigned long loadMicros = 0;
+        unsigned long writeCount = 0;
+
+        bool readRecord();
+        bool migrateLegacy();
+        void reset();
+        static uint32_t recordCrc(const Record& r);
+};
+
+extern ConfigClass Config;
+
+#endif
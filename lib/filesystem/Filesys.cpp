@@ -1,21 +1,24 @@
 #include <Filesys.h>
+#include <Config.h>
 
 FilesysClass Filesys;
 
 void FilesysClass::initFS() {
-    if (LittleFS.begin()) {
-        Serial.println("[LITTLEFS] - Setup done");
+    mounted = LittleFS.begin();
+    if (mounted) {
+        LOG_I("LITTLEFS", "Setup done");
+        Config.load();
     } else {
-        Serial.println("[LITTLEFS] - error has occurred while mounting.");
+        LOG_E("LITTLEFS", "error has occurred while mounting.");
     }
 }
 
 String FilesysClass::readFirstLine(const char* path) {
-    Serial.printf("[LITTLEFS] - Reading file #%s\n", path);
+    LOG_D("LITTLEFS", "Reading file #%s", path);
 
     File file = LittleFS.open(path, "r");
     if(!file || file.isDirectory()) {
-        Serial.println("[LITTLEFS] - failed to open file in RO mode.");
+        LOG_W("LITTLEFS", "failed to open %s in RO mode.", path);
         return "";
     }
 
@@ -30,11 +33,11 @@ String FilesysClass::readFirstLine(const char* path) {
 }
 
 String FilesysClass::readEntireFile(const char* path) {
-    Serial.printf("[LITTLEFS] - Reading file #%s\n", path);
+    LOG_D("LITTLEFS", "Reading file #%s", path);
 
     File file = LittleFS.open(path, "r");
     if(!file || file.isDirectory()) {
-        Serial.println("[LITTLEFS] - failed to open file in RO mode.");
+        LOG_W("LITTLEFS", "failed to open %s in RO mode.", path);
         return "";
     }
 
@@ -45,17 +48,62 @@ String FilesysClass::readEntireFile(const char* path) {
 }
 
 void FilesysClass::writeFile(const char* path, const char* data) {
-    Serial.printf("[LITTLEFS] - Writing file #%s\r\n", path);
+    LOG_D("LITTLEFS", "Writing file #%s", path);
 
     File file = LittleFS.open(path, "w");
     if(!file) {
-        Serial.println("[LITTLEFS] - failed to open file in RW mode.");
+        LOG_E("LITTLEFS", "failed to open %s in RW mode.", path);
         return;
     }
 
     if(!file.print(data)) {
-        Serial.println("[LITTLEFS] - failed to write file.");
+        LOG_E("LITTLEFS", "failed to write %s.", path);
     }
 
     file.close();
-}
\ No newline at end of file
+}
+bool FilesysClass::readBinary(const char* path, void* data, size_t size) {
+    LOG_D("LITTLEFS", "Reading file #%s", path);
+
+    File file = LittleFS.open(path, "r");
+    if(!file || file.isDirectory()) {
+        LOG_D("LITTLEFS", "failed to open %s in RO mode.", path);
+        return false;
+    }
+
+    bool ok = file.size() == size && file.read((uint8_t*)data, size) == size;
+    file.close();
+    return ok;
+}
+
+bool FilesysClass::writeBinary(const char* path, const void* data, size_t size) {
+    LOG_D("LITTLEFS", "Writing file #%s", path);
+
+    File file = LittleFS.open(path, "w");
+    if(!file) {
+        LOG_E("LITTLEFS", "failed to open %s in RW mode.", path);
+        return false;
+    }
+
+    bool ok = file.write((const uint8_t*)data, size) == size;
+    if(!ok) {
+        LOG_E("LITTLEFS", "failed to write %s.", path);
+    }
+
+    file.close();
+    return ok;
+}
+
+// CRC-32 (IEEE 802.3), bitwise to keep the table out of RAM
+uint32_t FilesysClass::crc32(const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (size--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
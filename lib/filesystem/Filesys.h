@@ -2,6 +2,7 @@
 #define Fs_H_
 
 #include <LittleFS.h>
+#include <Log.h>
 
 class FilesysClass {
     
@@ -13,8 +14,17 @@ class FilesysClass {
         String
             readFirstLine(const char* path),
             readEntireFile(const char* path);
+
+        bool
+            readBinary(const char* path, void* data, size_t size),
+            writeBinary(const char* path, const void* data, size_t size);
+
+        bool isMounted() { return mounted; }
+
+        static uint32_t crc32(const void* data, size_t size);
     
     private:
+        bool mounted = false;
 };
 
 extern FilesysClass Filesys;
@@ -0,0 +1,372 @@
+#include <Fleet.h>
+
+FleetClass Fleet;
+
+const IPAddress FleetClass::GROUP(239, 255, 87, 87);
+
+static const uint16_t MAGIC = 0x5746;           // "FW"
+static const uint8_t PROTO = 1;
+static const size_t HEADER_SIZE = 8;            // magic, proto, type, chip
+static const size_t COMMAND_SIZE = 16;
+
+static inline uint16_t load16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t load32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void store32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static size_t putHeader(uint8_t* out, uint8_t type, uint32_t chip) {
+    store16(out, MAGIC);
+    out[2] = PROTO;
+    out[3] = type;
+    store32(out + 4, chip);
+    return HEADER_SIZE;
+}
+
+// Length-prefixed, truncated to fit size including the length byte
+static size_t putString(uint8_t* out, const char* s, size_t size) {
+    size_t len = strnlen(s, size - 1);
+    out[0] = (uint8_t)len;
+    memcpy(out + 1, s, len);
+    return 1 + len;
+}
+
+// Copies a length-prefixed string out of a packet; 0 if it overruns it
+static size_t getString(const uint8_t* data, size_t len, char* out, size_t size) {
+    if (len < 1 || data[0] >= size || (size_t)data[0] + 1 > len) {
+        return 0;
+    }
+    memcpy(out, data + 1, data[0]);
+    out[data[0]] = '\0';
+    return 1 + data[0];
+}
+
+void FleetClass::initFleet(const char* version, const char* name, std::function<void(uint8_t, bool)> onCommandFunc) {
+    this->onCommand = onCommandFunc;
+    chip = ESP.getChipId();
+    strlcpy(this->version, version, sizeof(this->version));
+    strlcpy(this->name, name, sizeof(this->name));
+    nonce = (uint16_t)ESP.random();
+    memset(peers, 0, sizeof(peers));
+    memset(seenChip, 0, sizeof(seenChip));
+}
+
+void FleetClass::onWifiDown() {
+    joinPending = false;
+    if (joined) {
+        udp.stop();
+        joined = false;
+    }
+}
+
+size_t FleetClass::buildHeartbeat() {
+    uint8_t channels = Power.getChannelCount();
+    uint32_t busy = 0;
+    for (uint8_t ch = 0; ch < channels; ch++) {
+        if (Power.getState(ch) != PowerClass::IDLE) {
+            busy |= 1UL << ch;
+        }
+    }
+
+    size_t pos = putHeader(packet, PKT_HEARTBEAT, chip);
+    store16(packet + pos, seq);
+    store32(packet + pos + 2, Hal.millis() / 1000);
+    packet[pos + 6] = (uint8_t)(int8_t)WiFi.RSSI();
+    packet[pos + 7] = Prober.getState();
+    packet[pos + 8] = channels;
+    store32(packet + pos + 9, busy);
+    pos += 13;
+    pos += putString(packet + pos, version, VERSION_SIZE);
+    pos += putString(packet + pos, name, NAME_SIZE);
+    return pos;
+}
+
+void FleetClass::sendHeartbeat(size_t len) {
+    udp.beginPacketMulticast(GROUP, PORT, WiFi.localIP());
+    udp.write(packet, len);
+    udp.endPacket();
+
+    memcpy(lastSent, packet, len);
+    lastSentLen = len;
+    lastSendTime = Hal.millis();
+    everSent = true;
+    seq++;
+    stats.sent++;
+}
+
+bool FleetClass::sendCommand(uint32_t target, uint8_t channel, bool on) {
+    if (target == 0 || target == chip) {
+        if (onCommand) {
+            onCommand(channel, on);
+        }
+        if (target == chip) {
+            return true;
+        }
+    }
+    if (!joined || pending.repeats > 0) {
+        return false;
+    }
+
+    uint8_t* p = pending.packet;
+    size_t pos = putHeader(p, PKT_COMMAND, chip);
+    store16(p + pos, ++nonce);
+    store32(p + pos + 2, target);
+    p[pos + 6] = channel;
+    p[pos + 7] = on;
+    pending.repeats = COMMAND_REPEATS;
+    pending.nextSend = Hal.millis();
+    return true;
+}
+
+void FleetClass::sendPending() {
+    if (pending.repeats == 0 || (long)(Hal.millis() - pending.nextSend) < 0) {
+        return;
+    }
+    udp.beginPacketMulticast(GROUP, PORT, WiFi.localIP());
+    udp.write(pending.packet, COMMAND_SIZE);
+    udp.endPacket();
+    stats.sent++;
+    pending.repeats--;
+    pending.nextSend = Hal.millis() + REPEAT_SPACING;
+}
+
+// The peer's entry, or a free (or the stalest) one when create is set
+FleetClass::Peer* FleetClass::findPeer(uint32_t chip, bool create) {
+    Peer* free = nullptr;
+    Peer* oldest = nullptr;
+    unsigned long now = Hal.millis();
+
+    for (int i = 0; i < MAX_PEERS; i++) {
+        Peer& p = peers[i];
+        if (p.chip == chip) {
+            return &p;
+        }
+        if (p.chip == 0 || now - p.lastSeen > PEER_EXPIRE) {
+            if (free == nullptr) {
+                free = &p;
+            }
+        } else if (oldest == nullptr || now - p.lastSeen > now - oldest->lastSeen) {
+            oldest = &p;
+        }
+    }
+
+    if (!create) {
+        return nullptr;
+    }
+    if (free == nullptr) {
+        free = oldest;
+        stats.evicted++;
+    }
+    memset(free, 0, sizeof(Peer));
+    free->chip = chip;
+    return free;
+}
+
+bool FleetClass::parseHeartbeat(const uint8_t* data, size_t len, Peer& out) {
+    size_t pos = HEADER_SIZE + 13;
+    size_t n;
+    if (len < pos || (n = getString(data + pos, len - pos, out.version, VERSION_SIZE)) == 0 ||
+        getString(data + pos + n, len - pos - n, out.name, NAME_SIZE) == 0) {
+        return false;
+    }
+
+    out.chip = load32(data + 4);
+    out.seq = load16(data + HEADER_SIZE);
+    out.uptime = load32(data + HEADER_SIZE + 2);
+    out.rssi = (int8_t)data[HEADER_SIZE + 6];
+    out.pc = data[HEADER_SIZE + 7];
+    out.channels = data[HEADER_SIZE + 8];
+    out.busy = load32(data + HEADER_SIZE + 9);
+    return true;
+}
+
+void FleetClass::handleHeartbeat(const uint8_t* data, size_t len, uint32_t ip) {
+    Peer update = {};
+    if (!parseHeartbeat(data, len, update)) {
+        stats.invalid++;
+        return;
+    }
+    update.ip = ip;
+    update.lastSeen = Hal.millis();
+
+    *findPeer(update.chip, true) = update;
+    stats.heartbeats++;
+}
+
+void FleetClass::handleCommand(const uint8_t* data, size_t len) {
+    if (len != COMMAND_SIZE) {
+        stats.invalid++;
+        return;
+    }
+    uint32_t sender = load32(data + 4);
+    uint16_t id = load16(data + HEADER_SIZE);
+    uint32_t target = load32(data + HEADER_SIZE + 2);
+    if (target != 0 && target != chip) {
+        return;
+    }
+
+    for (int i = 0; i < SEEN_SIZE; i++) {
+        if (seenChip[i] == sender && seenNonce[i] == id) {
+            stats.duplicates++;
+            return;
+        }
+    }
+    seenChip[seenNext] = sender;
+    seenNonce[seenNext] = id;
+    seenNext = (seenNext + 1) % SEEN_SIZE;
+
+    stats.commands++;
+    LOG_I("FLEET", "Command from %06lx: %s on channel %u", (unsigned long)sender,
+          data[HEADER_SIZE + 7] ? "on" : "off", data[HEADER_SIZE + 6]);
+    if (onCommand) {
+        onCommand(data[HEADER_SIZE + 6], data[HEADER_SIZE + 7] != 0);
+    }
+}
+
+bool FleetClass::handlePacket(const uint8_t* data, size_t len, uint32_t ip) {
+    if (len < HEADER_SIZE || load16(data) != MAGIC || data[2] != PROTO) {
+        stats.invalid++;
+        return false;
+    }
+    if (load32(data + 4) == chip) {
+        return false;
+    }
+
+    unsigned long start = Hal.micros();
+    if (data[3] == PKT_HEARTBEAT) {
+        handleHeartbeat(data, len, ip);
+    } else if (data[3] == PKT_COMMAND) {
+        handleCommand(data, len);
+    } else {
+        stats.invalid++;
+        return false;
+    }
+    stats.lastUpdateMicros = Hal.micros() - start;
+    if (stats.lastUpdateMicros > stats.maxUpdateMicros) {
+        stats.maxUpdateMicros = stats.lastUpdateMicros;
+    }
+    return true;
+}
+
+void FleetClass::receive() {
+    int size;
+    while ((size = udp.parsePacket()) > 0) {
+        int n = udp.read(rx, sizeof(rx));
+        udp.flush();
+        if (n > 0 && (size_t)size <= PACKET_SIZE) {
+            handlePacket(rx, (size_t)n, (uint32_t)udp.remoteIP());
+        } else {
+            stats.invalid++;
+        }
+    }
+}
+
+void FleetClass::loopFleet() {
+    if (joinPending) {
+        joinPending = false;
+        udp.stop();
+        joined = udp.beginMulticast(WiFi.localIP(), GROUP, PORT);
+        everSent = false;
+        if (joined) {
+            LOG_I("FLEET", "Joined %s:%u", GROUP.toString().c_str(), PORT);
+        } else {
+            LOG_W("FLEET", "Could not join %s:%u", GROUP.toString().c_str(), PORT);
+        }
+    }
+    if (!joined) {
+        return;
+    }
+
+    receive();
+    sendPending();
+
+    // Uptime and RSSI drift all the time; only the fields after them count
+    // as a change
+    const size_t stable = HEADER_SIZE + 7;
+    size_t len = buildHeartbeat();
+    unsigned long since = Hal.millis() - lastSendTime;
+    bool changed = len != lastSentLen || memcmp(packet + stable, lastSent + stable, len - stable) != 0;
+    if (!everSent || since >= KEEPALIVE || (changed && since >= MIN_INTERVAL)) {
+        sendHeartbeat(len);
+    }
+}
+
+int FleetClass::getPeerCount() {
+    int n = 0;
+    unsigned long now = Hal.millis();
+    for (int i = 0; i < MAX_PEERS; i++) {
+        n += peers[i].chip != 0 && now - peers[i].lastSeen <= PEER_EXPIRE;
+    }
+    return n;
+}
+
+int FleetClass::getOnlineCount() {
+    int n = 0;
+    unsigned long now = Hal.millis();
+    for (int i = 0; i < MAX_PEERS; i++) {
+        n += peers[i].chip != 0 && now - peers[i].lastSeen <= PEER_TIMEOUT;
+    }
+    return n;
+}
+
+void FleetClass::writeString(Print& out, const char* s) {
+    out.print('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            out.print('\\');
+            out.print(*s);
+        } else if ((uint8_t)*s < 0x20) {
+            out.printf("\\u%04x", (uint8_t)*s);
+        } else {
+            out.print(*s);
+        }
+    }
+    out.print('"');
+}
+
+void FleetClass::writePeer(Print& out, const Peer& p, bool self) {
+    unsigned long age = Hal.millis() - p.lastSeen;
+    out.printf("{\"chip\":\"%06lx\",\"self\":%s,\"name\":", (unsigned long)p.chip, self ? "true" : "false");
+    writeString(out, p.name);
+    out.print(",\"version\":");
+    writeString(out, p.version);
+    out.printf(",\"ip\":\"%s\",\"uptime\":%lu,\"rssi\":%d,\"pc\":\"%s\",\"channels\":%u,\"busy\":%lu,"
+               "\"age_ms\":%lu,\"online\":%s}",
+               IPAddress(p.ip).toString().c_str(), (unsigned long)p.uptime, p.rssi,
+               p.pc <= ProberClass::PC_ON ? ProberClass::stateName((ProberClass::PcState)p.pc) : "unknown",
+               p.channels, (unsigned long)p.busy, age, age <= PEER_TIMEOUT ? "true" : "false");
+}
+
+void FleetClass::writeJson(Print& out) {
+    Peer self = {};
+    parseHeartbeat(packet, buildHeartbeat(), self);
+    self.chip = chip;
+    self.ip = WiFi.localIP();
+    self.lastSeen = Hal.millis();
+
+    out.printf("{\"group\":\"%s:%u\",\"peers\":[", GROUP.toString().c_str(), PORT);
+    writePeer(out, self, true);
+
+    unsigned long now = Hal.millis();
+    for (int i = 0; i < MAX_PEERS; i++) {
+        if (peers[i].chip != 0 && now - peers[i].lastSeen <= PEER_EXPIRE) {
+            out.print(',');
+            writePeer(out, peers[i], false);
+        }
+    }
+    out.print("]}");
+}
@@ -0,0 +1,141 @@
+#ifndef FLEET_H_
+#define FLEET_H_
+
+#include <functional>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <Hal.h>
+#include <Log.h>
+#include <Power.h>
+#include <Prober.h>
+
+// Boards on one LAN find each other through UDP multicast. Each one sends a
+// compact heartbeat when its state changes (at most every MIN_INTERVAL) and
+// otherwise every KEEPALIVE, and every board keeps a table of the peers it
+// hears, so any of them can serve the whole fleet. Power commands for peers
+// go out on the same group, repeated to ride out multicast loss and
+// deduplicated by the receivers.
+//
+//   heartbeat = magic:u16 proto:u8 type:u8 chip:u32 seq:u16 uptime s:u32 rssi:i8
+//               pc:u8 channels:u8 busy mask:u32 version len:u8 version
+//               name len:u8 name                                  (little endian)
+//   command   = magic:u16 proto:u8 type:u8 chip:u32 nonce:u16 target chip:u32
+//               (0 for all) channel:u8 on:u8
+class FleetClass {
+
+    public:
+        static const uint16_t PORT = 4587;
+        static const unsigned long MIN_INTERVAL = 1000;        // ms between change-driven heartbeats
+        static const unsigned long KEEPALIVE = 30000;          // ms
+        static const unsigned long PEER_TIMEOUT = 3 * KEEPALIVE + 5000;    // ms of silence before offline
+        static const unsigned long PEER_EXPIRE = 600000;       // ms of silence before the entry is freed
+        static const uint8_t COMMAND_REPEATS = 3;
+        static const unsigned long REPEAT_SPACING = 100;       // ms
+        static const int MAX_PEERS = 32;
+        static const size_t VERSION_SIZE = 12;
+        static const size_t NAME_SIZE = 33;
+        static const size_t PACKET_SIZE = 21 + VERSION_SIZE + NAME_SIZE;
+
+        enum PacketType : uint8_t { PKT_HEARTBEAT = 1, PKT_COMMAND = 2 };
+
+        struct Peer {
+            uint32_t chip;              // 0 marks a free entry
+            uint32_t ip;
+            unsigned long lastSeen;     // ms
+            uint32_t uptime;            // s, as last reported
+            uint16_t seq;
+            int8_t rssi;
+            uint8_t pc;
+            uint8_t channels;
+            uint32_t busy;
+            char version[VERSION_SIZE];
+            char name[NAME_SIZE];
+        };
+
+        struct Stats {
+            unsigned long sent;
+            unsigned long heartbeats;
+            unsigned long commands;
+            unsigned long duplicates;
+            unsigned long invalid;
+            unsigned long evicted;      // table full, oldest peer replaced
+            unsigned long lastUpdateMicros;
+            unsigned long maxUpdateMicros;
+        };
+
+        static const IPAddress GROUP;
+
+        void initFleet(const char* version, const char* name, std::function<void(uint8_t channel, bool on)> onCommandFunc);
+        void loopFleet();
+
+        // Wifi events: join the group on a new lease, stop sending on loss
+        void onWifiUp() { joinPending = true; }
+        void onWifiDown();
+
+        // Queues a repeated command for one peer by chip id, or all with 0;
+        // one addressed to this board (or all) also runs here
+        bool sendCommand(uint32_t target, uint8_t channel, bool on);
+
+        // Runs one datagram through parsing and the peer table
+        bool handlePacket(const uint8_t* data, size_t len, uint32_t ip);
+
+        // The table as JSON, this board first
+        void writeJson(Print& out);
+
+        uint32_t getChipId() { return chip; }
+        int getPeerCount();
+        int getOnlineCount();
+        const Stats& getStats() { return stats; }
+
+    private:
+        struct Pending {
+            uint8_t packet[16];
+            uint8_t repeats;
+            unsigned long nextSend;
+        };
+
+        std::function<void(uint8_t, bool)> onCommand;
+        WiFiUDP udp;
+        bool joined = false;
+        volatile bool joinPending = false;
+
+        uint32_t chip = 0;
+        char version[VERSION_SIZE] = "";
+        char name[NAME_SIZE] = "";
+        uint16_t seq = 0;
+        uint16_t nonce = 0;
+
+        uint8_t packet[PACKET_SIZE];
+        uint8_t lastSent[PACKET_SIZE];
+        size_t lastSentLen = 0;
+        unsigned long lastSendTime = 0;
+        bool everSent = false;
+
+        Pending pending = {};
+        Peer peers[MAX_PEERS];
+
+        // Recent commands by sender and nonce, to drop the repeats
+        static const int SEEN_SIZE = 8;
+        uint32_t seenChip[SEEN_SIZE];
+        uint16_t seenNonce[SEEN_SIZE];
+        uint8_t seenNext = 0;
+
+        uint8_t rx[PACKET_SIZE + 1];
+
+        Stats stats = {};
+
+        size_t buildHeartbeat();
+        void sendHeartbeat(size_t len);
+        void sendPending();
+        void receive();
+        Peer* findPeer(uint32_t chip, bool create);
+        void handleHeartbeat(const uint8_t* data, size_t len, uint32_t ip);
+        static bool parseHeartbeat(const uint8_t* data, size_t len, Peer& out);
+        void handleCommand(const uint8_t* data, size_t len);
+        static void writeString(Print& out, const char* s);
+        void writePeer(Print& out, const Peer& p, bool self);
+};
+
+extern FleetClass Fleet;
+
+#endif
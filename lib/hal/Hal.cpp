@@ -0,0 +1,275 @@
+#include <Hal.h>
+
+#ifndef NATIVE
+#include <ESP8266WiFi.h>
+#endif
+
+HalClass Hal;
+
+#ifndef NATIVE
+
+unsigned long HalClass::millis() {
+    return ::millis();
+}
+
+unsigned long IRAM_ATTR HalClass::micros() {
+    return ::micros();
+}
+
+uint32_t HalClass::cycles() {
+    return ESP.getCycleCount();
+}
+
+time_t HalClass::epoch() {
+    return ::time(nullptr);
+}
+
+void HalClass::sleep(unsigned long ms) {
+    ::delay(ms);
+}
+
+uint32_t HalClass::freeHeap() {
+    return ESP.getFreeHeap();
+}
+
+void HalClass::pinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= EXPANDER_BASE) {
+        return;
+    }
+    ::pinMode(pin, mode);
+}
+
+void IRAM_ATTR HalClass::digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin >= EXPANDER_BASE) {
+        writeExpander(pin - EXPANDER_BASE, val);
+        return;
+    }
+    ::digitalWrite(pin, val);
+}
+
+int HalClass::digitalRead(uint8_t pin) {
+    if (pin >= EXPANDER_BASE) {
+        return (expanderState >> (pin - EXPANDER_BASE)) & 1;
+    }
+    return ::digitalRead(pin);
+}
+
+void HalClass::attachExpander(uint8_t dataPin, uint8_t clockPin, uint8_t latchPin) {
+    expanderData = dataPin;
+    expanderClock = clockPin;
+    expanderLatch = latchPin;
+    ::pinMode(dataPin, OUTPUT);
+    ::pinMode(clockPin, OUTPUT);
+    ::pinMode(latchPin, OUTPUT);
+    expanderAttached = true;
+
+    // Start with every output low
+    expanderState = 0;
+    writeExpander(0, LOW);
+}
+
+// Shifts the whole chain out, about 100 us for 32 bits; safe from the timer interrupt
+void IRAM_ATTR HalClass::writeExpander(uint8_t bit, uint8_t val) {
+    if (!expanderAttached || bit >= EXPANDER_BITS) {
+        return;
+    }
+
+    uint32_t state = val ? (expanderState | (1UL << bit)) : (expanderState & ~(1UL << bit));
+    expanderState = state;
+
+    for (int i = EXPANDER_BITS - 1; i >= 0; i--) {
+        ::digitalWrite(expanderData, (state >> i) & 1);
+        ::digitalWrite(expanderClock, HIGH);
+        ::digitalWrite(expanderClock, LOW);
+    }
+    ::digitalWrite(expanderLatch, HIGH);
+    ::digitalWrite(expanderLatch, LOW);
+}
+
+void IRAM_ATTR HalClass::interruptsOff() {
+    noInterrupts();
+}
+
+void IRAM_ATTR HalClass::interruptsOn() {
+    interrupts();
+}
+
+void HalClass::timerAttach(TimerCallback callback) {
+    timer1_isr_init();
+    timer1_attachInterrupt(callback);
+}
+
+// DIV16 gives 5 ticks per microsecond; the 23-bit counter tops out near 1.6 s
+void IRAM_ATTR HalClass::timerArm(uint32_t us) {
+    if (us > TIMER_MAX_US) {
+        us = TIMER_MAX_US;
+    }
+    timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+    timer1_write(us < 2 ? 10 : us * 5);
+}
+
+void IRAM_ATTR HalClass::timerDisarm() {
+    timer1_disable();
+}
+
+bool HalClass::wifiConnected() {
+    return WiFi.status() == WL_CONNECTED;
+}
+
+void HalClass::wifiBegin(const char* ssid, const char* pass, int32_t channel, const uint8_t* bssid) {
+    WiFi.begin(ssid, pass, channel, bssid, true);
+}
+
+void HalClass::wifiDisconnect() {
+    WiFi.disconnect();
+}
+
+#else
+
+unsigned long HalClass::millis() {
+    return simMicros / 1000;
+}
+
+unsigned long HalClass::micros() {
+    return simMicros;
+}
+
+uint32_t HalClass::cycles() {
+    return (uint32_t)(simMicros * CPU_MHZ);
+}
+
+time_t HalClass::epoch() {
+    return simEpochBase + (time_t)(simMicros / 1000000UL);
+}
+
+void HalClass::sleep(unsigned long ms) {
+    advance(ms);
+}
+
+uint32_t HalClass::freeHeap() {
+    return simFreeHeap;
+}
+
+void HalClass::pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void HalClass::digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin >= EXPANDER_BASE) {
+        writeExpander(pin - EXPANDER_BASE, val);
+    } else if (pin < SIM_PINS) {
+        pinLevels[pin] = val;
+    } else {
+        return;
+    }
+
+    Edge& e = edges[edgeCount % SIM_EDGE_LOG];
+    e.pin = pin;
+    e.level = val;
+    e.atMicros = simMicros;
+    edgeCount++;
+}
+
+int HalClass::digitalRead(uint8_t pin) {
+    if (pin >= EXPANDER_BASE) {
+        return (expanderState >> (pin - EXPANDER_BASE)) & 1;
+    }
+    return pin < SIM_PINS ? pinLevels[pin] : LOW;
+}
+
+// The simulated chain needs no wiring, its outputs are always available
+void HalClass::attachExpander(uint8_t dataPin, uint8_t clockPin, uint8_t latchPin) {
+    expanderData = dataPin;
+    expanderClock = clockPin;
+    expanderLatch = latchPin;
+    expanderAttached = true;
+    expanderState = 0;
+}
+
+void HalClass::writeExpander(uint8_t bit, uint8_t val) {
+    if (bit >= EXPANDER_BITS) {
+        return;
+    }
+    expanderState = val ? (expanderState | (1UL << bit)) : (expanderState & ~(1UL << bit));
+}
+
+void HalClass::interruptsOff() {
+}
+
+void HalClass::interruptsOn() {
+}
+
+void HalClass::timerAttach(TimerCallback callback) {
+    timerCallback = callback;
+}
+
+void HalClass::timerArm(uint32_t us) {
+    if (us > TIMER_MAX_US) {
+        us = TIMER_MAX_US;
+    }
+    timerDeadline = simMicros + us;
+    timerArmed = true;
+}
+
+void HalClass::timerDisarm() {
+    timerArmed = false;
+}
+
+bool HalClass::wifiConnected() {
+    return simWifiConnected;
+}
+
+void HalClass::wifiBegin(const char* ssid, const char* pass, int32_t channel, const uint8_t* bssid) {
+    (void)ssid;
+    (void)pass;
+    (void)bssid;
+    wifiBeginCount++;
+    wifiBeginChannel = channel;
+}
+
+void HalClass::wifiDisconnect() {
+    simWifiConnected = false;
+}
+
+void HalClass::reset() {
+    simMicros = 0;
+    simEpochBase = 0;
+    simFreeHeap = SIM_FREE_HEAP;
+    for (int i = 0; i < SIM_PINS; i++) {
+        pinLevels[i] = LOW;
+    }
+    edgeCount = 0;
+    timerArmed = false;
+    simWifiConnected = false;
+    wifiBeginCount = 0;
+    wifiBeginChannel = 0;
+}
+
+void HalClass::advance(unsigned long ms) {
+    advanceMicros(ms * 1000UL);
+}
+
+// Fires the timer exactly at its deadline, as an ideal interrupt would
+void HalClass::advanceMicros(unsigned long us) {
+    unsigned long target = simMicros + us;
+    while (timerArmed && (long)(target - timerDeadline) >= 0) {
+        simMicros = timerDeadline;
+        timerArmed = false;
+        if (timerCallback) {
+            timerCallback();
+        }
+    }
+    simMicros = target;
+}
+
+void HalClass::setWifiConnected(bool connected) {
+    simWifiConnected = connected;
+}
+
+// Steps the wall clock (an SNTP sync or a jump) without moving millis()
+void HalClass::setEpoch(time_t t) {
+    simEpochBase = t - (time_t)(simMicros / 1000000UL);
+}
+
+#endif
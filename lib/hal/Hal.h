@@ -0,0 +1,119 @@
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifndef NATIVE
+#include <Arduino.h>
+#else
+#ifndef LOW
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x00
+#define OUTPUT 0x01
+#endif
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+#endif
+
+// Thin hardware abstraction over clock, GPIO (plus a 74HC595 output chain),
+// a one-shot timer and the WiFi link.
+// On the ESP every call forwards to the Arduino core; built with -D NATIVE
+// (env:native) it runs against a simulated board whose clock only moves
+// when advance() is called, so hours of timing can be replayed instantly.
+class HalClass {
+
+    public:
+        // Clock
+        unsigned long millis();
+        unsigned long micros();
+        uint32_t cycles();                  // CPU cycle counter, wraps
+        time_t epoch();                     // wall clock, UTC seconds; near 0 until SNTP syncs
+        void sleep(unsigned long ms);       // delay(), yields to the WiFi stack meanwhile
+        static const uint32_t CPU_MHZ = 80;
+
+        // Memory
+        uint32_t freeHeap();
+
+        // GPIO. Pins from EXPANDER_BASE up are outputs of the shift-register
+        // chain, bit 0 being the first output of the last register shifted.
+        static const uint8_t EXPANDER_BASE = 100;
+        static const uint8_t EXPANDER_BITS = 32;
+
+        void pinMode(uint8_t pin, uint8_t mode);
+        void digitalWrite(uint8_t pin, uint8_t val);
+        int digitalRead(uint8_t pin);
+        void attachExpander(uint8_t dataPin, uint8_t clockPin, uint8_t latchPin);
+
+        // Short critical sections shared with interrupt handlers
+        void interruptsOff();
+        void interruptsOn();
+
+        // One-shot microsecond timer (timer1 on the ESP). The callback runs in
+        // interrupt context, so it and everything it calls must be IRAM_ATTR.
+        typedef void (*TimerCallback)();
+        static const uint32_t TIMER_MAX_US = 1000000;   // longer waits are re-armed in chunks
+
+        void timerAttach(TimerCallback callback);
+        void timerArm(uint32_t us);
+        void timerDisarm();
+
+        // WiFi driver
+        bool wifiConnected();
+        void wifiBegin(const char* ssid, const char* pass, int32_t channel, const uint8_t* bssid);
+        void wifiDisconnect();
+
+#ifdef NATIVE
+        // Simulation controls
+        static const int SIM_PINS = 17;
+        static const size_t SIM_EDGE_LOG = 256;
+        static const uint32_t SIM_FREE_HEAP = 40000;       // roughly what the firmware leaves after setup()
+
+        struct Edge {
+            uint8_t pin;
+            uint8_t level;
+            unsigned long atMicros;
+        };
+
+        void reset();
+        void advance(unsigned long ms);
+        void advanceMicros(unsigned long us);
+        void setWifiConnected(bool connected);
+        void setEpoch(time_t t);
+        void setFreeHeap(uint32_t bytes) { simFreeHeap = bytes; }
+        unsigned int getWifiBeginCount() { return wifiBeginCount; }
+        int32_t getWifiBeginChannel() { return wifiBeginChannel; }
+        size_t getEdgeCount() { return edgeCount; }
+        const Edge& getEdge(size_t i) { return edges[i % SIM_EDGE_LOG]; }
+
+    private:
+        unsigned long simMicros = 0;
+        time_t simEpochBase = 0;            // epoch at simMicros == 0
+        uint32_t simFreeHeap = SIM_FREE_HEAP;
+        uint8_t pinLevels[SIM_PINS] = {0};
+        Edge edges[SIM_EDGE_LOG];
+        size_t edgeCount = 0;
+        TimerCallback timerCallback = nullptr;
+        bool timerArmed = false;
+        unsigned long timerDeadline = 0;
+        bool simWifiConnected = false;
+        unsigned int wifiBeginCount = 0;
+        int32_t wifiBeginChannel = 0;
+#endif
+
+    private:
+        uint8_t expanderData = 0;
+        uint8_t expanderClock = 0;
+        uint8_t expanderLatch = 0;
+        bool expanderAttached = false;
+        volatile uint32_t expanderState = 0;
+
+        void writeExpander(uint8_t bit, uint8_t val);
+};
+
+extern HalClass Hal;
+
+#endif
@@ -0,0 +1,109 @@
+#include <Log.h>
+#include <stdio.h>
+#include <string.h>
+
+LogClass Log;
+
+void LogClass::write(uint8_t level, const char* subsystem, const char* fmt, ...) {
+    Record& r = records[written % CAPACITY];
+    r.timestamp = Hal.millis();
+    r.level = level;
+    strncpy(r.subsystem, subsystem, SUBSYSTEM_SIZE - 1);
+    r.subsystem[SUBSYSTEM_SIZE - 1] = '\0';
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(r.text, TEXT_SIZE, fmt, args);
+    va_end(args);
+
+    written++;
+
+    char line[LINE_SIZE];
+    format(r, line, sizeof(line));
+#ifndef NATIVE
+    Serial.println(line);
+#else
+    printf("%s\n", line);
+#endif
+}
+
+size_t LogClass::format(const Record& r, char* out, size_t size) {
+    static const char LEVELS[] = "-EWID";
+    char level = r.level <= LOG_LEVEL_DEBUG ? LEVELS[r.level] : '?';
+
+    int n = snprintf(out, size, "[%6lu.%03lu] %c %s: %s",
+                     r.timestamp / 1000, r.timestamp % 1000, level, r.subsystem, r.text);
+    if (n < 0) {
+        out[0] = '\0';
+        return 0;
+    }
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
+
+size_t LogClass::appendLine(char* buf, size_t pos, const char* line, size_t len) {
+    if (pos > 0) {
+        buf[pos++] = '\n';
+    }
+    memcpy(buf + pos, line, len);
+    pos += len;
+    buf[pos] = '\0';
+    return pos;
+}
+
+void LogClass::loopLog() {
+    if (flushed == written) {
+        return;
+    }
+    if (!sink) {
+        flushed = written;
+        return;
+    }
+    if (Hal.millis() - lastFlush < FLUSH_INTERVAL) {
+        return;
+    }
+    lastFlush = Hal.millis();
+
+    size_t pos = 0;
+
+    // Records overwritten before this flush could pick them up
+    if (written - flushed > CAPACITY) {
+        uint32_t lost = written - flushed - CAPACITY;
+        dropped += lost;
+        flushed = written - CAPACITY;
+        pos = snprintf(batch, BATCH_SIZE, "... %lu lines dropped", (unsigned long)lost);
+    }
+
+    // One message per flush; whatever does not fit waits for the next one
+    char line[LINE_SIZE];
+    while (flushed != written) {
+        size_t len = format(records[flushed % CAPACITY], line, sizeof(line));
+        if (pos + len + 2 > BATCH_SIZE) {
+            break;
+        }
+        pos = appendLine(batch, pos, line, len);
+        flushed++;
+    }
+
+    sink(batch, pos);
+}
+
+void LogClass::replay(Sink send, size_t count) {
+    uint32_t available = written < CAPACITY ? written : CAPACITY;
+    uint32_t n = count < available ? count : available;
+
+    char line[LINE_SIZE];
+    size_t pos = 0;
+
+    for (uint32_t seq = written - n; seq != written; seq++) {
+        size_t len = format(records[seq % CAPACITY], line, sizeof(line));
+        if (pos + len + 2 > BATCH_SIZE) {
+            send(replayBuffer, pos);
+            pos = 0;
+        }
+        pos = appendLine(replayBuffer, pos, line, len);
+    }
+
+    if (pos > 0) {
+        send(replayBuffer, pos);
+    }
+}
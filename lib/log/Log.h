@@ -0,0 +1,93 @@
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <functional>
+#include <Hal.h>
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// Build with -D LOG_LEVEL=... to compile out more verbose levels entirely
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(sub, ...) Log.write(LOG_LEVEL_ERROR, sub, __VA_ARGS__)
+#else
+#define LOG_E(sub, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(sub, ...) Log.write(LOG_LEVEL_WARN, sub, __VA_ARGS__)
+#else
+#define LOG_W(sub, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(sub, ...) Log.write(LOG_LEVEL_INFO, sub, __VA_ARGS__)
+#else
+#define LOG_I(sub, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(sub, ...) Log.write(LOG_LEVEL_DEBUG, sub, __VA_ARGS__)
+#else
+#define LOG_D(sub, ...) do {} while (0)
+#endif
+
+// Preallocated ring of log records. Lines go to Serial immediately and are
+// flushed to the sink (the /ws clients) in batches at a bounded rate.
+class LogClass {
+
+    public:
+        static const size_t CAPACITY = 64;
+        static const size_t TEXT_SIZE = 96;
+        static const size_t SUBSYSTEM_SIZE = 10;
+        static const size_t LINE_SIZE = TEXT_SIZE + SUBSYSTEM_SIZE + 24;
+        static const size_t BATCH_SIZE = 1024;
+        static const unsigned long FLUSH_INTERVAL = 100;       // ms between sink flushes
+        static const size_t REPLAY_COUNT = 32;                 // lines sent to a new client
+
+        typedef std::function<void(const char* text, size_t len)> Sink;
+
+        struct Record {
+            unsigned long timestamp;
+            uint8_t level;
+            char subsystem[SUBSYSTEM_SIZE];
+            char text[TEXT_SIZE];
+        };
+
+        void write(uint8_t level, const char* subsystem, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+        void setSink(Sink sink) { this->sink = sink; }
+        void loopLog();
+        void replay(Sink send, size_t count = REPLAY_COUNT);
+
+        static size_t format(const Record& r, char* out, size_t size);
+
+        uint32_t getWritten() { return written; }
+        uint32_t getDropped() { return dropped; }
+
+    private:
+        Record records[CAPACITY];
+        uint32_t written = 0;      // total records ever written
+        uint32_t flushed = 0;      // records already handed to the sink
+        uint32_t dropped = 0;      // overwritten before they could be flushed
+
+        Sink sink;
+        unsigned long lastFlush = 0;
+        char batch[BATCH_SIZE];
+        char replayBuffer[BATCH_SIZE];
+
+        size_t appendLine(char* buf, size_t pos, const char* line, size_t len);
+};
+
+extern LogClass Log;
+
+#endif
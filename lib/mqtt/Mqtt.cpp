@@ -0,0 +1,522 @@
+#include <Mqtt.h>
+
+MqttClass Mqtt;
+
+// Packet types, high nibble of the fixed header
+static const uint8_t CONNECT = 0x10;
+static const uint8_t CONNACK = 0x20;
+static const uint8_t PUBLISH = 0x30;
+static const uint8_t PUBACK = 0x40;
+static const uint8_t SUBSCRIBE = 0x82;      // reserved flags 0010
+static const uint8_t SUBACK = 0x90;
+static const uint8_t PINGREQ = 0xC0;
+static const uint8_t PINGRESP = 0xD0;
+static const uint8_t DISCONNECT = 0xE0;
+
+void MqttClass::initMqtt(std::function<void(const char*, const char*)> onMessageFunc) {
+    this->onMessage = onMessageFunc;
+    snprintf(clientId, sizeof(clientId), "wow-%06lx", (unsigned long)ESP.getChipId());
+
+    // Async callbacks run in the network context; they only buffer and set
+    // flags that loopMqtt() consumes
+    client.onConnect([](void* arg, AsyncClient* c) {
+        ((MqttClass*)arg)->tcpConnected = true;
+    }, this);
+
+    client.onDisconnect([](void* arg, AsyncClient* c) {
+        ((MqttClass*)arg)->tcpClosed = true;
+    }, this);
+
+    client.onError([](void* arg, AsyncClient* c, int8_t error) {
+        ((MqttClass*)arg)->tcpClosed = true;
+    }, this);
+
+    client.onData([](void* arg, AsyncClient* c, void* data, size_t len) {
+        MqttClass* self = (MqttClass*)arg;
+        if (self->rxLen + len > RX_SIZE) {
+            self->rxOverflow = true;
+            return;
+        }
+        memcpy(self->rx + self->rxLen, data, len);
+        self->rxLen += len;
+        self->rxMicros = Hal.micros();
+    }, this);
+
+    applyConfig();
+}
+
+bool MqttClass::parseBroker(const char* broker) {
+    const char* colon = strrchr(broker, ':');
+    size_t hostLen = colon != nullptr ? (size_t)(colon - broker) : strlen(broker);
+    if (hostLen == 0 || hostLen >= sizeof(host)) {
+        return false;
+    }
+
+    unsigned long p = colon != nullptr ? strtoul(colon + 1, NULL, 10) : 1883;
+    if (p == 0 || p > 65535) {
+        return false;
+    }
+
+    memcpy(host, broker, hostLen);
+    host[hostLen] = '\0';
+    port = (uint16_t)p;
+    return true;
+}
+
+void MqttClass::applyConfig() {
+    const char* topic = Config.get(ConfigClass::MQTT_TOPIC);
+    snprintf(base, sizeof(base), "%s", *topic ? topic : clientId);
+
+    if (!parseBroker(Config.get(ConfigClass::MQTT_BROKER))) {
+        state = MQTT_DISABLED;
+        LOG_I("MQTT", "No broker configured");
+        return;
+    }
+
+    // Connect on the next loop
+    state = MQTT_IDLE;
+    retryDelay = RETRY_MIN;
+    stateTimer = Hal.millis() - RETRY_MIN;
+    LOG_I("MQTT", "Broker %s:%u, base topic %s", host, port, base);
+}
+
+bool MqttClass::setBroker(const char* broker, const char* user, const char* pass, const char* topic) {
+    if (broker == nullptr) {
+        broker = "";
+    }
+    if (*broker && !parseBroker(broker)) {
+        return false;
+    }
+
+    if (!Config.set(ConfigClass::MQTT_BROKER, broker) ||
+        !Config.set(ConfigClass::MQTT_USER, user ? user : "") ||
+        !Config.set(ConfigClass::MQTT_PASS, pass ? pass : "") ||
+        !Config.set(ConfigClass::MQTT_TOPIC, topic ? topic : "")) {
+        return false;
+    }
+
+    disconnect();
+    head = tail;
+    applyConfig();
+    return true;
+}
+
+void MqttClass::onWifiUp() {
+    if (state == MQTT_IDLE) {
+        retryDelay = RETRY_MIN;
+        stateTimer = Hal.millis() - RETRY_MIN;
+    }
+}
+
+void MqttClass::onWifiDown() {
+    if (state > MQTT_IDLE) {
+        drop("WiFi lost");
+    }
+    retryDelay = RETRY_MIN;
+}
+
+void MqttClass::startConnect() {
+    tcpConnected = false;
+    tcpClosed = false;
+    rxOverflow = false;
+    rxLen = 0;
+    state = MQTT_CONNECTING;
+    stateTimer = Hal.millis();
+
+    if (!client.connect(host, port)) {
+        drop("connect failed");
+    }
+}
+
+// Ungraceful end of a session: the broker publishes our will
+void MqttClass::drop(const char* reason) {
+    client.close(true);
+    stats.failures++;
+
+    state = MQTT_IDLE;
+    stateTimer = Hal.millis();
+    retryDelay = retryDelay * 2 < RETRY_MAX ? retryDelay * 2 : RETRY_MAX;
+    LOG_W("MQTT", "Disconnected: %s, retry in %lu ms", reason, retryDelay);
+}
+
+// Clean end of a session, announcing it first since the will is not sent
+void MqttClass::disconnect() {
+    if (state == MQTT_CONNECTED) {
+        char topic[TOPIC_SIZE + sizeof(base)];
+        size_t topicLen = fullTopic(topic, sizeof(topic), "status");
+        size_t pos = 0;
+
+        tx[pos++] = PUBLISH | 0x01;
+        pos += putLength(tx + pos, 2 + topicLen + 7);
+        pos += putString(tx + pos, topic, topicLen);
+        memcpy(tx + pos, "offline", 7);
+        pos += 7;
+        tx[pos++] = DISCONNECT;
+        tx[pos++] = 0;
+        sendPacket(tx, pos);
+    }
+    if (state > MQTT_IDLE) {
+        client.close();
+    }
+    state = MQTT_IDLE;
+}
+
+size_t MqttClass::fullTopic(char* out, size_t size, const char* topic) {
+    int n = snprintf(out, size, "%s/%s", base, topic);
+    return n > 0 && (size_t)n < size ? n : 0;
+}
+
+size_t MqttClass::putLength(uint8_t* out, size_t len) {
+    size_t n = 0;
+    do {
+        uint8_t b = len % 128;
+        len /= 128;
+        out[n++] = len > 0 ? b | 0x80 : b;
+    } while (len > 0);
+    return n;
+}
+
+size_t MqttClass::putString(uint8_t* out, const char* s, size_t len) {
+    out[0] = len >> 8;
+    out[1] = len & 0xFF;
+    memcpy(out + 2, s, len);
+    return 2 + len;
+}
+
+bool MqttClass::sendPacket(const uint8_t* data, size_t len) {
+    if (client.space() < len || client.write((const char*)data, len, ASYNC_WRITE_FLAG_COPY) != len) {
+        return false;
+    }
+    return true;
+}
+
+void MqttClass::sendConnect() {
+    const char* user = Config.get(ConfigClass::MQTT_USER);
+    const char* pass = Config.get(ConfigClass::MQTT_PASS);
+    char will[TOPIC_SIZE + sizeof(base)];
+    size_t willLen = fullTopic(will, sizeof(will), "status");
+
+    // Clean session, retained "offline" will on <base>/status
+    uint8_t flags = 0x02 | 0x04 | 0x20;
+    size_t remaining = 10 + 2 + strlen(clientId) + 2 + willLen + 2 + 7;
+    if (*user) {
+        flags |= 0x80;
+        remaining += 2 + strlen(user);
+        if (*pass) {
+            flags |= 0x40;
+            remaining += 2 + strlen(pass);
+        }
+    }
+
+    size_t pos = 0;
+    tx[pos++] = CONNECT;
+    pos += putLength(tx + pos, remaining);
+    pos += putString(tx + pos, "MQTT");
+    tx[pos++] = 4;                  // protocol level 3.1.1
+    tx[pos++] = flags;
+    tx[pos++] = KEEPALIVE >> 8;
+    tx[pos++] = KEEPALIVE & 0xFF;
+    pos += putString(tx + pos, clientId);
+    pos += putString(tx + pos, will, willLen);
+    pos += putString(tx + pos, "offline");
+    if (flags & 0x80) {
+        pos += putString(tx + pos, user);
+    }
+    if (flags & 0x40) {
+        pos += putString(tx + pos, pass);
+    }
+
+    if (!sendPacket(tx, pos)) {
+        drop("CONNECT not sent");
+        return;
+    }
+    state = MQTT_WAIT_CONNACK;
+}
+
+bool MqttClass::subscribe(const char* filter) {
+    if (strlen(filter) >= sizeof(this->filter)) {
+        return false;
+    }
+    strcpy(this->filter, filter);
+    if (state == MQTT_CONNECTED) {
+        sendSubscribe();
+    }
+    return true;
+}
+
+void MqttClass::sendSubscribe() {
+    char topic[TOPIC_SIZE + sizeof(base)];
+    size_t topicLen = fullTopic(topic, sizeof(topic), filter);
+    if (topicLen == 0) {
+        return;
+    }
+
+    packetId = packetId == 0xFFFF ? 1 : packetId + 1;
+
+    size_t pos = 0;
+    tx[pos++] = SUBSCRIBE;
+    pos += putLength(tx + pos, 2 + 2 + topicLen + 1);
+    tx[pos++] = packetId >> 8;
+    tx[pos++] = packetId & 0xFF;
+    pos += putString(tx + pos, topic, topicLen);
+    tx[pos++] = 0;                  // QoS 0
+    sendPacket(tx, pos);
+}
+
+bool MqttClass::publish(const char* topic, const char* payload, bool retain) {
+    if (state == MQTT_DISABLED || strlen(topic) >= TOPIC_SIZE || strlen(payload) >= PAYLOAD_SIZE) {
+        return false;
+    }
+
+    // A state that changed again before it went out only needs its latest value
+    for (uint8_t i = tail; i != head; i++) {
+        Message& m = queue[i & (QUEUE_SIZE - 1)];
+        if (strcmp(m.topic, topic) == 0) {
+            strcpy(m.payload, payload);
+            m.retain = retain;
+            stats.coalesced++;
+            return true;
+        }
+    }
+
+    if ((uint8_t)(head - tail) == QUEUE_SIZE) {
+        stats.dropped++;
+        return false;
+    }
+
+    Message& m = queue[head & (QUEUE_SIZE - 1)];
+    strcpy(m.topic, topic);
+    strcpy(m.payload, payload);
+    m.retain = retain;
+    head++;
+    return true;
+}
+
+// Packs as many queued messages as the send window takes into one write
+void MqttClass::flushQueue() {
+    if (head == tail || !client.canSend()) {
+        return;
+    }
+
+    size_t room = client.space() < TX_SIZE ? client.space() : TX_SIZE;
+    size_t pos = 0;
+    int count = 0;
+    uint8_t next = tail;
+
+    // Messages leave the queue only once the batch is handed to the socket
+    while (next != head) {
+        const Message& m = queue[next & (QUEUE_SIZE - 1)];
+        char topic[TOPIC_SIZE + sizeof(base)];
+        size_t topicLen = fullTopic(topic, sizeof(topic), m.topic);
+        size_t payloadLen = strlen(m.payload);
+        size_t remaining = 2 + topicLen + payloadLen;
+
+        if (pos + 1 + 4 + remaining > room) {
+            break;
+        }
+        tx[pos++] = PUBLISH | (m.retain ? 0x01 : 0x00);
+        pos += putLength(tx + pos, remaining);
+        pos += putString(tx + pos, topic, topicLen);
+        memcpy(tx + pos, m.payload, payloadLen);
+        pos += payloadLen;
+
+        next++;
+        count++;
+    }
+
+    if (count > 0 && sendPacket(tx, pos)) {
+        tail = next;
+        stats.published += count;
+        stats.batches++;
+    }
+}
+
+void MqttClass::parseRx() {
+    while (rxLen >= 2) {
+        // Remaining length is 1-4 bytes, 7 bits each
+        size_t remaining = 0;
+        size_t lenBytes = 0;
+        uint8_t b;
+        do {
+            if (1 + lenBytes >= rxLen) {
+                return;
+            }
+            b = rx[1 + lenBytes];
+            remaining |= (size_t)(b & 0x7F) << (7 * lenBytes);
+            lenBytes++;
+        } while ((b & 0x80) && lenBytes < 4);
+
+        size_t total = 1 + lenBytes + remaining;
+        if (total > RX_SIZE) {
+            drop("inbound packet too large");
+            return;
+        }
+        if (rxLen < total) {
+            return;
+        }
+
+        lastReceive = Hal.millis();
+        handlePacket(rx[0], rx + 1 + lenBytes, remaining);
+        if (state < MQTT_WAIT_CONNACK) {
+            return;
+        }
+
+        memmove(rx, rx + total, rxLen - total);
+        rxLen -= total;
+    }
+}
+
+void MqttClass::handlePacket(uint8_t type, const uint8_t* body, size_t len) {
+    switch (type & 0xF0) {
+        case CONNACK:
+            if (state != MQTT_WAIT_CONNACK) {
+                return;
+            }
+            if (len < 2 || body[1] != 0) {
+                LOG_E("MQTT", "Broker refused connection, code %u", len >= 2 ? body[1] : 0);
+                drop("refused");
+                return;
+            }
+            state = MQTT_CONNECTED;
+            retryDelay = RETRY_MIN;
+            stats.connects++;
+            LOG_I("MQTT", "Connected to %s:%u as %s", host, port, clientId);
+
+            if (*filter) {
+                sendSubscribe();
+            }
+            publish("status", "online", true);
+            return;
+
+        case PUBLISH: {
+            if (len < 2) {
+                return;
+            }
+            uint8_t qos = (type >> 1) & 0x03;
+            size_t topicLen = (body[0] << 8) | body[1];
+            size_t pos = 2 + topicLen;
+            if (pos + (qos > 0 ? 2 : 0) > len) {
+                return;
+            }
+            if (qos == 1) {
+                uint8_t ack[4] = { PUBACK, 2, body[pos], body[pos + 1] };
+                sendPacket(ack, sizeof(ack));
+            }
+            if (qos > 0) {
+                pos += 2;
+            }
+            stats.received++;
+
+            // A retained command would replay on every reconnect
+            if (type & 0x01) {
+                LOG_W("MQTT", "Ignoring retained message on a command topic");
+                return;
+            }
+
+            size_t baseLen = strlen(base);
+            if (topicLen <= baseLen + 1 || topicLen - baseLen - 1 >= TOPIC_SIZE ||
+                memcmp(body + 2, base, baseLen) != 0 || body[2 + baseLen] != '/') {
+                return;
+            }
+            char topic[TOPIC_SIZE];
+            memcpy(topic, body + 2 + baseLen + 1, topicLen - baseLen - 1);
+            topic[topicLen - baseLen - 1] = '\0';
+
+            char payload[PAYLOAD_SIZE];
+            size_t payloadLen = len - pos < sizeof(payload) - 1 ? len - pos : sizeof(payload) - 1;
+            memcpy(payload, body + pos, payloadLen);
+            payload[payloadLen] = '\0';
+
+            if (onMessage) {
+                onMessage(topic, payload);
+            }
+            stats.lastDispatchMicros = Hal.micros() - rxMicros;
+            return;
+        }
+
+        case PINGRESP:
+            return;
+
+        case SUBACK:
+            if (len >= 3 && body[2] == 0x80) {
+                LOG_W("MQTT", "Subscription to %s/%s refused", base, filter);
+            }
+            return;
+
+        default:
+            return;
+    }
+}
+
+void MqttClass::loopMqtt() {
+    if (state == MQTT_DISABLED) {
+        return;
+    }
+
+    if (state > MQTT_IDLE && tcpClosed) {
+        drop("connection closed");
+    }
+
+    switch (state) {
+        case MQTT_IDLE:
+            if (Hal.wifiConnected() && Hal.millis() - stateTimer >= retryDelay) {
+                startConnect();
+            }
+            break;
+
+        case MQTT_CONNECTING:
+            if (tcpConnected) {
+                lastReceive = Hal.millis();
+                lastPing = lastReceive;
+                sendConnect();
+            } else if (Hal.millis() - stateTimer >= CONNECT_TIMEOUT) {
+                drop("connect timeout");
+            }
+            break;
+
+        case MQTT_WAIT_CONNACK:
+            parseRx();
+            if (state == MQTT_WAIT_CONNACK && Hal.millis() - stateTimer >= CONNECT_TIMEOUT) {
+                drop("no CONNACK");
+            }
+            break;
+
+        case MQTT_CONNECTED:
+            if (rxOverflow) {
+                drop("receive buffer overflow");
+                break;
+            }
+            parseRx();
+            if (state != MQTT_CONNECTED) {
+                break;
+            }
+
+            if (Hal.millis() - lastReceive >= KEEPALIVE * 1500UL) {
+                drop("keepalive timeout");
+                break;
+            }
+            // Ping at half the keepalive whatever else is sent, so a silent
+            // broker is noticed even while publishing
+            if (Hal.millis() - lastPing >= KEEPALIVE * 500UL) {
+                uint8_t ping[2] = { PINGREQ, 0 };
+                if (sendPacket(ping, sizeof(ping))) {
+                    lastPing = Hal.millis();
+                }
+            }
+            flushQueue();
+            break;
+
+        default:
+            break;
+    }
+}
+
+const char* MqttClass::stateName(ConnState s) {
+    switch (s) {
+        case MQTT_IDLE:         return "disconnected";
+        case MQTT_CONNECTING:   return "connecting";
+        case MQTT_WAIT_CONNACK: return "handshake";
+        case MQTT_CONNECTED:    return "connected";
+        default:                return "disabled";
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef MQTT_H_
+#define MQTT_H_
+
+#include <functional>
+#include <ESPAsyncTCP.h>
+#include <Hal.h>
+#include <Log.h>
+#include <Config.h>
+
+// Minimal MQTT 3.1.1 client (QoS 0) on the async TCP stack. Nothing here
+// blocks: the network callbacks only buffer bytes and set flags, loopMqtt()
+// runs the connection state machine and parses what arrived. Outgoing
+// messages go through a fixed queue where a newer message for a topic that
+// is still pending replaces the older one, and whatever fits in the TCP send
+// window goes out as one write. Topics are relative to the configured base,
+// e.g. "pc" is published as "<base>/pc".
+class MqttClass {
+
+    public:
+        enum ConnState { MQTT_DISABLED, MQTT_IDLE, MQTT_CONNECTING, MQTT_WAIT_CONNACK, MQTT_CONNECTED };
+
+        static const uint16_t KEEPALIVE = 30;                  // s
+        static const unsigned long CONNECT_TIMEOUT = 5000;     // ms for TCP plus CONNACK
+        static const unsigned long RETRY_MIN = 2000;           // ms, doubled per failure
+        static const unsigned long RETRY_MAX = 60000;
+        static const uint8_t QUEUE_SIZE = 16;                  // pending outbound messages, power of two
+        static const size_t TOPIC_SIZE = 64;                   // relative topic
+        static const size_t PAYLOAD_SIZE = 32;
+        static const size_t RX_SIZE = 256;                     // largest inbound packet
+        static const size_t TX_SIZE = 512;                     // one batched write
+
+        struct Stats {
+            unsigned long connects;
+            unsigned long failures;
+            unsigned long published;
+            unsigned long batches;
+            unsigned long coalesced;
+            unsigned long dropped;          // queue full
+            unsigned long received;
+            unsigned long lastDispatchMicros; // packet arrival to onMessage() return, not the pulse itself
+        };
+
+        void initMqtt(std::function<void(const char*, const char*)> onMessageFunc);
+        void loopMqtt();
+
+        // Validates and stores new settings, then reconnects; an empty broker
+        // ("" or nullptr) turns the client off
+        bool setBroker(const char* broker, const char* user, const char* pass, const char* topic);
+        const char* getBase() { return base; }
+
+        // Wifi events: connect at once on a new lease, drop the session on loss
+        void onWifiUp();
+        void onWifiDown();
+
+        // Queued until connected; false if the queue is full or MQTT is off
+        bool publish(const char* topic, const char* payload, bool retain);
+        bool subscribe(const char* filter);
+
+        ConnState getState() { return state; }
+        uint8_t getQueueDepth() { return (uint8_t)(head - tail); }
+        const Stats& getStats() { return stats; }
+        static const char* stateName(ConnState s);
+
+    private:
+        struct Message {
+            char topic[TOPIC_SIZE];
+            char payload[PAYLOAD_SIZE];
+            bool retain;
+        };
+
+        std::function<void(const char*, const char*)> onMessage;
+        AsyncClient client;
+
+        char host[64] = "";
+        uint16_t port = 0;
+        char base[48] = "";
+        char clientId[16] = "";
+        char filter[TOPIC_SIZE] = "";       // the one subscription, relative
+
+        ConnState state = MQTT_DISABLED;
+        unsigned long stateTimer = 0;
+        unsigned long retryDelay = RETRY_MIN;
+        unsigned long lastPing = 0;
+        unsigned long lastReceive = 0;
+        uint16_t packetId = 0;
+
+        // Set from the network context, consumed by loopMqtt()
+        volatile bool tcpConnected = false;
+        volatile bool tcpClosed = false;
+        volatile bool rxOverflow = false;
+        uint8_t rx[RX_SIZE];
+        volatile size_t rxLen = 0;
+        volatile unsigned long rxMicros = 0;
+
+        Message queue[QUEUE_SIZE];
+        uint8_t head = 0;
+        uint8_t tail = 0;
+        uint8_t tx[TX_SIZE];
+
+        Stats stats = {};
+
+        bool parseBroker(const char* broker);
+        void applyConfig();
+        void startConnect();
+        void drop(const char* reason);
+        void disconnect();
+        void sendConnect();
+        void sendSubscribe();
+        bool sendPacket(const uint8_t* data, size_t len);
+        void flushQueue();
+        void parseRx();
+        void handlePacket(uint8_t type, const uint8_t* body, size_t len);
+
+        size_t fullTopic(char* out, size_t size, const char* topic);
+        static size_t putLength(uint8_t* out, size_t len);
+        static size_t putString(uint8_t* out, const char* s, size_t len);
+        static size_t putString(uint8_t* out, const char* s) { return putString(out, s, strlen(s)); }
+};
+
+extern MqttClass Mqtt;
+
+#endif
@@ -0,0 +1,175 @@
+#include <Ota.h>
+#include <ElegantOTA.h>
+#include <Updater.h>
+
+OtaClass Ota;
+
+void OtaClass::initOta(std::function<void()> onDoneFunc) {
+    this->onDone = onDoneFunc;
+
+    // Full images, plain or gzip; a delta upload keeps its own stats
+    ElegantOTA.onStart([this]() {
+        if (owner == nullptr) {
+            start(OTA_FULL);
+        }
+    });
+    ElegantOTA.onProgress([this](size_t current, size_t final) {
+        if (owner == nullptr) {
+            stats.uploadBytes = current;
+            sampleHeap();
+        }
+    });
+    ElegantOTA.onEnd([this](bool success) {
+        if (owner != nullptr) {
+            return;
+        }
+        if (!success) {
+            LOG_E("OTA", "Updater: %s", Update.getErrorString().c_str());
+        }
+        finish(success, "updater error");
+    });
+}
+
+const char* OtaClass::kindName(Kind kind) {
+    static const char* const NAMES[] = { "none", "full", "delta" };
+    return NAMES[kind];
+}
+
+void OtaClass::md5Hex(const uint8_t* md5, char* out) {
+    for (size_t i = 0; i < DeltaPatch::MD5_SIZE; i++) {
+        snprintf(out + i * 2, 3, "%02x", md5[i]);
+    }
+}
+
+void OtaClass::start(Kind kind) {
+    stats.kind = kind;
+    stats.running = true;
+    stats.success = false;
+    stats.uploadBytes = 0;
+    stats.imageBytes = 0;
+    stats.error = nullptr;
+    startTime = Hal.millis();
+    startHeap = Hal.freeHeap();
+    stats.minFreeHeap = startHeap;
+    stats.heapUsedPeak = 0;
+    LOG_I("OTA", "%s update started", kind == OTA_DELTA ? "Delta" : "Full");
+}
+
+void OtaClass::sampleHeap() {
+    uint32_t freeHeap = Hal.freeHeap();
+    if (freeHeap < stats.minFreeHeap) {
+        stats.minFreeHeap = freeHeap;
+        stats.heapUsedPeak = startHeap - freeHeap;
+    }
+}
+
+// error is kept in the stats, so it has to be a literal
+void OtaClass::finish(bool success, const char* error) {
+    stats.running = false;
+    stats.success = success;
+    stats.transferMs = Hal.millis() - startTime;
+    if (success) {
+        stats.updates++;
+        LOG_I("OTA", "Update done: %lu bytes uploaded in %lu ms, heap low %lu",
+              (unsigned long)stats.uploadBytes, stats.transferMs, (unsigned long)stats.minFreeHeap);
+    } else {
+        stats.failures++;
+        LOG_E("OTA", "Update failed after %lu bytes: %s", (unsigned long)stats.uploadBytes, error);
+        stats.error = error;
+    }
+}
+
+// A finished but unverified image must not be committed; a checksum that
+// cannot match makes end() discard it
+void OtaClass::abortDelta(const char* error) {
+    if (Update.isRunning()) {
+        Update.setMD5("00000000000000000000000000000000");
+        Update.end();
+    }
+    result = DeltaPatch::DELTA_ERROR;
+    finish(false, error);
+}
+
+void OtaClass::handleDeltaUpload(AsyncWebServerRequest* request, const String& filename, size_t index,
+                                 uint8_t* data, size_t len, bool final) {
+    if (index == 0) {
+        if (owner != nullptr || Update.isRunning()) {
+            return;
+        }
+        owner = request;
+        result = DeltaPatch::DELTA_MORE;
+        start(OTA_DELTA);
+
+        // A dropped upload never reaches handleDeltaRequest()
+        request->onDisconnect([this, request]() {
+            if (owner == request) {
+                if (stats.running) {
+                    abortDelta("upload interrupted");
+                }
+                owner = nullptr;
+            }
+        });
+
+        Update.runAsync(true);
+        patch.begin(
+            [this](const DeltaPatch::Header& header) {
+                char md5[2 * DeltaPatch::MD5_SIZE + 1];
+                md5Hex(header.oldMd5, md5);
+                if (header.oldSize != ESP.getSketchSize() || ESP.getSketchMD5() != md5) {
+                    return false;
+                }
+                md5Hex(header.newMd5, md5);
+                return Update.begin(header.newSize, U_FLASH) && Update.setMD5(md5);
+            },
+            [](uint32_t offset, uint8_t* out, size_t len) {
+                return ESP.flashRead(offset, out, len);
+            },
+            [](const uint8_t* data, size_t len) {
+                return Update.write(const_cast<uint8_t*>(data), len) == len;
+            });
+    }
+
+    if (owner != request || result != DeltaPatch::DELTA_MORE) {
+        return;
+    }
+
+    stats.uploadBytes = index + len;
+    result = patch.feed(data, len);
+    stats.imageBytes = patch.getWritten();
+    sampleHeap();
+
+    if (result == DeltaPatch::DELTA_ERROR) {
+        abortDelta(patch.getError());
+    } else if (result == DeltaPatch::DELTA_DONE) {
+        if (Update.end()) {
+            finish(true, nullptr);
+        } else {
+            result = DeltaPatch::DELTA_ERROR;
+            finish(false, "image checksum mismatch");
+        }
+    } else if (final) {
+        abortDelta("patch truncated");
+    }
+}
+
+void OtaClass::handleDeltaRequest(AsyncWebServerRequest* request) {
+    if (owner != request) {
+        request->send(409, "application/json", "{\"result\":\"another update is running\"}");
+        return;
+    }
+    owner = nullptr;
+
+    char json[160];
+    if (result != DeltaPatch::DELTA_DONE) {
+        snprintf(json, sizeof(json), "{\"result\":\"error\",\"error\":\"%s\"}", stats.error ? stats.error : "no patch");
+        request->send(400, "application/json", json);
+        return;
+    }
+
+    snprintf(json, sizeof(json), "{\"result\":\"ok\",\"upload_bytes\":%lu,\"image_bytes\":%lu,\"transfer_ms\":%lu}",
+             (unsigned long)stats.uploadBytes, (unsigned long)stats.imageBytes, stats.transferMs);
+    request->send(200, "application/json", json);
+    if (onDone) {
+        onDone();
+    }
+}
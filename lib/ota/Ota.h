@@ -0,0 +1,68 @@
+#ifndef OTA_H_
+#define OTA_H_
+
+#include <functional>
+#include <ESPAsyncWebServer.h>
+#include <Hal.h>
+#include <Log.h>
+#include <Delta.h>
+
+// Bookkeeping for firmware updates, plus the delta upload path.
+//
+// Full images still go through ElegantOTA on /update, either plain or gzip
+// compressed (gzip -9 firmware.bin): the updater stores a compressed image
+// as it is and the boot loader inflates it into place through its own fixed
+// window, so only the compressed bytes cross the air. Delta patches (see
+// DeltaPatch) are posted to /api/ota/delta and rebuilt against the running
+// image while they stream in. Their result must match the MD5 in the patch
+// before the updater marks it bootable.
+class OtaClass {
+
+    public:
+        enum Kind { OTA_NONE, OTA_FULL, OTA_DELTA };
+
+        struct Stats {
+            Kind kind;                  // of the last update
+            bool running;
+            bool success;
+            unsigned long updates;
+            unsigned long failures;
+            uint32_t uploadBytes;
+            uint32_t imageBytes;        // written to flash, 0 if not known
+            unsigned long transferMs;
+            uint32_t minFreeHeap;
+            uint32_t heapUsedPeak;      // free heap at start minus the lowest seen
+            const char* error;
+        };
+
+        // onDone runs after a delta update is verified, to schedule the reboot
+        void initOta(std::function<void()> onDoneFunc);
+
+        // Upload and completion handlers for POST /api/ota/delta
+        void handleDeltaUpload(AsyncWebServerRequest* request, const String& filename, size_t index,
+                               uint8_t* data, size_t len, bool final);
+        void handleDeltaRequest(AsyncWebServerRequest* request);
+
+        const Stats& getStats() { return stats; }
+        static const char* kindName(Kind kind);
+
+    private:
+        std::function<void()> onDone;
+        DeltaPatch patch;
+        AsyncWebServerRequest* owner = nullptr;
+        DeltaPatch::Result result = DeltaPatch::DELTA_MORE;
+        unsigned long startTime = 0;
+        uint32_t startHeap = 0;
+
+        Stats stats = {};
+
+        void start(Kind kind);
+        void sampleHeap();
+        void finish(bool success, const char* error);
+        void abortDelta(const char* error);
+        static void md5Hex(const uint8_t* md5, char* out);
+};
+
+extern OtaClass Ota;
+
+#endif
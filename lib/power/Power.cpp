@@ -0,0 +1,490 @@
+#include <Power.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+PowerClass Power;
+
+static void IRAM_ATTR pulseTimerIsr() {
+    Power.onPulseTimer();
+}
+
+void PowerClass::initPower(std::function<void(const Command&)> onUpdate) {
+    this->onUpdate = onUpdate;
+    Hal.timerAttach(pulseTimerIsr);
+}
+
+// Returns the channel index, or -1 when the table is full
+int PowerClass::addChannel(const char* name, uint8_t pin, uint16_t shortMs, uint16_t longMs) {
+    if (channelCount >= MAX_CHANNELS) {
+        return -1;
+    }
+
+    uint8_t ch = channelCount++;
+    strncpy(names[ch], name, NAME_SIZE - 1);
+    names[ch][NAME_SIZE - 1] = '\0';
+    pins[ch] = pin;
+    shortPress[ch] = shortMs;
+    longPress[ch] = longMs;
+    states[ch] = IDLE;
+    memset(&running[ch], 0, sizeof(Command));
+
+    Hal.pinMode(pin, OUTPUT);
+    Hal.digitalWrite(pin, LOW);
+
+    LOG_I("POWER", "Channel %u \"%s\" on pin %u (%u/%u ms)", ch, names[ch], pin, shortMs, longMs);
+    return ch;
+}
+
+// One line per output: "<pin> <short ms> <long ms> <name>". A line
+// "595 <data> <clock> <latch>" attaches a shift-register chain whose outputs
+// are then addressed as pins HalClass::EXPANDER_BASE and up.
+int PowerClass::loadChannels(const char* table) {
+    const char* line = table;
+
+    while (*line != '\0') {
+        const char* eol = strchr(line, '\n');
+        size_t len = eol ? (size_t)(eol - line) : strlen(line);
+
+        char buf[64];
+        if (len >= sizeof(buf)) {
+            len = sizeof(buf) - 1;
+        }
+        memcpy(buf, line, len);
+        buf[len] = '\0';
+        if (len > 0 && buf[len - 1] == '\r') {
+            buf[len - 1] = '\0';
+        }
+
+        unsigned int a, b, c;
+        int nameAt = 0;
+        if (sscanf(buf, "595 %u %u %u", &a, &b, &c) == 3) {
+            Hal.attachExpander(a, b, c);
+        } else if (sscanf(buf, "%u %u %u %n", &a, &b, &c, &nameAt) == 3 && nameAt > 0 && buf[nameAt] != '\0') {
+            // Durations are stored as uint16_t and must pass submitPulse()
+            if (b == 0 || c == 0 || b > MAX_SEGMENT_MS || c > MAX_SEGMENT_MS) {
+                LOG_W("POWER", "Press duration not 1..%u ms, ignoring channel line: %s", MAX_SEGMENT_MS, buf);
+            } else {
+                addChannel(buf + nameAt, a, b, c);
+            }
+        } else if (buf[0] != '\0' && buf[0] != '#') {
+            LOG_W("POWER", "Ignoring channel line: %s", buf);
+        }
+
+        line += len;
+        while (*line == '\r' || *line == '\n') {
+            line++;
+        }
+    }
+
+    return channelCount;
+}
+
+int PowerClass::findChannel(const char* nameOrIndex) {
+    char* end;
+    unsigned long index = strtoul(nameOrIndex, &end, 10);
+    if (end != nameOrIndex && *end == '\0') {
+        return index < channelCount ? (int)index : -1;
+    }
+
+    for (uint8_t ch = 0; ch < channelCount; ch++) {
+        if (strcasecmp(names[ch], nameOrIndex) == 0) {
+            return ch;
+        }
+    }
+    return -1;
+}
+
+// The channel's own durations; unknown channels are rejected before the
+// per-channel tables are read
+uint32_t PowerClass::pressShort(uint8_t channel, Source source) {
+    if (channel >= channelCount) {
+        rejected++;
+        return 0;
+    }
+    return submit(channel, shortPress[channel], source);
+}
+
+uint32_t PowerClass::pressLong(uint8_t channel, Source source) {
+    if (channel >= channelCount) {
+        rejected++;
+        return 0;
+    }
+    return submit(channel, longPress[channel], source);
+}
+
+uint32_t PowerClass::submit(uint8_t channel, unsigned long duration, Source source) {
+    // Checked here too: the cast to a segment would wrap
+    if (duration > MAX_SEGMENT_MS) {
+        rejected++;
+        LOG_W("POWER", "Press of %lu ms over %u ms, rejecting", duration, MAX_SEGMENT_MS);
+        return 0;
+    }
+
+    Pulse pulse = {};
+    pulse.count = 1;
+    pulse.segments[0] = (uint16_t)duration;
+    return submitPulse(channel, pulse, source);
+}
+
+// Returns the command id, or 0 when the queue is full or the request is malformed
+uint32_t PowerClass::submitPulse(uint8_t channel, const Pulse& pulse, Source source) {
+    unsigned long now = Hal.millis();
+
+    if (channel >= channelCount || pulse.count == 0 || pulse.count > MAX_SEGMENTS || pulse.count % 2 == 0) {
+        rejected++;
+        return 0;
+    }
+    for (uint8_t i = 0; i < pulse.count; i++) {
+        if (pulse.segments[i] == 0 || pulse.segments[i] > MAX_SEGMENT_MS) {
+            rejected++;
+            LOG_W("POWER", "Pulse segment of %u ms not 1..%u ms, rejecting %s command",
+                  pulse.segments[i], MAX_SEGMENT_MS, sourceName(source));
+            return 0;
+        }
+    }
+
+    // The same press again shortly after: hand back the one already on its way
+    const Command& active = running[channel];
+    if (active.status == CMD_RUNNING && samePulse(active.pulse, pulse) && now - active.queuedAt < COALESCE_WINDOW) {
+        coalesced++;
+        return active.id;
+    }
+    for (uint8_t i = tail; i != head; i++) {
+        const Command& pending = queue[i & (QUEUE_SIZE - 1)];
+        if (pending.status == CMD_QUEUED && pending.channel == channel &&
+            samePulse(pending.pulse, pulse) && now - pending.queuedAt < COALESCE_WINDOW) {
+            coalesced++;
+            return pending.id;
+        }
+    }
+
+    if ((uint8_t)(head - tail) >= QUEUE_SIZE) {
+        rejected++;
+        LOG_W("POWER", "Queue full, rejecting %s command", sourceName(source));
+        return 0;
+    }
+
+    Command& cmd = queue[head & (QUEUE_SIZE - 1)];
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.id = nextId++;
+    if (nextId == 0) {
+        nextId = 1;
+    }
+    cmd.pulse = pulse;
+    cmd.queuedAt = now;
+    cmd.channel = channel;
+    cmd.source = source;
+    cmd.status = CMD_QUEUED;
+
+    // Publish only once the slot is complete
+    head++;
+    submitted++;
+
+    return cmd.id;
+}
+
+bool PowerClass::samePulse(const Pulse& a, const Pulse& b) {
+    return a.count == b.count && memcmp(a.segments, b.segments, a.count * sizeof(a.segments[0])) == 0;
+}
+
+bool PowerClass::isForceOff(uint8_t channel, const Pulse& pulse) {
+    for (uint8_t i = 0; i < pulse.count; i += 2) {
+        if (pulse.segments[i] >= longPress[channel]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// "500" or "200,300,200": press, gap, press ... in ms
+bool PowerClass::parsePulse(const char* text, Pulse& out) {
+    memset(&out, 0, sizeof(out));
+
+    while (*text != '\0') {
+        char* end;
+        unsigned long ms = strtoul(text, &end, 10);
+        if (end == text || ms == 0 || ms > MAX_SEGMENT_MS || out.count >= MAX_SEGMENTS) {
+            return false;
+        }
+        out.segments[out.count++] = (uint16_t)ms;
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return false;
+        }
+        text = end;
+    }
+
+    return out.count % 2 == 1;
+}
+
+bool PowerClass::forceOffQueuedAfter(uint8_t from, uint8_t channel) {
+    for (uint8_t i = from; i != head; i++) {
+        const Command& cmd = queue[i & (QUEUE_SIZE - 1)];
+        if (cmd.status == CMD_QUEUED && cmd.channel == channel && isForceOff(channel, cmd.pulse)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hands queued commands to idle channels. A command for a busy channel stays
+// in its slot without holding up other channels behind it.
+void PowerClass::dispatch() {
+    for (uint8_t i = tail; i != head; i++) {
+        Command& cmd = queue[i & (QUEUE_SIZE - 1)];
+        if (cmd.status != CMD_QUEUED) {
+            continue;
+        }
+
+        uint8_t ch = cmd.channel;
+        bool forceOff = isForceOff(ch, cmd.pulse);
+
+        // A force-off queued behind a short press makes the press pointless
+        if (!forceOff && forceOffQueuedAfter(i + 1, ch)) {
+            finish(cmd, CMD_SUPERSEDED);
+            continue;
+        }
+
+        if (states[ch] != IDLE) {
+            // Still safe to drop a short press the button has not seen yet
+            if (forceOff && states[ch] == START_PRESS && !isForceOff(ch, running[ch].pulse)) {
+                Hal.interruptsOff();
+                cancelMask |= 1UL << ch;
+                Hal.interruptsOn();
+            }
+            continue;
+        }
+
+        start(ch, cmd);
+        cmd.status = CMD_RUNNING;
+    }
+
+    // Reclaim slots taken from the front
+    while (tail != head && queue[tail & (QUEUE_SIZE - 1)].status != CMD_QUEUED) {
+        tail++;
+    }
+}
+
+void PowerClass::start(uint8_t ch, const Command& cmd) {
+    Command& run = running[ch];
+    run = cmd;
+    run.status = CMD_RUNNING;
+    for (uint8_t i = 0; i < run.pulse.count; i += 2) {
+        run.requestedWidth += run.pulse.segments[i] * 1000UL;
+    }
+
+    edgeIndex[ch] = 0;
+    pulseActualWidth[ch] = 0;
+    pulseMaxJitter[ch] = 0;
+    triggerMicros[ch] = Hal.micros();
+    nextEdgeAt[ch] = triggerMicros[ch] + PRE_PRESS_DELAY * 1000UL;
+    states[ch] = START_PRESS;
+
+    uint32_t bit = 1UL << ch;
+    Hal.interruptsOff();
+    cancelMask &= ~bit;
+    busyMask |= bit;
+    armTimer();
+    Hal.interruptsOn();
+
+    if (onUpdate) {
+        onUpdate(run);
+    }
+}
+
+// Arms the timer for the earliest pending edge of any channel
+void IRAM_ATTR PowerClass::armTimer() {
+    uint32_t pending = busyMask & ~doneMask;
+    if (pending == 0) {
+        Hal.timerDisarm();
+        return;
+    }
+
+    unsigned long now = Hal.micros();
+    long wait = 0x7FFFFFFF;
+    while (pending) {
+        uint8_t ch = __builtin_ctz(pending);
+        pending &= pending - 1;
+
+        long w = (long)(nextEdgeAt[ch] - now);
+        if (w < wait) {
+            wait = w;
+        }
+    }
+    Hal.timerArm(wait > 0 ? (uint32_t)wait : 0);
+}
+
+// Runs in interrupt context: no logging, no allocation, IRAM only
+void IRAM_ATTR PowerClass::onPulseTimer() {
+    unsigned long now = Hal.micros();
+    uint32_t pending = busyMask & ~doneMask;
+
+    while (pending) {
+        uint8_t ch = __builtin_ctz(pending);
+        uint32_t bit = 1UL << ch;
+        pending &= pending - 1;
+
+        // Not due yet, or a long hold arriving in timer-range chunks
+        long early = (long)(nextEdgeAt[ch] - now);
+        if (early > 0) {
+            continue;
+        }
+
+        if (edgeIndex[ch] == 0 && (cancelMask & bit)) {
+            doneMask |= bit;
+            continue;
+        }
+
+        bool press = edgeIndex[ch] % 2 == 0;
+        Hal.digitalWrite(pins[ch], press ? HIGH : LOW);
+
+        unsigned long late = (unsigned long)(-early);
+        if (late > pulseMaxJitter[ch]) {
+            pulseMaxJitter[ch] = late;
+        }
+        if (edgeIndex[ch] == 0) {
+            firstEdgeAt[ch] = now;
+            pressedMask |= bit;
+        }
+        if (press) {
+            pressStartedAt[ch] = now;
+        } else {
+            pulseActualWidth[ch] += now - pressStartedAt[ch];
+        }
+
+        edgeIndex[ch]++;
+        if (edgeIndex[ch] > running[ch].pulse.count) {
+            doneMask |= bit;
+            continue;
+        }
+        nextEdgeAt[ch] += running[ch].pulse.segments[edgeIndex[ch] - 1] * 1000UL;
+    }
+
+    armTimer();
+}
+
+void PowerClass::complete(uint8_t ch) {
+    Command& run = running[ch];
+    states[ch] = IDLE;
+
+    if (edgeIndex[ch] == 0) {
+        finish(run, CMD_SUPERSEDED);
+        return;
+    }
+
+    run.actualWidth = pulseActualWidth[ch];
+    run.maxJitter = pulseMaxJitter[ch];
+
+    lastRequestedWidth = run.requestedWidth;
+    lastActualWidth = run.actualWidth;
+    lastPressLatency = firstEdgeAt[ch] - triggerMicros[ch];
+    lastMaxJitter = run.maxJitter;
+    if (lastMaxJitter > worstJitter) {
+        worstJitter = lastMaxJitter;
+    }
+    completedActions++;
+
+    LOG_I("POWER", "Power button released on %s (%lu us requested, %lu us actual, %lu us jitter)",
+          names[ch], lastRequestedWidth, lastActualWidth, lastMaxJitter);
+    finish(run, CMD_DONE);
+}
+
+void PowerClass::finish(Command& cmd, CommandStatus status) {
+    cmd.status = status;
+    cmd.finishedAt = Hal.millis();
+
+    if (status == CMD_SUPERSEDED) {
+        superseded++;
+        LOG_I("POWER", "Command #%lu superseded by force shutdown", (unsigned long)cmd.id);
+    }
+
+    history[historyNext] = cmd;
+    historyNext = (historyNext + 1) % HISTORY_SIZE;
+
+    if (onUpdate) {
+        onUpdate(cmd);
+    }
+}
+
+// One pass for all channels. Edges come from the timer interrupt; with
+// nothing queued and nothing reported this is a couple of mask reads,
+// whatever the channel count.
+void PowerClass::handlePowerStateMachine() {
+    Hal.interruptsOff();
+    uint32_t done = doneMask;
+    uint32_t pressed = pressedMask & ~reportedMask;
+    busyMask &= ~done;
+    doneMask &= ~done;
+    pressedMask &= ~done;
+    Hal.interruptsOn();
+
+    reportedMask = (reportedMask | pressed) & ~done;
+
+    while (pressed) {
+        uint8_t ch = __builtin_ctz(pressed);
+        pressed &= pressed - 1;
+        LOG_I("POWER", "Power button pressed on %s...", names[ch]);
+        states[ch] = HOLDING;
+    }
+
+    while (done) {
+        uint8_t ch = __builtin_ctz(done);
+        done &= done - 1;
+        complete(ch);
+    }
+
+    if (tail != head) {
+        dispatch();
+    }
+}
+
+bool PowerClass::getCommand(uint32_t id, Command& out) {
+    if (id == 0) {
+        return false;
+    }
+    for (uint8_t ch = 0; ch < channelCount; ch++) {
+        if (running[ch].id == id) {
+            out = running[ch];
+            return true;
+        }
+    }
+    for (uint8_t i = tail; i != head; i++) {
+        if (queue[i & (QUEUE_SIZE - 1)].id == id) {
+            out = queue[i & (QUEUE_SIZE - 1)];
+            return true;
+        }
+    }
+    for (int i = 0; i < HISTORY_SIZE; i++) {
+        if (history[i].id == id) {
+            out = history[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* PowerClass::stateName(uint8_t state) {
+    switch (state) {
+        case IDLE: return "idle";
+        case START_PRESS: return "pending";
+        default: return "pressed";
+    }
+}
+
+const char* PowerClass::statusName(uint8_t status) {
+    switch (status) {
+        case CMD_QUEUED: return "queued";
+        case CMD_RUNNING: return "running";
+        case CMD_DONE: return "done";
+        case CMD_SUPERSEDED: return "superseded";
+        default: return "unknown";
+    }
+}
+
+const char* PowerClass::sourceName(uint8_t source) {
+    static const char* const NAMES[SOURCE_COUNT] = { "http", "led", "alexa", "ws", "relay", "schedule", "mqtt", "fleet" };
+    return source < SOURCE_COUNT ? NAMES[source] : "unknown";
+}
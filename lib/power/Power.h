@@ -0,0 +1,165 @@
+#ifndef POWER_H_
+#define POWER_H_
+
+#include <functional>
+#include <Hal.h>
+#include <Log.h>
+
+// Power button outputs, one per channel. Commands from every source go
+// through one bounded queue; button edges are generated by a single hardware
+// timer interrupt serving all channels, and loop() only hands out queued
+// commands and reports what the interrupt finished.
+class PowerClass {
+
+    public:
+        enum PowerState { IDLE, START_PRESS, HOLDING, RELEASING };
+
+        // Where a command came from, reported back with its status
+        enum Source { SRC_HTTP, SRC_LED, SRC_ALEXA, SRC_WS, SRC_RELAY, SRC_SCHEDULE, SRC_MQTT, SRC_FLEET, SOURCE_COUNT };
+
+        enum CommandStatus { CMD_NONE, CMD_QUEUED, CMD_RUNNING, CMD_DONE, CMD_SUPERSEDED };
+
+        static const uint8_t MAX_CHANNELS = 32;                // one bit each in the interrupt masks
+        static const uint8_t NAME_SIZE = 24;
+        static const uint8_t MAX_SEGMENTS = 7;                 // up to four presses
+        static const uint16_t MAX_SEGMENT_MS = 60000;          // longest press or gap
+
+        // Alternating press/release durations in ms, starting and ending with a
+        // press, each 1..MAX_SEGMENT_MS
+        struct Pulse {
+            uint8_t count;
+            uint16_t segments[MAX_SEGMENTS];
+        };
+
+        struct Command {
+            uint32_t id;
+            Pulse pulse;
+            unsigned long queuedAt;     // ms
+            unsigned long finishedAt;   // ms, 0 while pending
+            uint8_t channel;
+            uint8_t source;
+            uint8_t status;
+
+            // Measured by the timer interrupt, valid once done (micros)
+            unsigned long requestedWidth;   // sum of the presses
+            unsigned long actualWidth;
+            unsigned long maxJitter;        // worst edge distance from schedule
+        };
+
+        static const unsigned long PRE_PRESS_DELAY = 100;      // ms before the button is pressed
+        static const unsigned long SHORT_PRESS = 500;          // ms, default power toggle
+        static const unsigned long LONG_PRESS = 5000;          // ms, default force shutdown
+
+        static const uint8_t QUEUE_SIZE = 16;                  // pending commands, power of two
+        static const uint8_t HISTORY_SIZE = 16;                // finished commands kept for status lookups
+        static const unsigned long COALESCE_WINDOW = 2000;     // ms, identical presses inside it collapse
+
+        void initPower(std::function<void(const Command&)> onUpdate = nullptr);
+        int addChannel(const char* name, uint8_t pin, uint16_t shortMs = SHORT_PRESS, uint16_t longMs = LONG_PRESS);
+        int loadChannels(const char* table);
+
+        uint32_t submit(uint8_t channel, unsigned long duration, Source source);
+        uint32_t submitPulse(uint8_t channel, const Pulse& pulse, Source source);
+        uint32_t pressShort(uint8_t channel, Source source);
+        uint32_t pressLong(uint8_t channel, Source source);
+        void handlePowerStateMachine();
+
+        bool getCommand(uint32_t id, Command& out);
+        bool isForceOff(uint8_t channel, const Pulse& pulse);
+        static bool parsePulse(const char* text, Pulse& out);
+        static const char* stateName(uint8_t state);
+        static const char* statusName(uint8_t status);
+        static const char* sourceName(uint8_t source);
+
+        // Channel table
+        uint8_t getChannelCount() { return channelCount; }
+        int findChannel(const char* nameOrIndex);
+        const char* getChannelName(uint8_t channel) { return names[channel]; }
+        uint8_t getChannelPin(uint8_t channel) { return pins[channel]; }
+        PowerState getState(uint8_t channel = 0) { return states[channel]; }
+        uint8_t getQueueDepth() { return (uint8_t)(head - tail); }
+
+        // Pulse timing of the last completed action on any channel (micros)
+        unsigned long getLastRequestedWidth() { return lastRequestedWidth; }
+        unsigned long getLastActualWidth() { return lastActualWidth; }
+        unsigned long getLastPressLatency() { return lastPressLatency; }
+        unsigned long getLastMaxJitter() { return lastMaxJitter; }
+        unsigned long getWorstJitter() { return worstJitter; }
+        unsigned long getCompletedActions() { return completedActions; }
+
+        // Queue counters since boot
+        unsigned long getSubmitted() { return submitted; }
+        unsigned long getCoalesced() { return coalesced; }
+        unsigned long getSuperseded() { return superseded; }
+        unsigned long getRejected() { return rejected; }
+
+        // Timer interrupt entry point, not for general use
+        void onPulseTimer();
+
+    private:
+        std::function<void(const Command&)> onUpdate;
+
+        // Channel table
+        uint8_t channelCount = 0;
+        char names[MAX_CHANNELS][NAME_SIZE];
+        uint8_t pins[MAX_CHANNELS];
+        uint16_t shortPress[MAX_CHANNELS];
+        uint16_t longPress[MAX_CHANNELS];
+
+        // Single-producer/single-consumer ring: submit() only moves head,
+        // loop() hands queued commands to idle channels and moves tail past
+        // the ones it has taken. Slots are filled before head is published.
+        Command queue[QUEUE_SIZE];
+        volatile uint8_t head = 0;
+        volatile uint8_t tail = 0;
+
+        Command history[HISTORY_SIZE] = {};
+        uint8_t historyNext = 0;
+        uint32_t nextId = 1;
+
+        // Per-channel run state as parallel arrays. The interrupt owns the
+        // edge fields while a channel's bit is set in busyMask; it reports
+        // the first edge and completion through pressedMask and doneMask so
+        // loop() does nothing per channel unless something happened. Edges
+        // are scheduled against the start time, not the previous edge, so a
+        // late interrupt never stretches the rest of the sequence.
+        PowerState states[MAX_CHANNELS];
+        Command running[MAX_CHANNELS];
+        uint8_t edgeIndex[MAX_CHANNELS];
+        unsigned long nextEdgeAt[MAX_CHANNELS];
+        unsigned long pressStartedAt[MAX_CHANNELS];
+        unsigned long firstEdgeAt[MAX_CHANNELS];
+        unsigned long triggerMicros[MAX_CHANNELS];
+        unsigned long pulseActualWidth[MAX_CHANNELS];
+        unsigned long pulseMaxJitter[MAX_CHANNELS];
+
+        volatile uint32_t busyMask = 0;
+        volatile uint32_t pressedMask = 0;
+        volatile uint32_t doneMask = 0;
+        volatile uint32_t cancelMask = 0;
+        uint32_t reportedMask = 0;
+
+        unsigned long lastRequestedWidth = 0;
+        unsigned long lastActualWidth = 0;
+        unsigned long lastPressLatency = 0;
+        unsigned long lastMaxJitter = 0;
+        unsigned long worstJitter = 0;
+        unsigned long completedActions = 0;
+
+        unsigned long submitted = 0;
+        unsigned long coalesced = 0;
+        unsigned long superseded = 0;
+        unsigned long rejected = 0;
+
+        void dispatch();
+        void start(uint8_t channel, const Command& cmd);
+        void complete(uint8_t channel);
+        bool forceOffQueuedAfter(uint8_t from, uint8_t channel);
+        void finish(Command& cmd, CommandStatus status);
+        void armTimer();
+        static bool samePulse(const Pulse& a, const Pulse& b);
+};
+
+extern PowerClass Power;
+
+#endif
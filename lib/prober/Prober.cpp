@@ -0,0 +1,149 @@
+#include <Prober.h>
+
+ProberClass Prober;
+
+void ProberClass::initProber(std::function<void(PcState)> onChangeFunc) {
+    this->onChange = onChangeFunc;
+
+    // Async callbacks run in the network context; they only set flags that
+    // loopProber() consumes
+    client.onConnect([](void* arg, AsyncClient* c) {
+        ProberClass* self = (ProberClass*)arg;
+        self->probeResult = true;
+        self->probeDone = true;
+        c->close(true);
+    }, this);
+
+    client.onError([](void* arg, AsyncClient* c, int8_t error) {
+        ProberClass* self = (ProberClass*)arg;
+        // A reset means the host answered (port closed) and is therefore up
+        self->probeResult = (error == ERR_RST);
+        self->probeDone = true;
+    }, this);
+
+    if (parseTarget(Config.get(ConfigClass::PROBE_TARGET))) {
+        LOG_I("PROBER", "Target %s:%u", host, port);
+    } else {
+        LOG_I("PROBER", "No probe target configured");
+    }
+}
+
+bool ProberClass::parseTarget(const char* target) {
+    const char* colon = strrchr(target, ':');
+    if (colon == nullptr || colon == target || (size_t)(colon - target) >= sizeof(host)) {
+        return false;
+    }
+
+    unsigned long p = strtoul(colon + 1, NULL, 10);
+    if (p == 0 || p > 65535) {
+        return false;
+    }
+
+    memcpy(host, target, colon - target);
+    host[colon - target] = '\0';
+    port = (uint16_t)p;
+    return true;
+}
+
+bool ProberClass::setTarget(const char* target) {
+    if (!parseTarget(target)) {
+        return false;
+    }
+
+    Config.set(ConfigClass::PROBE_TARGET, target);
+
+    // Re-learn the state against the new target straight away
+    state = UNKNOWN;
+    failures = 0;
+    lastProbeDone = 0;
+    return true;
+}
+
+void ProberClass::notifyPowerAction() {
+    actionTime = Hal.millis();
+    actionPending = true;
+}
+
+unsigned long ProberClass::currentInterval() {
+    if (state == UNKNOWN || Hal.millis() - actionTime < FAST_WINDOW) {
+        return FAST_INTERVAL;
+    }
+    return SLOW_INTERVAL;
+}
+
+void ProberClass::startProbe() {
+    probeDone = false;
+    probeResult = false;
+    probeStart = Hal.millis();
+
+    if (client.connect(host, port)) {
+        inFlight = true;
+    } else {
+        finishProbe(false);
+    }
+}
+
+void ProberClass::finishProbe(bool alive) {
+    inFlight = false;
+    lastProbeDone = Hal.millis();
+    lastRtt = lastProbeDone - probeStart;
+    applyResult(alive);
+}
+
+void ProberClass::applyResult(bool alive) {
+    PcState newState = state;
+
+    if (alive) {
+        failures = 0;
+        newState = PC_ON;
+    } else if (++failures >= FAIL_THRESHOLD || state == UNKNOWN) {
+        newState = PC_OFF;
+    }
+
+    if (newState == state) {
+        return;
+    }
+
+    state = newState;
+    lastChange = Hal.millis();
+
+    if (actionPending) {
+        lastDetectLatency = (long)(lastChange - actionTime);
+        actionPending = false;
+    }
+
+    LOG_I("PROBER", "PC is %s", stateName(state));
+    if (onChange) {
+        onChange(state);
+    }
+}
+
+void ProberClass::loopProber() {
+    if (port == 0) {
+        return;
+    }
+
+    if (inFlight) {
+        if (probeDone) {
+            finishProbe(probeResult);
+        } else if (Hal.millis() - probeStart >= PROBE_TIMEOUT) {
+            client.close(true);
+            finishProbe(false);
+        }
+        return;
+    }
+
+    if (lastProbeDone == 0 || Hal.millis() - lastProbeDone >= currentInterval()) {
+        if (Hal.wifiConnected()) {
+            startProbe();
+        }
+    }
+}
+
+const char* ProberClass::stateName(PcState s) {
+    switch (s) {
+        case PC_ON:  return "ON";
+        case PC_OFF: return "OFF";
+        default:     return "UNKNOWN";
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef PROBER_H_
+#define PROBER_H_
+
+#include <functional>
+#include <ESPAsyncTCP.h>
+#include <Hal.h>
+#include <Log.h>
+#include <Config.h>
+
+// Non-blocking PC liveness check: an async TCP connect to host:port on an
+// adaptive schedule, fast right after a power action and slow when stable.
+class ProberClass {
+
+    public:
+        enum PcState { UNKNOWN, PC_OFF, PC_ON };
+
+        static const unsigned long FAST_INTERVAL = 2000;       // ms, after a power action
+        static const unsigned long SLOW_INTERVAL = 30000;      // ms, steady state
+        static const unsigned long FAST_WINDOW = 120000;       // ms of fast probing after an action
+        static const unsigned long PROBE_TIMEOUT = 1500;       // ms per connect attempt
+        static const int FAIL_THRESHOLD = 2;                   // consecutive failures before OFF
+
+        void initProber(std::function<void(PcState)> onChangeFunc);
+        void loopProber();
+        void notifyPowerAction();
+
+        bool setTarget(const char* target);
+        const char* getHost() { return host; }
+        uint16_t getPort() { return port; }
+
+        PcState getState() { return state; }
+        unsigned long getLastChange() { return lastChange; }
+        unsigned long getLastProbe() { return lastProbeDone; }
+        unsigned long getLastRtt() { return lastRtt; }
+        long getLastDetectLatency() { return lastDetectLatency; }   // -1 if none measured yet
+        static const char* stateName(PcState s);
+
+    private:
+        std::function<void(PcState)> onChange;
+        AsyncClient client;
+
+        char host[64] = "";
+        uint16_t port = 0;
+
+        PcState state = UNKNOWN;
+        int failures = 0;
+        bool inFlight = false;
+        volatile bool probeResult = false;
+        volatile bool probeDone = false;
+
+        unsigned long probeStart = 0;
+        unsigned long lastProbeDone = 0;
+        unsigned long lastRtt = 0;
+        unsigned long lastChange = 0;
+        unsigned long actionTime = 0;
+        bool actionPending = false;
+        long lastDetectLatency = -1;
+
+        bool parseTarget(const char* target);
+        void startProbe();
+        void finishProbe(bool alive);
+        void applyResult(bool alive);
+        unsigned long currentInterval();
+};
+
+extern ProberClass Prober;
+
+#endif
@@ -0,0 +1,231 @@
+#include <Profiler.h>
+#include <ESPAsyncWebServer.h>
+#include <Log.h>
+
+ProfilerClass Profiler;
+
+#ifdef LOOP_PROFILER
+
+// Microseconds printed as seconds without going through floats
+static void printSeconds(Print& out, uint64_t us) {
+    out.printf("%lu.%06lu", (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+}
+
+void ProfilerClass::add(Histogram& h, uint32_t cycles) {
+    if (h.count == 0 || cycles < h.minCycles) {
+        h.minCycles = cycles;
+    }
+    if (cycles > h.maxCycles) {
+        h.maxCycles = cycles;
+    }
+    h.count++;
+    h.sumCycles += cycles;
+
+    // Bucket k holds durations up to 2^k us
+    uint32_t us = cycles / HalClass::CPU_MHZ;
+    int bucket = us <= 1 ? 0 : 32 - __builtin_clz(us - 1);
+    if (bucket >= BUCKETS) {
+        bucket = BUCKETS - 1;
+    }
+    h.buckets[bucket]++;
+}
+
+void ProfilerClass::record(Stage stage, uint32_t cycles) {
+    add(stages[stage], cycles);
+}
+
+void ProfilerClass::markLoop() {
+    uint32_t now = Hal.cycles();
+    if (loopStarted) {
+        add(loopPeriod, now - lastLoopCycles);
+    }
+    lastLoopCycles = now;
+    loopStarted = true;
+
+    uint32_t freeHeap = Hal.freeHeap();
+    if (freeHeap < minFreeHeap) {
+        minFreeHeap = freeHeap;
+    }
+}
+
+const char* ProfilerClass::stageName(int stage) {
+    static const char* const NAMES[STAGE_COUNT] = {
+        "wifi", "ota", "mdns", "alexa", "wol", "wol_relay", "prober", "schedule", "ws", "status", "mqtt", "fleet", "log", "config", "power"
+    };
+    return NAMES[stage];
+}
+
+// Line k < BUCKETS is bucket k, then the sum and the count
+void ProfilerClass::writeHistogramLine(Print& out, const char* name, const char* stage, const Histogram& h, int line) {
+    if (line < BUCKETS) {
+        uint32_t cumulative = 0;
+        for (int i = 0; i <= line; i++) {
+            cumulative += h.buckets[i];
+        }
+        out.printf("%s_bucket{stage=\"%s\",le=\"", name, stage);
+        if (line == BUCKETS - 1) {
+            out.print("+Inf");
+        } else {
+            printSeconds(out, 1ULL << line);
+        }
+        out.printf("\"} %lu\n", (unsigned long)cumulative);
+    } else if (line == BUCKETS) {
+        out.printf("%s_sum{stage=\"%s\"} ", name, stage);
+        printSeconds(out, h.sumCycles / HalClass::CPU_MHZ);
+        out.print("\n");
+    } else {
+        out.printf("%s_count{stage=\"%s\"} %lu\n", name, stage, (unsigned long)h.count);
+    }
+}
+
+#endif
+
+// The exposition as a list of short units, so it can be produced a chunk at
+// a time without holding the whole text. Values are read as each unit is
+// written, so one scrape may straddle a few new samples.
+bool ProfilerClass::writeLine(Print& out, uint16_t line) {
+#ifdef LOOP_PROFILER
+    static const uint16_t HIST_LINES = BUCKETS + 2;
+
+    if (line == 0) {
+        out.print("# HELP wow_loop_stage_seconds Duration of each loop() stage\n"
+                  "# TYPE wow_loop_stage_seconds histogram\n");
+        return true;
+    }
+    line--;
+    if (line < STAGE_COUNT * HIST_LINES) {
+        int stage = line / HIST_LINES;
+        writeHistogramLine(out, "wow_loop_stage_seconds", stageName(stage), stages[stage], line % HIST_LINES);
+        return true;
+    }
+    line -= STAGE_COUNT * HIST_LINES;
+
+    if (line == 0) {
+        out.print("# HELP wow_loop_stage_max_seconds Longest single run of each stage\n"
+                  "# TYPE wow_loop_stage_max_seconds gauge\n");
+        return true;
+    }
+    line--;
+    if (line < STAGE_COUNT) {
+        out.printf("wow_loop_stage_max_seconds{stage=\"%s\"} ", stageName(line));
+        printSeconds(out, stages[line].maxCycles / HalClass::CPU_MHZ);
+        out.print("\n");
+        return true;
+    }
+    line -= STAGE_COUNT;
+
+    if (line == 0) {
+        out.print("# HELP wow_loop_stage_min_seconds Shortest single run of each stage\n"
+                  "# TYPE wow_loop_stage_min_seconds gauge\n");
+        return true;
+    }
+    line--;
+    if (line < STAGE_COUNT) {
+        out.printf("wow_loop_stage_min_seconds{stage=\"%s\"} ", stageName(line));
+        printSeconds(out, stages[line].minCycles / HalClass::CPU_MHZ);
+        out.print("\n");
+        return true;
+    }
+    line -= STAGE_COUNT;
+
+    if (line == 0) {
+        out.print("# HELP wow_loop_period_seconds Time between successive loop() starts\n"
+                  "# TYPE wow_loop_period_seconds histogram\n");
+        return true;
+    }
+    line--;
+    if (line < HIST_LINES) {
+        writeHistogramLine(out, "wow_loop_period_seconds", "loop", loopPeriod, line);
+        return true;
+    }
+    line -= HIST_LINES;
+
+    if (line == 0) {
+        out.print("# HELP wow_loop_period_max_seconds Longest loop() period\n"
+                  "# TYPE wow_loop_period_max_seconds gauge\n"
+                  "wow_loop_period_max_seconds ");
+        printSeconds(out, loopPeriod.maxCycles / HalClass::CPU_MHZ);
+        out.print("\n");
+        return true;
+    }
+    if (line == 1) {
+        uint32_t lowestHeap = loopStarted ? minFreeHeap : Hal.freeHeap();
+        out.printf("# HELP wow_heap_min_free_bytes Lowest free heap seen at loop start\n"
+                   "# TYPE wow_heap_min_free_bytes gauge\n"
+                   "wow_heap_min_free_bytes %lu\n", (unsigned long)lowestHeap);
+        return true;
+    }
+    line -= 2;
+#endif
+
+    switch (line) {
+        case 0:
+            out.printf("# HELP wow_heap_free_bytes Free heap\n"
+                       "# TYPE wow_heap_free_bytes gauge\n"
+                       "wow_heap_free_bytes %lu\n", (unsigned long)Hal.freeHeap());
+            return true;
+        case 1:
+            out.printf("# HELP wow_heap_max_free_block_bytes Largest allocatable block\n"
+                       "# TYPE wow_heap_max_free_block_bytes gauge\n"
+                       "wow_heap_max_free_block_bytes %lu\n", (unsigned long)ESP.getMaxFreeBlockSize());
+            return true;
+        case 2:
+            out.printf("# HELP wow_heap_fragmentation_percent Heap fragmentation\n"
+                       "# TYPE wow_heap_fragmentation_percent gauge\n"
+                       "wow_heap_fragmentation_percent %u\n", (unsigned)ESP.getHeapFragmentation());
+            return true;
+        case 3:
+            out.printf("# HELP wow_uptime_seconds Time since boot\n"
+                       "# TYPE wow_uptime_seconds gauge\n"
+                       "wow_uptime_seconds %lu\n", Hal.millis() / 1000);
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ProfilerClass::writeMetrics(Print& out) {
+    for (uint16_t line = 0; writeLine(out, line); line++) {
+    }
+}
+
+namespace {
+
+// One unit rendered on the stack; longer output is cut and flagged
+class LineBuffer : public Print {
+    public:
+        char text[ProfilerClass::LINE_SIZE];
+        size_t len = 0;
+        bool overflow = false;
+
+        size_t write(uint8_t c) override {
+            if (len == sizeof(text)) {
+                overflow = true;
+                return 0;
+            }
+            text[len++] = (char)c;
+            return 1;
+        }
+};
+
+}
+
+size_t ProfilerClass::writeMetrics(uint8_t* buf, size_t len, uint16_t& line) {
+    size_t pos = 0;
+    while (true) {
+        LineBuffer unit;
+        if (!writeLine(unit, line)) {
+            break;
+        }
+        if (unit.overflow) {
+            LOG_E("PROFILER", "Metrics unit %u over %u bytes, skipped", (unsigned)line, (unsigned)LINE_SIZE);
+        } else if (unit.len > len - pos) {
+            return pos > 0 ? pos : RESPONSE_TRY_AGAIN;
+        } else {
+            memcpy(buf + pos, unit.text, unit.len);
+            pos += unit.len;
+        }
+        line++;
+    }
+    return pos;
+}
@@ -0,0 +1,70 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <Arduino.h>
+#include <Hal.h>
+
+// Loop-latency instrumentation, enabled with -D LOOP_PROFILER. When the flag
+// is absent PROFILE() runs the statement bare and nothing is recorded.
+#ifdef LOOP_PROFILER
+#define PROFILE(stage, statement) do { \
+        uint32_t _start = Hal.cycles(); \
+        statement; \
+        Profiler.record(stage, Hal.cycles() - _start); \
+    } while (0)
+#define PROFILE_LOOP() Profiler.markLoop()
+#else
+#define PROFILE(stage, statement) do { statement; } while (0)
+#define PROFILE_LOOP() do {} while (0)
+#endif
+
+class ProfilerClass {
+
+    public:
+        enum Stage { WIFI, OTA, MDNS, ALEXA, WOL, WOL_RELAY, PROBER, SCHEDULE, WS, STATUS, MQTT, FLEET, LOG, CONFIG, POWER, STAGE_COUNT };
+
+        // Buckets are powers of two in microseconds: le 1, 2, 4 ... 32768, +Inf
+        static const int BUCKETS = 17;
+
+        struct Histogram {
+            uint32_t count;
+            uint64_t sumCycles;
+            uint32_t minCycles;
+            uint32_t maxCycles;
+            uint32_t buckets[BUCKETS];
+        };
+
+#ifdef LOOP_PROFILER
+        void record(Stage stage, uint32_t cycles);
+        void markLoop();
+#endif
+
+        static const size_t LINE_SIZE = 192;       // longest unit of the text, HELP and TYPE included
+
+        // Prometheus text exposition format, written directly to the stream
+        void writeMetrics(Print& out);
+
+        // The same text for a chunked response: fills buf with whole lines
+        // from line on and advances it. Returns 0 once everything was sent,
+        // RESPONSE_TRY_AGAIN if not even the next line fits.
+        size_t writeMetrics(uint8_t* buf, size_t len, uint16_t& line);
+
+    private:
+        bool writeLine(Print& out, uint16_t line);
+
+#ifdef LOOP_PROFILER
+        Histogram stages[STAGE_COUNT];
+        Histogram loopPeriod;
+        uint32_t lastLoopCycles = 0;
+        bool loopStarted = false;
+        uint32_t minFreeHeap = UINT32_MAX;
+
+        static void add(Histogram& h, uint32_t cycles);
+        static void writeHistogramLine(Print& out, const char* name, const char* stage, const Histogram& h, int line);
+        static const char* stageName(int stage);
+#endif
+};
+
+extern ProfilerClass Profiler;
+
+#endif
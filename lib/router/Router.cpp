@@ -0,0 +1,141 @@
+#include <Router.h>
+#include <limits.h>
+
+RouterClass Router;
+
+void RouterClass::initRouter(const Route* routes, uint8_t count) {
+    this->routes = routes;
+    this->routeCount = count;
+}
+
+bool RouterClass::capture(SegmentType type, const char* text, unsigned long& number) {
+    switch (type) {
+        case CAP_UINT: {
+            // Digits only: strtoul() would also take a sign or blanks
+            number = 0;
+            for (const char* p = text; *p != '\0'; p++) {
+                if (*p < '0' || *p > '9' || number > (ULONG_MAX - 9) / 10) {
+                    return false;
+                }
+                number = number * 10 + (*p - '0');
+            }
+            return true;
+        }
+        case CAP_SWITCH:
+            number = strcmp(text, "ON") == 0;
+            return number || strcmp(text, "OFF") == 0;
+        default:
+            number = 0;
+            return true;
+    }
+}
+
+// Splits path in place and returns the index of the first matching route,
+// or -1. The url is already percent-decoded by the server.
+int RouterClass::match(AsyncWebServerRequest* request, char* path, Params* params) const {
+    const String& url = request->url();
+    if (url.length() >= MAX_PATH || url[0] != '/') {
+        return -1;
+    }
+    memcpy(path, url.c_str(), url.length() + 1);
+
+    const char* segments[MAX_SEGMENTS];
+    uint32_t hashes[MAX_SEGMENTS];
+    uint8_t count = 0;
+
+    // A trailing slash leaves an empty last segment, which nothing matches
+    for (char* p = path + 1; ; ) {
+        if (count == MAX_SEGMENTS) {
+            return -1;
+        }
+        char* slash = strchr(p, '/');
+        if (slash != nullptr) {
+            *slash = '\0';
+        }
+        segments[count] = p;
+        hashes[count] = hash(p);
+        count++;
+        if (slash == nullptr) {
+            break;
+        }
+        p = slash + 1;
+    }
+
+    for (int r = 0; r < routeCount; r++) {
+        const Route& route = routes[r];
+        if (route.count != count || !(route.method & request->method())) {
+            continue;
+        }
+
+        uint8_t captured = 0;
+        uint8_t i = 0;
+        for (; i < count; i++) {
+            const Segment& seg = route.segments[i];
+            if (seg.type == SEG_LITERAL) {
+                if (seg.hash != hashes[i] || strcmp(seg.text, segments[i]) != 0) {
+                    break;
+                }
+                continue;
+            }
+
+            unsigned long number;
+            if (*segments[i] == '\0' || !capture(seg.type, segments[i], number)) {
+                break;
+            }
+            if (params != nullptr) {
+                params->text[captured] = segments[i];
+                params->number[captured] = number;
+            }
+            captured++;
+        }
+
+        if (i == count) {
+            if (params != nullptr) {
+                params->count = captured;
+            }
+            return r;
+        }
+    }
+    return -1;
+}
+
+// Matches once: the route and its captures ride on the request's
+// _tempObject (freed with the request) until handleRequest(). A request
+// whose _tempObject is already taken belongs to another handler.
+bool RouterClass::canHandle(AsyncWebServerRequest* request) const {
+    if (request->_tempObject != nullptr) {
+        return false;
+    }
+
+    Match m;
+    unsigned long start = Hal.micros();
+    m.route = match(request, m.path, &m.params);
+    lastMatchMicros = Hal.micros() - start;
+    if (lastMatchMicros > maxMatchMicros) {
+        maxMatchMicros = lastMatchMicros;
+    }
+    if (m.route < 0) {
+        return false;
+    }
+
+    Match* saved = (Match*)malloc(sizeof(Match));
+    if (saved == nullptr) {
+        return false;
+    }
+    memcpy(saved, &m, sizeof(Match));
+    for (uint8_t i = 0; i < m.params.count; i++) {
+        saved->params.text[i] = saved->path + (m.params.text[i] - m.path);
+    }
+    request->_tempObject = saved;
+    return true;
+}
+
+void RouterClass::handleRequest(AsyncWebServerRequest* request) {
+    const Match* m = (const Match*)request->_tempObject;
+    if (m == nullptr) {
+        request->send(404);
+        return;
+    }
+    dispatched++;
+    routes[m->route].handler(request, m->params);
+}
@@ -0,0 +1,96 @@
+#ifndef ROUTER_H_
+#define ROUTER_H_
+
+#include <ESPAsyncWebServer.h>
+#include <Hal.h>
+
+// Routes with path parameters, matched without std::regex. A route is a
+// method plus up to MAX_SEGMENTS path segments, each a literal or a typed
+// capture. Literal hashes are computed at compile time, so a request is split
+// once and compared segment by segment as integers, with strcmp only to
+// confirm a hash hit. The whole table is served by this one handler.
+class RouterClass : public AsyncWebHandler {
+
+    public:
+        static const uint8_t MAX_SEGMENTS = 6;
+        static const size_t MAX_PATH = 96;
+
+        enum SegmentType : uint8_t {
+            SEG_LITERAL,
+            CAP_TEXT,       // any non-empty segment
+            CAP_UINT,       // decimal number
+            CAP_SWITCH      // ON or OFF, captured as 1 or 0
+        };
+
+        struct Segment {
+            SegmentType type;
+            uint32_t hash;
+            const char* text;
+        };
+
+        // Captures in path order; text points into a copy of the path that
+        // lives until the handler returns
+        struct Params {
+            uint8_t count;
+            const char* text[MAX_SEGMENTS];
+            unsigned long number[MAX_SEGMENTS];
+        };
+
+        typedef void (*Handler)(AsyncWebServerRequest* request, const Params& params);
+
+        struct Route {
+            WebRequestMethodComposite method;
+            uint8_t count;
+            Segment segments[MAX_SEGMENTS];
+            Handler handler;
+        };
+
+        // FNV-1a, usable both in constant expressions and at request time
+        static constexpr uint32_t hash(const char* s) {
+            uint32_t h = 2166136261u;
+            while (*s) {
+                h = (h ^ (uint8_t)*s++) * 16777619u;
+            }
+            return h;
+        }
+
+        static constexpr Segment lit(const char* text) { return { SEG_LITERAL, hash(text), text }; }
+        static constexpr Segment cap(SegmentType type) { return { type, 0, nullptr }; }
+
+        template <typename... Segments>
+        static constexpr Route route(WebRequestMethodComposite method, Handler handler, Segments... segments) {
+            static_assert(sizeof...(Segments) <= MAX_SEGMENTS, "too many path segments");
+            return { method, (uint8_t)sizeof...(Segments), { segments... }, handler };
+        }
+
+        void initRouter(const Route* routes, uint8_t count);
+
+        bool canHandle(AsyncWebServerRequest* request) const override;
+        void handleRequest(AsyncWebServerRequest* request) override;
+
+        unsigned long getDispatched() { return dispatched; }
+        unsigned long getLastMatchMicros() { return lastMatchMicros; }
+        unsigned long getMaxMatchMicros() { return maxMatchMicros; }
+
+    private:
+        // What canHandle() matched, kept on the request for handleRequest()
+        struct Match {
+            int route;
+            Params params;
+            char path[MAX_PATH];
+        };
+
+        const Route* routes = nullptr;
+        uint8_t routeCount = 0;
+
+        unsigned long dispatched = 0;
+        mutable unsigned long lastMatchMicros = 0;
+        mutable unsigned long maxMatchMicros = 0;
+
+        int match(AsyncWebServerRequest* request, char* path, Params* params) const;
+        static bool capture(SegmentType type, const char* text, unsigned long& number);
+};
+
+extern RouterClass Router;
+
+#endif
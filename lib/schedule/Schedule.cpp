@@ -0,0 +1,336 @@
+#include <Schedule.h>
+#include <stdlib.h>
+#include <string.h>
+
+ScheduleClass Schedule;
+
+void ScheduleClass::initSchedule(std::function<void(uint8_t, Action)> onFire, std::function<void()> onChange) {
+    this->onFire = onFire;
+    this->onChange = onChange;
+
+    load();
+    configTime(getTimezone(), "pool.ntp.org", "time.nist.gov");
+
+    LOG_I("SCHEDULE", "%d rules, timezone %s", getRuleCount(), getTimezone());
+}
+
+void ScheduleClass::load() {
+    Store store;
+    memset(rules, 0, sizeof(rules));
+
+    if (!Filesys.readBinary(schedulePath, &store, sizeof(store))) {
+        return;
+    }
+    if (store.magic != MAGIC || store.crc != Filesys.crc32(store.rules, sizeof(store.rules))) {
+        LOG_W("SCHEDULE", "%s invalid, ignoring", schedulePath);
+        return;
+    }
+    memcpy(rules, store.rules, sizeof(rules));
+}
+
+bool ScheduleClass::save() {
+    Store store;
+    store.magic = MAGIC;
+    memcpy(store.rules, rules, sizeof(rules));
+    store.crc = Filesys.crc32(store.rules, sizeof(store.rules));
+    if (!Filesys.writeBinary(schedulePath, &store, sizeof(store))) {
+        LOG_E("SCHEDULE", "Failed to write %s", schedulePath);
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+// Writes out lastFired updates still waiting for WRITE_DELAY
+bool ScheduleClass::commit() {
+    return !dirty || save();
+}
+
+void ScheduleClass::loopSchedule() {
+    if (dirty && Hal.millis() - dirtySince >= WRITE_DELAY) {
+        commit();
+    }
+
+    time_t now = Hal.epoch();
+    if (now < MIN_VALID_EPOCH) {
+        return;
+    }
+
+    // The wall clock stepped against millis(): first SNTP sync, a resync or a
+    // manual change. DST needs no handling here, the clock itself is UTC.
+    unsigned long ms = Hal.millis();
+    long drift = (long)(now - lastSeen) - (long)((ms - lastSeenMs) / 1000);
+    if (compiled && (drift > (long)JUMP_THRESHOLD || drift < -(long)JUMP_THRESHOLD)) {
+        LOG_W("SCHEDULE", "Clock stepped by %ld s, recomputing", drift);
+        compiled = false;
+    }
+    lastSeen = now;
+    lastSeenMs = ms;
+
+    if (!compiled) {
+        compile(now);
+    }
+
+    // Sorted, so only the head can be due
+    if (fireCount == 0 || now < fires[0].at) {
+        return;
+    }
+
+    while (fireCount > 0 && now >= fires[0].at) {
+        Fire fire = fires[0];
+        memmove(&fires[0], &fires[1], (fireCount - 1) * sizeof(Fire));
+        fireCount--;
+
+        Rule& rule = rules[fire.slot];
+        rule.lastFired = (uint32_t)fire.at;
+
+        if (now - fire.at <= MISSED_GRACE) {
+            firedCount++;
+            LOG_I("SCHEDULE", "Rule %u fired: power %s on channel %u", rule.id, actionName(rule.action), rule.channel);
+            if (onFire) {
+                onFire(rule.channel, (Action)rule.action);
+            }
+        } else {
+            skippedCount++;
+            LOG_W("SCHEDULE", "Rule %u missed by %ld s, skipped", rule.id, (long)(now - fire.at));
+        }
+
+        insertFire(fire.slot, now);
+    }
+
+    // lastFired keeps a reboot from repeating the fire; the write is deferred
+    // so rules firing together, or minutes apart, share one flash write
+    if (!dirty) {
+        dirty = true;
+        dirtySince = Hal.millis();
+    }
+    changed();
+}
+
+void ScheduleClass::compile(time_t now) {
+    fireCount = 0;
+    for (int i = 0; i < MAX_RULES; i++) {
+        if (rules[i].id != 0 && rules[i].enabled) {
+            insertFire(i, now - MISSED_GRACE);
+        }
+    }
+    compiled = true;
+    changed();
+}
+
+void ScheduleClass::insertFire(uint8_t slot, time_t after) {
+    time_t at = nextFire(rules[slot], after);
+    if (at == 0) {
+        return;
+    }
+
+    int i = fireCount;
+    while (i > 0 && fires[i - 1].at > at) {
+        fires[i] = fires[i - 1];
+        i--;
+    }
+    fires[i].at = at;
+    fires[i].slot = slot;
+    fireCount++;
+}
+
+// First local HH:MM on an enabled weekday strictly after both `after` and the
+// rule's last fire. mktime() resolves DST: a time skipped by spring-forward
+// moves to the first valid minute, and a rule never fires twice on the same
+// local date, which covers the repeated hour in autumn.
+time_t ScheduleClass::nextFire(const Rule& rule, time_t after) {
+    if (rule.days == 0) {
+        return 0;
+    }
+    if ((time_t)rule.lastFired > after) {
+        after = rule.lastFired;
+    }
+
+    struct tm base;
+    localtime_r(&after, &base);
+
+    struct tm fired;
+    time_t lastFired = rule.lastFired;
+    localtime_r(&lastFired, &fired);
+
+    for (int d = 0; d <= 8; d++) {
+        struct tm t;
+        memset(&t, 0, sizeof(t));
+        t.tm_year = base.tm_year;
+        t.tm_mon = base.tm_mon;
+        t.tm_mday = base.tm_mday + d;
+        t.tm_hour = rule.hour;
+        t.tm_min = rule.minute;
+        t.tm_isdst = -1;
+
+        time_t at = mktime(&t);
+        if (at == (time_t)-1 || at <= after || !(rule.days & (1 << t.tm_wday))) {
+            continue;
+        }
+        if (rule.lastFired != 0 && t.tm_year == fired.tm_year && t.tm_yday == fired.tm_yday) {
+            continue;
+        }
+        return at;
+    }
+    return 0;
+}
+
+void ScheduleClass::changed() {
+    if (onChange) {
+        onChange();
+    }
+}
+
+int ScheduleClass::findSlot(uint8_t id) {
+    for (int i = 0; i < MAX_RULES; i++) {
+        if (id != 0 && rules[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int ScheduleClass::getRuleCount() {
+    int count = 0;
+    for (int i = 0; i < MAX_RULES; i++) {
+        if (rules[i].id != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+time_t ScheduleClass::getNextFire(uint8_t id) {
+    for (int i = 0; i < fireCount; i++) {
+        if (rules[fires[i].slot].id == id) {
+            return fires[i].at;
+        }
+    }
+    return 0;
+}
+
+// Returns the new rule id, or -1 when full or invalid
+int ScheduleClass::addRule(uint8_t channel, uint8_t days, uint8_t hour, uint8_t minute, Action action, bool enabled) {
+    int slot = -1;
+    for (int i = 0; slot < 0 && i < MAX_RULES; i++) {
+        if (rules[i].id == 0) {
+            slot = i;
+        }
+    }
+    if (slot < 0 || days == 0 || days > 0x7F || hour > 23 || minute > 59) {
+        return -1;
+    }
+
+    uint8_t id = 1;
+    while (findSlot(id) >= 0) {
+        id++;
+    }
+
+    Rule& rule = rules[slot];
+    memset(&rule, 0, sizeof(rule));
+    rule.id = id;
+    rule.channel = channel;
+    rule.days = days;
+    rule.hour = hour;
+    rule.minute = minute;
+    rule.action = action;
+    rule.enabled = enabled;
+
+    save();
+    compiled = false;
+    LOG_I("SCHEDULE", "Rule %u added: %02u:%02u days 0x%02x power %s", id, hour, minute, days, actionName(action));
+    return id;
+}
+
+bool ScheduleClass::updateRule(uint8_t id, uint8_t channel, uint8_t days, uint8_t hour, uint8_t minute, Action action, bool enabled) {
+    int slot = findSlot(id);
+    if (slot < 0 || days == 0 || days > 0x7F || hour > 23 || minute > 59) {
+        return false;
+    }
+
+    Rule& rule = rules[slot];
+    if (rule.hour != hour || rule.minute != minute) {
+        rule.lastFired = 0;    // a new time of day may fire again today
+    }
+    rule.channel = channel;
+    rule.days = days;
+    rule.hour = hour;
+    rule.minute = minute;
+    rule.action = action;
+    rule.enabled = enabled;
+
+    save();
+    compiled = false;
+    return true;
+}
+
+bool ScheduleClass::removeRule(uint8_t id) {
+    int slot = findSlot(id);
+    if (slot < 0) {
+        return false;
+    }
+
+    memset(&rules[slot], 0, sizeof(Rule));
+    save();
+    compiled = false;
+    LOG_I("SCHEDULE", "Rule %u removed", id);
+    return true;
+}
+
+const char* ScheduleClass::getTimezone() {
+    const char* tz = Config.get(ConfigClass::TIMEZONE);
+    return tz[0] != '\0' ? tz : "UTC0";
+}
+
+bool ScheduleClass::setTimezone(const char* tz) {
+    if (tz[0] == '\0' || !Config.set(ConfigClass::TIMEZONE, tz)) {
+        return false;
+    }
+
+    setenv("TZ", getTimezone(), 1);
+    tzset();
+    compiled = false;
+    LOG_I("SCHEDULE", "Timezone %s", getTimezone());
+    return true;
+}
+
+// "62", "daily", "weekdays", "weekends" or "mon,wed,fri"
+bool ScheduleClass::parseDays(const char* text, uint8_t& days) {
+    static const char* const NAMES[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+    if (strcmp(text, "daily") == 0) {
+        days = 0x7F;
+        return true;
+    }
+    if (strcmp(text, "weekdays") == 0) {
+        days = 0x3E;
+        return true;
+    }
+    if (strcmp(text, "weekends") == 0) {
+        days = 0x41;
+        return true;
+    }
+
+    char* end;
+    unsigned long mask = strtoul(text, &end, 10);
+    if (end != text && *end == '\0') {
+        days = (uint8_t)mask;
+        return mask > 0 && mask <= 0x7F;
+    }
+
+    days = 0;
+    while (*text != '\0') {
+        int match = -1;
+        for (int i = 0; i < 7; i++) {
+            if (strncasecmp(text, NAMES[i], 3) == 0) {
+                match = i;
+            }
+        }
+        if (match < 0 || (text[3] != ',' && text[3] != '\0')) {
+            return false;
+        }
+        days |= 1 << match;
+        text += text[3] == ',' ? 4 : 3;
+    }
+    return days != 0;
+}
@@ -0,0 +1,104 @@
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include <functional>
+#include <time.h>
+#include <Hal.h>
+#include <Log.h>
+#include <Filesys.h>
+#include <Config.h>
+
+// On-device power calendar. Rules are "weekday mask + local HH:MM + action",
+// stored as one fixed-size CRC-checked record. At load they are compiled into
+// an array of next fire times sorted ascending, so loopSchedule() only has to
+// compare the head against the clock. Local time and DST come from the POSIX
+// TZ string in the config record; the clock from SNTP.
+class ScheduleClass {
+
+    public:
+        enum Action { ACTION_ON, ACTION_OFF };
+
+        static const int MAX_RULES = 16;
+        static const time_t MIN_VALID_EPOCH = 1600000000;      // anything earlier means SNTP has not synced
+        static const time_t MISSED_GRACE = 300;                // s, a fire missed by less than this still runs
+        static const time_t JUMP_THRESHOLD = 60;               // s of clock step that forces a recompile
+        static const unsigned long WRITE_DELAY = 60000;        // ms, fires within this window share one write
+
+        struct __attribute__((packed)) Rule {
+            uint8_t id;             // 0 marks a free slot
+            uint8_t days;           // bit 0 = Sunday ... bit 6 = Saturday
+            uint8_t hour;
+            uint8_t minute;
+            uint8_t action;
+            uint8_t enabled;
+            uint8_t channel;        // power output the action goes to
+            uint8_t reserved;
+            uint32_t lastFired;     // epoch of the last fire, survives reboots
+        };
+
+        struct Fire {
+            time_t at;
+            uint8_t slot;
+        };
+
+        void initSchedule(std::function<void(uint8_t, Action)> onFire, std::function<void()> onChange = nullptr);
+        void loopSchedule();
+        bool commit();
+
+        int addRule(uint8_t channel, uint8_t days, uint8_t hour, uint8_t minute, Action action, bool enabled);
+        bool updateRule(uint8_t id, uint8_t channel, uint8_t days, uint8_t hour, uint8_t minute, Action action, bool enabled);
+        bool removeRule(uint8_t id);
+        bool setTimezone(const char* tz);
+
+        bool isSynced() { return Hal.epoch() >= MIN_VALID_EPOCH; }
+        bool isDirty() { return dirty; }
+        const char* getTimezone();
+        int getRuleCount();
+        const Rule* getRule(int slot) { return rules[slot].id != 0 ? &rules[slot] : nullptr; }
+        int getFireCount() { return fireCount; }
+        const Fire& getFire(int i) { return fires[i]; }
+        time_t getNextFire(uint8_t id);
+        unsigned long getFiredCount() { return firedCount; }
+        unsigned long getSkippedCount() { return skippedCount; }
+
+        static bool parseDays(const char* text, uint8_t& days);
+        static const char* actionName(uint8_t action) { return action == ACTION_OFF ? "off" : "on"; }
+
+    private:
+        static const uint32_t MAGIC = 0x57575343;               // "WWSC"
+
+        struct __attribute__((packed)) Store {
+            uint32_t magic;
+            uint32_t crc;           // over rules
+            Rule rules[MAX_RULES];
+        };
+
+        const char* schedulePath = "/schedule.bin";
+
+        std::function<void(uint8_t, Action)> onFire;
+        std::function<void()> onChange;
+
+        Rule rules[MAX_RULES];
+        Fire fires[MAX_RULES];
+        int fireCount = 0;
+        bool compiled = false;
+        time_t lastSeen = 0;
+        unsigned long lastSeenMs = 0;
+        bool dirty = false;     // lastFired changed since the last write
+        unsigned long dirtySince = 0;
+
+        unsigned long firedCount = 0;
+        unsigned long skippedCount = 0;
+
+        void load();
+        bool save();
+        void compile(time_t now);
+        void insertFire(uint8_t slot, time_t after);
+        void changed();
+        time_t nextFire(const Rule& rule, time_t after);
+        int findSlot(uint8_t id);
+};
+
+extern ScheduleClass Schedule;
+
+#endif
@@ -0,0 +1,160 @@
+#include <Status.h>
+
+StatusClass Status;
+
+void* StatusClass::Arena::allocate(size_t size) {
+    size_t total = HEADER + align(size);
+    if (used + total > ARENA_SIZE) {
+        return nullptr;
+    }
+
+    uint8_t* block = buffer + used;
+    *(size_t*)block = size;
+    last = used;
+    used += total;
+    if (used > peak) {
+        peak = used;
+    }
+    return block + HEADER;
+}
+
+void StatusClass::Arena::deallocate(void* ptr) {
+    if (ptr != nullptr && (uint8_t*)ptr - HEADER == buffer + last) {
+        used = last;
+        last = NONE;
+    }
+}
+
+void* StatusClass::Arena::reallocate(void* ptr, size_t newSize) {
+    if (ptr == nullptr) {
+        return allocate(newSize);
+    }
+
+    uint8_t* block = (uint8_t*)ptr - HEADER;
+    size_t oldSize = *(size_t*)block;
+
+    // Newest block: grow or shrink where it is
+    if (block == buffer + last) {
+        size_t end = last + HEADER + align(newSize);
+        if (end > ARENA_SIZE) {
+            return nullptr;
+        }
+        *(size_t*)block = newSize;
+        used = end;
+        if (used > peak) {
+            peak = used;
+        }
+        return ptr;
+    }
+
+    if (newSize <= oldSize) {
+        return ptr;
+    }
+
+    void* moved = allocate(newSize);
+    if (moved != nullptr) {
+        memcpy(moved, ptr, oldSize);
+    }
+    return moved;
+}
+
+void StatusClass::initStatus(std::function<void(JsonObject)> fill) {
+    this->fill = fill;
+    bootId = ESP.random();
+}
+
+void StatusClass::formatETag(char* out, size_t size) {
+    snprintf(out, size, "W/\"%08lx-%lu\"", (unsigned long)bootId, (unsigned long)version);
+}
+
+bool StatusClass::notModified(AsyncWebServerRequest* request) {
+    if (!request->hasHeader("If-None-Match")) {
+        return false;
+    }
+    char etag[32];
+    formatETag(etag, sizeof(etag));
+    // Match on the quoted tag so a client dropping the W/ prefix still hits
+    return strstr(request->header("If-None-Match").c_str(), etag + 2) != nullptr;
+}
+
+void StatusClass::handleRequest(AsyncWebServerRequest* request) {
+    requests++;
+
+    if (!notModified(request)) {
+        sendStatus(request);
+        return;
+    }
+
+    unsigned long wait = request->hasParam("wait") ? strtoul(request->getParam("wait")->value().c_str(), nullptr, 10) * 1000 : 0;
+    if (wait == 0) {
+        sendNotModified(request);
+        return;
+    }
+
+    // A freed slot's weak pointer has expired, whether we answered it or the client went away
+    for (int i = 0; i < MAX_WAITERS; i++) {
+        if (waiters[i].request.expired()) {
+            waiters[i].request = request->pause();
+            waiters[i].version = version;
+            waiters[i].since = Hal.millis();
+            waiters[i].timeout = wait < MAX_WAIT ? wait : MAX_WAIT;
+            longPolls++;
+            return;
+        }
+    }
+
+    // Every slot is taken; the client simply polls again
+    sendNotModified(request);
+}
+
+void StatusClass::loopStatus() {
+    for (int i = 0; i < MAX_WAITERS; i++) {
+        auto request = waiters[i].request.lock();
+        if (!request) {
+            continue;
+        }
+
+        if (waiters[i].version != version) {
+            sendStatus(request.get());
+        } else if (Hal.millis() - waiters[i].since >= waiters[i].timeout) {
+            sendNotModified(request.get());
+        } else {
+            continue;
+        }
+        waiters[i].request.reset();
+    }
+}
+
+void StatusClass::sendStatus(AsyncWebServerRequest* request) {
+    arena.clear();
+    JsonDocument doc(&arena);
+    fill(doc.to<JsonObject>());
+
+    if (doc.overflowed()) {
+        overflows++;
+        LOG_W("STATUS", "Document exceeds %u byte arena", (unsigned)ARENA_SIZE);
+        request->send(500, "application/json", "{\"error\":\"status too large\"}");
+        return;
+    }
+
+    // Sized up front so the stream buffer is allocated once and never grows
+    AsyncResponseStream* response = request->beginResponseStream("application/json", measureJson(doc));
+    serializeJson(doc, *response);
+
+    char etag[32];
+    formatETag(etag, sizeof(etag));
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+void StatusClass::sendNotModified(AsyncWebServerRequest* request) {
+    notModifiedCount++;
+
+    char etag[32];
+    formatETag(etag, sizeof(etag));
+    AsyncWebServerResponse* response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
@@ -0,0 +1,86 @@
+#ifndef STATUS_H_
+#define STATUS_H_
+
+#include <functional>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <Hal.h>
+#include <Log.h>
+
+// Aggregated /api/status. The document is built by a caller supplied filler
+// into a JsonDocument whose memory comes from a fixed arena, then streamed to
+// the response, so a request does not touch the heap beyond the response
+// itself. touch() bumps a version counter that backs a weak ETag: pollers
+// sending If-None-Match get 304 while nothing changed, and with ?wait=<s>
+// the request is parked until the version moves or the wait runs out.
+class StatusClass {
+
+    public:
+        static const size_t ARENA_SIZE = 7168 / 4 * sizeof(void*);  // one document; slots grow with pointers on a 64-bit host
+        static const int MAX_WAITERS = 4;                      // parked long-poll requests
+        static const unsigned long MAX_WAIT = 30000;           // ms, cap on ?wait=
+
+        void initStatus(std::function<void(JsonObject)> fill);
+        void loopStatus();
+        void handleRequest(AsyncWebServerRequest* request);
+
+        // Something clients care about changed
+        void touch() { version++; }
+
+        uint32_t getVersion() { return version; }
+        unsigned long getRequests() { return requests; }
+        unsigned long getNotModified() { return notModifiedCount; }
+        unsigned long getLongPolls() { return longPolls; }
+        unsigned long getOverflows() { return overflows; }
+        size_t getArenaPeak() { return arena.getPeak(); }
+
+    private:
+        // Bump allocator over a static buffer, reset before every document.
+        // Only the most recent block can be grown in place or given back.
+        class Arena : public ArduinoJson::Allocator {
+            public:
+                void* allocate(size_t size) override;
+                void deallocate(void* ptr) override;
+                void* reallocate(void* ptr, size_t newSize) override;
+                void clear() { used = 0; last = NONE; }
+                size_t getPeak() { return peak; }
+
+            private:
+                static const size_t HEADER = 8;                 // block size, keeps payloads 8-aligned
+                static const size_t NONE = (size_t)-1;
+
+                alignas(8) uint8_t buffer[ARENA_SIZE];
+                size_t used = 0;
+                size_t last = NONE;                             // offset of the newest block
+                size_t peak = 0;
+
+                static size_t align(size_t n) { return (n + 7) & ~(size_t)7; }
+        };
+
+        struct Waiter {
+            AsyncWebServerRequestPtr request;
+            uint32_t version;
+            unsigned long since;
+            unsigned long timeout;
+        };
+
+        std::function<void(JsonObject)> fill;
+        Arena arena;
+        Waiter waiters[MAX_WAITERS];
+        uint32_t bootId = 0;                                    // keeps ETags from matching across reboots
+        uint32_t version = 1;
+
+        unsigned long requests = 0;
+        unsigned long notModifiedCount = 0;
+        unsigned long longPolls = 0;
+        unsigned long overflows = 0;
+
+        void formatETag(char* out, size_t size);
+        bool notModified(AsyncWebServerRequest* request);
+        void sendStatus(AsyncWebServerRequest* request);
+        void sendNotModified(AsyncWebServerRequest* request);
+};
+
+extern StatusClass Status;
+
+#endif
@@ -0,0 +1,162 @@
+#include <Tasks.h>
+
+TasksClass Tasks;
+
+int TasksClass::add(const char* name, TaskFunc func, unsigned long period) {
+    if (count == MAX_TASKS) {
+        LOG_E("TASKS", "No slot for task %s, MAX_TASKS is %u", name, MAX_TASKS);
+        return -1;
+    }
+    uint8_t id = count++;
+    tasks[id] = {};
+    tasks[id].name = name;
+    tasks[id].func = func;
+    tasks[id].period = period;
+    if (period > 0) {
+        tasks[id].deadline = Hal.millis() + period;
+        push(id);
+    }
+    return id;
+}
+
+void TasksClass::at(int id, unsigned long deadline) {
+    if (id < 0 || id >= count) {
+        return;
+    }
+    if (tasks[id].queued) {
+        remove(id);
+    }
+    tasks[id].deadline = deadline;
+    push(id);
+}
+
+void TasksClass::place(uint8_t pos, uint8_t id) {
+    heap[pos] = id;
+    slot[id] = pos;
+}
+
+void TasksClass::siftUp(uint8_t pos) {
+    uint8_t id = heap[pos];
+    while (pos > 0) {
+        uint8_t parent = (pos - 1) / 2;
+        if (!before(id, heap[parent])) {
+            break;
+        }
+        place(pos, heap[parent]);
+        pos = parent;
+    }
+    place(pos, id);
+}
+
+void TasksClass::siftDown(uint8_t pos) {
+    uint8_t id = heap[pos];
+    while (true) {
+        uint8_t child = pos * 2 + 1;
+        if (child >= heapSize) {
+            break;
+        }
+        if (child + 1 < heapSize && before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!before(heap[child], id)) {
+            break;
+        }
+        place(pos, heap[child]);
+        pos = child;
+    }
+    place(pos, id);
+}
+
+void TasksClass::push(uint8_t id) {
+    tasks[id].queued = true;
+    place(heapSize, id);
+    siftUp(heapSize++);
+}
+
+void TasksClass::remove(uint8_t id) {
+    uint8_t pos = slot[id];
+    tasks[id].queued = false;
+    heapSize--;
+    if (pos == heapSize) {
+        return;
+    }
+    uint8_t moved = heap[heapSize];
+    place(pos, moved);
+    siftUp(pos);
+    if (slot[moved] == pos) {
+        siftDown(pos);
+    }
+}
+
+// Wall time and idle time, summed per pass so micros() may wrap
+void TasksClass::account() {
+    unsigned long now = Hal.micros();
+    if (passes > 0) {
+        elapsedMicros += now - lastPassMicros;
+    }
+    lastPassMicros = now;
+    passes++;
+}
+
+void TasksClass::loopTasks() {
+    account();
+
+    // At most one run per task and pass, so a task that is due again at once
+    // cannot starve the ones behind it
+    unsigned long now = Hal.millis();
+    for (uint8_t ran = 0; ran < count && heapSize > 0; ran++) {
+        uint8_t id = heap[0];
+        Task& t = tasks[id];
+        unsigned long late = now - t.deadline;
+        if ((long)late < 0) {
+            break;
+        }
+        remove(id);
+
+        if (late > t.maxLate) {
+            t.maxLate = late;
+        }
+        if (t.period > 0 && late >= t.period) {
+            t.overruns++;
+        }
+
+        unsigned long start = Hal.micros();
+        t.func();
+        uint32_t took = Hal.micros() - start;
+        t.runs++;
+        t.totalMicros += took;
+        if (took > t.maxMicros) {
+            t.maxMicros = took;
+        }
+
+        // Missed slots are skipped rather than run back to back; a task that
+        // rescheduled itself keeps its own deadline
+        now = Hal.millis();
+        if (t.period > 0 && !t.queued) {
+            t.deadline += t.period;
+            if ((long)(now - t.deadline) >= 0) {
+                t.deadline = now + t.period;
+            }
+            push(id);
+        }
+    }
+
+    unsigned long wait = MAX_SLEEP;
+    if (heapSize > 0) {
+        long until = (long)(tasks[heap[0]].deadline - now);
+        wait = until <= 0 ? 0 : until < (long)MAX_SLEEP ? until : MAX_SLEEP;
+    }
+    if (wait > 0) {
+        unsigned long start = Hal.micros();
+        Hal.sleep(wait);
+        idleMicros += Hal.micros() - start;
+    }
+}
+
+uint16_t TasksClass::getCpuPermille(int id) {
+    return elapsedMicros == 0 ? 0 : (uint16_t)(tasks[id].totalMicros * 1000 / elapsedMicros);
+}
+
+uint16_t TasksClass::getIdlePermille() {
+    return elapsedMicros == 0 ? 0 : (uint16_t)(idleMicros * 1000 / elapsedMicros);
+}
@@ -0,0 +1,74 @@
+#ifndef TASKS_H_
+#define TASKS_H_
+
+#include <Hal.h>
+#include <Log.h>
+
+// Cooperative scheduler for the main loop. Every subsystem is a task with a
+// period (or a one-shot deadline); the deadlines sit in a binary min-heap, so
+// a pass only runs what is due and then sleeps until the earliest deadline
+// instead of spinning. Work arriving from network callbacks waits at most one
+// period of the task that picks it up. Deadlines are in Hal.millis() and may
+// be changed from web handlers, never from interrupts.
+class TasksClass {
+
+    public:
+        static const uint8_t MAX_TASKS = 24;
+        static const unsigned long MAX_SLEEP = 100;            // ms, also with nothing queued
+
+        typedef void (*TaskFunc)();
+
+        struct Task {
+            const char* name;
+            TaskFunc func;
+            unsigned long period;       // ms, 0 for one-shot
+            unsigned long deadline;
+            bool queued;
+            uint32_t runs;
+            uint32_t overruns;          // started a full period or more late
+            unsigned long maxLate;      // ms
+            uint32_t maxMicros;
+            uint64_t totalMicros;
+        };
+
+        // Periodic tasks first run one period from now; one-shot tasks only
+        // once given a deadline. Returns the id, -1 if the table is full.
+        int add(const char* name, TaskFunc func, unsigned long period);
+        void at(int id, unsigned long deadline);
+        void after(int id, unsigned long ms) { at(id, Hal.millis() + ms); }
+        void wake(int id) { at(id, Hal.millis()); }
+
+        // Runs the due tasks in deadline order, then sleeps until the next one
+        void loopTasks();
+
+        uint8_t getTaskCount() { return count; }
+        const Task& getTask(int id) { return tasks[id]; }
+        uint32_t getPasses() { return passes; }
+        uint16_t getCpuPermille(int id);
+        uint16_t getIdlePermille();
+
+    private:
+        Task tasks[MAX_TASKS];
+        uint8_t count = 0;
+
+        uint8_t heap[MAX_TASKS];        // task ids, earliest deadline first
+        uint8_t slot[MAX_TASKS];        // heap position of each queued task
+        uint8_t heapSize = 0;
+
+        uint32_t passes = 0;
+        unsigned long lastPassMicros = 0;
+        uint64_t elapsedMicros = 0;
+        uint64_t idleMicros = 0;
+
+        bool before(uint8_t a, uint8_t b) { return (long)(tasks[a].deadline - tasks[b].deadline) < 0; }
+        void place(uint8_t pos, uint8_t id);
+        void siftUp(uint8_t pos);
+        void siftDown(uint8_t pos);
+        void push(uint8_t id);
+        void remove(uint8_t id);
+        void account();
+};
+
+extern TasksClass Tasks;
+
+#endif
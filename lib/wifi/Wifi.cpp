@@ -5,19 +5,19 @@ extern "C" {
 
 WifiClass Wifi;
 
-void WifiClass::initWiFi(AsyncWebServer *server, std::function<void(bool)> alexaCb) {
-    this->server = server;
-    this->alexaCallback = alexaCb;
-    
+void WifiClass::initWiFi(std::function<void()> onConnectFunc, std::function<void()> onDisconnectFunc) {
+    this->onConnect = onConnectFunc;
+    this->onDisconnect = onDisconnectFunc;
+
     // Load WiFi credentials
-    ssid = Filesys.readFirstLine(ssidPath);
-    pass = Filesys.readFirstLine(passPath);
-  
+    ssid = Config.get(ConfigClass::SSID);
+    pass = Config.get(ConfigClass::PASS);
+
     if(ssid == "" || pass == "") {
-        Serial.println("No WiFi credentials found. Starting in Access Point Mode");
+        LOG_I("WIFI", "No WiFi credentials found. Starting in Access Point Mode");
         switchToAPMode();
     } else {
-        Serial.println("WiFi credentials found. Starting in Station Mode");
+        LOG_I("WIFI", "WiFi credentials found. Starting in Station Mode");
         switchToStaMode();
     }
 }
@@ -32,249 +32,388 @@ void WifiClass::switchToStaMode() {
     WiFi.setSleepMode(WIFI_NONE_SLEEP);  // Disable WiFi sleep
     WiFi.setOutputPower(20.5);           // Wifi max power
 
+    cacheValid = loadCache();
+    applyStaticIP();
+
     // Event handlers
     wifiConnectHandler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP& event) {
         this->onWifiConnect(event);
     });
-    
+
     wifiDisconnectHandler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected& event) {
         this->onWifiDisconnect(event);
     });
 
     // Wifi Attempt
+    startCycle();
     connectToWiFi();
 }
 
+void WifiClass::startCycle() {
+    cycleActive = true;
+    cycleStart = Hal.millis();
+    cycleMaxCallMicros = 0;
+}
+
+uint32_t WifiClass::cacheCrc(const WifiCache& c) {
+    return Filesys.crc32((const uint8_t*)&c + sizeof(c.crc), sizeof(c) - sizeof(c.crc));
+}
+
+// Ties the cache to the network it was saved on, so new credentials never
+// reuse the old BSSID or lease
+uint32_t WifiClass::credentialsHash() {
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), "%s\n%s", ssid.c_str(), pass.c_str());
+    return Filesys.crc32(buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+// RTC memory survives resets and OTA reboots, LittleFS survives power loss
+bool WifiClass::loadCache() {
+    uint32_t credentials = credentialsHash();
+    bool stale = false;
+
+    if (ESP.rtcUserMemoryRead(RTC_CACHE_OFFSET, (uint32_t*)&cache, sizeof(cache)) &&
+        cache.crc == cacheCrc(cache)) {
+        if (cache.credentials == credentials) {
+            LOG_I("WIFI", "Using cached AP from RTC memory, channel %d", cache.channel);
+            return true;
+        }
+        stale = true;
+    }
+
+    if (Filesys.readBinary(cachePath, &cache, sizeof(cache)) && cache.crc == cacheCrc(cache)) {
+        if (cache.credentials == credentials) {
+            LOG_I("WIFI", "Using cached AP from LittleFS, channel %d", cache.channel);
+            return true;
+        }
+        stale = true;
+    }
+
+    if (stale) {
+        LOG_I("WIFI", "Cached AP was saved for other credentials, ignoring it");
+    }
+    return false;
+}
+
+void WifiClass::saveCache() {
+    WifiCache fresh;
+    fresh.credentials = credentialsHash();
+    memcpy(fresh.bssid, WiFi.BSSID(), sizeof(fresh.bssid));
+    fresh.channel = (uint8_t)WiFi.channel();
+    fresh.reserved = 0;
+    fresh.ip = (uint32_t)WiFi.localIP();
+    fresh.gateway = (uint32_t)WiFi.gatewayIP();
+    fresh.mask = (uint32_t)WiFi.subnetMask();
+    fresh.dns = (uint32_t)WiFi.dnsIP();
+    fresh.crc = cacheCrc(fresh);
+
+    ESP.rtcUserMemoryWrite(RTC_CACHE_OFFSET, (uint32_t*)&fresh, sizeof(fresh));
+
+    // Only touch flash when the AP or lease actually changed
+    if (!cacheValid || memcmp(&fresh, &cache, sizeof(fresh)) != 0) {
+        Filesys.writeBinary(cachePath, &fresh, sizeof(fresh));
+    }
+
+    cache = fresh;
+    cacheValid = true;
+}
+
+// The static_ip setting holds "auto" (reuse the cached lease, skipping DHCP)
+// or "<ip> <gateway> <mask> <dns>"
+void WifiClass::applyStaticIP() {
+    String line = Config.get(ConfigClass::STATIC_IP);
+    line.trim();
+    if (line.length() == 0) {
+        return;
+    }
+
+    IPAddress ip, gateway, mask, dns;
+
+    if (line == "auto") {
+        if (!cacheValid || cache.ip == 0) {
+            return;
+        }
+        ip = IPAddress(cache.ip);
+        gateway = IPAddress(cache.gateway);
+        mask = IPAddress(cache.mask);
+        dns = IPAddress(cache.dns);
+    } else {
+        char buf[64];
+        strncpy(buf, line.c_str(), sizeof(buf) - 1);
+        buf[sizeof(buf) - 1] = '\0';
+
+        char* fields[4];
+        int count = 0;
+        for (char* tok = strtok(buf, " "); tok != nullptr && count < 4; tok = strtok(nullptr, " ")) {
+            fields[count++] = tok;
+        }
+        if (count != 4 || !ip.fromString(fields[0]) || !gateway.fromString(fields[1]) ||
+            !mask.fromString(fields[2]) || !dns.fromString(fields[3])) {
+            LOG_W("WIFI", "Ignoring malformed static_ip setting");
+            return;
+        }
+    }
+
+    WiFi.config(ip, gateway, mask, dns);
+    LOG_I("WIFI", "Static IP %s", ip.toString().c_str());
+}
+
 void WifiClass::onWifiConnect(const WiFiEventStationModeGotIP& event) {
+    if (!bootConnected) {
+        bootConnected = true;
+        bootViaCache = fastAttempt;
+        bootConnectedMs = Hal.millis();
+        LOG_I("WIFI", "Boot to IP: %lu ms via %s", bootConnectedMs, getBootPath());
+    }
+
+    if (cycleActive) {
+        cycleActive = false;
+        lastCycleDuration = Hal.millis() - cycleStart;
+        lastCycleMaxCallMicros = cycleMaxCallMicros;
+        lastCycleAttempts = connectionAttempts;
+        LOG_I("WIFI", "Reconnect cycle: %lu ms, %d attempt(s), longest call %lu us",
+              lastCycleDuration, lastCycleAttempts, lastCycleMaxCallMicros);
+    }
+
     // Reset tracking vars
     connectionAttempts = 0;
-    wifiConnectStartTime = 0;
-    shouldReconnect = false;
-    lastDisconnectTime = 0;
-    isConnecting = false;
-
-    Serial.println("\n=== WiFi Connected Successfully ===");
-    Serial.printf("IP Address: %s\n", WiFi.localIP().toString().c_str());
-    Serial.printf("Gateway: %s\n", WiFi.gatewayIP().toString().c_str());
-    Serial.printf("Subnet Mask: %s\n", WiFi.subnetMask().toString().c_str());
-    Serial.printf("DNS Server: %s\n", WiFi.dnsIP().toString().c_str());
-    Serial.printf("Signal Strength: %d dBm\n", WiFi.RSSI());
-    Serial.printf("Channel: %d\n", WiFi.channel());
-    Serial.printf("BSSID: %s\n", WiFi.BSSIDstr().c_str());
-    Serial.println("===================================\n");
-
-    // Initialize Alexa when wifi is connected
-    if (alexaCallback) {
-        Alexa.initAlexa(server, alexaCallback);  
+    connState = CONN_IDLE;
+    fastAttempt = false;
+    fastTried = false;
+
+    saveCache();
+
+    LOG_I("WIFI", "Connected: IP %s, gateway %s, mask %s",
+          WiFi.localIP().toString().c_str(), WiFi.gatewayIP().toString().c_str(),
+          WiFi.subnetMask().toString().c_str());
+    LOG_I("WIFI", "DNS %s, RSSI %d dBm, channel %d, BSSID %s",
+          WiFi.dnsIP().toString().c_str(), WiFi.RSSI(), WiFi.channel(), WiFi.BSSIDstr().c_str());
+
+    if (onConnect) {
+        onConnect();
     }
 }
 
 void WifiClass::onWifiDisconnect(const WiFiEventStationModeDisconnected& event) {
-    // Ignore disconnect events if we're already handling reconnection
-    // or if we intentionally disconnected (switching to AP mode)
-    if (WiFi.getMode() == WIFI_AP) {
+    // Ignore disconnect events if we intentionally disconnected (switching to AP mode)
+    if (WiFi.getMode() == WIFI_AP || connState == CONN_AP_PENDING || connState == CONN_AP) {
         return;
     }
 
-    Serial.printf("\n=== WiFi Disconnected ===\n");
-    Serial.printf("Reason Code: %d\n", event.reason);
-    
+    LOG_W("WIFI", "Disconnected, reason code %d", event.reason);
+    if (onDisconnect) {
+        onDisconnect();
+    }
+
+    if (connState == CONN_CONNECTING && fastAttempt) {
+        fastFailed = true;
+    }
+
     // Only schedule a reconnect if one isn't already pending/in-progress
-    if (!shouldReconnect && !isConnecting) {
-        shouldReconnect = true;
-        lastDisconnectTime = millis();
-        Serial.println("Reconnection scheduled...");
+    if (connState == CONN_IDLE) {
+        startCycle();
+        connState = CONN_WAIT_RETRY;
+        stateTimer = Hal.millis();
+        LOG_I("WIFI", "Reconnection scheduled...");
     }
-    Serial.println("========================\n");
 }
 
-String WifiClass::getBestBSSID() {
-    int n = WiFi.scanNetworks();
-    String bestBSSID = "";
+// Picks the strongest AP for our SSID from completed scan results
+bool WifiClass::getBestBSSID(int n, uint8_t* bssid, int32_t* channel) {
+    int bestIndex = -1;
     int bestRSSI = -100;
-    int targetChannel = 0;
-    
-    Serial.printf("Looking for network: %s\n", ssid.c_str());
-    
+
+    LOG_D("WIFI", "Looking for network: %s", ssid.c_str());
+
     for (int i = 0; i < n; i++) {
         if (WiFi.SSID(i) == ssid) {
             int currentRSSI = WiFi.RSSI(i);
-            Serial.printf("Found %s: BSSID=%s, RSSI=%d dBm, Channel=%d\n", 
-                         ssid.c_str(), WiFi.BSSIDstr(i).c_str(), 
-                         currentRSSI, WiFi.channel(i));
-                         
+            LOG_D("WIFI", "Found %s: BSSID=%s, RSSI=%d dBm, Channel=%d",
+                  ssid.c_str(), WiFi.BSSIDstr(i).c_str(), currentRSSI, WiFi.channel(i));
+
             if (currentRSSI > bestRSSI) {
                 bestRSSI = currentRSSI;
-                bestBSSID = WiFi.BSSIDstr(i);
-                targetChannel = WiFi.channel(i);
+                bestIndex = i;
             }
         }
     }
-    
-    if (bestBSSID != "") {
-        Serial.printf("Selected best AP: BSSID=%s, RSSI=%d dBm, Channel=%d\n", 
-                     bestBSSID.c_str(), bestRSSI, targetChannel);
-    } else {
-        Serial.println("ERROR: Target network not found in scan results!");
-    }
-    
-    return bestBSSID;
-}
 
-void WifiClass::convertBSSIDStringToBytes(const String& bssidStr, uint8_t* bssidBytes) {
-    int byteIndex = 0;
-    size_t start = 0;
-    size_t length = bssidStr.length();
-
-    for (size_t i = 0; i <= length && byteIndex < 6; i++) {
-        if (i == length || bssidStr.charAt(i) == ':') {
-            if (i > start) {
-                String hexPart = bssidStr.substring(start, i);
-                bssidBytes[byteIndex] = (uint8_t)strtol(hexPart.c_str(), NULL, 16);
-                byteIndex++;
-            }
-            start = i + 1;
-        }
+    if (bestIndex < 0) {
+        LOG_W("WIFI", "Target network not found in scan results");
+        return false;
     }
-    
-    // Verify we got all 6 bytes
-    if (byteIndex == 6) {
-        Serial.printf("BSSID successfully converted: %s\n", bssidStr.c_str());
-    } else {
-        Serial.printf("BSSID conversion failed: %s (got %d bytes)\n", bssidStr.c_str(), byteIndex);
-        // Fill remaining bytes with zeros
-        for (int i = byteIndex; i < 6; i++) {
-            bssidBytes[i] = 0;
-        }
+
+    memcpy(bssid, WiFi.BSSID(bestIndex), 6);
+    *channel = WiFi.channel(bestIndex);
+
+    LOG_I("WIFI", "Selected best AP: BSSID=%s, RSSI=%d dBm, Channel=%d",
+          WiFi.BSSIDstr(bestIndex).c_str(), bestRSSI, (int)*channel);
+    if (bestRSSI < WEAK_SIGNAL_THRESHOLD) {
+        LOG_W("WIFI", "Weak signal: %d dBm", bestRSSI);
     }
+    return true;
 }
 
+// Starts an attempt with an async scan; the rest happens in handleWiFiReconnection()
 void WifiClass::connectToWiFi() {
-    Serial.printf("\n=== Connection Attempt #%d ===\n", connectionAttempts + 1);
-    
-    isConnecting = true;
-
-    // Scan for available networks and find best AP
-    String bestBSSID = getBestBSSID();
-    
-    if (bestBSSID == "") {
-        Serial.println("ERROR: Target network not found!");
-        isConnecting = false;
-        connectionAttempts++;
-        if (connectionAttempts >= MAX_WIFI_ATTEMPTS) {
-            Serial.println("Max attempts reached, switching to AP mode");
-            switchToAPMode();
-        } else {
-            // Schedule another attempt
-            shouldReconnect = true;
-            lastDisconnectTime = millis();
-        }
+    // Skip the scan once per cycle when we know where the AP was
+    if (cacheValid && !fastTried) {
+        fastTried = true;
+        fastAttempt = true;
+        fastFailed = false;
+        LOG_I("WIFI", "Fast connect to cached AP, channel %d", cache.channel);
+
+        Hal.wifiBegin(ssid.c_str(), pass.c_str(), cache.channel, cache.bssid);
+        connState = CONN_CONNECTING;
+        stateTimer = Hal.millis();
         return;
     }
-    
-    // Get the channel from the scan results already in memory
-    int targetChannel = 0;
-    int n = WiFi.scanComplete();
-    if (n > 0) {
-        for (int i = 0; i < n; i++) {
-            if (WiFi.BSSIDstr(i) == bestBSSID) {
-                targetChannel = WiFi.channel(i);
-                break;
-            }
-        }
+
+    fastAttempt = false;
+
+    if (connectionAttempts >= MAX_WIFI_ATTEMPTS) {
+        LOG_W("WIFI", "Max attempts reached, switching to AP mode");
+        switchToAPMode();
+        return;
     }
-    
-    uint8_t bssidBytes[6];
-    convertBSSIDStringToBytes(bestBSSID, bssidBytes);
-    
-    Serial.printf("Connecting to: %s\n", ssid.c_str());
-    Serial.printf("Target BSSID: %s\n", bestBSSID.c_str());
-    Serial.printf("Target Channel: %d\n", targetChannel);
-    
-    WiFi.begin(ssid.c_str(), pass.c_str(), targetChannel, bssidBytes, true);
-
-    // Set connection tracking variables
-    wifiConnectStartTime = millis();
+
     connectionAttempts++;
-    
-    Serial.println("Connection initiated...");
+    LOG_I("WIFI", "Connection attempt #%d", connectionAttempts);
+
+    WiFi.scanDelete();
+    WiFi.scanNetworks(true, false);
+    connState = CONN_SCANNING;
+    stateTimer = Hal.millis();
 }
 
-void WifiClass::handleWiFiReconnection() {
-    // Handle connection timeout
-    if (isConnecting && wifiConnectStartTime > 0 &&
-        millis() - wifiConnectStartTime > WIFI_TIMEOUT) {
-        
-        Serial.println("WiFi connection timeout detected");
-        isConnecting = false;
-        wifiConnectStartTime = 0;
-
-        if (connectionAttempts >= MAX_WIFI_ATTEMPTS) {
-            Serial.println("Max attempts reached, switching to AP mode");
-            switchToAPMode();
-        } else {
-            // Schedule another retry after RECONNECT_DELAY
-            shouldReconnect = true;
-            lastDisconnectTime = millis();
-        }
+void WifiClass::onScanComplete(int n) {
+    uint8_t bssid[6];
+    int32_t channel = 0;
+    bool found = n > 0 && getBestBSSID(n, bssid, &channel);
+    WiFi.scanDelete();
+
+    if (!found) {
+        LOG_E("WIFI", "Target network not found!");
+        attemptFailed();
         return;
     }
-    
-    // Handle scheduled reconnection (after delay)
-    if (shouldReconnect && !isConnecting &&
-        millis() - lastDisconnectTime > RECONNECT_DELAY) {
-        shouldReconnect = false;
-        
-        if (WiFi.status() != WL_CONNECTED) {
-            if (connectionAttempts >= MAX_WIFI_ATTEMPTS) {
-                Serial.println("Max attempts reached, switching to AP mode");
-                switchToAPMode();
+
+    LOG_I("WIFI", "Connecting to %s, channel %d", ssid.c_str(), (int)channel);
+    Hal.wifiBegin(ssid.c_str(), pass.c_str(), channel, bssid);
+
+    connState = CONN_CONNECTING;
+    stateTimer = Hal.millis();
+}
+
+void WifiClass::attemptFailed() {
+    if (connectionAttempts >= MAX_WIFI_ATTEMPTS) {
+        LOG_W("WIFI", "Max attempts reached, switching to AP mode");
+        switchToAPMode();
+    } else {
+        // Schedule another retry after RECONNECT_DELAY
+        connState = CONN_WAIT_RETRY;
+        stateTimer = Hal.millis();
+    }
+}
+
+void WifiClass::handleWiFiReconnection() {
+    unsigned long callStart = Hal.micros();
+
+    switch (connState) {
+        case CONN_WAIT_RETRY:
+            if (Hal.wifiConnected()) {
+                // We reconnected in the meantime (autoReconnect worked)
+                connState = CONN_IDLE;
+                connectionAttempts = 0;
+                cycleActive = false;
+            } else if (Hal.millis() - stateTimer > RECONNECT_DELAY) {
+                LOG_I("WIFI", "Initiating scheduled reconnection...");
+                connectToWiFi();
+            }
+            break;
+
+        case CONN_SCANNING: {
+            int n = WiFi.scanComplete();
+            if (n == WIFI_SCAN_RUNNING) {
+                if (Hal.millis() - stateTimer > SCAN_TIMEOUT) {
+                    LOG_W("WIFI", "Scan timeout");
+                    WiFi.scanDelete();
+                    attemptFailed();
+                }
             } else {
-                Serial.println("Initiating scheduled reconnection...");
+                onScanComplete(n);
+            }
+            break;
+        }
+
+        case CONN_CONNECTING:
+            if (fastAttempt && (fastFailed || Hal.millis() - stateTimer > FAST_CONNECT_TIMEOUT)) {
+                LOG_W("WIFI", "Cached AP unreachable, falling back to scan");
                 connectToWiFi();
+            } else if (!fastAttempt && Hal.millis() - stateTimer > WIFI_TIMEOUT) {
+                LOG_W("WIFI", "WiFi connection timeout detected");
+                attemptFailed();
+            }
+            break;
+
+        case CONN_AP_PENDING:
+            if (Hal.millis() - stateTimer >= AP_SWITCH_DELAY) {
+                startAccessPoint();
             }
-        } else {
-            // We reconnected in the meantime (autoReconnect worked)
-            isConnecting = false;
-            connectionAttempts = 0;
+            break;
+
+        default:
+            break;
+    }
+
+    if (cycleActive) {
+        unsigned long call = Hal.micros() - callStart;
+        if (call > cycleMaxCallMicros) {
+            cycleMaxCallMicros = call;
         }
     }
 }
 
-
 void WifiClass::switchToAPMode() {
     // Don't switch to AP mode if we're successfully connected
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("Already connected to WiFi, canceling AP mode switch");
+    if (Hal.wifiConnected()) {
+        LOG_I("WIFI", "Already connected to WiFi, canceling AP mode switch");
+        connState = CONN_IDLE;
         return;
     }
-    
-    Serial.println("\n=== Switching to Access Point Mode ===");
-    
-    // Disconnect from any existing connection
-    WiFi.disconnect();
-    delay(1000);
-    
+
+    LOG_I("WIFI", "Switching to Access Point Mode");
+
+    // Disconnect from any existing connection, AP comes up after AP_SWITCH_DELAY
+    Hal.wifiDisconnect();
+    connState = CONN_AP_PENDING;
+    stateTimer = Hal.millis();
+}
+
+void WifiClass::startAccessPoint() {
     // Switch to AP mode
     WiFi.mode(WIFI_AP);
-    
+
     // Create AP with default settings
     bool apStarted = WiFi.softAP("WoW - AP", NULL);
-    
+
     if (apStarted) {
         IPAddress IP = WiFi.softAPIP();
-        Serial.printf("Access Point started successfully\n");
-        Serial.printf("AP SSID: WoW - AP\n");
-        Serial.printf("AP IP address: %s\n", IP.toString().c_str());
-        Serial.printf("Connect to this network to configure WiFi credentials\n");
+        LOG_I("WIFI", "Access Point \"WoW - AP\" started at %s, connect to configure WiFi credentials",
+              IP.toString().c_str());
     } else {
-        Serial.println("Failed to start Access Point!");
+        LOG_E("WIFI", "Failed to start Access Point!");
     }
-    
-    Serial.println("=====================================\n");
-    
+
     // Reset connection tracking
+    connState = CONN_AP;
     connectionAttempts = 0;
-    wifiConnectStartTime = 0;
-    shouldReconnect = false;
+    cycleActive = false;
+}
+
+// Dotted quad of the station address, without a String on the heap
+const char* WifiClass::getLocalIP() {
+    IPAddress ip = WiFi.localIP();
+    snprintf(localIP, sizeof(localIP), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return localIP;
 }
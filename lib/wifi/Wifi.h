@@ -1,52 +1,118 @@
 #ifndef WIFI_H
 #define WIFI_H
 
-#include <ESPAsyncWebServer.h>
+#include <functional>
 #include <ESP8266WiFi.h>
+#include <Hal.h>
+#include <Log.h>
 #include <Filesys.h>
-#include <Alexa.h>
+#include <Config.h>
 
 class WifiClass {
     private:
         // Constants
         static const unsigned long RECONNECT_DELAY = 10000;     // 10 seconds between retries
         static const unsigned long WIFI_TIMEOUT = 30000;        // 30 seconds per connection attempt
+        static const unsigned long SCAN_TIMEOUT = 10000;        // 10 seconds for an async scan
+        static const unsigned long AP_SWITCH_DELAY = 1000;      // settle time after disconnect
+        static const unsigned long FAST_CONNECT_TIMEOUT = 5000; // 5 seconds for the cached BSSID
+        static const uint32_t RTC_CACHE_OFFSET = 32;            // blocks; the first 128 bytes belong to OTA
         static const int MAX_WIFI_ATTEMPTS = 10;
         static const int WEAK_SIGNAL_THRESHOLD = -80;           // dBm
 
-        AsyncWebServer* server;
-        std::function<void(bool)> alexaCallback;
+        // Connection state machine, advanced from handleWiFiReconnection()
+        enum ConnState {
+            CONN_IDLE,          // connected, or nothing to do
+            CONN_WAIT_RETRY,    // waiting RECONNECT_DELAY before the next attempt
+            CONN_SCANNING,      // async scan running
+            CONN_CONNECTING,    // WiFi.begin() issued, waiting for an IP
+            CONN_AP_PENDING,    // disconnected, waiting to bring up the AP
+            CONN_AP             // access point mode
+        };
+
+        std::function<void()> onConnect;
+        std::function<void()> onDisconnect;
         String ssid;
         String pass;
-        const char* ssidPath = "/ssid.txt";
-        const char* passPath = "/pass.txt";
-        
+        const char* cachePath = "/wifi_cache.bin";
+        char localIP[16];
+
+        // Last good AP and DHCP lease, kept in RTC memory with a LittleFS copy.
+        // Only valid for the credentials it was saved with.
+        struct WifiCache {
+            uint32_t crc;
+            uint32_t credentials;       // credentialsHash() at save time
+            uint8_t bssid[6];
+            uint8_t channel;
+            uint8_t reserved;
+            uint32_t ip;
+            uint32_t gateway;
+            uint32_t mask;
+            uint32_t dns;
+        };
+
+        WifiCache cache;
+        bool cacheValid = false;
+        bool fastAttempt = false;      // current attempt goes straight to the cached BSSID
+        bool fastTried = false;
+        bool fastFailed = false;
+
+        // Boot path instrumentation
+        bool bootConnected = false;
+        bool bootViaCache = false;
+        unsigned long bootConnectedMs = 0;
+
         // Connection state
-        unsigned long wifiConnectStartTime = 0;
-        unsigned long lastDisconnectTime = 0;
+        ConnState connState = CONN_IDLE;
+        unsigned long stateTimer = 0;
         int connectionAttempts = 0;
-        bool shouldReconnect = false;
-        bool isConnecting = false;
+
+        // Reconnect cycle instrumentation
+        bool cycleActive = false;
+        unsigned long cycleStart = 0;
+        unsigned long cycleMaxCallMicros = 0;     // longest single handleWiFiReconnection()
+        unsigned long lastCycleDuration = 0;
+        unsigned long lastCycleMaxCallMicros = 0;
+        int lastCycleAttempts = 0;
 
         // Event handlers
         WiFiEventHandler wifiConnectHandler;
         WiFiEventHandler wifiDisconnectHandler;
-        
+
         // Private methods
         void connectToWiFi();
+        void onScanComplete(int n);
+        void attemptFailed();
         void onWifiConnect(const WiFiEventStationModeGotIP& event);
         void onWifiDisconnect(const WiFiEventStationModeDisconnected& event);
         void switchToAPMode();
+        void startAccessPoint();
         void switchToStaMode();
-        String getBestBSSID();
-        void convertBSSIDStringToBytes(const String& bssidStr, uint8_t* bssidBytes);
-        
+        bool getBestBSSID(int n, uint8_t* bssid, int32_t* channel);
+        void startCycle();
+        bool loadCache();
+        void saveCache();
+        void applyStaticIP();
+        uint32_t credentialsHash();
+        static uint32_t cacheCrc(const WifiCache& c);
+
     public:
-        void initWiFi(AsyncWebServer* server, std::function<void(bool)> alexaCb = nullptr);
+        // onConnect runs on every new IP, onDisconnect on every unplanned link loss
+        void initWiFi(std::function<void()> onConnectFunc, std::function<void()> onDisconnectFunc);
         void handleWiFiReconnection();
         wl_status_t getStatus() { return WiFi.status(); }
-        String getLocalIP() { return WiFi.localIP().toString(); }
+        const char* getLocalIP();
         int getRSSI() { return WiFi.RSSI(); }
+
+        // Stats of the last completed reconnect cycle. How late the loop ran
+        // this task is the scheduler's maxLate for "wifi", not counted here.
+        unsigned long getLastCycleDuration() { return lastCycleDuration; }
+        unsigned long getLastCycleMaxCallMicros() { return lastCycleMaxCallMicros; }
+        int getLastCycleAttempts() { return lastCycleAttempts; }
+
+        // Boot to first IP, and whether the cached BSSID/channel path got us there
+        unsigned long getBootConnectedMs() { return bootConnectedMs; }
+        const char* getBootPath() { return !bootConnected ? "pending" : bootViaCache ? "cache" : "scan"; }
 };
 
 extern WifiClass Wifi;
@@ -0,0 +1,214 @@
+#include <Wol.h>
+
+WolClass Wol;
+
+void WolClass::initWol() {
+    loadTargets();
+}
+
+void WolClass::loadTargets() {
+    String content = Filesys.readEntireFile(targetsPath);
+    targetCount = parseMacList(content.c_str(), targets, MAX_TARGETS);
+    for (int i = 0; i < targetCount; i++) {
+        targetLatency[i] = 0;
+    }
+    LOG_I("WOL", "%d target(s) loaded", targetCount);
+}
+
+// Accepts MACs separated by newlines, commas or spaces. Tokens that don't
+// parse or don't fit are skipped and counted in rejected.
+int WolClass::parseMacList(const char* macList, uint8_t (*macs)[MAC_SIZE], int maxMacs, int* rejected) {
+    int count = 0;
+    int skipped = 0;
+    char token[18];
+    size_t len = 0;
+
+    for (const char* p = macList; ; p++) {
+        char c = *p;
+        bool separator = (c == '\0' || c == '\n' || c == '\r' || c == ',' || c == ' ');
+
+        if (!separator) {
+            if (len < sizeof(token) - 1) {
+                token[len] = c;
+            }
+            len++;
+        } else {
+            if (len > 0 && len < sizeof(token) && count < maxMacs) {
+                token[len] = '\0';
+                if (parseMac(token, macs[count])) {
+                    count++;
+                } else {
+                    skipped++;
+                }
+            } else if (len > 0) {
+                skipped++;
+            }
+            len = 0;
+        }
+
+        if (c == '\0') {
+            break;
+        }
+    }
+
+    if (rejected) {
+        *rejected = skipped;
+    }
+    return count;
+}
+
+// The whole list is validated before the stored targets or file are touched
+bool WolClass::saveTargets(const char* macList) {
+    uint8_t parsed[MAX_TARGETS][MAC_SIZE];
+    int rejected = 0;
+    int count = parseMacList(macList, parsed, MAX_TARGETS, &rejected);
+    if (count == 0 || rejected > 0) {
+        LOG_W("WOL", "Target list rejected: %d valid, %d invalid or over %d", count, rejected, MAX_TARGETS);
+        return false;
+    }
+
+    memcpy(targets, parsed, sizeof(parsed[0]) * count);
+    for (int i = 0; i < count; i++) {
+        targetLatency[i] = 0;
+    }
+
+    // Persist in canonical form, one MAC per line
+    char content[MAX_TARGETS * 18 + 1];
+    size_t pos = 0;
+    for (int i = 0; i < count; i++) {
+        formatMac(targets[i], content + pos);
+        pos += 17;
+        content[pos++] = '\n';
+    }
+    content[pos] = '\0';
+
+    Filesys.writeFile(targetsPath, content);
+
+    targetCount = count;
+    batchIndex = MAX_TARGETS;
+    return true;
+}
+
+size_t WolClass::buildMagicPacket(uint8_t* buf, const uint8_t* mac, const uint8_t* secureOn) {
+    memset(buf, 0xFF, MAC_SIZE);
+    for (size_t i = 1; i <= 16; i++) {
+        memcpy(buf + i * MAC_SIZE, mac, MAC_SIZE);
+    }
+
+    if (secureOn) {
+        memcpy(buf + MAGIC_PACKET_SIZE, secureOn, SECUREON_SIZE);
+        return MAGIC_PACKET_SIZE + SECUREON_SIZE;
+    }
+    return MAGIC_PACKET_SIZE;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses "AA:BB:CC:DD:EE:FF" or "AA-BB-CC-DD-EE-FF"
+bool WolClass::parseMac(const char* str, uint8_t* mac) {
+    for (size_t i = 0; i < MAC_SIZE; i++) {
+        int hi = hexValue(str[0]);
+        if (hi < 0) {
+            return false;
+        }
+        int lo = hexValue(str[1]);
+        if (lo < 0) {
+            return false;
+        }
+        mac[i] = (uint8_t)((hi << 4) | lo);
+        str += 2;
+
+        if (i < MAC_SIZE - 1) {
+            if (*str != ':' && *str != '-') {
+                return false;
+            }
+            str++;
+        }
+    }
+    return *str == '\0';
+}
+
+void WolClass::formatMac(const uint8_t* mac, char* out) {
+    snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+IPAddress WolClass::broadcastAddress() {
+    if (WiFi.status() != WL_CONNECTED) {
+        return IPAddress(255, 255, 255, 255);
+    }
+
+    // Directed broadcast of the station subnet
+    uint32_t ip = (uint32_t)WiFi.localIP();
+    uint32_t mask = (uint32_t)WiFi.subnetMask();
+    return IPAddress(ip | ~mask);
+}
+
+bool WolClass::send(const uint8_t* mac, const uint8_t* secureOn, unsigned long* latency) {
+    unsigned long start = Hal.micros();
+
+    size_t len = buildMagicPacket(packet, mac, secureOn);
+
+    bool ok = udp.beginPacket(broadcastAddress(), WOL_PORT) &&
+              udp.write(packet, len) == len &&
+              udp.endPacket();
+
+    if (latency) {
+        *latency = Hal.micros() - start;
+    }
+    return ok;
+}
+
+bool WolClass::wake(const uint8_t* mac, const uint8_t* secureOn) {
+    unsigned long latency = 0;
+    bool ok = send(mac, secureOn, &latency);
+
+    char macStr[18];
+    formatMac(mac, macStr);
+    LOG_I("WOL", "Magic packet to %s %s (%lu us)", macStr, ok ? "sent" : "failed", latency);
+
+    for (int i = 0; i < targetCount; i++) {
+        if (memcmp(targets[i], mac, MAC_SIZE) == 0) {
+            targetLatency[i] = latency;
+        }
+    }
+    return ok;
+}
+
+bool WolClass::startBatch(unsigned long spacingMs, const uint8_t* secureOn) {
+    if (targetCount == 0 || isBatchRunning()) {
+        return false;
+    }
+
+    batchSpacing = spacingMs;
+    batchUseSecureOn = (secureOn != nullptr);
+    if (batchUseSecureOn) {
+        memcpy(batchSecureOn, secureOn, SECUREON_SIZE);
+    }
+
+    batchIndex = 0;
+    batchTimer = Hal.millis() - spacingMs;  // first target goes out on the next loop
+
+    LOG_I("WOL", "Batch wake started");
+    return true;
+}
+
+void WolClass::loopWol() {
+    if (!isBatchRunning() || Hal.millis() - batchTimer < batchSpacing) {
+        return;
+    }
+
+    wake(targets[batchIndex], batchUseSecureOn ? batchSecureOn : nullptr);
+    batchTimer = Hal.millis();
+    batchIndex++;
+
+    if (!isBatchRunning()) {
+        batchIndex = MAX_TARGETS;
+        LOG_I("WOL", "Batch wake finished");
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef WOL_H_
+#define WOL_H_
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <Hal.h>
+#include <Log.h>
+#include <Filesys.h>
+
+class WolClass {
+
+    public:
+        static const int MAX_TARGETS = 16;
+        static const size_t MAC_SIZE = 6;
+        static const size_t MAGIC_PACKET_SIZE = 102;           // 6 x 0xFF + 16 x MAC
+        static const size_t SECUREON_SIZE = 6;
+        static const uint16_t WOL_PORT = 9;
+        static const unsigned long DEFAULT_SPACING = 2000;     // ms between batch targets
+
+        void initWol();
+        void loopWol();
+
+        bool wake(const uint8_t* mac, const uint8_t* secureOn = nullptr);
+        bool startBatch(unsigned long spacingMs, const uint8_t* secureOn = nullptr);
+        bool isBatchRunning() { return batchIndex < targetCount; }
+
+        bool saveTargets(const char* macList);
+        int getTargetCount() { return targetCount; }
+        const uint8_t* getTargetMac(int i) { return targets[i]; }
+        unsigned long getTargetLatency(int i) { return targetLatency[i]; }
+
+        static size_t buildMagicPacket(uint8_t* buf, const uint8_t* mac, const uint8_t* secureOn);
+        static bool parseMac(const char* str, uint8_t* mac);
+        static int parseMacList(const char* macList, uint8_t (*macs)[MAC_SIZE], int maxMacs, int* rejected = nullptr);
+        static void formatMac(const uint8_t* mac, char* out);
+
+    private:
+        const char* targetsPath = "/wol_targets.txt";
+
+        WiFiUDP udp;
+
+        // Preallocated packet buffer, reused for every send
+        uint8_t packet[MAGIC_PACKET_SIZE + SECUREON_SIZE];
+
+        uint8_t targets[MAX_TARGETS][MAC_SIZE];
+        unsigned long targetLatency[MAX_TARGETS];              // micros, last send
+        int targetCount = 0;
+
+        // Batch state
+        int batchIndex = MAX_TARGETS;
+        unsigned long batchSpacing = DEFAULT_SPACING;
+        unsigned long batchTimer = 0;
+        uint8_t batchSecureOn[SECUREON_SIZE];
+        bool batchUseSecureOn = false;
+
+        void loadTargets();
+        bool send(const uint8_t* mac, const uint8_t* secureOn, unsigned long* latency);
+        IPAddress broadcastAddress();
+};
+
+extern WolClass Wol;
+
+#endif
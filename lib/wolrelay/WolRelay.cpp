@@ -0,0 +1,148 @@
+#include <WolRelay.h>
+
+WolRelayClass WolRelay;
+
+// Unaligned-safe loads; memcpy compiles to plain word loads where allowed
+static inline uint32_t load32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint16_t load16(const uint8_t* p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void WolRelayClass::initWolRelay(std::function<void(const uint8_t*)> onWakeFunc) {
+    this->onWake = onWakeFunc;
+
+    String content = Filesys.readEntireFile(macsPath);
+    macCount = WolClass::parseMacList(content.c_str(), macs, MAX_MACS);
+    resetBurstState();
+
+    udpEcho.begin(7);
+    udpDiscard.begin(WolClass::WOL_PORT);
+
+    LOG_I("WOLRELAY", "Listening on UDP 7/9, %d MAC(s) configured", macCount);
+}
+
+// The whole list is validated before the relay table or file are touched;
+// an empty list turns the relay off
+bool WolRelayClass::saveMacs(const char* macList) {
+    uint8_t parsed[MAX_MACS][WolClass::MAC_SIZE];
+    int rejected = 0;
+    int count = WolClass::parseMacList(macList, parsed, MAX_MACS, &rejected);
+    if (rejected > 0) {
+        LOG_W("WOLRELAY", "MAC list rejected: %d valid, %d invalid or over %d", count, rejected, MAX_MACS);
+        return false;
+    }
+    memcpy(macs, parsed, sizeof(parsed[0]) * count);
+
+    char content[MAX_MACS * 18 + 1];
+    size_t pos = 0;
+    for (int i = 0; i < count; i++) {
+        WolClass::formatMac(macs[i], content + pos);
+        pos += 17;
+        content[pos++] = '\n';
+    }
+    content[pos] = '\0';
+
+    Filesys.writeFile(macsPath, content);
+
+    macCount = count;
+    resetBurstState();
+    return true;
+}
+
+void WolRelayClass::resetBurstState() {
+    for (int i = 0; i < MAX_MACS; i++) {
+        lastRelayed[i] = 0;
+        everRelayed[i] = false;
+    }
+}
+
+const uint8_t* WolRelayClass::parseMagicPacket(const uint8_t* data, size_t len) {
+    if (len < WolClass::MAGIC_PACKET_SIZE) {
+        return nullptr;
+    }
+
+    // Synchronization stream: 6 x 0xFF
+    if (load32(data) != 0xFFFFFFFFu || load16(data + 4) != 0xFFFFu) {
+        return nullptr;
+    }
+
+    // 16 repetitions of the MAC: every 6-byte block equals the previous one,
+    // so bytes [12, 102) must match bytes [6, 96)
+    const uint8_t* a = data + WolClass::MAC_SIZE;
+    const uint8_t* b = data + 2 * WolClass::MAC_SIZE;
+    const size_t span = WolClass::MAGIC_PACKET_SIZE - 2 * WolClass::MAC_SIZE;   // 90 bytes
+
+    size_t i = 0;
+    for (; i + 4 <= span; i += 4) {
+        if (load32(a + i) != load32(b + i)) {
+            return nullptr;
+        }
+    }
+    if (load16(a + i) != load16(b + i)) {
+        return nullptr;
+    }
+
+    return a;
+}
+
+bool WolRelayClass::handlePacket(const uint8_t* data, size_t len) {
+    stats.received++;
+
+    const uint8_t* mac = parseMagicPacket(data, len);
+    if (mac == nullptr) {
+        stats.invalid++;
+        return false;
+    }
+
+    for (int i = 0; i < macCount; i++) {
+        if (load32(macs[i]) != load32(mac) || load16(macs[i] + 4) != load16(mac + 4)) {
+            continue;
+        }
+
+        unsigned long now = Hal.millis();
+        if (everRelayed[i] && now - lastRelayed[i] < DUPLICATE_WINDOW) {
+            stats.suppressed++;
+            return false;
+        }
+
+        everRelayed[i] = true;
+        lastRelayed[i] = now;
+        stats.relayed++;
+
+        if (onWake) {
+            onWake(mac);
+        }
+        return true;
+    }
+
+    stats.unknownMac++;
+    return false;
+}
+
+void WolRelayClass::receive(WiFiUDP& udp) {
+    int size;
+    while ((size = udp.parsePacket()) > 0) {
+        // Oversized datagrams cannot be magic packets we care about; still drain them
+        int n = udp.read(rxBuffer, sizeof(rxBuffer));
+        udp.flush();
+
+        if (n > 0 && (size_t)size <= sizeof(rxBuffer)) {
+            handlePacket(rxBuffer, (size_t)n);
+        } else {
+            stats.received++;
+            stats.invalid++;
+        }
+    }
+}
+
+void WolRelayClass::loopWolRelay() {
+    receive(udpEcho);
+    receive(udpDiscard);
+}
@@ -0,0 +1,63 @@
+#ifndef WOLRELAY_H_
+#define WOLRELAY_H_
+
+#include <functional>
+#include <WiFiUdp.h>
+#include <Hal.h>
+#include <Wol.h>
+
+// Listens for magic packets on UDP 7 and 9 and hands matching MACs to a
+// callback, so etherwake / router WoL pages can press the power button.
+class WolRelayClass {
+
+    public:
+        static const int MAX_MACS = 8;
+        static const unsigned long DUPLICATE_WINDOW = 3000;    // ms, tools send bursts of 3-5 copies
+        static const size_t MAX_PACKET_SIZE = 128;
+
+        struct Stats {
+            unsigned long received;
+            unsigned long invalid;
+            unsigned long unknownMac;
+            unsigned long suppressed;
+            unsigned long relayed;
+        };
+
+        void initWolRelay(std::function<void(const uint8_t*)> onWakeFunc);
+        void loopWolRelay();
+
+        bool saveMacs(const char* macList);
+        int getMacCount() { return macCount; }
+        const uint8_t* getMac(int i) { return macs[i]; }
+        const Stats& getStats() { return stats; }
+
+        // Validates the packet in place and returns a pointer to the target MAC
+        // inside it, or nullptr if it is not a magic packet
+        static const uint8_t* parseMagicPacket(const uint8_t* data, size_t len);
+
+        // Runs one received datagram through parsing, matching and burst suppression
+        bool handlePacket(const uint8_t* data, size_t len);
+
+    private:
+        const char* macsPath = "/wol_relay.txt";
+
+        std::function<void(const uint8_t*)> onWake;
+        WiFiUDP udpEcho;         // port 7
+        WiFiUDP udpDiscard;      // port 9
+
+        uint8_t rxBuffer[MAX_PACKET_SIZE];
+
+        uint8_t macs[MAX_MACS][WolClass::MAC_SIZE];
+        unsigned long lastRelayed[MAX_MACS];
+        bool everRelayed[MAX_MACS];
+        int macCount = 0;
+
+        Stats stats = {0, 0, 0, 0, 0};
+
+        void receive(WiFiUDP& udp);
+        void resetBurstState();
+};
+
+extern WolRelayClass WolRelay;
+
+#endif
@@ -0,0 +1,394 @@
+#include <WsProto.h>
+
+WsProtoClass WsProto;
+
+static inline uint16_t load16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t load32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void store32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+void WsProtoClass::initWsProto(AsyncWebSocket* ws, std::function<void(AsyncWebSocketClient*, bool)> onResync) {
+    this->ws = ws;
+    this->onResync = onResync;
+    memset(clients, 0, sizeof(clients));
+}
+
+// Catches up clients that drained and evicts the ones that did not
+void WsProtoClass::loopWsProto() {
+    if (ws == nullptr || ws->count() == 0) {
+        return;
+    }
+
+    uint32_t stalled = 0;
+    for (AsyncWebSocketClient& client : ws->getClients()) {
+        Client* c = findClient(client.id());
+        if (c == nullptr || client.status() != WS_CONNECTED) {
+            continue;
+        }
+        if (client.queueLen() < CLIENT_BUDGET) {
+            c->congestedSince = 0;
+            catchUp(c, client);
+            continue;
+        }
+        if (c->congestedSince == 0) {
+            c->congestedSince = Hal.millis() | 1;
+        } else if (stalled == 0 && Hal.millis() - c->congestedSince > STALL_TIMEOUT) {
+            stalled = c->id;
+        }
+    }
+
+    // Closing drops the client from the list, so not while walking it
+    if (stalled != 0) {
+        AsyncWebSocketClient* client = ws->client(stalled);
+        if (client != nullptr && client->client() != nullptr) {
+            evicted++;
+            LOG_W("WS", "Client #%lu stalled with %u queued, disconnecting",
+                  (unsigned long)stalled, (unsigned)client->queueLen());
+            client->client()->close(true);
+        }
+    }
+}
+
+// Under budget clients first get what they missed, then the new message
+bool WsProtoClass::admit(Client* c, AsyncWebSocketClient& client) {
+    if (client.queueLen() >= CLIENT_BUDGET) {
+        if (c != nullptr) {
+            c->dropped++;
+            if (c->congestedSince == 0) {
+                c->congestedSince = Hal.millis() | 1;
+            }
+        }
+        return false;
+    }
+    if (c != nullptr) {
+        catchUp(c, client);
+    }
+    return true;
+}
+
+void WsProtoClass::catchUp(Client* c, AsyncWebSocketClient& client) {
+    if (c->skippedLines > 0 && (!c->binary || c->logs)) {
+        char marker[40];
+        int n = snprintf(marker, sizeof(marker), "[%lu log lines skipped]", c->skippedLines);
+        if (c->binary) {
+            uint8_t frame[HEADER_SIZE + sizeof(marker)];
+            client.binary(frame, putFrame(frame, sizeof(frame), OP_LOG, 0, (const uint8_t*)marker, n));
+        } else {
+            client.text(marker, n);
+        }
+    }
+    c->skippedLines = 0;
+
+    if (c->resync) {
+        c->resync = false;
+        if (c->binary) {
+            uint8_t frame[HEADER_SIZE + 3 + PowerClass::MAX_CHANNELS];
+            client.binary(frame, putStatus(frame, sizeof(frame), 0));
+        }
+        if (onResync) {
+            onResync(&client, c->binary);
+        }
+    }
+}
+
+WsProtoClass::Client* WsProtoClass::findClient(uint32_t id) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].id == id) {
+            return &clients[i];
+        }
+    }
+    return nullptr;
+}
+
+void WsProtoClass::onConnect(AsyncWebSocketClient* client) {
+    Client* c = findClient(0);
+    if (c != nullptr) {
+        memset(c, 0, sizeof(Client));
+        c->id = client->id();
+    }
+}
+
+void WsProtoClass::onDisconnect(AsyncWebSocketClient* client) {
+    Client* c = findClient(client->id());
+    if (c != nullptr) {
+        c->id = 0;
+    }
+}
+
+// Returns the bytes written, 0 if the frame does not fit
+size_t WsProtoClass::putFrame(uint8_t* out, size_t cap, uint8_t op, uint16_t id, const uint8_t* payload, uint16_t len) {
+    if (cap < HEADER_SIZE + len) {
+        return 0;
+    }
+    out[0] = op;
+    store16(out + 1, id);
+    store16(out + 3, len);
+    if (len > 0) {
+        memcpy(out + HEADER_SIZE, payload, len);
+    }
+    return HEADER_SIZE + len;
+}
+
+size_t WsProtoClass::putStatus(uint8_t* out, size_t cap, uint16_t id) {
+    uint8_t status[3 + PowerClass::MAX_CHANNELS];
+    uint8_t count = Power.getChannelCount();
+    status[0] = Prober.getState();
+    status[1] = Power.getQueueDepth();
+    status[2] = count;
+    for (uint8_t ch = 0; ch < count; ch++) {
+        status[3 + ch] = Power.getState(ch);
+    }
+    return putFrame(out, cap, OP_STATUS, id, status, 3 + count);
+}
+
+size_t WsProtoClass::putAck(uint8_t* out, size_t cap, uint16_t id, uint8_t status, uint32_t commandId) {
+    uint8_t payload[5];
+    payload[0] = status;
+    if (commandId == 0) {
+        return putFrame(out, cap, OP_ACK, id, payload, 1);
+    }
+    store32(payload + 1, commandId);
+    return putFrame(out, cap, OP_ACK, id, payload, 5);
+}
+
+// Frames are parsed in place from the receive buffer; replies are appended
+// to one buffer and sent as a single message, or flushed early when the next
+// reply might not fit
+void WsProtoClass::handleMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t len) {
+    Client* c = findClient(client->id());
+    if (c != nullptr) {
+        c->binary = true;
+    }
+
+    size_t pos = 0;
+    size_t out = 0;
+
+    while (pos + HEADER_SIZE <= len) {
+        uint8_t op = data[pos];
+        uint16_t id = load16(data + pos + 1);
+        uint16_t payloadLen = load16(data + pos + 3);
+        if (pos + HEADER_SIZE + payloadLen > len) {
+            break;
+        }
+
+        // Send what is buffered before running a frame whose reply might not fit
+        if (sizeof(reply) - out < MAX_FRAME_REPLY) {
+            client->binary(reply, out);
+            out = 0;
+        }
+
+        frames++;
+        out += handleFrame(c, client, op, id, data + pos + HEADER_SIZE, payloadLen, reply + out, sizeof(reply) - out);
+        pos += HEADER_SIZE + payloadLen;
+    }
+
+    if (pos != len) {
+        malformed++;
+        LOG_W("WS", "Dropped %u bytes of truncated frame", (unsigned)(len - pos));
+    }
+
+    if (out > 0) {
+        client->binary(reply, out);
+    }
+}
+
+size_t WsProtoClass::handleFrame(Client* c, AsyncWebSocketClient* client, uint8_t op, uint16_t id,
+                                 const uint8_t* payload, uint16_t len, uint8_t* out, size_t cap) {
+    switch (op) {
+        case OP_POWER: {
+            if (len != 2 || payload[0] >= Power.getChannelCount()) {
+                return putAck(out, cap, id, ACK_BAD_REQUEST, 0);
+            }
+            uint8_t ch = payload[0];
+            uint32_t cmd = payload[1] ? Power.pressLong(ch, PowerClass::SRC_WS) : Power.pressShort(ch, PowerClass::SRC_WS);
+            if (cmd != 0) {
+                Prober.notifyPowerAction();
+                LOG_I("WS", "Power %s on %s, command #%lu", payload[1] ? "long" : "short",
+                      Power.getChannelName(ch), (unsigned long)cmd);
+            }
+            return putAck(out, cap, id, cmd ? ACK_OK : ACK_BUSY, cmd);
+        }
+
+        case OP_PULSE: {
+            PowerClass::Pulse pulse = {};
+            uint8_t count = (len - 1) / 2;
+            if (len < 3 || len % 2 == 0 || count > PowerClass::MAX_SEGMENTS || count % 2 == 0 ||
+                payload[0] >= Power.getChannelCount()) {
+                return putAck(out, cap, id, ACK_BAD_REQUEST, 0);
+            }
+            pulse.count = count;
+            for (uint8_t i = 0; i < count; i++) {
+                pulse.segments[i] = load16(payload + 1 + i * 2);
+                if (pulse.segments[i] == 0 || pulse.segments[i] > PowerClass::MAX_SEGMENT_MS) {
+                    return putAck(out, cap, id, ACK_BAD_REQUEST, 0);
+                }
+            }
+            uint32_t cmd = Power.submitPulse(payload[0], pulse, PowerClass::SRC_WS);
+            if (cmd != 0) {
+                Prober.notifyPowerAction();
+            }
+            return putAck(out, cap, id, cmd ? ACK_OK : ACK_BUSY, cmd);
+        }
+
+        case OP_STATUS:
+            return putStatus(out, cap, id);
+
+        case OP_COMMAND: {
+            PowerClass::Command cmd;
+            if (len != 4 || !Power.getCommand(load32(payload), cmd)) {
+                return putAck(out, cap, id, ACK_NOT_FOUND, 0);
+            }
+            uint8_t info[14];
+            store32(info, cmd.id);
+            info[4] = cmd.channel;
+            info[5] = cmd.status;
+            store32(info + 6, cmd.actualWidth);
+            store32(info + 10, cmd.maxJitter);
+            return putFrame(out, cap, OP_COMMAND, id, info, sizeof(info));
+        }
+
+        case OP_LOGS: {
+            if (len != 1 || c == nullptr) {
+                return putAck(out, cap, id, ACK_BAD_REQUEST, 0);
+            }
+            bool enable = payload[0] != 0;
+            size_t n = putAck(out, cap, id, ACK_OK, 0);
+
+            // Bring the new subscriber up to date before live lines arrive
+            if (enable && !c->logs) {
+                Log.replay([this, client](const char* text, size_t len) {
+                    size_t n = putFrame(logFrame, sizeof(logFrame), OP_LOG, 0, (const uint8_t*)text, len);
+                    if (n > 0) {
+                        client->binary(logFrame, n);
+                    }
+                });
+            }
+            c->logs = enable;
+            return n;
+        }
+
+        case OP_WOL: {
+            if (len == 0) {
+                bool started = Wol.startBatch(WolClass::DEFAULT_SPACING);
+                return putAck(out, cap, id, started ? ACK_OK : ACK_BUSY, 0);
+            }
+            if (len != WolClass::MAC_SIZE) {
+                return putAck(out, cap, id, ACK_BAD_REQUEST, 0);
+            }
+            Wol.wake(payload);
+            return putAck(out, cap, id, ACK_OK, 0);
+        }
+
+        case OP_PING: {
+            if (len < 1 || len > PING_SIZE) {
+                return putAck(out, cap, id, ACK_BAD_REQUEST, 0);
+            }
+            if (!payload[0]) {
+                return putFrame(out, cap, OP_PING, id, payload, len);
+            }
+
+            // Load generators time the same frame arriving at every client;
+            // a client over budget misses the ping like any other event
+            uint8_t frame[HEADER_SIZE + PING_SIZE];
+            size_t n = putFrame(frame, sizeof(frame), OP_PING, id, payload, len);
+            unsigned long start = Hal.micros();
+            for (AsyncWebSocketClient& other : ws->getClients()) {
+                Client* oc = findClient(other.id());
+                if (other.status() == WS_CONNECTED && oc != nullptr && oc->binary && admit(oc, other)) {
+                    other.binary(frame, n);
+                }
+            }
+            lastFanoutMicros = Hal.micros() - start;
+            return 0;
+        }
+
+        default:
+            return putAck(out, cap, id, ACK_UNKNOWN_OP, 0);
+    }
+}
+
+// State events for a client over budget collapse into one resync
+void WsProtoClass::broadcast(const char* text, uint8_t op, const uint8_t* payload, uint16_t len) {
+    if (ws == nullptr || ws->count() == 0) {
+        return;
+    }
+
+    uint8_t frame[HEADER_SIZE + 32];
+    size_t n = op == 0 ? 0 : putFrame(frame, sizeof(frame), op, 0, payload, len);
+
+    for (AsyncWebSocketClient& client : ws->getClients()) {
+        if (client.status() != WS_CONNECTED) {
+            continue;
+        }
+        Client* c = findClient(client.id());
+        if (!admit(c, client)) {
+            if (c != nullptr) {
+                c->resync = true;
+                coalesced++;
+            }
+            continue;
+        }
+        if (c != nullptr && c->binary && op != 0) {
+            if (n > 0) {
+                client.binary(frame, n);
+            }
+        } else {
+            client.text(text);
+        }
+    }
+}
+
+// Text clients always get the log, binary ones only once subscribed; a
+// client over budget only has the lines counted
+void WsProtoClass::sendLogs(const char* text, size_t len) {
+    if (ws == nullptr || ws->count() == 0) {
+        return;
+    }
+
+    size_t n = 0;
+    for (AsyncWebSocketClient& client : ws->getClients()) {
+        if (client.status() != WS_CONNECTED) {
+            continue;
+        }
+        Client* c = findClient(client.id());
+        if (c != nullptr && c->binary && !c->logs) {
+            continue;
+        }
+        if (!admit(c, client)) {
+            if (c != nullptr) {
+                unsigned long lines = len > 0 && text[len - 1] != '\n';
+                for (size_t i = 0; i < len; i++) {
+                    lines += text[i] == '\n';
+                }
+                c->skippedLines += lines;
+                skippedLines += lines;
+            }
+            continue;
+        }
+        if (c == nullptr || !c->binary) {
+            client.text(text, len);
+        } else {
+            if (n == 0) {
+                n = putFrame(logFrame, sizeof(logFrame), OP_LOG, 0, (const uint8_t*)text, len);
+            }
+            if (n > 0) {
+                client.binary(logFrame, n);
+            }
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef WSPROTO_H_
+#define WSPROTO_H_
+
+#include <functional>
+#include <ESPAsyncWebServer.h>
+#include <Log.h>
+#include <Power.h>
+#include <Prober.h>
+#include <Wol.h>
+
+// Compact binary control protocol on /ws. A binary message carries one or
+// more frames, so requests can be pipelined; every request is answered with
+// a frame echoing its id, the replies to one message going out together (in
+// REPLY_SIZE pieces when there are many). A frame only runs once there is
+// room for its reply, so no command is carried out unacknowledged.
+//
+//   frame   = op:u8  id:u16  len:u16  payload[len]      (little endian)
+//
+// Requests               payload                         reply
+//   OP_POWER     0x01    channel:u8 action:u8 (0 short,  ACK + command id:u32
+//                        1 long)
+//   OP_PULSE     0x02    channel:u8 segments:u16[]       ACK + command id:u32
+//   OP_STATUS    0x03    -                               OP_STATUS
+//   OP_COMMAND   0x04    command id:u32                  OP_COMMAND
+//   OP_LOGS      0x05    enable:u8                       ACK, then OP_LOG events
+//   OP_WOL       0x06    mac[6], or empty for all        ACK
+//   OP_PING      0x07    fanout:u8 data[<=32]            OP_PING echoing the payload, to
+//                                                        every binary client if fanout
+//
+// Replies and events (id 0 for unsolicited)
+//   OP_ACK       0x80    status:u8 [command id:u32]
+//   OP_STATUS    0x03    pc:u8 depth:u8 count:u8 channel states:u8[count]
+//   OP_COMMAND   0x04    command id:u32 channel:u8 status:u8 actual us:u32 jitter us:u32
+//   OP_LOG       0x83    newline separated log lines
+//   OP_PC        0x84    pc state:u8
+//
+// Clients that never send a binary frame keep getting the JSON and plain
+// text messages, so the console page works unchanged.
+//
+// Each client may have at most CLIENT_BUDGET messages waiting in its send
+// queue. Events for a client over budget are not queued: state events only
+// mark it for a fresh snapshot once it drains, log batches are counted and
+// replaced by one "[N log lines skipped]" line. A client that stays over
+// budget for STALL_TIMEOUT is disconnected.
+class WsProtoClass {
+
+    public:
+        enum Op {
+            OP_POWER = 0x01, OP_PULSE = 0x02, OP_STATUS = 0x03, OP_COMMAND = 0x04,
+            OP_LOGS = 0x05, OP_WOL = 0x06, OP_PING = 0x07,
+            OP_ACK = 0x80, OP_LOG = 0x83, OP_PC = 0x84
+        };
+
+        enum AckStatus { ACK_OK, ACK_BUSY, ACK_BAD_REQUEST, ACK_UNKNOWN_OP, ACK_NOT_FOUND };
+
+        static const size_t HEADER_SIZE = 5;
+        static const size_t REPLY_SIZE = 512;                  // replies to one message
+        static const size_t MAX_FRAME_REPLY = HEADER_SIZE + 3 + PowerClass::MAX_CHANNELS;   // OP_STATUS, the largest
+        static const int MAX_CLIENTS = 8;
+        static const size_t PING_SIZE = 33;                    // fanout flag plus 32 bytes of data
+        static const size_t CLIENT_BUDGET = 4;                 // queued messages per client
+        static const unsigned long STALL_TIMEOUT = 10000;      // ms over budget before eviction
+
+        struct Client {
+            uint32_t id;            // 0 marks a free entry
+            bool binary;
+            bool logs;
+            bool resync;            // state events were withheld
+            unsigned long congestedSince;
+            unsigned long dropped;  // events withheld over budget
+            unsigned long skippedLines;
+        };
+
+        // onResync sends the state that is not part of OP_STATUS to a client
+        // that missed events, binary telling which protocol it speaks
+        void initWsProto(AsyncWebSocket* ws, std::function<void(AsyncWebSocketClient*, bool binary)> onResync);
+        void loopWsProto();
+        void onConnect(AsyncWebSocketClient* client);
+        void onDisconnect(AsyncWebSocketClient* client);
+        void handleMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t len);
+
+        // Event fan-out: binary clients get the frame, the others the text.
+        // op 0 sends the text to everyone.
+        void broadcast(const char* text, uint8_t op, const uint8_t* payload, uint16_t len);
+        void sendLogs(const char* text, size_t len);
+
+        static size_t putFrame(uint8_t* out, size_t cap, uint8_t op, uint16_t id, const uint8_t* payload, uint16_t len);
+
+        unsigned long getFrames() { return frames; }
+        unsigned long getMalformed() { return malformed; }
+        unsigned long getLastFanoutMicros() { return lastFanoutMicros; }
+        unsigned long getEvicted() { return evicted; }
+        unsigned long getCoalesced() { return coalesced; }
+        unsigned long getSkippedLines() { return skippedLines; }
+        const Client& getClient(int i) { return clients[i]; }
+
+    private:
+        std::function<void(AsyncWebSocketClient*, bool)> onResync;
+        AsyncWebSocket* ws = nullptr;
+        Client clients[MAX_CLIENTS];
+        uint8_t reply[REPLY_SIZE];
+        uint8_t logFrame[HEADER_SIZE + LogClass::BATCH_SIZE];
+
+        unsigned long frames = 0;
+        unsigned long malformed = 0;
+        unsigned long lastFanoutMicros = 0;
+        unsigned long evicted = 0;
+        unsigned long coalesced = 0;
+        unsigned long skippedLines = 0;
+
+        Client* findClient(uint32_t id);
+        size_t handleFrame(Client* c, AsyncWebSocketClient* client, uint8_t op, uint16_t id,
+                           const uint8_t* payload, uint16_t len, uint8_t* out, size_t cap);
+        bool admit(Client* c, AsyncWebSocketClient& client);
+        void catchUp(Client* c, AsyncWebSocketClient& client);
+        static size_t putStatus(uint8_t* out, size_t cap, uint16_t id);
+        static size_t putAck(uint8_t* out, size_t cap, uint16_t id, uint8_t status, uint32_t commandId);
+};
+
+extern WsProtoClass WsProto;
+
+#endif
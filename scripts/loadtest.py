@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+# HTTP and WebSocket load generator for a running device. This is an optional
+# check on hardware; the per-route latency and allocation figures tracked
+# across builds come from the native bench (pio test -e native -f test_bench).
+#
+# - every --scenario ("METHOD /path") is hammered by --concurrency workers for
+#   --duration seconds; throughput and p50/p95/p99 latency are reported
+# - free heap, its low-water mark and the largest free block are read from
+#   /metrics before and after the run
+# - --ws-clients sockets speak the binary /ws protocol (lib/wsproto); one of
+#   them sends OP_PING with the fanout flag and every socket timestamps the
+#   arrival, giving delivery latency and first-to-last spread per broadcast
+#
+# Results are written as JSON (--output, default stdout) tagged with the
+# firmware version from /api/status, so runs can be compared across builds.
+# Only the standard library is used.
+#
+#   scripts/loadtest.py pc-switch.local --duration 20 --concurrency 4 --ws-clients 8 -o run.json
+#
+# Power routes such as "PUT /api/state/ON" really press the button; they are
+# never part of the default scenarios.
+
+import argparse
+import asyncio
+import base64
+import json
+import os
+import re
+import struct
+import sys
+import time
+
+DEFAULT_SCENARIOS = ["GET /api/status", "GET /api/firmware", "GET /"]
+
+OP_PING = 0x07
+HEADER = struct.Struct("<BHH")          # op, id, len
+
+
+def percentiles(samples):
+    if not samples:
+        return None
+    ordered = sorted(samples)
+
+    def pick(p):
+        return round(ordered[min(len(ordered) - 1, int(p / 100.0 * len(ordered)))] * 1000.0, 3)
+
+    return {"p50": pick(50), "p95": pick(95), "p99": pick(99), "max": round(ordered[-1] * 1000.0, 3)}
+
+
+async def http_request(host, port, method, path, timeout):
+    """Returns (status, body) for one request on its own connection."""
+    reader, writer = await asyncio.wait_for(asyncio.open_connection(host, port), timeout)
+    try:
+        writer.write(("%s %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\nContent-Length: 0\r\n\r\n"
+                      % (method, path, host)).encode())
+        await writer.drain()
+        data = await asyncio.wait_for(reader.read(), timeout)
+    finally:
+        writer.close()
+
+    head, _, body = data.partition(b"\r\n\r\n")
+    match = re.match(rb"HTTP/1\.[01] (\d{3})", head)
+    return (int(match.group(1)) if match else 0), body
+
+
+async def run_scenario(args, scenario):
+    method, path = scenario.split(" ", 1)
+    latencies = []
+    statuses = {}
+    errors = 0
+    deadline = time.monotonic() + args.duration
+
+    async def worker():
+        nonlocal errors
+        while time.monotonic() < deadline:
+            start = time.perf_counter()
+            try:
+                status, _ = await http_request(args.host, args.port, method, path, args.timeout)
+            except (OSError, asyncio.TimeoutError):
+                errors += 1
+                continue
+            latencies.append(time.perf_counter() - start)
+            statuses[str(status)] = statuses.get(str(status), 0) + 1
+
+    started = time.monotonic()
+    await asyncio.gather(*(worker() for _ in range(args.concurrency)))
+    elapsed = time.monotonic() - started
+
+    return {
+        "requests": len(latencies),
+        "errors": errors,
+        "status": statuses,
+        "throughput_rps": round(len(latencies) / elapsed, 2) if elapsed > 0 else 0,
+        "latency_ms": percentiles(latencies),
+    }
+
+
+async def read_metrics(args):
+    """Heap gauges from the Prometheus endpoint."""
+    _, body = await http_request(args.host, args.port, "GET", "/metrics", args.timeout)
+    values = {}
+    for name in ("wow_heap_free_bytes", "wow_heap_min_free_bytes",
+                 "wow_heap_max_free_block_bytes", "wow_heap_fragmentation_percent"):
+        match = re.search(rb"^" + name.encode() + rb" (\d+)", body, re.M)
+        if match:
+            values[name[4:]] = int(match.group(1))
+    return values
+
+
+async def read_status(args):
+    _, body = await http_request(args.host, args.port, "GET", "/api/status", args.timeout)
+    return json.loads(body)
+
+
+class WsClient:
+    """Just enough of RFC 6455 for binary frames from the device."""
+
+    async def connect(self, host, port, timeout):
+        self.reader, self.writer = await asyncio.wait_for(asyncio.open_connection(host, port), timeout)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.writer.write(("GET /ws HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (host, key)).encode())
+        await self.writer.drain()
+        response = await asyncio.wait_for(self.reader.readuntil(b"\r\n\r\n"), timeout)
+        if b" 101 " not in response.split(b"\r\n", 1)[0]:
+            raise OSError("WebSocket upgrade refused")
+
+    def send(self, op, request_id, payload):
+        message = HEADER.pack(op, request_id, len(payload)) + payload
+        mask = os.urandom(4)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(message))
+        length = len(message)
+        header = bytes([0x82, 0x80 | length]) if length < 126 else bytes([0x82, 0x80 | 126]) + struct.pack(">H", length)
+        self.writer.write(header + mask + masked)
+
+    async def receive(self):
+        """Next WebSocket message as (opcode, data)."""
+        b0, b1 = await self.reader.readexactly(2)
+        length = b1 & 0x7F
+        if length == 126:
+            length = struct.unpack(">H", await self.reader.readexactly(2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", await self.reader.readexactly(8))[0]
+        return b0 & 0x0F, await self.reader.readexactly(length)
+
+    async def frames(self):
+        """Protocol frames from binary messages; text messages are skipped."""
+        while True:
+            opcode, data = await self.receive()
+            if opcode == 0x8:
+                raise OSError("closed by device")
+            if opcode != 0x2:
+                continue
+            pos = 0
+            while pos + HEADER.size <= len(data):
+                op, request_id, length = HEADER.unpack_from(data, pos)
+                yield op, request_id, data[pos + HEADER.size:pos + HEADER.size + length]
+                pos += HEADER.size + length
+
+    def close(self):
+        self.writer.close()
+
+
+async def run_fanout(args):
+    clients = []
+    for _ in range(args.ws_clients):
+        client = WsClient()
+        await client.connect(args.host, args.port, args.timeout)
+        clients.append(client)
+
+    # A first binary frame marks each socket as a protocol client
+    for i, client in enumerate(clients):
+        client.send(OP_PING, i + 1, b"\x00")
+        await client.writer.drain()
+        async for op, request_id, _ in client.frames():
+            if op == OP_PING and request_id == i + 1:
+                break
+
+    delivery = []
+    spread = []
+    lost = 0
+    for round_id in range(1, args.ws_rounds + 1):
+        sent = time.perf_counter()
+        clients[0].send(OP_PING, round_id, b"\x01" + struct.pack("<I", round_id))
+        await clients[0].writer.drain()
+
+        async def arrival(client):
+            async for op, request_id, _ in client.frames():
+                if op == OP_PING and request_id == round_id:
+                    return time.perf_counter()
+
+        results = await asyncio.gather(*(asyncio.wait_for(arrival(c), args.timeout) for c in clients),
+                                       return_exceptions=True)
+        arrived = [t for t in results if isinstance(t, float)]
+        lost += len(clients) - len(arrived)
+        delivery.extend(t - sent for t in arrived)
+        if arrived:
+            spread.append(max(arrived) - min(arrived))
+        await asyncio.sleep(args.ws_interval)
+
+    for client in clients:
+        client.close()
+
+    return {
+        "clients": len(clients),
+        "rounds": args.ws_rounds,
+        "lost": lost,
+        "delivery_ms": percentiles(delivery),
+        "spread_ms": percentiles(spread),
+    }
+
+
+async def main(args):
+    status = await read_status(args)
+    results = {
+        "firmware": status.get("version"),
+        "host": args.host,
+        "timestamp": int(time.time()),
+        "config": {"duration_s": args.duration, "concurrency": args.concurrency},
+        "heap_before": await read_metrics(args),
+        "http": {},
+    }
+
+    for scenario in args.scenario or DEFAULT_SCENARIOS:
+        print("%-24s ..." % scenario, file=sys.stderr)
+        results["http"][scenario] = await run_scenario(args, scenario)
+        print("%-24s %s" % (scenario, json.dumps(results["http"][scenario])), file=sys.stderr)
+
+    if args.ws_clients > 0:
+        results["ws"] = await run_fanout(args)
+        results["ws"]["device_fanout_us"] = (await read_status(args)).get("ws", {}).get("last_fanout_us")
+        print("ws fan-out              %s" % json.dumps(results["ws"]), file=sys.stderr)
+
+    results["heap_after"] = await read_metrics(args)
+
+    out = json.dumps(results, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(out + "\n")
+    else:
+        print(out)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="HTTP and WebSocket load generator for a running device")
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--scenario", action="append", help='"METHOD /path", repeatable')
+    parser.add_argument("--duration", type=float, default=10.0, help="seconds per scenario")
+    parser.add_argument("--concurrency", type=int, default=4, help="parallel HTTP connections")
+    parser.add_argument("--timeout", type=float, default=5.0)
+    parser.add_argument("--ws-clients", type=int, default=8, help="0 skips the WebSocket run")
+    parser.add_argument("--ws-rounds", type=int, default=50)
+    parser.add_argument("--ws-interval", type=float, default=0.1, help="seconds between broadcasts")
+    parser.add_argument("-o", "--output")
+    asyncio.run(main(parser.parse_args()))
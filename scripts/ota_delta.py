@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+# Firmware delta patches for POST /api/ota/delta (format in lib/delta/Delta.h).
+#
+#   scripts/ota_delta.py diff old.bin new.bin -o update.wwd
+#   scripts/ota_delta.py apply old.bin update.wwd -o check.bin
+#   scripts/ota_delta.py upload pc-switch.local update.wwd
+#
+# old.bin must be exactly the image running on the board; the device checks
+# its MD5 before writing anything and the MD5 of the result before the new
+# image is marked bootable. "apply" runs the same format on the host so a
+# patch can be checked against real builds before it is uploaded.
+# Only the standard library is used.
+
+import argparse
+import hashlib
+import http.client
+import os
+import struct
+import sys
+import time
+import uuid
+
+MAGIC = b"WWD1"
+OP_END, OP_COPY, OP_INSERT = 0x00, 0x01, 0x02
+KEY = 16                # bytes hashed per lookup
+MIN_MATCH = 24          # shorter matches cost more than the literal bytes
+MAX_CANDIDATES = 8
+
+
+def match_length(old, o, new, n):
+    limit = min(len(old) - o, len(new) - n)
+    length = 0
+    while length < limit and old[o + length] == new[n + length]:
+        length += 1
+    return length
+
+
+def diff(old, new):
+    index = {}
+    for o in range(len(old) - KEY + 1):
+        bucket = index.setdefault(old[o:o + KEY], [])
+        if len(bucket) < MAX_CANDIDATES:
+            bucket.append(o)
+
+    ops = []
+    literal = bytearray()
+    pos = 0
+    expected = None     # where the old image continues after the last copy
+
+    def emit_copy(offset, length):
+        if literal:
+            ops.append((OP_INSERT, bytes(literal)))
+            literal.clear()
+        if ops and ops[-1][0] == OP_COPY and ops[-1][1] + ops[-1][2] == offset:
+            ops[-1] = (OP_COPY, ops[-1][1], ops[-1][2] + length)
+        else:
+            ops.append((OP_COPY, offset, length))
+
+    while pos < len(new):
+        best, best_len = None, 0
+        candidates = list(index.get(new[pos:pos + KEY], ()))
+        if expected is not None and expected < len(old):
+            candidates.insert(0, expected)
+        for o in candidates:
+            length = match_length(old, o, new, pos)
+            if length > best_len:
+                best, best_len = o, length
+
+        if best_len >= MIN_MATCH:
+            emit_copy(best, best_len)
+            pos += best_len
+            expected = best + best_len
+        else:
+            literal.append(new[pos])
+            pos += 1
+            if expected is not None:
+                expected += 1
+
+    if literal:
+        ops.append((OP_INSERT, bytes(literal)))
+
+    out = bytearray(MAGIC)
+    out += struct.pack("<I", len(old)) + hashlib.md5(old).digest()
+    out += struct.pack("<I", len(new)) + hashlib.md5(new).digest()
+    for op in ops:
+        if op[0] == OP_COPY:
+            out += struct.pack("<BII", OP_COPY, op[1], op[2])
+        else:
+            out += struct.pack("<BI", OP_INSERT, len(op[1])) + op[1]
+    out.append(OP_END)
+    return bytes(out)
+
+
+def apply(old, patch):
+    if patch[:4] != MAGIC:
+        raise ValueError("not a delta patch")
+    old_size, old_md5, new_size, new_md5 = struct.unpack_from("<I16sI16s", patch, 4)
+    if old_size != len(old) or hashlib.md5(old).digest() != old_md5:
+        raise ValueError("patch was made for a different old image")
+
+    new = bytearray()
+    pos = 44
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            offset, length = struct.unpack_from("<II", patch, pos)
+            pos += 8
+            new += old[offset:offset + length]
+        elif op == OP_INSERT:
+            (length,) = struct.unpack_from("<I", patch, pos)
+            pos += 4
+            new += patch[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError("unknown op 0x%02x" % op)
+
+    if len(new) != new_size or hashlib.md5(new).digest() != new_md5:
+        raise ValueError("result does not match the new image")
+    return bytes(new)
+
+
+def upload(host, port, patch, name):
+    boundary = uuid.uuid4().hex
+    body = (("--%s\r\nContent-Disposition: form-data; name=\"patch\"; filename=\"%s\"\r\n"
+             "Content-Type: application/octet-stream\r\n\r\n" % (boundary, name)).encode()
+            + patch + ("\r\n--%s--\r\n" % boundary).encode())
+    conn = http.client.HTTPConnection(host, port, timeout=120)
+    start = time.monotonic()
+    conn.request("POST", "/api/ota/delta", body, {"Content-Type": "multipart/form-data; boundary=" + boundary})
+    response = conn.getresponse()
+    reply = response.read().decode(errors="replace")
+    print("%d %s (%d bytes in %.1f s)" % (response.status, reply, len(patch), time.monotonic() - start))
+    return response.status == 200
+
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Firmware delta patches for /api/ota/delta")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("diff", help="make a patch from the running image to a new one")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("-o", "--output", required=True)
+
+    p = sub.add_parser("apply", help="apply a patch on the host and verify it")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("-o", "--output")
+
+    p = sub.add_parser("upload", help="send a patch to a board")
+    p.add_argument("host")
+    p.add_argument("patch")
+    p.add_argument("--port", type=int, default=80)
+
+    args = parser.parse_args()
+
+    if args.command == "diff":
+        old, new = read(args.old), read(args.new)
+        start = time.monotonic()
+        patch = diff(old, new)
+        apply(old, patch)
+        with open(args.output, "wb") as f:
+            f.write(patch)
+        print("%d -> %d bytes, patch %d bytes (%.1f%% of the new image) in %.1f s"
+              % (len(old), len(new), len(patch), 100.0 * len(patch) / max(len(new), 1), time.monotonic() - start),
+              file=sys.stderr)
+    elif args.command == "apply":
+        new = apply(read(args.old), read(args.patch))
+        if args.output:
+            with open(args.output, "wb") as f:
+                f.write(new)
+        print("ok, %d bytes, md5 %s" % (len(new), hashlib.md5(new).hexdigest()), file=sys.stderr)
+    else:
+        sys.exit(0 if upload(args.host, args.port, read(args.patch), os.path.basename(args.patch)) else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+# Pre-build step for the web UI.
+#
+# - data/* is gzipped (text files, deterministic mtime 0), content hashed and
+#   compiled into the firmware as PROGMEM arrays in generated/WebAssets.h
+# - local references inside HTML are fingerprinted as "?v=<hash>"
+# - optional overrides in data/www/ are staged the same way into the
+#   buildfs/uploadfs image under /www, listed in /assets.txt as "<path> <hash>"
+#
+# The firmware (lib/assets) serves /www overrides first, then the embedded copy.
+
+Import("env")
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+
+COMPRESS = (".html", ".css", ".js", ".json", ".svg", ".txt")
+
+project_dir = env.subst("$PROJECT_DIR")
+build_dir = env.subst("$PROJECT_BUILD_DIR")
+
+src_dir = os.path.join(project_dir, "data")
+override_dir = os.path.join(src_dir, "www")
+fs_dir = os.path.join(build_dir, "data")
+gen_dir = os.path.join(build_dir, "generated")
+
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()[:8]
+
+
+def fingerprint(html, hashes):
+    def repl(match):
+        name = match.group(2)
+        if name in hashes:
+            return '%s="%s?v=%s"' % (match.group(1), name, hashes[name])
+        return match.group(0)
+    return re.sub(r'(href|src)="([^":?#/][^":?#]*)"', repl, html)
+
+
+def process(directory):
+    """Returns [(name, hash, payload, gzipped)] with HTML processed last."""
+    if not os.path.isdir(directory):
+        return []
+
+    names = sorted(f for f in os.listdir(directory) if os.path.isfile(os.path.join(directory, f)))
+    names.sort(key=lambda f: f.endswith(".html"))
+
+    hashes = {}
+    assets = []
+    for name in names:
+        with open(os.path.join(directory, name), "rb") as f:
+            data = f.read()
+
+        if name.endswith(".html"):
+            data = fingerprint(data.decode("utf-8"), hashes).encode("utf-8")
+
+        hashes[name] = content_hash(data)
+        gzipped = name.endswith(COMPRESS)
+        if gzipped:
+            data = gzip.compress(data, compresslevel=9, mtime=0)
+        assets.append((name, hashes[name], data, gzipped))
+
+    return assets
+
+
+def identifier(name):
+    return "asset_" + re.sub(r"[^0-9A-Za-z]", "_", name)
+
+
+def write_header(assets):
+    os.makedirs(gen_dir, exist_ok=True)
+
+    lines = [
+        "// Generated by scripts/web_assets.py - do not edit",
+        "#ifndef WEBASSETS_H_",
+        "#define WEBASSETS_H_",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "struct EmbeddedAsset {",
+        "    const char* path;",
+        "    const uint8_t* data;",
+        "    size_t length;",
+        "    const char* hash;",
+        "    bool gzipped;",
+        "};",
+        "",
+    ]
+
+    for name, _, data, _ in assets:
+        body = ",".join("0x%02x" % b for b in data)
+        lines.append("static constexpr uint8_t %s[] PROGMEM = {%s};" % (identifier(name), body))
+
+    lines.append("")
+    lines.append("static const EmbeddedAsset EMBEDDED_ASSETS[] = {")
+    for name, digest, data, gzipped in assets:
+        lines.append('    {"/%s", %s, %d, "%s", %s},' %
+                     (name, identifier(name), len(data), digest, "true" if gzipped else "false"))
+    lines.append("};")
+    lines.append("")
+    lines.append("static const int EMBEDDED_ASSET_COUNT = %d;" % len(assets))
+    lines.append("")
+    lines.append("#endif")
+
+    path = os.path.join(gen_dir, "WebAssets.h")
+    content = "\n".join(lines) + "\n"
+
+    # Only touch the header when it changes, to avoid needless rebuilds
+    if os.path.isfile(path):
+        with open(path) as f:
+            if f.read() == content:
+                return
+    with open(path, "w") as f:
+        f.write(content)
+
+
+def stage_overrides(assets):
+    if os.path.isdir(fs_dir):
+        shutil.rmtree(fs_dir)
+    os.makedirs(os.path.join(fs_dir, "www"))
+
+    for name, _, data, gzipped in assets:
+        with open(os.path.join(fs_dir, "www", name + (".gz" if gzipped else "")), "wb") as f:
+            f.write(data)
+
+    with open(os.path.join(fs_dir, "assets.txt"), "w") as f:
+        for name, digest, _, _ in assets:
+            f.write("/%s %s\n" % (name, digest))
+
+
+embedded = process(src_dir)
+overrides = process(override_dir)
+
+write_header(embedded)
+stage_overrides(overrides)
+
+raw_total = sum(os.path.getsize(os.path.join(src_dir, n)) for n, _, _, _ in embedded)
+out_total = sum(len(d) for _, _, d, _ in embedded)
+print("[ASSETS] - %d files embedded, %d -> %d bytes (%.0f%%), %d override(s)" %
+      (len(embedded), raw_total, out_total, 100.0 * out_total / max(raw_total, 1), len(overrides)))
+
+env.Append(CPPPATH=[gen_dir])
+env.Replace(PROJECT_DATA_DIR=fs_dir)
@@ -4,13 +4,28 @@
 
 #include <ElegantOTA.h>
 
+#include <Log.h>
+#include <Mqtt.h>
+#include <Ota.h>
+#include <Profiler.h>
 #include <Filesys.h>
+#include <Fleet.h>
+#include <Config.h>
+#include <Assets.h>
+#include <Power.h>
+#include <Prober.h>
+#include <Router.h>
+#include <Schedule.h>
+#include <Status.h>
+#include <Tasks.h>
+#include <WsProto.h>
 #include <Wifi.h>
+#include <Wol.h>
+#include <WolRelay.h>
 #include <Alexa.h>
 #include <ESP8266mDNS.h>
 
 const char* VERSION = "1.0.14";
-const char* devNamePath = "/dev_name.txt";
 
 // AsyncWebServer on port 80
 AsyncWebServer server(80);
@@ -20,231 +35,1002 @@ AsyncWebSocket ws("/ws");
 const int ledPin = 2;
 String ledState;
 
-// GPIO switch
+// GPIO switch, the only channel unless /channels.txt says otherwise
 const int WOL = 5;
+const char* channelsPath = "/channels.txt";
 
-// ESP responsive delay / restart
-enum PowerState { IDLE, START_PRESS, HOLDING, RELEASING };
-PowerState currentPowerState = IDLE;
+// ESP responsive restart, a one-shot task armed after Wi-Fi setup
+int restartTask = -1;
 
-unsigned long powerTimer = 0;
-unsigned long holdDuration = 0;
-unsigned long restartTimer = 0;
-boolean restartPending = false;
+// Boot to first HTTP request served, 0 until it happens
+unsigned long firstHttpMs = 0;
 
 void initAsyncWebServer();
 void initGPIO();
-void pushPwrOn();
-void pushPwrOff();
-void handleAlexaCommand(bool state);
+void initPowerChannels();
+int channelParam(AsyncWebServerRequest *request, bool post);
+uint32_t pushPwrOn(uint8_t channel, PowerClass::Source source);
+uint32_t pushPwrOff(uint8_t channel, PowerClass::Source source);
+void onPowerUpdate(const PowerClass::Command& cmd);
+void onScheduledFire(uint8_t channel, ScheduleClass::Action action);
+void onScheduleChange();
+size_t formatUpcoming(char* buf, size_t size);
+void sendPowerAccepted(AsyncWebServerRequest *request, uint32_t id);
+void handleAlexaCommand(uint8_t channel, bool state);
+void handleWolCommand(const char* mac);
+void handleWolRelay(const uint8_t* mac);
+void onPcStateChange(ProberClass::PcState state);
+void onWifiUp();
+void onWifiDown();
+void onMqttMessage(const char* topic, const char* payload);
+void onFleetCommand(uint8_t channel, bool on);
+void fillStatus(JsonObject doc);
 void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
-void webLog(String message);
-void handlePowerStateMachine(); 
+void onWsResync(AsyncWebSocketClient *client, bool binary);
+void flushLog(const char* text, size_t len);
 void initmDNS();
+void initTasks();
 
 void setup() {
 
     // Initialize GPIO
     initGPIO();
 
-    // Initialize Serial port
+    // Initialize Serial port and the log ring buffer
     Serial.begin(115200);
+    Log.setSink(flushLog);
 
     // Initialize File System
     Filesys.initFS();
+    Assets.initAssets();
+
+    // Power outputs from the channel table
+    initPowerChannels();
      
     // Initialize Web Server 
     initAsyncWebServer();
     
     // Initialize WiFi
-    Wifi.initWiFi(&server, handleAlexaCommand);
+    Wifi.initWiFi(onWifiUp, onWifiDown);
+
+    // Initialize Wake-on-LAN sender
+    Wol.initWol();
+    WolRelay.initWolRelay(handleWolRelay);
+
+    // Initialize PC liveness prober
+    Prober.initProber(onPcStateChange);
+
+    // Initialize MQTT, commands come in on <base>/power/<channel>/set
+    Mqtt.initMqtt(onMqttMessage);
+    Mqtt.subscribe("power/+/set");
+
+    // Initialize power calendar and SNTP
+    Schedule.initSchedule(onScheduledFire, onScheduleChange);
+
+    // Aggregated /api/status document
+    Status.initStatus(fillStatus);
 
     // Initialize OTA
     ElegantOTA.begin(&server);
+    Ota.initOta([]() { Tasks.after(restartTask, 2000); });
     
     // Initialize WebSocket
+    WsProto.initWsProto(&ws, onWsResync);
     ws.onEvent(onWsEvent);
     server.addHandler(&ws);
 
-    // Initialize mDNS
+    // Initialize mDNS and the fleet heartbeat, both named after the device
     initmDNS();
+    Fleet.initFleet(VERSION, Config.get(ConfigClass::DEV_NAME), onFleetCommand);
 
     server.begin();
-    webLog("Web server started for PC Control");
+    LOG_I("APP", "Web server started for PC Control");
+
+    initTasks();
 }
 
 void loop() {
-    Wifi.handleWiFiReconnection();
-    ElegantOTA.loop();
-    MDNS.update();
-    Alexa.loopAlexa();
-    ws.cleanupClients();
+    PROFILE_LOOP();
+    Tasks.loopTasks();
+}
 
-    handlePowerStateMachine();
-    
-    if (restartPending && (millis() - restartTimer >= 5000)) {
+// Periods follow how soon each subsystem has to notice work handed over by
+// the network callbacks; the subsystems keep their own finer timers
+void initTasks() {
+    Tasks.add("power", []() { PROFILE(ProfilerClass::POWER, Power.handlePowerStateMachine()); }, 10);
+    Tasks.add("mqtt", []() { PROFILE(ProfilerClass::MQTT, Mqtt.loopMqtt()); }, 20);
+    Tasks.add("alexa", []() { PROFILE(ProfilerClass::ALEXA, Alexa.loopAlexa()); }, 20);
+    Tasks.add("wol_relay", []() { PROFILE(ProfilerClass::WOL_RELAY, WolRelay.loopWolRelay()); }, 20);
+    Tasks.add("wifi", []() { PROFILE(ProfilerClass::WIFI, Wifi.handleWiFiReconnection()); }, 50);
+    Tasks.add("mdns", []() { PROFILE(ProfilerClass::MDNS, MDNS.update()); }, 50);
+    Tasks.add("wol", []() { PROFILE(ProfilerClass::WOL, Wol.loopWol()); }, 50);
+    Tasks.add("prober", []() { PROFILE(ProfilerClass::PROBER, Prober.loopProber()); }, 50);
+    Tasks.add("status", []() { PROFILE(ProfilerClass::STATUS, Status.loopStatus()); }, 50);
+    Tasks.add("fleet", []() { PROFILE(ProfilerClass::FLEET, Fleet.loopFleet()); }, 50);
+    Tasks.add("ota", []() { PROFILE(ProfilerClass::OTA, ElegantOTA.loop()); }, 100);
+    Tasks.add("ws", []() { PROFILE(ProfilerClass::WS, ws.cleanupClients(); WsProto.loopWsProto()); }, 100);
+    Tasks.add("log", []() { PROFILE(ProfilerClass::LOG, Log.loopLog()); }, LogClass::FLUSH_INTERVAL);
+    Tasks.add("schedule", []() { PROFILE(ProfilerClass::SCHEDULE, Schedule.loopSchedule()); }, 250);
+    Tasks.add("config", []() { PROFILE(ProfilerClass::CONFIG, Config.loopConfig()); }, 250);
+    restartTask = Tasks.add("restart", []() {
+        Schedule.commit();
         ESP.restart();
-    } 
+    }, 0);
 }
 
 void initmDNS() {
-    String devName = Filesys.readFirstLine(devNamePath);
+    String devName = Config.get(ConfigClass::DEV_NAME);
     if (devName.length() == 0) {
         devName = "pc-switch";
-        Filesys.writeFile(devNamePath, devName.c_str());
+        Config.set(ConfigClass::DEV_NAME, devName.c_str());
     }
     
     if (MDNS.begin(devName.c_str())) {
         MDNS.addService("http", "tcp", 80); 
-        webLog("mDNS started: http://" + devName + ".local/");
+
+        // Fleet members are recognisable from a browse; pc is filled in per query
+        char chip[8];
+        snprintf(chip, sizeof(chip), "%06lx", (unsigned long)ESP.getChipId());
+        MDNS.addServiceTxt("http", "tcp", "fw", VERSION);
+        MDNS.addServiceTxt("http", "tcp", "chip", chip);
+        MDNS.addServiceTxt("http", "tcp", "fleet", String(FleetClass::PORT).c_str());
+        MDNS.setDynamicServiceTxtCallback([](const MDNSResponder::hMDNSService service) {
+            MDNS.addDynamicServiceTxt(service, "pc", ProberClass::stateName(Prober.getState()));
+        });
+        LOG_I("MDNS", "mDNS started: http://%s.local/", devName.c_str());
     } else {
-        webLog("Error starting mDNS");
+        LOG_E("MDNS", "Error starting mDNS");
     }
 }
 
-void triggerPowerAction(unsigned long duration) {
-    if (currentPowerState == IDLE) {
-        holdDuration = duration;
-        currentPowerState = START_PRESS;
-        powerTimer = millis();
-    }
-}
+void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+    if (type == WS_EVT_CONNECT) {
+        WsProto.onConnect(client);
+        client->text("Connected to PC Controller");
 
-void handlePowerStateMachine() {
-    switch (currentPowerState) {
-        case START_PRESS:
-            if (millis() - powerTimer >= 100) {
-                digitalWrite(WOL, HIGH);
-                webLog("Power button pressed...");
-                powerTimer = millis();
-                currentPowerState = HOLDING;
-            }
-            break;
+        // Bring a late console up to date with recent history
+        Log.replay([client](const char* text, size_t len) { client->text(text, len); });
 
-        case HOLDING:
-            if (millis() - powerTimer >= holdDuration) {
-                digitalWrite(WOL, LOW);
-                webLog("Power button released");
-                currentPowerState = IDLE;
-            }
-            break;
-            
-        default:
-            break;
+        char upcoming[320];
+        formatUpcoming(upcoming, sizeof(upcoming));
+        client->text(upcoming);
+    } else if (type == WS_EVT_DISCONNECT) {
+        WsProto.onDisconnect(client);
+    } else if (type == WS_EVT_DATA) {
+        AwsFrameInfo *info = (AwsFrameInfo*)arg;
+        if (!info->final || info->index != 0 || info->len != len) {
+            return;
+        }
+
+        // Framed binary protocol, see WsProto.h
+        if (info->opcode == WS_BINARY) {
+            WsProto.handleMessage(client, data, len);
+            return;
+        }
+        if (info->opcode != WS_TEXT) {
+            return;
+        }
+
+        // "wol" wakes every stored target, "wol AA:BB:CC:DD:EE:FF" a single host,
+        // "on [channel]" and "off [channel]" queue a short press or a force shutdown
+        char cmd[32];
+        size_t n = len < sizeof(cmd) - 1 ? len : sizeof(cmd) - 1;
+        memcpy(cmd, data, n);
+        cmd[n] = '\0';
+
+        if (strncmp(cmd, "wol", 3) == 0 && (cmd[3] == '\0' || cmd[3] == ' ')) {
+            handleWolCommand(cmd[3] == ' ' ? cmd + 4 : nullptr);
+        } else if (strncmp(cmd, "on", 2) == 0 || strncmp(cmd, "off", 3) == 0) {
+            bool on = cmd[1] == 'n';
+            const char* arg = cmd + (on ? 2 : 3);
+            int channel = *arg == ' ' ? Power.findChannel(arg + 1) : *arg == '\0' ? 0 : -1;
+            uint32_t id = channel < 0 ? 0 : on ? pushPwrOn(channel, PowerClass::SRC_WS) : pushPwrOff(channel, PowerClass::SRC_WS);
+            char msg[64];
+            snprintf(msg, sizeof(msg), "{\"type\":\"power\",\"id\":%lu,\"status\":\"%s\"}",
+                     (unsigned long)id, id ? "queued" : "rejected");
+            client->text(msg);
+        }
     }
 }
 
-void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
-    if (type == WS_EVT_CONNECT) {
-        client->text("Connected to PC Controller");
+// A client that fell behind missed state events; OP_STATUS already went to
+// binary clients, the rest is sent here
+void onWsResync(AsyncWebSocketClient *client, bool binary) {
+    if (!binary) {
+        char msg[48];
+        snprintf(msg, sizeof(msg), "{\"type\":\"pc\",\"state\":\"%s\"}", ProberClass::stateName(Prober.getState()));
+        client->text(msg);
     }
+
+    char upcoming[320];
+    formatUpcoming(upcoming, sizeof(upcoming));
+    client->text(upcoming);
 }
 
-// Send log message to WebSocket
-void webLog(String message) {
-    Serial.println(message);
-    if (ws.count() > 0) {
-        ws.textAll(message);
-    }
+// Batched log lines from the ring buffer, newline separated
+void flushLog(const char* text, size_t len) {
+    WsProto.sendLogs(text, len);
 }
 
 // Initialize GPIO
 void initGPIO() {
 
-    // Set GPIO 4 (switch) as an OUTPUT
-    pinMode(WOL, OUTPUT);
-    digitalWrite(WOL, LOW);
+    // Power outputs are driven from the pulse timer; channels come later from the filesystem
+    Power.initPower(onPowerUpdate);
 
     // Set GPIO 2 as an OUTPUT
     pinMode(ledPin, OUTPUT);
     digitalWrite(ledPin, LOW);
 }
 
+// "<pin> <short ms> <long ms> <name>" per line, see PowerClass::loadChannels()
+void initPowerChannels() {
+    String table = Filesys.readEntireFile(channelsPath);
+    if (Power.loadChannels(table.c_str()) == 0) {
+        Power.addChannel("Remote PC", WOL);
+    }
+}
+
+// ?channel= by index or name, channel 0 when absent; -1 if unknown
+int channelParam(AsyncWebServerRequest *request, bool post) {
+    if (!request->hasParam("channel", post)) {
+        return 0;
+    }
+    return Power.findChannel(request->getParam("channel", post)->value().c_str());
+}
+
 void initAsyncWebServer() {
 
+    // Boot-time instrumentation: remember when the first request arrives
+    server.addMiddleware([](AsyncWebServerRequest *request, ArMiddlewareNext next) {
+        if (firstHttpMs == 0) {
+            firstHttpMs = Hal.millis();
+        }
+        next();
+    });
+
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (WiFi.getMode() == WIFI_AP || WiFi.status() != WL_CONNECTED) {
-            request->send(LittleFS, "/wifi_setup.html", "text/html");
+            Assets.send(request, "/wifi_setup.html");
         } else {
-            request->send(LittleFS, "/index.html", "text/html");
+            Assets.send(request, "/index.html");
         }
     });
 
     server.on("/api/firmware", HTTP_GET, [](AsyncWebServerRequest *request) {
-        String json = "{\"version\":\"" + String(VERSION) + "\"}";
+        char json[48];
+        snprintf(json, sizeof(json), "{\"version\":\"%s\"}", VERSION);
         request->send(200, "application/json", json);
     });
 
+    // Everything the dashboard needs in one round trip, see StatusClass
+    server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request) {
+        Status.handleRequest(request);
+    });
+
+    // Prometheus scrape target, written a few lines per chunk so the text
+    // (about 21 KB with the profiler on) never sits in heap as a whole
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+        uint16_t line = 0;
+        request->send(request->beginChunkedResponse("text/plain; version=0.0.4",
+            [line](uint8_t *buffer, size_t maxLen, size_t index) mutable {
+                return Profiler.writeMetrics(buffer, maxLen, line);
+            }));
+    });
+
+    server.on("/api/probe", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("target", true) ||
+            !Prober.setTarget(request->getParam("target", true)->value().c_str())) {
+            request->send(400, "application/json", "{\"result\":\"expected target=host:port\"}");
+            return;
+        }
+        Status.touch();
+        request->send(200, "application/json", "{\"result\":\"ok\"}");
+    });
+
+    // broker=host[:port], user=, pass=, topic=; an empty broker turns MQTT off
+    server.on("/api/mqtt", HTTP_POST, [](AsyncWebServerRequest *request) {
+        auto param = [request](const char* name) {
+            return request->hasParam(name, true) ? request->getParam(name, true)->value().c_str() : "";
+        };
+        if (!Mqtt.setBroker(param("broker"), param("user"), param("pass"), param("topic"))) {
+            request->send(400, "application/json", "{\"result\":\"invalid MQTT settings\"}");
+            return;
+        }
+        request->send(200, "application/json", "{\"result\":\"ok\"}");
+    });
+
     // Console page
     server.on("/console", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(LittleFS, "/console.html", "text/html");
+        Assets.send(request, "/console.html");
     });
 
-    server.on("^\\/api\\/state\\/(ON|OFF)$", HTTP_PUT, [](AsyncWebServerRequest *request) {
-        String state = request->pathArg(0);
-        bool powerOn = (state == "ON");
-        
-        webLog("API command : Power " + state);
-    
-        powerOn ? pushPwrOn() : pushPwrOff();
+    // Delta firmware patch against the running image, see scripts/ota_delta.py
+    server.on("/api/ota/delta", HTTP_POST, [](AsyncWebServerRequest *request) {
+        Ota.handleDeltaRequest(request);
+    }, [](AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final) {
+        Ota.handleDeltaUpload(request, filename, index, data, len, final);
+    });
+
+    // Every board heard on the fleet group, this one first
+    server.on("/fleet", HTTP_GET, [](AsyncWebServerRequest *request) {
+        Assets.send(request, "/fleet.html");
+    });
+
+    server.on("/api/fleet", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        Fleet.writeJson(*response);
+        request->send(response);
+    });
+
+    // peer=<chip id>|all, action=on|off, optional channel index
+    server.on("/api/fleet/power", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("peer", true) || !request->hasParam("action", true)) {
+            request->send(400, "application/json", "{\"result\":\"expected peer and action\"}");
+            return;
+        }
+        const String& peer = request->getParam("peer", true)->value();
+        const String& action = request->getParam("action", true)->value();
+        unsigned long channel = request->hasParam("channel", true) ?
+                                strtoul(request->getParam("channel", true)->value().c_str(), NULL, 10) : 0;
+        char* end;
+        uint32_t target = peer == "all" ? 0 : strtoul(peer.c_str(), &end, 16);
+        if ((peer != "all" && (target == 0 || *end != '\0')) || (action != "on" && action != "off") ||
+            channel >= PowerClass::MAX_CHANNELS) {
+            request->send(400, "application/json", "{\"result\":\"bad peer, action or channel\"}");
+            return;
+        }
+
+        bool sent = Fleet.sendCommand(target, channel, action == "on");
+        LOG_I("API", "Fleet power %s on %s channel %lu%s", action.c_str(), peer.c_str(), channel, sent ? "" : " not sent");
+        request->send(sent ? 202 : 503, "application/json", sent ? "{\"result\":\"sent\"}" : "{\"result\":\"busy\"}");
+    });
+
+    // Power by path: /api/state/ON drives channel 0, /api/state/1/ON or
+    // /api/state/build-box/OFF a channel by index or name. Routes are tried in
+    // order, so an index never reaches the name lookup.
+    static constexpr RouterClass::Route routes[] = {
+        RouterClass::route(HTTP_PUT, [](AsyncWebServerRequest *request, const RouterClass::Params& params) {
+            bool powerOn = params.number[0];
+            LOG_I("API", "API command : Power %s", powerOn ? "ON" : "OFF");
+
+            uint32_t id = powerOn ? pushPwrOn(0, PowerClass::SRC_HTTP) : pushPwrOff(0, PowerClass::SRC_HTTP);
+            sendPowerAccepted(request, id);
+        }, RouterClass::lit("api"), RouterClass::lit("state"), RouterClass::cap(RouterClass::CAP_SWITCH)),
+
+        RouterClass::route(HTTP_PUT, [](AsyncWebServerRequest *request, const RouterClass::Params& params) {
+            if (params.number[0] >= Power.getChannelCount()) {
+                request->send(404, "application/json", "{\"result\":\"unknown channel\"}");
+                return;
+            }
+
+            uint8_t channel = params.number[0];
+            bool powerOn = params.number[1];
+            LOG_I("API", "API command : Power %s on %s", powerOn ? "ON" : "OFF", Power.getChannelName(channel));
+
+            uint32_t id = powerOn ? pushPwrOn(channel, PowerClass::SRC_HTTP) : pushPwrOff(channel, PowerClass::SRC_HTTP);
+            sendPowerAccepted(request, id);
+        }, RouterClass::lit("api"), RouterClass::lit("state"), RouterClass::cap(RouterClass::CAP_UINT), RouterClass::cap(RouterClass::CAP_SWITCH)),
+
+        // Anything else in the channel position is a name
+        RouterClass::route(HTTP_PUT, [](AsyncWebServerRequest *request, const RouterClass::Params& params) {
+            int channel = Power.findChannel(params.text[0]);
+            if (channel < 0) {
+                request->send(404, "application/json", "{\"result\":\"unknown channel\"}");
+                return;
+            }
+
+            bool powerOn = params.number[1];
+            LOG_I("API", "API command : Power %s on %s", powerOn ? "ON" : "OFF", Power.getChannelName(channel));
+
+            uint32_t id = powerOn ? pushPwrOn(channel, PowerClass::SRC_HTTP) : pushPwrOff(channel, PowerClass::SRC_HTTP);
+            sendPowerAccepted(request, id);
+        }, RouterClass::lit("api"), RouterClass::lit("state"), RouterClass::cap(RouterClass::CAP_TEXT), RouterClass::cap(RouterClass::CAP_SWITCH)),
+    };
+    Router.initRouter(routes, sizeof(routes) / sizeof(routes[0]));
+    server.addHandler(&Router);
+
+    server.on("/api/channels", HTTP_GET, [](AsyncWebServerRequest *request) {
+        static char json[32 + PowerClass::MAX_CHANNELS * (PowerClass::NAME_SIZE + 96)];
+        size_t pos = snprintf(json, sizeof(json), "{\"channels\":[");
+
+        for (uint8_t ch = 0; ch < Power.getChannelCount(); ch++) {
+            pos += snprintf(json + pos, sizeof(json) - pos, "%s{\"index\":%u,\"name\":\"%s\",\"pin\":%u,\"state\":\"%s\"}",
+                            ch > 0 ? "," : "", ch, Power.getChannelName(ch), Power.getChannelPin(ch),
+                            PowerClass::stateName(Power.getState(ch)));
+        }
+        snprintf(json + pos, sizeof(json) - pos, "]}");
+
+        request->send(200, "application/json", json);
+    });
+
+    // Status of a queued power command, or queue counters without ?id=
+    server.on("/api/power", HTTP_GET, [](AsyncWebServerRequest *request) {
+        char json[320];
+
+        if (!request->hasParam("id")) {
+            snprintf(json, sizeof(json),
+                     "{\"depth\":%u,\"submitted\":%lu,\"coalesced\":%lu,\"superseded\":%lu,\"rejected\":%lu,\"completed\":%lu,"
+                     "\"last\":{\"requested_us\":%lu,\"actual_us\":%lu,\"jitter_us\":%lu,\"latency_us\":%lu},\"worst_jitter_us\":%lu}",
+                     Power.getQueueDepth(), Power.getSubmitted(), Power.getCoalesced(),
+                     Power.getSuperseded(), Power.getRejected(), Power.getCompletedActions(),
+                     Power.getLastRequestedWidth(), Power.getLastActualWidth(), Power.getLastMaxJitter(),
+                     Power.getLastPressLatency(), Power.getWorstJitter());
+            request->send(200, "application/json", json);
+            return;
+        }
+
+        PowerClass::Command cmd;
+        uint32_t id = strtoul(request->getParam("id")->value().c_str(), NULL, 10);
+        if (!Power.getCommand(id, cmd)) {
+            request->send(404, "application/json", "{\"result\":\"unknown command\"}");
+            return;
+        }
+
+        snprintf(json, sizeof(json),
+                 "{\"id\":%lu,\"channel\":%u,\"source\":\"%s\",\"action\":\"%s\",\"status\":\"%s\",\"queued_ms\":%lu,\"finished_ms\":%lu,"
+                 "\"requested_us\":%lu,\"actual_us\":%lu,\"jitter_us\":%lu}",
+                 (unsigned long)cmd.id, cmd.channel, PowerClass::sourceName(cmd.source),
+                 Power.isForceOff(cmd.channel, cmd.pulse) ? "off" : cmd.pulse.count == 1 ? "on" : "sequence",
+                 PowerClass::statusName(cmd.status), cmd.queuedAt, cmd.finishedAt,
+                 cmd.requestedWidth, cmd.actualWidth, cmd.maxJitter);
+        request->send(200, "application/json", json);
+    });
+
+    // Arbitrary press pattern, e.g. pattern=200,300,200 for a double press, optional channel=
+    server.on("/api/power", HTTP_POST, [](AsyncWebServerRequest *request) {
+        PowerClass::Pulse pulse;
+        int channel = channelParam(request, true);
+        if (channel < 0 || !request->hasParam("pattern", true) ||
+            !PowerClass::parsePulse(request->getParam("pattern", true)->value().c_str(), pulse)) {
+            request->send(400, "application/json", "{\"result\":\"invalid pattern\"}");
+            return;
+        }
+
+        LOG_I("API", "API command : Pulse %s", request->getParam("pattern", true)->value().c_str());
+        Prober.notifyPowerAction();
+        sendPowerAccepted(request, Power.submitPulse(channel, pulse, PowerClass::SRC_HTTP));
+    });
+
+    server.on("/api/schedule/timezone", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("tz", true) || !Schedule.setTimezone(request->getParam("tz", true)->value().c_str())) {
+            request->send(400, "application/json", "{\"result\":\"invalid timezone\"}");
+            return;
+        }
         request->send(200, "application/json", "{\"result\":\"ok\"}");
     });
 
+    server.on("/api/schedule", HTTP_GET, [](AsyncWebServerRequest *request) {
+        static char json[160 + ScheduleClass::MAX_RULES * 128];
+        size_t pos = snprintf(json, sizeof(json), "{\"timezone\":\"%s\",\"synced\":%s,\"now\":%ld,\"fired\":%lu,\"skipped\":%lu,\"rules\":[",
+                              Schedule.getTimezone(), Schedule.isSynced() ? "true" : "false", (long)Hal.epoch(),
+                              Schedule.getFiredCount(), Schedule.getSkippedCount());
+
+        bool first = true;
+        for (int i = 0; i < ScheduleClass::MAX_RULES; i++) {
+            const ScheduleClass::Rule* rule = Schedule.getRule(i);
+            if (rule == nullptr) {
+                continue;
+            }
+            pos += snprintf(json + pos, sizeof(json) - pos,
+                            "%s{\"id\":%u,\"channel\":%u,\"days\":%u,\"time\":\"%02u:%02u\",\"action\":\"%s\",\"enabled\":%s,\"next\":%ld}",
+                            first ? "" : ",", rule->id, rule->channel, rule->days, rule->hour, rule->minute,
+                            ScheduleClass::actionName(rule->action), rule->enabled ? "true" : "false",
+                            (long)Schedule.getNextFire(rule->id));
+            first = false;
+        }
+        snprintf(json + pos, sizeof(json) - pos, "]}");
+
+        request->send(200, "application/json", json);
+    });
+
+    // Create, or update with ?id=: days=weekdays|mon,fri|<mask>, time=HH:MM, action=on|off, enabled=0|1, channel=
+    server.on("/api/schedule", HTTP_POST, [](AsyncWebServerRequest *request) {
+        uint8_t days;
+        unsigned int hour, minute;
+        int channel = channelParam(request, true);
+        if (channel < 0 || !request->hasParam("days", true) || !request->hasParam("time", true) ||
+            !ScheduleClass::parseDays(request->getParam("days", true)->value().c_str(), days) ||
+            sscanf(request->getParam("time", true)->value().c_str(), "%u:%u", &hour, &minute) != 2) {
+            request->send(400, "application/json", "{\"result\":\"invalid rule\"}");
+            return;
+        }
+
+        ScheduleClass::Action action = ScheduleClass::ACTION_ON;
+        if (request->hasParam("action", true) && request->getParam("action", true)->value() == "off") {
+            action = ScheduleClass::ACTION_OFF;
+        }
+        bool enabled = !request->hasParam("enabled", true) || request->getParam("enabled", true)->value() != "0";
+
+        int id;
+        if (request->hasParam("id", true)) {
+            id = atoi(request->getParam("id", true)->value().c_str());
+            if (!Schedule.updateRule(id, channel, days, hour, minute, action, enabled)) {
+                id = -1;
+            }
+        } else {
+            id = Schedule.addRule(channel, days, hour, minute, action, enabled);
+        }
+
+        if (id < 0) {
+            request->send(400, "application/json", "{\"result\":\"invalid rule or schedule full\"}");
+            return;
+        }
+
+        char json[48];
+        snprintf(json, sizeof(json), "{\"result\":\"ok\",\"id\":%d}", id);
+        request->send(200, "application/json", json);
+    });
+
+    server.on("/api/schedule", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+        bool removed = request->hasParam("id") && Schedule.removeRule(atoi(request->getParam("id")->value().c_str()));
+        request->send(removed ? 200 : 404, "application/json", removed ? "{\"result\":\"ok\"}" : "{\"result\":\"unknown rule\"}");
+    });
+
+    server.on("/api/wol/targets", HTTP_GET, [](AsyncWebServerRequest *request) {
+        static char json[64 + WolClass::MAX_TARGETS * 64];
+        size_t pos = snprintf(json, sizeof(json), "{\"targets\":[");
+
+        for (int i = 0; i < Wol.getTargetCount(); i++) {
+            char mac[18];
+            WolClass::formatMac(Wol.getTargetMac(i), mac);
+            pos += snprintf(json + pos, sizeof(json) - pos, "%s{\"mac\":\"%s\",\"latency_us\":%lu}",
+                            i > 0 ? "," : "", mac, Wol.getTargetLatency(i));
+        }
+        snprintf(json + pos, sizeof(json) - pos, "],\"batch_running\":%s}", Wol.isBatchRunning() ? "true" : "false");
+
+        request->send(200, "application/json", json);
+    });
+
+    server.on("/api/wol/targets", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("macs", true)) {
+            request->send(400, "application/json", "{\"result\":\"missing macs\"}");
+            return;
+        }
+        if (!Wol.saveTargets(request->getParam("macs", true)->value().c_str())) {
+            request->send(400, "application/json", "{\"result\":\"invalid macs\"}");
+            return;
+        }
+        request->send(200, "application/json", "{\"result\":\"ok\"}");
+    });
+
+    server.on("/api/wol/relay", HTTP_GET, [](AsyncWebServerRequest *request) {
+        static char json[160 + WolRelayClass::MAX_MACS * 24];
+        const WolRelayClass::Stats& st = WolRelay.getStats();
+        size_t pos = snprintf(json, sizeof(json), "{\"macs\":[");
+
+        for (int i = 0; i < WolRelay.getMacCount(); i++) {
+            char mac[18];
+            WolClass::formatMac(WolRelay.getMac(i), mac);
+            pos += snprintf(json + pos, sizeof(json) - pos, "%s\"%s\"", i > 0 ? "," : "", mac);
+        }
+        snprintf(json + pos, sizeof(json) - pos,
+                 "],\"received\":%lu,\"invalid\":%lu,\"unknown_mac\":%lu,\"suppressed\":%lu,\"relayed\":%lu}",
+                 st.received, st.invalid, st.unknownMac, st.suppressed, st.relayed);
+
+        request->send(200, "application/json", json);
+    });
+
+    server.on("/api/wol/relay", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("macs", true)) {
+            request->send(400, "application/json", "{\"result\":\"missing macs\"}");
+            return;
+        }
+        if (!WolRelay.saveMacs(request->getParam("macs", true)->value().c_str())) {
+            request->send(400, "application/json", "{\"result\":\"invalid macs\"}");
+            return;
+        }
+        request->send(200, "application/json", "{\"result\":\"ok\"}");
+    });
+
+    // Wake a single MAC (mac=) or batch wake all stored targets
+    server.on("/api/wol", HTTP_POST, [](AsyncWebServerRequest *request) {
+        uint8_t mac[WolClass::MAC_SIZE];
+        uint8_t secureOn[WolClass::SECUREON_SIZE];
+        bool useSecureOn = false;
+
+        if (request->hasParam("password", true)) {
+            if (!WolClass::parseMac(request->getParam("password", true)->value().c_str(), secureOn)) {
+                request->send(400, "application/json", "{\"result\":\"invalid password\"}");
+                return;
+            }
+            useSecureOn = true;
+        }
+
+        if (request->hasParam("mac", true)) {
+            if (!WolClass::parseMac(request->getParam("mac", true)->value().c_str(), mac)) {
+                request->send(400, "application/json", "{\"result\":\"invalid mac\"}");
+                return;
+            }
+            bool ok = Wol.wake(mac, useSecureOn ? secureOn : nullptr);
+            request->send(ok ? 200 : 500, "application/json", ok ? "{\"result\":\"ok\"}" : "{\"result\":\"send failed\"}");
+            return;
+        }
+
+        unsigned long spacing = WolClass::DEFAULT_SPACING;
+        if (request->hasParam("spacing", true)) {
+            spacing = strtoul(request->getParam("spacing", true)->value().c_str(), NULL, 10);
+        }
+
+        bool started = Wol.startBatch(spacing, useSecureOn ? secureOn : nullptr);
+        request->send(started ? 202 : 409, "application/json", started ? "{\"result\":\"started\"}" : "{\"result\":\"busy or no targets\"}");
+    });
+
     // TODO refactor - Raspberry handler for Alexa
     server.on("/led_on", HTTP_GET, [](AsyncWebServerRequest *request) {
-        pushPwrOn();
+        pushPwrOn(0, PowerClass::SRC_LED);
         request->send(302, "text/plain", "OK");
     });
 
     // WiFi setup POST handler
     server.on("/", HTTP_POST, [](AsyncWebServerRequest *request) {
-        String newSSID = "", newPass = "", devName = "";
-        
         int params = request->params();
         for(int i = 0; i < params; i++){
             const AsyncWebParameter* p = request->getParam(i);
             
             if(p->isPost()){
                 if (p->name() == "ssid") {
-                    newSSID = p->value();
-                    Filesys.writeFile("/ssid.txt", newSSID.c_str());
+                    Config.set(ConfigClass::SSID, p->value().c_str());
                 }
                 if (p->name() == "pass") {
-                    newPass = p->value();
-                    Filesys.writeFile("/pass.txt", newPass.c_str());
+                    Config.set(ConfigClass::PASS, p->value().c_str());
                 }
                 if (p->name() == "dev_name") {
-                    devName = p->value();
-                    Filesys.writeFile("/dev_name.txt", devName.c_str());
+                    Config.set(ConfigClass::DEV_NAME, p->value().c_str());
                 }                  
             }
         }
+
+        // Persist now rather than racing the coalescing delay against the restart
+        Config.commit();
         
-        request->send(LittleFS, "/wifi_setup_success.html", "text/html");
+        Assets.send(request, "/wifi_setup_success.html");
 
-        restartTimer = millis();
-        restartPending = true;
+        Tasks.after(restartTask, 5000);
     });
 
-    // Serve static files (CSS, JS, Favicon, etc)
+    // Serve static files (CSS, JS, Favicon, etc), manifest assets first
+    server.addHandler(&Assets);
     server.serveStatic("/", LittleFS, "/");
 }
 
-void handleAlexaCommand(bool state) {
+void handleAlexaCommand(uint8_t channel, bool state) {
     if (state) {
-        pushPwrOn();
+        pushPwrOn(channel, PowerClass::SRC_ALEXA);
         digitalWrite(ledPin, LOW);
     } else {
         digitalWrite(ledPin, HIGH);
     }
 }
 
-void pushPwrOn() {
-    webLog("Action: Power ON/OFF (Short Press)");
-    triggerPowerAction(500); // 500ms
+void handleWolCommand(const char* mac) {
+    if (mac == nullptr) {
+        if (!Wol.startBatch(WolClass::DEFAULT_SPACING)) {
+            LOG_W("WOL", "Batch rejected: busy or no targets");
+        }
+        return;
+    }
+
+    uint8_t bytes[WolClass::MAC_SIZE];
+    if (WolClass::parseMac(mac, bytes)) {
+        Wol.wake(bytes);
+    } else {
+        LOG_W("WOL", "Command rejected: invalid MAC");
+    }
+}
+
+void handleWolRelay(const uint8_t* mac) {
+    char macStr[18];
+    WolClass::formatMac(mac, macStr);
+    LOG_I("WOLRELAY", "Magic packet for %s", macStr);
+    pushPwrOn(0, PowerClass::SRC_RELAY);
+}
+
+// Push PC liveness transitions to every dashboard
+void onPcStateChange(ProberClass::PcState state) {
+    Status.touch();
+    Mqtt.publish("pc", ProberClass::stateName(state), true);
+
+    char msg[48];
+    uint8_t payload = state;
+    snprintf(msg, sizeof(msg), "{\"type\":\"pc\",\"state\":\"%s\"}", ProberClass::stateName(state));
+    WsProto.broadcast(msg, WsProtoClass::OP_PC, &payload, 1);
+}
+
+// Everything that holds a socket follows the station link
+void onWifiUp() {
+    Status.touch();
+    Mqtt.onWifiUp();
+    Fleet.onWifiUp();
+
+    // Alexa needs the station IP, it only starts once
+    Alexa.initAlexa(&server, handleAlexaCommand);
+}
+
+void onWifiDown() {
+    Status.touch();
+    Mqtt.onWifiDown();
+    Fleet.onWifiDown();
+}
+
+uint32_t pushPwrOn(uint8_t channel, PowerClass::Source source) {
+    uint32_t id = Power.pressShort(channel, source); // 500ms by default
+    LOG_I("POWER", "Action: Power ON/OFF (Short Press) #%lu on %s from %s",
+          (unsigned long)id, Power.getChannelName(channel), PowerClass::sourceName(source));
+    Prober.notifyPowerAction();
+    return id;
 }
 
-void pushPwrOff() {
-    webLog("Action: Force Shutdown (5s hold)");
-    triggerPowerAction(5000); // 5000ms
+uint32_t pushPwrOff(uint8_t channel, PowerClass::Source source) {
+    uint32_t id = Power.pressLong(channel, source); // 5000ms by default
+    LOG_I("POWER", "Action: Force Shutdown (Long Press) #%lu on %s from %s",
+          (unsigned long)id, Power.getChannelName(channel), PowerClass::sourceName(source));
+    Prober.notifyPowerAction();
+    return id;
+}
+
+// 202 with a status URL, or 503 if the command queue is full
+void sendPowerAccepted(AsyncWebServerRequest *request, uint32_t id) {
+    if (id == 0) {
+        request->send(503, "application/json", "{\"result\":\"busy\"}");
+        return;
+    }
+
+    char url[32];
+    char json[96];
+    snprintf(url, sizeof(url), "/api/power?id=%lu", (unsigned long)id);
+    snprintf(json, sizeof(json), "{\"result\":\"accepted\",\"id\":%lu,\"status_url\":\"%s\"}", (unsigned long)id, url);
+
+    AsyncWebServerResponse *response = request->beginResponse(202, "application/json", json);
+    response->addHeader("Location", url);
+    request->send(response);
+}
+
+void onScheduledFire(uint8_t channel, ScheduleClass::Action action) {
+    if (channel >= Power.getChannelCount()) {
+        LOG_W("SCHEDULE", "Channel %u no longer exists", channel);
+        return;
+    }
+    action == ScheduleClass::ACTION_OFF ? pushPwrOff(channel, PowerClass::SRC_SCHEDULE) : pushPwrOn(channel, PowerClass::SRC_SCHEDULE);
+}
+
+// Next few fires, soonest first
+size_t formatUpcoming(char* buf, size_t size) {
+    size_t pos = snprintf(buf, size, "{\"type\":\"schedule\",\"upcoming\":[");
+    int count = Schedule.getFireCount() < 4 ? Schedule.getFireCount() : 4;
+    for (int i = 0; i < count && pos < size; i++) {
+        const ScheduleClass::Fire& fire = Schedule.getFire(i);
+        const ScheduleClass::Rule* rule = Schedule.getRule(fire.slot);
+        pos += snprintf(buf + pos, size - pos, "%s{\"id\":%u,\"channel\":%u,\"at\":%ld,\"action\":\"%s\"}",
+                        i > 0 ? "," : "", rule->id, rule->channel, (long)fire.at, ScheduleClass::actionName(rule->action));
+    }
+    if (pos < size) {
+        pos += snprintf(buf + pos, size - pos, "]}");
+    }
+    return pos;
+}
+
+// Rules edited, a rule fired or the clock stepped
+void onScheduleChange() {
+    if (ws.count() > 0) {
+        char msg[320];
+        formatUpcoming(msg, sizeof(msg));
+        WsProto.broadcast(msg, 0, nullptr, 0);
+    }
+}
+
+// Command started, finished or was dropped in favour of a force shutdown
+void onPowerUpdate(const PowerClass::Command& cmd) {
+    Status.touch();
+
+    char topic[24];
+    snprintf(topic, sizeof(topic), "power/%u/status", cmd.channel);
+    Mqtt.publish(topic, PowerClass::statusName(cmd.status), true);
+
+    if (ws.count() > 0) {
+        char msg[112];
+        snprintf(msg, sizeof(msg), "{\"type\":\"power\",\"id\":%lu,\"channel\":%u,\"source\":\"%s\",\"status\":\"%s\"}",
+                 (unsigned long)cmd.id, cmd.channel, PowerClass::sourceName(cmd.source), PowerClass::statusName(cmd.status));
+
+        uint8_t info[14];
+        memcpy(info, &cmd.id, 4);
+        info[4] = cmd.channel;
+        info[5] = cmd.status;
+        memcpy(info + 6, &cmd.actualWidth, 4);
+        memcpy(info + 10, &cmd.maxJitter, 4);
+        WsProto.broadcast(msg, WsProtoClass::OP_COMMAND, info, sizeof(info));
+    }
+}
+
+// Power command from another board's fleet page
+void onFleetCommand(uint8_t channel, bool on) {
+    if (channel >= Power.getChannelCount()) {
+        LOG_W("FLEET", "No channel %u", channel);
+        return;
+    }
+    if (on) {
+        pushPwrOn(channel, PowerClass::SRC_FLEET);
+    } else {
+        pushPwrOff(channel, PowerClass::SRC_FLEET);
+    }
+}
+
+// "power/<channel>/set" with ON or OFF, channel by index or name
+void onMqttMessage(const char* topic, const char* payload) {
+    if (strncmp(topic, "power/", 6) != 0) {
+        return;
+    }
+    const char* name = topic + 6;
+    const char* slash = strchr(name, '/');
+    char channelName[PowerClass::NAME_SIZE];
+    if (slash == nullptr || strcmp(slash, "/set") != 0 || (size_t)(slash - name) >= sizeof(channelName)) {
+        return;
+    }
+    memcpy(channelName, name, slash - name);
+    channelName[slash - name] = '\0';
+
+    int channel = Power.findChannel(channelName);
+    bool powerOn = strcasecmp(payload, "ON") == 0;
+    if (channel < 0 || (!powerOn && strcasecmp(payload, "OFF") != 0)) {
+        LOG_W("MQTT", "Ignoring %s: %s", topic, payload);
+        return;
+    }
+
+    LOG_I("MQTT", "Command: Power %s on %s", powerOn ? "ON" : "OFF", Power.getChannelName(channel));
+    if (powerOn) {
+        pushPwrOn(channel, PowerClass::SRC_MQTT);
+    } else {
+        pushPwrOff(channel, PowerClass::SRC_MQTT);
+    }
+}
+
+// Body of /api/status. Keys are literals and stay out of the arena, other
+// strings are copied into it.
+void fillStatus(JsonObject doc) {
+    char probeTarget[80];
+    snprintf(probeTarget, sizeof(probeTarget), "%s:%u", Prober.getHost(), Prober.getPort());
+
+    doc["version"] = VERSION;
+    doc["pc"] = ProberClass::stateName(Prober.getState());
+    doc["probe_target"] = (const char*)probeTarget;
+    doc["last_probe_ms"] = Prober.getLastProbe();
+    doc["last_rtt_ms"] = Prober.getLastRtt();
+    doc["last_change_ms"] = Prober.getLastChange();
+    doc["detect_latency_ms"] = Prober.getLastDetectLatency();
+
+    JsonObject wifi = doc["wifi"].to<JsonObject>();
+    wifi["ip"] = Wifi.getLocalIP();
+    wifi["rssi"] = Wifi.getRSSI();
+
+    JsonObject power = doc["power"].to<JsonObject>();
+    power["depth"] = Power.getQueueDepth();
+    power["completed"] = Power.getCompletedActions();
+    JsonArray channels = power["channels"].to<JsonArray>();
+    for (uint8_t ch = 0; ch < Power.getChannelCount(); ch++) {
+        JsonObject channel = channels.add<JsonObject>();
+        channel["name"] = Power.getChannelName(ch);
+        channel["state"] = PowerClass::stateName(Power.getState(ch));
+    }
+
+    JsonObject assets = doc["assets"].to<JsonObject>();
+    const AssetsClass::SourceStats* sources[2] = { &Assets.getFlashStats(), &Assets.getFsStats() };
+    for (int i = 0; i < 2; i++) {
+        JsonObject source = assets[i == 0 ? "flash" : "fs"].to<JsonObject>();
+        source["requests"] = sources[i]->requests;
+        source["not_modified"] = sources[i]->notModified;
+        source["max_handler_us"] = sources[i]->maxHandlerMicros;
+        source["min_free_heap"] = sources[i]->requests ? sources[i]->minFreeHeap : 0;
+    }
+
+    JsonObject cycle = doc["wifi_cycle"].to<JsonObject>();
+    cycle["duration_ms"] = Wifi.getLastCycleDuration();
+    cycle["attempts"] = Wifi.getLastCycleAttempts();
+    cycle["max_call_us"] = Wifi.getLastCycleMaxCallMicros();
+
+    JsonObject boot = doc["boot"].to<JsonObject>();
+    boot["path"] = Wifi.getBootPath();
+    boot["connected_ms"] = Wifi.getBootConnectedMs();
+    boot["first_http_ms"] = firstHttpMs;
+
+    JsonObject config = doc["config"].to<JsonObject>();
+    config["load_us"] = Config.getLoadMicros();
+    config["writes"] = Config.getWriteCount();
+    config["dirty"] = Config.isDirty();
+
+    JsonObject wsStats = doc["ws"].to<JsonObject>();
+    wsStats["clients"] = ws.count();
+    wsStats["frames"] = WsProto.getFrames();
+    wsStats["malformed"] = WsProto.getMalformed();
+    wsStats["last_fanout_us"] = WsProto.getLastFanoutMicros();
+    wsStats["evicted"] = WsProto.getEvicted();
+    wsStats["coalesced"] = WsProto.getCoalesced();
+    wsStats["skipped_lines"] = WsProto.getSkippedLines();
+    JsonArray wsClients = wsStats["per_client"].to<JsonArray>();
+    for (int i = 0; i < WsProtoClass::MAX_CLIENTS; i++) {
+        const WsProtoClass::Client& c = WsProto.getClient(i);
+        AsyncWebSocketClient* client = c.id != 0 ? ws.client(c.id) : nullptr;
+        if (client == nullptr) {
+            continue;
+        }
+        JsonObject entry = wsClients.add<JsonObject>();
+        entry["id"] = c.id;
+        entry["queue"] = client->queueLen();
+        entry["dropped"] = c.dropped;
+        entry["skipped_lines"] = c.skippedLines;
+    }
+
+    const MqttClass::Stats& broker = Mqtt.getStats();
+    JsonObject mqtt = doc["mqtt"].to<JsonObject>();
+    mqtt["state"] = MqttClass::stateName(Mqtt.getState());
+    mqtt["depth"] = Mqtt.getQueueDepth();
+    mqtt["connects"] = broker.connects;
+    mqtt["failures"] = broker.failures;
+    mqtt["published"] = broker.published;
+    mqtt["batches"] = broker.batches;
+    mqtt["coalesced"] = broker.coalesced;
+    mqtt["dropped"] = broker.dropped;
+    mqtt["received"] = broker.received;
+    mqtt["last_dispatch_us"] = broker.lastDispatchMicros;
+
+    const AlexaClass::Stats& hue = Alexa.getStats();
+    JsonObject alexa = doc["alexa"].to<JsonObject>();
+    alexa["discovery"] = hue.discovery;
+    alexa["control"] = hue.control;
+    alexa["filtered"] = hue.filtered;
+    alexa["unhandled"] = hue.unhandled;
+    alexa["last_us"] = hue.lastMicros;
+    alexa["max_us"] = hue.maxMicros;
+
+    JsonObject router = doc["router"].to<JsonObject>();
+    router["dispatched"] = Router.getDispatched();
+    router["last_match_us"] = Router.getLastMatchMicros();
+    router["max_match_us"] = Router.getMaxMatchMicros();
+
+    const FleetClass::Stats& fleetStats = Fleet.getStats();
+    JsonObject fleet = doc["fleet"].to<JsonObject>();
+    fleet["peers"] = Fleet.getPeerCount();
+    fleet["online"] = Fleet.getOnlineCount();
+    fleet["sent"] = fleetStats.sent;
+    fleet["heartbeats"] = fleetStats.heartbeats;
+    fleet["commands"] = fleetStats.commands;
+    fleet["invalid"] = fleetStats.invalid;
+    fleet["evicted"] = fleetStats.evicted;
+    fleet["last_update_us"] = fleetStats.lastUpdateMicros;
+    fleet["max_update_us"] = fleetStats.maxUpdateMicros;
+
+    const OtaClass::Stats& otaStats = Ota.getStats();
+    JsonObject ota = doc["ota"].to<JsonObject>();
+    ota["kind"] = OtaClass::kindName(otaStats.kind);
+    ota["running"] = otaStats.running;
+    ota["success"] = otaStats.success;
+    ota["updates"] = otaStats.updates;
+    ota["failures"] = otaStats.failures;
+    ota["upload_bytes"] = otaStats.uploadBytes;
+    ota["image_bytes"] = otaStats.imageBytes;
+    ota["transfer_ms"] = otaStats.transferMs;
+    ota["min_free_heap"] = otaStats.minFreeHeap;
+    ota["heap_used_peak"] = otaStats.heapUsedPeak;
+    ota["error"] = otaStats.error;
+
+    JsonObject tasks = doc["tasks"].to<JsonObject>();
+    tasks["passes"] = Tasks.getPasses();
+    tasks["idle_permille"] = Tasks.getIdlePermille();
+    JsonArray taskList = tasks["list"].to<JsonArray>();
+    for (int i = 0; i < Tasks.getTaskCount(); i++) {
+        const TasksClass::Task& t = Tasks.getTask(i);
+        JsonObject entry = taskList.add<JsonObject>();
+        entry["name"] = t.name;
+        entry["runs"] = t.runs;
+        entry["overruns"] = t.overruns;
+        entry["max_late_ms"] = t.maxLate;
+        entry["max_us"] = t.maxMicros;
+        entry["cpu_permille"] = Tasks.getCpuPermille(i);
+    }
+
+    JsonObject status = doc["status"].to<JsonObject>();
+    status["version"] = Status.getVersion();
+    status["requests"] = Status.getRequests();
+    status["not_modified"] = Status.getNotModified();
+    status["long_polls"] = Status.getLongPolls();
+    status["arena_peak"] = Status.getArenaPeak();
 }
@@ -0,0 +1,183 @@
+#ifndef ARDUINO_DOUBLE_H_
+#define ARDUINO_DOUBLE_H_
+
+// Host stand-in for the parts of the ESP8266 Arduino core the libraries use,
+// on the include path of env:native only. Time comes from the simulated
+// clock in lib/hal; nothing here talks to real hardware.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <string>
+#include <Hal.h>
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+#define PROGMEM
+
+inline unsigned long millis() { return Hal.millis(); }
+inline unsigned long micros() { return Hal.micros(); }
+inline void delay(unsigned long ms) { Hal.sleep(ms); }
+inline void yield() {}
+inline void pinMode(uint8_t pin, uint8_t mode) { Hal.pinMode(pin, mode); }
+inline void digitalWrite(uint8_t pin, uint8_t val) { Hal.digitalWrite(pin, val); }
+inline int digitalRead(uint8_t pin) { return Hal.digitalRead(pin); }
+
+class String {
+    public:
+        String(const char* s = "") : s(s ? s : "") {}
+        String(const std::string& s) : s(s) {}
+        explicit String(int v) : s(std::to_string(v)) {}
+        explicit String(unsigned int v) : s(std::to_string(v)) {}
+        explicit String(long v) : s(std::to_string(v)) {}
+        explicit String(unsigned long v) : s(std::to_string(v)) {}
+
+        const char* c_str() const { return s.c_str(); }
+        unsigned int length() const { return (unsigned int)s.size(); }
+        int toInt() const { return atoi(s.c_str()); }
+        char operator[](unsigned int i) const { return i < s.size() ? s[i] : '\0'; }
+
+        void trim() {
+            size_t start = s.find_first_not_of(" \t\r\n");
+            size_t end = s.find_last_not_of(" \t\r\n");
+            s = start == std::string::npos ? "" : s.substr(start, end - start + 1);
+        }
+
+        String& operator+=(const String& other) { s += other.s; return *this; }
+        String& operator+=(const char* other) { s += other; return *this; }
+        String& operator+=(char c) { s += c; return *this; }
+
+        bool operator==(const String& other) const { return s == other.s; }
+        bool operator==(const char* other) const { return s == other; }
+        bool operator!=(const String& other) const { return s != other.s; }
+        bool operator!=(const char* other) const { return s != other; }
+
+    private:
+        std::string s;
+};
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+
+        virtual size_t write(const uint8_t* data, size_t len) {
+            size_t n = 0;
+            while (len--) {
+                n += write(*data++);
+            }
+            return n;
+        }
+
+        size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+        size_t print(const char* s) { return write(s); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(const String& s) { return write(s.c_str()); }
+        size_t println(const char* s = "") { return write(s) + write("\r\n"); }
+
+        size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+            char buf[256];
+            va_list args;
+            va_start(args, fmt);
+            int n = vsnprintf(buf, sizeof(buf), fmt, args);
+            va_end(args);
+            if (n < 0) {
+                return 0;
+            }
+            if ((size_t)n >= sizeof(buf)) {
+                std::string big(n + 1, '\0');
+                va_start(args, fmt);
+                vsnprintf(&big[0], big.size(), fmt, args);
+                va_end(args);
+                return write((const uint8_t*)big.data(), n);
+            }
+            return write((const uint8_t*)buf, n);
+        }
+};
+
+// Log lines already go to stdout on the host; anything printed here joins them
+class HardwareSerial : public Print {
+    public:
+        void begin(unsigned long baud) { (void)baud; }
+        size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+};
+
+inline HardwareSerial Serial;
+
+// Chip identity, RTC user memory, the hardware RNG and the running image.
+// There is no image on the host: its size is 0 and flash reads fail.
+class EspClass {
+    public:
+        static const size_t RTC_USER_SIZE = 512;
+
+        uint32_t getChipId() { return chipId; }
+        uint32_t getFreeHeap() { return Hal.freeHeap(); }
+        uint32_t getMaxFreeBlockSize() { return Hal.freeHeap() * 3 / 4; }
+        uint8_t getHeapFragmentation() { return 25; }
+        uint32_t random() { return (uint32_t)::random(); }
+
+        bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+            if (offset * 4 + size > RTC_USER_SIZE) {
+                return false;
+            }
+            memcpy(data, rtc + offset * 4, size);
+            return true;
+        }
+
+        bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+            if (offset * 4 + size > RTC_USER_SIZE) {
+                return false;
+            }
+            memcpy(rtc + offset * 4, data, size);
+            return true;
+        }
+
+        void restart() { restarts++; }
+
+        uint32_t getSketchSize() { return 0; }
+        String getSketchMD5() { return String(); }
+        bool flashRead(uint32_t offset, uint8_t* data, size_t size) {
+            (void)offset;
+            (void)data;
+            (void)size;
+            return false;
+        }
+
+        // Simulation controls
+        void setChipId(uint32_t id) { chipId = id; }
+        void clearRtc() { memset(rtc, 0, sizeof(rtc)); }
+        unsigned int getRestartCount() { return restarts; }
+
+    private:
+        uint32_t chipId = 0x00C0FFEE;
+        uint8_t rtc[RTC_USER_SIZE] = {0};
+        unsigned int restarts = 0;
+};
+
+inline EspClass ESP;
+
+// SNTP is not simulated; like the core, configTime() installs the TZ rules
+inline void configTime(const char* tz, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr) {
+    (void)server1;
+    (void)server2;
+    (void)server3;
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef ESP8266WIFI_DOUBLE_H_
+#define ESP8266WIFI_DOUBLE_H_
+
+// Station/AP driver for env:native. The link itself is the simulated one in
+// lib/hal (Hal.wifiBegin() and Hal.wifiConnected()); this adds the scan
+// table, addresses and the got-IP/disconnect events, which tests raise with
+// the simulation controls at the bottom.
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class IPAddress {
+    public:
+        IPAddress() : addr(0) {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+            : addr((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+        IPAddress(uint32_t addr) : addr(addr) {}
+
+        operator uint32_t() const { return addr; }
+        uint8_t operator[](int i) const { return (uint8_t)(addr >> (8 * i)); }
+
+        bool fromString(const char* s) {
+            unsigned int a, b, c, d;
+            char extra;
+            if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+                return false;
+            }
+            *this = IPAddress(a, b, c, d);
+            return true;
+        }
+
+        String toString() const {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+            return String(buf);
+        }
+
+    private:
+        uint32_t addr;
+};
+
+typedef enum {
+    WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL = 1, WL_SCAN_COMPLETED = 2, WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4, WL_CONNECTION_LOST = 5, WL_WRONG_PASSWORD = 6, WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+typedef enum { WIFI_NONE_SLEEP = 0, WIFI_LIGHT_SLEEP = 1, WIFI_MODEM_SLEEP = 2 } WiFiSleepType_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+enum WiFiDisconnectReason { WIFI_DISCONNECT_REASON_BEACON_TIMEOUT = 200, WIFI_DISCONNECT_REASON_NO_AP_FOUND = 201 };
+
+struct WiFiEventStationModeGotIP {
+    IPAddress ip;
+    IPAddress mask;
+    IPAddress gw;
+};
+
+struct WiFiEventStationModeDisconnected {
+    String ssid;
+    uint8_t bssid[6];
+    WiFiDisconnectReason reason;
+};
+
+typedef std::shared_ptr<void> WiFiEventHandler;
+
+class ESP8266WiFiClass {
+    public:
+        struct Network {
+            String ssid;
+            int32_t rssi;
+            int32_t channel;
+            uint8_t bssid[6];
+            char bssidStr[18];
+        };
+
+        bool mode(WiFiMode_t m) { currentMode = m; return true; }
+        WiFiMode_t getMode() { return currentMode; }
+        void setAutoReconnect(bool on) { (void)on; }
+        void persistent(bool on) { (void)on; }
+        bool setSleepMode(WiFiSleepType_t type) { sleepMode = type; return true; }
+        void setOutputPower(float dBm) { (void)dBm; }
+        bool config(IPAddress ip, IPAddress gateway, IPAddress mask, IPAddress dns) {
+            staticIp = ip;
+            (void)gateway;
+            (void)mask;
+            (void)dns;
+            return true;
+        }
+
+        wl_status_t status() { return Hal.wifiConnected() ? WL_CONNECTED : WL_DISCONNECTED; }
+        int8_t RSSI() { return Hal.wifiConnected() ? -55 : 0; }
+        IPAddress localIP() { return Hal.wifiConnected() ? ip : IPAddress(); }
+        IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+        IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+        IPAddress dnsIP() { return IPAddress(192, 168, 1, 1); }
+        int32_t channel() { return 6; }
+        const uint8_t* BSSID() { return linkBssid; }
+        String BSSIDstr() { return String("02:00:00:00:00:01"); }
+
+        bool softAP(const char* ssid, const char* pass) {
+            (void)ssid;
+            (void)pass;
+            return currentMode == WIFI_AP || currentMode == WIFI_AP_STA;
+        }
+        IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+
+        // Scans finish by the next scanComplete() call
+        int8_t scanNetworks(bool async, bool showHidden) {
+            (void)async;
+            (void)showHidden;
+            scans++;
+            scanDone = true;
+            return WIFI_SCAN_RUNNING;
+        }
+        int8_t scanComplete() { return scanDone ? (int8_t)networks.size() : WIFI_SCAN_FAILED; }
+        void scanDelete() { scanDone = false; }
+        String SSID(uint8_t i) { return networks[i].ssid; }
+        int32_t RSSI(uint8_t i) { return networks[i].rssi; }
+        int32_t channel(uint8_t i) { return networks[i].channel; }
+        const uint8_t* BSSID(uint8_t i) { return networks[i].bssid; }
+        String BSSIDstr(uint8_t i) { return String(networks[i].bssidStr); }
+
+        WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP&)> f) {
+            gotIpHandler = f;
+            return std::make_shared<int>(0);
+        }
+        WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected&)> f) {
+            disconnectedHandler = f;
+            return std::make_shared<int>(0);
+        }
+
+        // Simulation controls
+        void reset() {
+            networks.clear();
+            scanDone = false;
+            scans = 0;
+            currentMode = WIFI_OFF;
+            sleepMode = WIFI_NONE_SLEEP;
+            staticIp = IPAddress();
+            gotIpHandler = nullptr;
+            disconnectedHandler = nullptr;
+        }
+
+        void addNetwork(const char* ssid, int32_t rssi, int32_t channel) {
+            Network n;
+            n.ssid = ssid;
+            n.rssi = rssi;
+            n.channel = channel;
+            uint8_t bssid[6] = {0x02, 0, 0, 0, 0, (uint8_t)(networks.size() + 1)};
+            memcpy(n.bssid, bssid, sizeof(bssid));
+            snprintf(n.bssidStr, sizeof(n.bssidStr), "02:00:00:00:00:%02X", n.bssid[5]);
+            networks.push_back(n);
+        }
+
+        void clearNetworks() { networks.clear(); }
+
+        // The station got a lease: the link goes up and the event fires
+        void gotIP(IPAddress address = IPAddress(192, 168, 1, 50)) {
+            ip = address;
+            Hal.setWifiConnected(true);
+            if (gotIpHandler) {
+                WiFiEventStationModeGotIP event = {address, subnetMask(), gatewayIP()};
+                gotIpHandler(event);
+            }
+        }
+
+        void linkLost(WiFiDisconnectReason reason = WIFI_DISCONNECT_REASON_BEACON_TIMEOUT) {
+            Hal.setWifiConnected(false);
+            if (disconnectedHandler) {
+                WiFiEventStationModeDisconnected event = {};
+                event.reason = reason;
+                disconnectedHandler(event);
+            }
+        }
+
+        unsigned int getScanCount() { return scans; }
+        WiFiSleepType_t getSleepMode() { return sleepMode; }
+        IPAddress getStaticIp() { return staticIp; }
+
+    private:
+        std::vector<Network> networks;
+        bool scanDone = false;
+        unsigned int scans = 0;
+        WiFiMode_t currentMode = WIFI_OFF;
+        WiFiSleepType_t sleepMode = WIFI_NONE_SLEEP;
+        IPAddress ip;
+        IPAddress staticIp;
+        uint8_t linkBssid[6] = {0x02, 0, 0, 0, 0, 0x01};
+        std::function<void(const WiFiEventStationModeGotIP&)> gotIpHandler;
+        std::function<void(const WiFiEventStationModeDisconnected&)> disconnectedHandler;
+};
+
+inline ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef ESP8266MDNS_DOUBLE_H_
+#define ESP8266MDNS_DOUBLE_H_
+
+// Responder for env:native: records the host name and the TXT records of
+// the one service the firmware announces; nothing goes on the network.
+
+#include <functional>
+#include <map>
+#include <string>
+
+class MDNSResponder {
+    public:
+        typedef const void* hMDNSService;
+        typedef std::function<void(const hMDNSService)> MDNSDynamicServiceTxtCallbackFunc;
+
+        bool begin(const char* hostname) {
+            host = hostname;
+            return true;
+        }
+        bool update() { return true; }
+
+        hMDNSService addService(const char* name, const char* protocol, uint16_t port) {
+            (void)name;
+            (void)protocol;
+            (void)port;
+            return this;
+        }
+        bool addServiceTxt(const char* name, const char* protocol, const char* key, const char* value) {
+            (void)name;
+            (void)protocol;
+            txt[key] = value;
+            return true;
+        }
+        bool setDynamicServiceTxtCallback(MDNSDynamicServiceTxtCallbackFunc fn) {
+            dynamicTxt = fn;
+            return true;
+        }
+        bool addDynamicServiceTxt(hMDNSService service, const char* key, const char* value) {
+            (void)service;
+            txt[key] = value;
+            return true;
+        }
+
+        // Simulation controls
+        const std::string& getHost() { return host; }
+        std::string getTxt(const char* key) {
+            if (dynamicTxt) {
+                dynamicTxt(this);
+            }
+            return txt.count(key) ? txt[key] : std::string();
+        }
+
+    private:
+        std::string host;
+        std::map<std::string, std::string> txt;
+        MDNSDynamicServiceTxtCallbackFunc dynamicTxt;
+};
+
+inline MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef ESPASYNCTCP_DOUBLE_H_
+#define ESPASYNCTCP_DOUBLE_H_
+
+// Async TCP client for env:native. connect() only records the attempt; the
+// test then completes it with fireConnect() or fireError(), which run the
+// handlers as lwIP would from its callback. Bytes written are kept for the
+// test to read back, and the send window is whatever setSpace() says. A
+// library that keeps its client private is reached through lastDialed().
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+
+#define ERR_OK 0
+#define ERR_TIMEOUT -3
+#define ERR_ABRT -13
+#define ERR_RST -14
+#define ERR_CLSD -15
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+
+class AsyncClient;
+
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t)> AcErrorHandler;
+typedef std::function<void(void*, AsyncClient*, void* data, size_t len)> AcDataHandler;
+
+class AsyncClient {
+    public:
+        void onConnect(AcConnectHandler cb, void* arg = nullptr) { connectHandler = cb; connectArg = arg; }
+        void onDisconnect(AcConnectHandler cb, void* arg = nullptr) { disconnectHandler = cb; disconnectArg = arg; }
+        void onError(AcErrorHandler cb, void* arg = nullptr) { errorHandler = cb; errorArg = arg; }
+        void onData(AcDataHandler cb, void* arg = nullptr) { dataHandler = cb; dataArg = arg; }
+
+        bool connect(const char* host, uint16_t port) {
+            (void)host;
+            (void)port;
+            connects++;
+            dialed = this;
+            pending = true;
+            open = false;
+            return true;
+        }
+
+        void close(bool now = false) {
+            (void)now;
+            pending = false;
+            open = false;
+            closes++;
+        }
+
+        bool connected() { return open; }
+        bool canSend() { return open && window > 0; }
+        size_t space() { return open ? window : 0; }
+
+        size_t write(const char* data, size_t len, uint8_t flags = ASYNC_WRITE_FLAG_COPY) {
+            (void)flags;
+            if (!open || len > window) {
+                return 0;
+            }
+            written.append(data, len);
+            writes++;
+            return len;
+        }
+
+        // Simulation controls
+        void fireConnect() {
+            pending = false;
+            open = true;
+            if (connectHandler) {
+                connectHandler(connectArg, this);
+            }
+        }
+
+        void fireError(int8_t error) {
+            pending = false;
+            open = false;
+            if (errorHandler) {
+                errorHandler(errorArg, this, error);
+            }
+        }
+
+        // The peer closed the connection
+        void fireDisconnect() {
+            open = false;
+            if (disconnectHandler) {
+                disconnectHandler(disconnectArg, this);
+            }
+        }
+
+        // Bytes arriving from the peer, as one lwIP pbuf
+        void fireData(const void* data, size_t len) {
+            if (dataHandler) {
+                dataHandler(dataArg, this, (void*)data, len);
+            }
+        }
+        void fireData(const std::string& data) { fireData(data.data(), data.size()); }
+
+        void setSpace(size_t bytes) { window = bytes; }
+        const std::string& getWritten() { return written; }
+        void clearWritten() { written.clear(); }
+        unsigned long getWriteCount() { return writes; }
+
+        static AsyncClient* lastDialed() { return dialed; }
+        bool isPending() { return pending; }
+        unsigned long getConnectCount() { return connects; }
+        unsigned long getCloseCount() { return closes; }
+
+    private:
+        static inline AsyncClient* dialed = nullptr;
+
+        AcConnectHandler connectHandler;
+        AcConnectHandler disconnectHandler;
+        AcErrorHandler errorHandler;
+        AcDataHandler dataHandler;
+        void* connectArg = nullptr;
+        void* disconnectArg = nullptr;
+        void* errorArg = nullptr;
+        void* dataArg = nullptr;
+        bool pending = false;
+        bool open = false;
+        size_t window = 5744;           // lwIP TCP_SND_BUF with the default MSS
+        std::string written;
+        unsigned long writes = 0;
+        unsigned long connects = 0;
+        unsigned long closes = 0;
+};
+
+#endif
@@ -0,0 +1,504 @@
+#ifndef ESPASYNCWEBSERVER_DOUBLE_H_
+#define ESPASYNCWEBSERVER_DOUBLE_H_
+
+// Requests, responses and WebSocket clients for env:native. A test builds a
+// request, hands it to the handler under test and reads back what was sent.
+// Requests are owned by a shared_ptr like in the library, so pause() hands
+// out a weak pointer that expires when the test drops the request, i.e. when
+// the client goes away. The server keeps the library's order: middleware,
+// then handlers (on(), addHandler(), serveStatic()) as they were added.
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESPAsyncTCP.h>
+#include <LittleFS.h>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+typedef enum {
+    HTTP_GET = 0b00000001, HTTP_POST = 0b00000010, HTTP_DELETE = 0b00000100, HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000, HTTP_HEAD = 0b00100000, HTTP_OPTIONS = 0b01000000, HTTP_ANY = 0b01111111
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServerResponse {
+    public:
+        AsyncWebServerResponse(int code, const String& contentType = String(), const String& content = String())
+            : code(code), contentType(contentType), content(content) {}
+        virtual ~AsyncWebServerResponse() {}
+
+        void addHeader(const char* name, const char* value) { headers[name] = value; }
+
+        int code;
+        String contentType;
+        String content;
+        std::map<std::string, std::string> headers;
+};
+
+// The library sizes its buffer from the hint; so does this one, so a correct
+// hint means the body is never reallocated while it is written
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+    public:
+        AsyncResponseStream(const String& contentType, size_t bufferSize) : AsyncWebServerResponse(200, contentType) {
+            body.reserve(bufferSize);
+        }
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t* buf, size_t len) override {
+            body.append((const char*)buf, len);
+            return len;
+        }
+
+        std::string body;
+};
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+
+// Pulls the body from the filler like the library does while the socket has
+// room; drain() plays that with a fixed maxLen and records each chunk
+class AsyncChunkedResponse : public AsyncWebServerResponse {
+    public:
+        AsyncChunkedResponse(const String& contentType, AwsResponseFiller filler)
+            : AsyncWebServerResponse(200, contentType), filler(filler) {}
+
+        std::string drain(size_t maxLen) {
+            std::string body;
+            std::vector<uint8_t> buffer(maxLen);
+            chunks.clear();
+            retries = 0;
+            while (true) {
+                size_t n = filler(buffer.data(), maxLen, body.size());
+                if (n == RESPONSE_TRY_AGAIN) {
+                    if (++retries > 100) {
+                        break;
+                    }
+                    continue;
+                }
+                if (n == 0) {
+                    break;
+                }
+                chunks.push_back(n);
+                body.append((const char*)buffer.data(), n);
+            }
+            return body;
+        }
+
+        std::vector<size_t> chunks;
+        int retries = 0;
+
+    private:
+        AwsResponseFiller filler;
+};
+
+class AsyncWebParameter {
+    public:
+        AsyncWebParameter(const String& name, const String& value, bool form = false, bool file = false)
+            : paramName(name), paramValue(value), form(form), file(file) {}
+        const String& name() const { return paramName; }
+        const String& value() const { return paramValue; }
+        bool isPost() const { return form; }
+        bool isFile() const { return file; }
+
+    private:
+        String paramName;
+        String paramValue;
+        bool form;
+        bool file;
+};
+
+class AsyncWebServerRequest;
+typedef std::weak_ptr<AsyncWebServerRequest> AsyncWebServerRequestPtr;
+
+class AsyncWebServerRequest : public std::enable_shared_from_this<AsyncWebServerRequest> {
+    public:
+        AsyncWebServerRequest(const char* url = "/", WebRequestMethodComposite method = HTTP_GET)
+            : requestUrl(url), requestMethod(method) {}
+        ~AsyncWebServerRequest() { free(_tempObject); }
+
+        const String& url() const { return requestUrl; }
+        WebRequestMethodComposite method() const { return requestMethod; }
+        AsyncClient* client() { return nullptr; }
+
+        // Freed with the request, as in the library
+        void* _tempObject = nullptr;
+
+        bool hasHeader(const char* name) const { return requestHeaders.count(name) > 0; }
+        const String& header(const char* name) const { return requestHeaders.at(name); }
+
+        // Query parameters, or form fields of a POST body with post = true
+        bool hasParam(const char* name, bool post = false, bool file = false) const {
+            return getParam(name, post, file) != nullptr;
+        }
+        const AsyncWebParameter* getParam(const char* name, bool post = false, bool file = false) const {
+            for (const AsyncWebParameter& p : requestParams) {
+                if (p.name() == name && p.isPost() == post && p.isFile() == file) {
+                    return &p;
+                }
+            }
+            return nullptr;
+        }
+        size_t params() const { return requestParams.size(); }
+        const AsyncWebParameter* getParam(size_t i) const {
+            return i < requestParams.size() ? &requestParams[i] : nullptr;
+        }
+
+        void onDisconnect(std::function<void()> fn) { disconnectHandler = fn; }
+
+        AsyncWebServerRequestPtr pause() {
+            paused = true;
+            return shared_from_this();
+        }
+        bool isPaused() const { return paused; }
+
+        AsyncResponseStream* beginResponseStream(const char* contentType, size_t bufferSize = 1460) {
+            return new AsyncResponseStream(contentType, bufferSize);
+        }
+        AsyncWebServerResponse* beginResponse(int code, const char* contentType = "", const char* content = "") {
+            return new AsyncWebServerResponse(code, contentType, content);
+        }
+        AsyncWebServerResponse* beginChunkedResponse(const char* contentType, AwsResponseFiller filler) {
+            return new AsyncChunkedResponse(contentType, filler);
+        }
+        AsyncWebServerResponse* beginResponse(int code, const char* contentType, const uint8_t* content, size_t len) {
+            return new AsyncWebServerResponse(code, contentType, std::string((const char*)content, len));
+        }
+
+        // Like AsyncFileResponse: falls back to <path>.gz and marks it gzip
+        AsyncWebServerResponse* beginResponse(FS& fs, const String& path, const String& contentType = String()) {
+            std::string name = path.c_str();
+            bool gzipped = !fs.exists(name.c_str()) && fs.exists((name + ".gz").c_str());
+            File file = fs.open(gzipped ? (name + ".gz").c_str() : name.c_str(), "r");
+            if (!file) {
+                return new AsyncWebServerResponse(404);
+            }
+            std::string content(file.size(), '\0');
+            file.read((uint8_t*)&content[0], content.size());
+            AsyncWebServerResponse* response = new AsyncWebServerResponse(200, contentType, content);
+            if (gzipped) {
+                response->addHeader("Content-Encoding", "gzip");
+            }
+            return response;
+        }
+
+        void send(AsyncWebServerResponse* r) {
+            response.reset(r);
+            sends++;
+        }
+        void send(int code, const char* contentType = "", const char* content = "") {
+            send(beginResponse(code, contentType, content));
+        }
+        void send(FS& fs, const String& path, const char* contentType = "") {
+            send(beginResponse(fs, path, contentType));
+        }
+
+        // Test side
+        void setHeader(const char* name, const char* value) { requestHeaders[name] = String(value); }
+        void setParam(const char* name, const char* value, bool post = false) {
+            for (auto it = requestParams.begin(); it != requestParams.end(); ++it) {
+                if (it->name() == name && it->isPost() == post) {
+                    requestParams.erase(it);
+                    break;
+                }
+            }
+            requestParams.emplace_back(name, value, post);
+        }
+        AsyncWebServerResponse* getResponse() { return response.get(); }
+        int getResponseCode() { return response ? response->code : 0; }
+        std::string getResponseHeader(const char* name) {
+            return response && response->headers.count(name) ? response->headers[name] : std::string();
+        }
+        std::string getResponseBody() {
+            AsyncResponseStream* stream = dynamic_cast<AsyncResponseStream*>(response.get());
+            return stream ? stream->body : (response ? std::string(response->content.c_str(), response->content.length()) : std::string());
+        }
+        int getSendCount() { return sends; }
+
+    private:
+        String requestUrl;
+        WebRequestMethodComposite requestMethod;
+        std::map<std::string, String> requestHeaders;
+        std::vector<AsyncWebParameter> requestParams;
+        std::unique_ptr<AsyncWebServerResponse> response;
+        std::function<void()> disconnectHandler;
+        bool paused = false;
+        int sends = 0;
+};
+
+class AsyncWebHandler {
+    public:
+        virtual ~AsyncWebHandler() {}
+        virtual bool canHandle(AsyncWebServerRequest* request) const { (void)request; return false; }
+        virtual void handleRequest(AsyncWebServerRequest* request) { (void)request; }
+        virtual bool isRequestHandlerTrivial() const { return true; }
+};
+
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, uint8_t*, size_t, size_t, size_t)> ArBodyHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, const String&, size_t, uint8_t*, size_t, bool)> ArUploadHandlerFunction;
+typedef std::function<void(void)> ArMiddlewareNext;
+typedef std::function<void(AsyncWebServerRequest*, ArMiddlewareNext)> ArMiddlewareCallback;
+
+// server.on(): the URI itself or anything below it, for the given methods
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+    public:
+        AsyncCallbackWebHandler(const char* uri, WebRequestMethodComposite method,
+                                ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload)
+            : uri(uri), method(method), onRequest(onRequest), onUpload(onUpload) {}
+
+        bool canHandle(AsyncWebServerRequest* request) const override {
+            if (!(request->method() & method)) {
+                return false;
+            }
+            const std::string url = request->url().c_str();
+            return url == uri || url.compare(0, uri.size() + 1, uri + "/") == 0;
+        }
+
+        void handleRequest(AsyncWebServerRequest* request) override {
+            if (onRequest) {
+                onRequest(request);
+            } else {
+                request->send(500);
+            }
+        }
+
+    private:
+        std::string uri;
+        WebRequestMethodComposite method;
+        ArRequestHandlerFunction onRequest;
+        ArUploadHandlerFunction onUpload;
+};
+
+// serveStatic(): GET for files that exist under the mapped path
+class AsyncStaticWebHandler : public AsyncWebHandler {
+    public:
+        AsyncStaticWebHandler(const char* uri, FS& fs, const char* path) : uri(uri), fs(fs), path(path) {}
+
+        bool canHandle(AsyncWebServerRequest* request) const override {
+            std::string file;
+            return request->method() == HTTP_GET && resolve(request, file);
+        }
+
+        void handleRequest(AsyncWebServerRequest* request) override {
+            std::string file;
+            resolve(request, file);
+            request->send(fs, file.c_str());
+        }
+
+    private:
+        std::string uri;
+        FS& fs;
+        std::string path;
+
+        bool resolve(AsyncWebServerRequest* request, std::string& file) const {
+            const std::string url = request->url().c_str();
+            if (url.compare(0, uri.size(), uri) != 0) {
+                return false;
+            }
+            file = path + url.substr(uri.size());
+            return file.back() != '/' && (fs.exists(file.c_str()) || fs.exists((file + ".gz").c_str()));
+        }
+};
+
+// Handlers and the catch-alls; tests call dispatch() for what would reach them
+class AsyncWebServer {
+    public:
+        AsyncWebServer(uint16_t port) : port(port) {}
+
+        void begin() { started = true; }
+
+        AsyncWebHandler& addHandler(AsyncWebHandler* handler) {
+            handlers.push_back(handler);
+            return *handler;
+        }
+
+        AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                    ArUploadHandlerFunction onUpload = nullptr) {
+            auto handler = std::make_shared<AsyncCallbackWebHandler>(uri, method, onRequest, onUpload);
+            owned.push_back(handler);
+            addHandler(handler.get());
+            return *handler;
+        }
+
+        AsyncStaticWebHandler& serveStatic(const char* uri, FS& fs, const char* path) {
+            auto handler = std::make_shared<AsyncStaticWebHandler>(uri, fs, path);
+            owned.push_back(handler);
+            addHandler(handler.get());
+            return *handler;
+        }
+
+        void addMiddleware(ArMiddlewareCallback fn) { middleware.push_back(fn); }
+        void onNotFound(ArRequestHandlerFunction fn) { notFound = fn; }
+        void onRequestBody(ArBodyHandlerFunction fn) { body = fn; }
+
+        // Test side: delivers a request, its body in one chunk. Middleware
+        // that does not call next() ends it there.
+        void dispatch(AsyncWebServerRequest* request, const char* content = nullptr) {
+            if (content != nullptr && body) {
+                size_t len = strlen(content);
+                body(request, (uint8_t*)content, len, 0, len);
+            }
+            run(request, 0);
+        }
+
+        bool isStarted() { return started; }
+
+        uint16_t port;
+
+    private:
+        std::vector<AsyncWebHandler*> handlers;
+        std::vector<std::shared_ptr<AsyncWebHandler>> owned;
+        std::vector<ArMiddlewareCallback> middleware;
+        ArRequestHandlerFunction notFound;
+        ArBodyHandlerFunction body;
+        bool started = false;
+
+        void run(AsyncWebServerRequest* request, size_t next) {
+            if (next < middleware.size()) {
+                middleware[next](request, [this, request, next]() { run(request, next + 1); });
+                return;
+            }
+            for (AsyncWebHandler* handler : handlers) {
+                if (handler->canHandle(request)) {
+                    handler->handleRequest(request);
+                    return;
+                }
+            }
+            if (notFound) {
+                notFound(request);
+            } else {
+                request->send(404);
+            }
+        }
+};
+
+typedef enum { WS_DISCONNECTED, WS_CONNECTED, WS_DISCONNECTING } AwsClientStatus;
+typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PING, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA } AwsEventType;
+typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08, WS_PING, WS_PONG } AwsFrameType;
+
+typedef struct {
+    uint8_t message_opcode;
+    uint32_t num;
+    uint8_t final;
+    uint8_t masked;
+    uint8_t opcode;
+    uint64_t len;
+    uint8_t mask[4];
+    uint64_t index;
+} AwsFrameInfo;
+
+// A slow client keeps every message in its send queue until the test calls
+// drain(); a fast one drains as it sends. Everything sent is also logged.
+class AsyncWebSocketClient {
+    public:
+        struct Message {
+            bool binary;
+            std::string data;
+        };
+
+        AsyncWebSocketClient(uint32_t id, bool slow) : clientId(id), slow(slow) {}
+
+        uint32_t id() const { return clientId; }
+        AwsClientStatus status() { return tcp.getCloseCount() == 0 ? WS_CONNECTED : WS_DISCONNECTED; }
+        AsyncClient* client() { return &tcp; }
+        size_t queueLen() const { return queued; }
+
+        bool text(const char* message) { return text(message, strlen(message)); }
+        bool text(const char* message, size_t len) { return send(false, (const uint8_t*)message, len); }
+        bool binary(const uint8_t* message, size_t len) { return send(true, message, len); }
+
+        // Test side
+        void drain() { queued = 0; }
+        const std::vector<Message>& getSent() const { return sent; }
+        void clearSent() { sent.clear(); }
+
+    private:
+        uint32_t clientId;
+        bool slow;
+        size_t queued = 0;
+        AsyncClient tcp;
+        std::vector<Message> sent;
+
+        bool send(bool isBinary, const uint8_t* data, size_t len) {
+            if (status() != WS_CONNECTED) {
+                return false;
+            }
+            sent.push_back({isBinary, std::string((const char*)data, len)});
+            if (slow) {
+                queued++;
+            }
+            return true;
+        }
+};
+
+class AsyncWebSocket;
+typedef std::function<void(AsyncWebSocket*, AsyncWebSocketClient*, AwsEventType, void*, uint8_t*, size_t)> AwsEventHandler;
+
+// Upgrades are not simulated; the test connects clients and delivers
+// messages, which reach the event handler as single final frames
+class AsyncWebSocket : public AsyncWebHandler {
+    public:
+        AsyncWebSocket(const char* url) { (void)url; }
+
+        void onEvent(AwsEventHandler handler) { eventHandler = handler; }
+
+        std::list<AsyncWebSocketClient>& getClients() { return clients; }
+
+        size_t count() {
+            size_t n = 0;
+            for (AsyncWebSocketClient& c : clients) {
+                n += c.status() == WS_CONNECTED;
+            }
+            return n;
+        }
+
+        AsyncWebSocketClient* client(uint32_t id) {
+            for (AsyncWebSocketClient& c : clients) {
+                if (c.id() == id && c.status() == WS_CONNECTED) {
+                    return &c;
+                }
+            }
+            return nullptr;
+        }
+
+        void cleanupClients() {
+            clients.remove_if([](AsyncWebSocketClient& c) { return c.status() != WS_CONNECTED; });
+        }
+
+        // Test side
+        AsyncWebSocketClient* addClient(bool slow = false) {
+            clients.emplace_back(nextId++, slow);
+            return &clients.back();
+        }
+
+        AsyncWebSocketClient* connect(bool slow = false) {
+            AsyncWebSocketClient* client = addClient(slow);
+            event(client, WS_EVT_CONNECT, nullptr, nullptr, 0);
+            return client;
+        }
+
+        void message(AsyncWebSocketClient* client, const uint8_t* data, size_t len, bool binary) {
+            AwsFrameInfo info = {};
+            info.message_opcode = info.opcode = binary ? WS_BINARY : WS_TEXT;
+            info.final = 1;
+            info.len = len;
+            event(client, WS_EVT_DATA, &info, const_cast<uint8_t*>(data), len);
+        }
+
+    private:
+        std::list<AsyncWebSocketClient> clients;
+        uint32_t nextId = 1;
+        AwsEventHandler eventHandler;
+
+        void event(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
+            if (eventHandler) {
+                eventHandler(this, client, type, arg, data, len);
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef ELEGANTOTA_DOUBLE_H_
+#define ELEGANTOTA_DOUBLE_H_
+
+// The /update page is not served on the host; the callbacks are kept so a
+// test can play an upload's start, progress and end.
+
+#include <ESPAsyncWebServer.h>
+#include <functional>
+
+class ElegantOTAClass {
+    public:
+        void begin(AsyncWebServer* server) { (void)server; }
+        void loop() {}
+
+        void onStart(std::function<void()> fn) { startHandler = fn; }
+        void onProgress(std::function<void(size_t, size_t)> fn) { progressHandler = fn; }
+        void onEnd(std::function<void(bool)> fn) { endHandler = fn; }
+
+        // Simulation controls
+        void fireStart() {
+            if (startHandler) {
+                startHandler();
+            }
+        }
+        void fireProgress(size_t current, size_t final) {
+            if (progressHandler) {
+                progressHandler(current, final);
+            }
+        }
+        void fireEnd(bool success) {
+            if (endHandler) {
+                endHandler(success);
+            }
+        }
+
+    private:
+        std::function<void()> startHandler;
+        std::function<void(size_t, size_t)> progressHandler;
+        std::function<void(bool)> endHandler;
+};
+
+inline ElegantOTAClass ElegantOTA;
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef LITTLEFS_DOUBLE_H_
+#define LITTLEFS_DOUBLE_H_
+
+// In-memory LittleFS for env:native. Files are byte vectors keyed by path;
+// a file opened with "w" is truncated at once, like on flash. Counters let
+// tests check how often a module writes.
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+class File : public Print {
+    public:
+        File() {}
+        File(std::shared_ptr<std::vector<uint8_t>> data) : data(data) {}
+
+        explicit operator bool() const { return data != nullptr; }
+        bool isDirectory() const { return false; }
+        size_t size() const { return data ? data->size() : 0; }
+        int available() const { return data ? (int)(data->size() - pos) : 0; }
+        void close() { data.reset(); }
+
+        size_t write(uint8_t c) override {
+            return write(&c, 1);
+        }
+
+        size_t write(const uint8_t* buf, size_t len) override {
+            if (!data) {
+                return 0;
+            }
+            data->insert(data->end(), buf, buf + len);
+            return len;
+        }
+
+        size_t read(uint8_t* buf, size_t len) {
+            size_t n = available() < (int)len ? (size_t)available() : len;
+            if (n > 0) {
+                memcpy(buf, data->data() + pos, n);
+                pos += n;
+            }
+            return n;
+        }
+
+        size_t readBytesUntil(char terminator, char* buf, size_t len) {
+            size_t n = 0;
+            while (n < len && available() > 0) {
+                char c = (char)(*data)[pos++];
+                if (c == terminator) {
+                    break;
+                }
+                buf[n++] = c;
+            }
+            return n;
+        }
+
+        String readStringUntil(char terminator) {
+            std::string out;
+            while (available() > 0) {
+                char c = (char)(*data)[pos++];
+                if (c == terminator) {
+                    break;
+                }
+                out += c;
+            }
+            return String(out);
+        }
+
+        String readString() {
+            std::string out;
+            while (available() > 0) {
+                out += (char)(*data)[pos++];
+            }
+            return String(out);
+        }
+
+    private:
+        std::shared_ptr<std::vector<uint8_t>> data;
+        size_t pos = 0;
+};
+
+class FS {
+    public:
+        bool begin() { return !mountFails; }
+
+        File open(const char* path, const char* mode) {
+            auto it = files.find(path);
+            if (mode[0] == 'r') {
+                return it == files.end() ? File() : File(it->second);
+            }
+            if (full) {
+                return File();
+            }
+            writes++;
+            if (it == files.end() || mode[0] == 'w') {
+                files[path] = std::make_shared<std::vector<uint8_t>>();
+            }
+            return File(files[path]);
+        }
+
+        bool exists(const char* path) { return files.count(path) > 0; }
+
+        bool remove(const char* path) { return files.erase(path) > 0; }
+
+        bool rename(const char* from, const char* to) {
+            auto it = files.find(from);
+            if (it == files.end()) {
+                return false;
+            }
+            files[to] = it->second;
+            files.erase(it);
+            renames++;
+            return true;
+        }
+
+        // Simulation controls
+        void format() {
+            files.clear();
+            writes = 0;
+            renames = 0;
+            mountFails = false;
+            full = false;
+        }
+        void setMountFails(bool fails) { mountFails = fails; }
+        void setFull(bool on) { full = on; }          // opens for writing fail
+        unsigned long getWriteCount() { return writes; }      // opens for writing
+        unsigned long getRenameCount() { return renames; }
+
+    private:
+        std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+        unsigned long writes = 0;
+        unsigned long renames = 0;
+        bool mountFails = false;
+        bool full = false;
+};
+
+inline FS LittleFS;
+
+#endif
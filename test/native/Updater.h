@@ -0,0 +1,62 @@
+#ifndef UPDATER_DOUBLE_H_
+#define UPDATER_DOUBLE_H_
+
+// Flash updater for env:native: begin() opens a region of the given size,
+// write() appends to it and end() succeeds once it is full. The MD5 set
+// beforehand is only remembered, not checked.
+
+#include <Arduino.h>
+#include <string>
+
+#define U_FLASH 0
+
+class UpdaterClass {
+    public:
+        bool begin(size_t size, int command = U_FLASH) {
+            (void)command;
+            if (running) {
+                return false;
+            }
+            running = true;
+            expected = size;
+            image.clear();
+            return true;
+        }
+
+        bool setMD5(const char* md5) {
+            this->md5 = md5;
+            return true;
+        }
+
+        size_t write(uint8_t* data, size_t len) {
+            if (!running || image.size() + len > expected) {
+                return 0;
+            }
+            image.append((const char*)data, len);
+            return len;
+        }
+
+        bool end(bool evenIfRemaining = false) {
+            bool ok = running && (evenIfRemaining || image.size() == expected);
+            running = false;
+            return ok;
+        }
+
+        void runAsync(bool async) { (void)async; }
+        bool isRunning() { return running; }
+        String getErrorString() { return String(running ? "" : "no update running"); }
+
+        // Simulation controls
+        const std::string& getImage() { return image; }
+        const std::string& getMD5() { return md5; }
+
+    private:
+        bool running = false;
+        size_t expected = 0;
+        std::string image;
+        std::string md5;
+};
+
+inline UpdaterClass Update;
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef WIFIUDP_DOUBLE_H_
+#define WIFIUDP_DOUBLE_H_
+
+// UDP sockets for env:native on one simulated segment. Bound sockets (begin()
+// or beginMulticast()) receive what tests inject with deliver(); everything
+// sent is kept in a log that tests read back with getSent().
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+class WiFiUDP : public Print {
+    public:
+        struct Datagram {
+            IPAddress remote;
+            uint16_t port;
+            std::vector<uint8_t> data;
+        };
+
+        WiFiUDP() {}
+        WiFiUDP(const WiFiUDP&) : Print() {}
+        WiFiUDP& operator=(const WiFiUDP&) { stop(); return *this; }
+        ~WiFiUDP() { stop(); }
+
+        uint8_t begin(uint16_t port) {
+            stop();
+            localPort = port;
+            sockets().push_back(this);
+            return 1;
+        }
+
+        uint8_t beginMulticast(IPAddress iface, IPAddress group, uint16_t port) {
+            (void)iface;
+            (void)group;
+            return begin(port);
+        }
+
+        void stop() {
+            auto& s = sockets();
+            s.erase(std::remove(s.begin(), s.end(), this), s.end());
+            rx.clear();
+            localPort = 0;
+        }
+
+        int beginPacket(IPAddress ip, uint16_t port) {
+            tx.remote = ip;
+            tx.port = port;
+            tx.data.clear();
+            return 1;
+        }
+
+        int beginPacketMulticast(IPAddress group, uint16_t port, IPAddress iface, int ttl = 1) {
+            (void)iface;
+            (void)ttl;
+            return beginPacket(group, port);
+        }
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+
+        size_t write(const uint8_t* buf, size_t len) override {
+            tx.data.insert(tx.data.end(), buf, buf + len);
+            return len;
+        }
+
+        int endPacket() {
+            sent().push_back(tx);
+            return 1;
+        }
+
+        int parsePacket() {
+            if (rx.empty()) {
+                return 0;
+            }
+            current = rx.front();
+            rx.pop_front();
+            pos = 0;
+            return (int)current.data.size();
+        }
+
+        int read(uint8_t* buf, size_t len) {
+            size_t n = std::min(len, current.data.size() - pos);
+            memcpy(buf, current.data.data() + pos, n);
+            pos += n;
+            return (int)n;
+        }
+
+        void flush() { pos = current.data.size(); }
+        IPAddress remoteIP() { return current.remote; }
+
+        // Simulation controls. deliver() queues the datagram on every socket
+        // bound to port and returns how many got it.
+        static int deliver(uint16_t port, const uint8_t* data, size_t len, IPAddress from = IPAddress(192, 168, 1, 20)) {
+            int n = 0;
+            for (WiFiUDP* s : sockets()) {
+                if (s->localPort == port) {
+                    s->rx.push_back({from, port, std::vector<uint8_t>(data, data + len)});
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        static std::vector<Datagram>& getSent() { return sent(); }
+        static void clearSent() { sent().clear(); }
+
+    private:
+        uint16_t localPort = 0;
+        std::deque<Datagram> rx;
+        Datagram current;
+        size_t pos = 0;
+        Datagram tx;
+
+        // Never freed: global objects holding sockets unbind in their
+        // destructors, which can run after function statics are gone
+        static std::vector<WiFiUDP*>& sockets() {
+            static std::vector<WiFiUDP*>* all = new std::vector<WiFiUDP*>();
+            return *all;
+        }
+
+        static std::vector<Datagram>& sent() {
+            static std::vector<Datagram> log;
+            return log;
+        }
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef FAUXMOESP_DOUBLE_H_
+#define FAUXMOESP_DOUBLE_H_
+
+// Hue emulation for env:native. process() answers the paths fauxmoESP
+// answers (description, user registration, light list and state changes);
+// anything else is left for the caller to reject.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef std::function<void(unsigned char, const char*, bool, unsigned char)> TSetStateCallback;
+
+class fauxmoESP {
+    public:
+        void createServer(bool internal) { (void)internal; }
+        void setPort(unsigned long port) { (void)port; }
+        void enable(bool on) { enabled = on; }
+        void handle() {}
+        void onSetState(TSetStateCallback fn) { setState = fn; }
+
+        unsigned char addDevice(const char* name) {
+            devices.push_back(name);
+            return (unsigned char)(devices.size() - 1);
+        }
+
+        // Light ids in Hue URLs are 1-based
+        bool process(AsyncClient* client, bool isGet, String url, String body) {
+            (void)client;
+            if (!enabled) {
+                return false;
+            }
+
+            const char* u = url.c_str();
+            if (strcmp(u, "/description.xml") == 0) {
+                return isGet;
+            }
+            if (strcmp(u, "/api") == 0) {
+                return !isGet;      // user registration
+            }
+
+            unsigned int id;
+            int end = 0;
+            char user[64];
+            if (sscanf(u, "/api/%63[^/]/lights/%u/state%n", user, &id, &end) == 2 && u[end] == '\0') {
+                if (isGet || id == 0 || id > devices.size()) {
+                    return false;
+                }
+                const char* on = strstr(body.c_str(), "\"on\":");
+                if (on == nullptr || !setState) {
+                    return false;
+                }
+                setState((unsigned char)(id - 1), devices[id - 1].c_str(), strncmp(on + 5, "true", 4) == 0, 255);
+                return true;
+            }
+            end = 0;
+            if (sscanf(u, "/api/%63[^/]/lights%n", user, &end) == 1 && end > 0 && (u[end] == '\0' || u[end] == '/')) {
+                return isGet;
+            }
+            return false;
+        }
+
+    private:
+        bool enabled = false;
+        std::vector<std::string> devices;
+        TSetStateCallback setState;
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef USER_INTERFACE_DOUBLE_H_
+#define USER_INTERFACE_DOUBLE_H_
+
+// The few NONOS SDK calls the libraries make directly, as no-ops for env:native
+
+enum phy_mode { PHY_MODE_11B = 1, PHY_MODE_11G = 2, PHY_MODE_11N = 3 };
+
+static inline bool wifi_set_phy_mode(enum phy_mode mode) {
+    (void)mode;
+    return true;
+}
+
+#endif
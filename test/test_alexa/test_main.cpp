@@ -0,0 +1,179 @@
+#include <unity.h>
+#include <chrono>
+#include <Hal.h>
+#include <Power.h>
+#include <Alexa.h>
+
+// Replays the traffic an Echo and the usual LAN scanners send to port 80
+// through the catch-all handlers Alexa installs. Requests fauxmo answers
+// write to the socket directly, so they show up here as nothing sent.
+
+struct Recorded {
+    WebRequestMethod method;
+    const char* url;
+    const char* body;
+    bool hue;
+};
+
+static const char* USER = "2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr";
+
+// One discovery and control round plus background noise
+static const Recorded TRAFFIC[] = {
+    { HTTP_GET,  "/description.xml", nullptr, true },
+    { HTTP_POST, "/api", "{\"devicetype\":\"Echo\"}", true },
+    { HTTP_GET,  "/api/2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr/lights", nullptr, true },
+    { HTTP_GET,  "/api/2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr/lights/1", nullptr, true },
+    { HTTP_PUT,  "/api/2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr/lights/1/state", "{\"on\":true,\"bri\":255}", true },
+    { HTTP_GET,  "/favicon.ico", nullptr, false },
+    { HTTP_GET,  "/wp-login.php", nullptr, false },
+    { HTTP_GET,  "/.env", nullptr, false },
+    { HTTP_GET,  "/apix", nullptr, false },
+    { HTTP_POST, "/cgi-bin/luci", "user=root", false },
+    { HTTP_GET,  "/description.xml.bak", nullptr, false },
+};
+static const size_t TRAFFIC_COUNT = sizeof(TRAFFIC) / sizeof(TRAFFIC[0]);
+
+static AsyncWebServer server(80);
+static int messages = 0;
+static uint8_t lastChannel = 0xFF;
+static bool lastState = false;
+
+static std::shared_ptr<AsyncWebServerRequest> replay(WebRequestMethod method, const char* url, const char* body = nullptr) {
+    auto request = std::make_shared<AsyncWebServerRequest>(url, method);
+    server.dispatch(request.get(), body);
+    return request;
+}
+
+static void stateUrl(char* out, size_t size, int light) {
+    snprintf(out, size, "/api/%s/lights/%d/state", USER, light);
+}
+
+void setUp() {
+    Alexa = AlexaClass();
+    Alexa.initAlexa(&server, [](uint8_t channel, bool state) {
+        messages++;
+        lastChannel = channel;
+        lastState = state;
+    });
+    messages = 0;
+    lastChannel = 0xFF;
+}
+
+void tearDown() {
+}
+
+void test_hue_path_filter() {
+    TEST_ASSERT_TRUE(AlexaClass::isHuePath("/api"));
+    TEST_ASSERT_TRUE(AlexaClass::isHuePath("/api/user/lights"));
+    TEST_ASSERT_TRUE(AlexaClass::isHuePath("/description.xml"));
+    TEST_ASSERT_FALSE(AlexaClass::isHuePath("/apix"));
+    TEST_ASSERT_FALSE(AlexaClass::isHuePath("/ap"));
+    TEST_ASSERT_FALSE(AlexaClass::isHuePath("/description.xml.bak"));
+    TEST_ASSERT_FALSE(AlexaClass::isHuePath("/"));
+}
+
+// Noise gets a 404 without reaching fauxmo; Hue traffic is answered by it
+void test_replay_counts() {
+    for (size_t i = 0; i < TRAFFIC_COUNT; i++) {
+        auto request = replay(TRAFFIC[i].method, TRAFFIC[i].url, TRAFFIC[i].body);
+        if (TRAFFIC[i].hue) {
+            TEST_ASSERT_EQUAL_MESSAGE(0, request->getSendCount(), TRAFFIC[i].url);
+        } else {
+            TEST_ASSERT_EQUAL_MESSAGE(404, request->getResponseCode(), TRAFFIC[i].url);
+        }
+    }
+
+    const AlexaClass::Stats& st = Alexa.getStats();
+    TEST_ASSERT_EQUAL(3, st.discovery);
+    TEST_ASSERT_EQUAL(2, st.control);
+    TEST_ASSERT_EQUAL(6, st.filtered);
+    TEST_ASSERT_EQUAL(0, st.unhandled);
+}
+
+// The body captured in onRequestBody is what fauxmo parses
+void test_state_change_reaches_channel() {
+    char url[96];
+    stateUrl(url, sizeof(url), 2);
+    replay(HTTP_PUT, url, "{\"on\":true}");
+    TEST_ASSERT_EQUAL(1, messages);
+    TEST_ASSERT_EQUAL(1, lastChannel);
+    TEST_ASSERT_TRUE(lastState);
+
+    stateUrl(url, sizeof(url), 1);
+    replay(HTTP_PUT, url, "{\"on\":false}");
+    TEST_ASSERT_EQUAL(2, messages);
+    TEST_ASSERT_EQUAL(0, lastChannel);
+    TEST_ASSERT_FALSE(lastState);
+}
+
+// A body over MAX_BODY is not kept, so fauxmo sees none and the request is unhandled
+void test_oversized_body_dropped() {
+    char body[AlexaClass::MAX_BODY + 32];
+    memset(body, ' ', sizeof(body) - 1);
+    body[sizeof(body) - 1] = '\0';
+    memcpy(body, "{\"on\":true,", 11);
+
+    char url[96];
+    stateUrl(url, sizeof(url), 1);
+    auto request = replay(HTTP_PUT, url, body);
+    TEST_ASSERT_NULL(request->_tempObject);
+    TEST_ASSERT_EQUAL(404, request->getResponseCode());
+    TEST_ASSERT_EQUAL(0, messages);
+    TEST_ASSERT_EQUAL(1, Alexa.getStats().unhandled);
+}
+
+// Bodies of non-Hue requests are not copied at all
+void test_non_hue_body_not_captured() {
+    auto request = replay(HTTP_POST, "/cgi-bin/luci", "user=root");
+    TEST_ASSERT_NULL(request->_tempObject);
+    TEST_ASSERT_EQUAL(1, Alexa.getStats().filtered);
+}
+
+// initAlexa() runs on every reconnect but adds the devices only once
+void test_init_is_idempotent() {
+    Alexa.initAlexa(&server, [](uint8_t, bool) { messages += 100; });
+
+    char url[96];
+    stateUrl(url, sizeof(url), 3);
+    auto request = replay(HTTP_PUT, url, "{\"on\":true}");
+    TEST_ASSERT_EQUAL(404, request->getResponseCode());
+
+    stateUrl(url, sizeof(url), 1);
+    replay(HTTP_PUT, url, "{\"on\":true}");
+    TEST_ASSERT_EQUAL(1, messages);
+}
+
+void test_replay_throughput() {
+    static const int ROUNDS = 20000;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < TRAFFIC_COUNT; i++) {
+            replay(TRAFFIC[i].method, TRAFFIC[i].url, TRAFFIC[i].body);
+        }
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (ROUNDS * TRAFFIC_COUNT);
+
+    TEST_ASSERT_EQUAL(ROUNDS * 6, Alexa.getStats().filtered);
+    TEST_ASSERT_EQUAL(ROUNDS, messages);
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%.2f us per replayed request on the host", us);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    Power.initPower();
+    Power.addChannel("Remote PC", 5);
+    Power.addChannel("NAS", 4);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_hue_path_filter);
+    RUN_TEST(test_replay_counts);
+    RUN_TEST(test_state_change_reaches_channel);
+    RUN_TEST(test_oversized_body_dropped);
+    RUN_TEST(test_non_hue_body_not_captured);
+    RUN_TEST(test_init_is_idempotent);
+    RUN_TEST(test_replay_throughput);
+    return UNITY_END();
+}
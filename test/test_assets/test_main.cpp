@@ -0,0 +1,194 @@
+#include <unity.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <Hal.h>
+#include <Assets.h>
+#include <WebAssets.h>
+
+// Every embedded asset through Assets.send and the request double: body,
+// gzip and content headers, the ETag and 304 path, immutable fingerprinted
+// URLs and LittleFS overrides. The last test loads the dashboard cold and
+// warm and reports what goes over the wire.
+
+static std::shared_ptr<AsyncWebServerRequest> get(const char* url, const char* etag = nullptr, const char* version = nullptr) {
+    auto request = std::make_shared<AsyncWebServerRequest>(url, HTTP_GET);
+    if (etag != nullptr) {
+        request->setHeader("If-None-Match", etag);
+    }
+    if (version != nullptr) {
+        request->setParam("v", version);
+    }
+    if (Assets.canHandle(request.get())) {
+        Assets.handleRequest(request.get());
+    }
+    return request;
+}
+
+static std::string quoted(const char* hash) {
+    return std::string("\"") + hash + "\"";
+}
+
+void setUp() {
+    Hal.reset();
+    LittleFS.format();
+    Assets = AssetsClass();
+    Assets.initAssets();
+}
+
+void tearDown() {
+}
+
+void test_every_asset_served() {
+    TEST_ASSERT_TRUE(EMBEDDED_ASSET_COUNT > 0);
+    for (int i = 0; i < EMBEDDED_ASSET_COUNT; i++) {
+        const EmbeddedAsset& a = EMBEDDED_ASSETS[i];
+        auto request = get(a.path);
+        TEST_ASSERT_EQUAL_MESSAGE(200, request->getResponseCode(), a.path);
+
+        std::string body = request->getResponseBody();
+        TEST_ASSERT_EQUAL_MESSAGE(a.length, body.size(), a.path);
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(a.data, body.data(), a.length, a.path);
+        TEST_ASSERT_EQUAL_STRING(quoted(a.hash).c_str(), request->getResponseHeader("ETag").c_str());
+        TEST_ASSERT_EQUAL_STRING("no-cache", request->getResponseHeader("Cache-Control").c_str());
+
+        if (a.gzipped) {
+            TEST_ASSERT_EQUAL_STRING_MESSAGE("gzip", request->getResponseHeader("Content-Encoding").c_str(), a.path);
+            TEST_ASSERT_EQUAL_HEX8(0x1f, (uint8_t)body[0]);
+            TEST_ASSERT_EQUAL_HEX8(0x8b, (uint8_t)body[1]);
+        } else {
+            TEST_ASSERT_EQUAL_STRING_MESSAGE("", request->getResponseHeader("Content-Encoding").c_str(), a.path);
+        }
+    }
+    TEST_ASSERT_EQUAL(EMBEDDED_ASSET_COUNT, Assets.getFlashStats().requests);
+}
+
+void test_content_types() {
+    TEST_ASSERT_EQUAL_STRING("text/html", get("/index.html")->getResponse()->contentType.c_str());
+    TEST_ASSERT_EQUAL_STRING("text/css", get("/style.css")->getResponse()->contentType.c_str());
+    TEST_ASSERT_EQUAL_STRING("image/png", get("/favicon.png")->getResponse()->contentType.c_str());
+}
+
+// A matching If-None-Match, alone or in a list, gets an empty 304
+void test_revalidation() {
+    for (int i = 0; i < EMBEDDED_ASSET_COUNT; i++) {
+        const EmbeddedAsset& a = EMBEDDED_ASSETS[i];
+        auto request = get(a.path, quoted(a.hash).c_str());
+        TEST_ASSERT_EQUAL_MESSAGE(304, request->getResponseCode(), a.path);
+        TEST_ASSERT_EQUAL(0, request->getResponseBody().size());
+        TEST_ASSERT_EQUAL_STRING(quoted(a.hash).c_str(), request->getResponseHeader("ETag").c_str());
+    }
+    TEST_ASSERT_EQUAL(EMBEDDED_ASSET_COUNT, Assets.getFlashStats().notModified);
+
+    const EmbeddedAsset& a = EMBEDDED_ASSETS[0];
+    std::string list = "W/\"00000000\", " + quoted(a.hash);
+    TEST_ASSERT_EQUAL(304, get(a.path, list.c_str())->getResponseCode());
+    TEST_ASSERT_EQUAL(200, get(a.path, "\"00000000\"")->getResponseCode());
+    TEST_ASSERT_EQUAL(200, get(a.path, a.hash)->getResponseCode());
+}
+
+// Only the current fingerprint is cached forever
+void test_fingerprinted_urls() {
+    const EmbeddedAsset& a = EMBEDDED_ASSETS[0];
+    TEST_ASSERT_EQUAL_STRING("public, max-age=31536000, immutable",
+                             get(a.path, nullptr, a.hash)->getResponseHeader("Cache-Control").c_str());
+    TEST_ASSERT_EQUAL_STRING("no-cache", get(a.path, nullptr, "00000000")->getResponseHeader("Cache-Control").c_str());
+}
+
+void test_unknown_and_non_get_not_handled() {
+    auto request = get("/missing.js");
+    TEST_ASSERT_EQUAL(0, request->getSendCount());
+
+    auto post = std::make_shared<AsyncWebServerRequest>("/index.html", HTTP_POST);
+    TEST_ASSERT_FALSE(Assets.canHandle(post.get()));
+}
+
+// An override listed in /assets.txt wins over the embedded copy
+void test_override_from_littlefs() {
+    File manifest = LittleFS.open("/assets.txt", "w");
+    manifest.print("/style.css 0badc0de\n");
+    manifest.print("/too-long-hash.css 0123456789\n");
+    manifest.close();
+    File css = LittleFS.open("/www/style.css.gz", "w");
+    css.print("\x1f\x8b override");
+    css.close();
+    Assets.initAssets();
+
+    auto request = get("/style.css");
+    TEST_ASSERT_EQUAL(200, request->getResponseCode());
+    TEST_ASSERT_EQUAL_STRING("\x1f\x8b override", request->getResponseBody().c_str());
+    TEST_ASSERT_EQUAL_STRING("gzip", request->getResponseHeader("Content-Encoding").c_str());
+    TEST_ASSERT_EQUAL_STRING("\"0badc0de\"", request->getResponseHeader("ETag").c_str());
+    TEST_ASSERT_EQUAL(304, get("/style.css", "\"0badc0de\"")->getResponseCode());
+    TEST_ASSERT_EQUAL(2, Assets.getFsStats().requests);
+    TEST_ASSERT_EQUAL(1, Assets.getFsStats().notModified);
+    TEST_ASSERT_EQUAL(0, Assets.getFlashStats().requests);
+
+    // Others still come from flash
+    TEST_ASSERT_EQUAL(200, get("/index.html")->getResponseCode());
+    TEST_ASSERT_EQUAL(1, Assets.getFlashStats().requests);
+}
+
+// The dashboard is index.html plus the fingerprinted style.css and favicon.
+// Cold, everything is fetched; warm, the fingerprinted files come from the
+// browser cache and index.html revalidates to a 304.
+void test_dashboard_cold_and_warm() {
+    static const char* const PAGE[] = { "/index.html", "/style.css", "/favicon.png" };
+    static const int ROUNDS = 2000;
+
+    int cached[3];
+    for (int i = 0; i < 3; i++) {
+        cached[i] = -1;
+        for (int j = 0; j < EMBEDDED_ASSET_COUNT; j++) {
+            if (strcmp(EMBEDDED_ASSETS[j].path, PAGE[i]) == 0) {
+                cached[i] = j;
+            }
+        }
+        TEST_ASSERT_TRUE_MESSAGE(cached[i] >= 0, PAGE[i]);
+    }
+
+    size_t coldBytes = 0;
+    int coldRequests = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        coldBytes = 0;
+        coldRequests = 0;
+        for (int i = 0; i < 3; i++) {
+            const char* version = i == 0 ? nullptr : EMBEDDED_ASSETS[cached[i]].hash;
+            coldBytes += get(PAGE[i], nullptr, version)->getResponseBody().size();
+            coldRequests++;
+        }
+    }
+    double coldUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+    size_t warmBytes = 0;
+    int warmRequests = 0;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        auto request = get(PAGE[0], quoted(EMBEDDED_ASSETS[cached[0]].hash).c_str());
+        TEST_ASSERT_EQUAL(304, request->getResponseCode());
+        warmBytes = request->getResponseBody().size();
+        warmRequests = 1;
+    }
+    double warmUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+    TEST_ASSERT_EQUAL(0, warmBytes);
+    TEST_ASSERT_TRUE(coldBytes > 0);
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "dashboard cold: %d requests, %u body bytes, %.2f us; warm: %d request, %u body bytes, %.2f us (host handler time)",
+             coldRequests, (unsigned)coldBytes, coldUs, warmRequests, (unsigned)warmBytes, warmUs);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_every_asset_served);
+    RUN_TEST(test_content_types);
+    RUN_TEST(test_revalidation);
+    RUN_TEST(test_fingerprinted_urls);
+    RUN_TEST(test_unknown_and_non_get_not_handled);
+    RUN_TEST(test_override_from_littlefs);
+    RUN_TEST(test_dashboard_cold_and_warm);
+    return UNITY_END();
+}
@@ -0,0 +1,371 @@
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// Per-route cost of the firmware's own HTTP handlers. env:native leaves src/
+// out of the build, so the firmware translation unit is compiled into this
+// suite and setup() wires the real routes, router, middleware and assets to
+// the ESPAsyncWebServer double. Each request is built beforehand and only
+// server.dispatch() (plus draining a chunked body) is measured.
+//
+// Every route prints one JSON line, per request:
+//   {"route":"GET /api/status","form":"","rounds":200,"p50_ns":..,"p99_ns":..,
+//    "mean_ns":..,"allocs":..,"new":..,"alloc_bytes":..}
+// allocs counts every heap block (malloc, calloc, realloc, and operator new,
+// which goes through malloc), new the operator new calls among them. Heap use
+// of the doubles themselves (response objects, header maps) is included, as
+// the library allocates the same objects on the device. Timings are host
+// figures for comparing builds, not device latencies; scripts/loadtest.py
+// measures those on hardware. A binary OP_POWER frame on /ws is timed the
+// same way and reported next to the REST route for the same press, as a
+// "compare" line with both medians and their ratio. The socket double keeps
+// short replies inline, so the library's per-message buffer is not counted.
+//
+//   pio test -e native -f test_bench | grep -o '{"route".*}'
+
+#include "../../src/WakeOnWireless.cpp"
+
+static bool counting = false;
+static unsigned long heapBlocks = 0;
+static unsigned long heapBytes = 0;
+static unsigned long newCalls = 0;
+
+#if defined(__SANITIZE_ADDRESS__)
+// ASan owns malloc; it reports every block through these hooks instead
+extern "C" int __sanitizer_install_malloc_and_free_hooks(void (*onMalloc)(const volatile void*, size_t),
+                                                         void (*onFree)(const volatile void*));
+
+static void onMalloc(const volatile void* p, size_t size) {
+    (void)p;
+    if (counting) {
+        heapBlocks++;
+        heapBytes += size;
+    }
+}
+
+static void onFree(const volatile void* p) {
+    (void)p;
+}
+#elif defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+
+extern "C" void* malloc(size_t size) {
+    if (counting) {
+        heapBlocks++;
+        heapBytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    if (counting) {
+        heapBlocks++;
+        heapBytes += count * size;
+    }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size) {
+    if (counting) {
+        heapBlocks++;
+        heapBytes += size;
+    }
+    return __libc_realloc(p, size);
+}
+#endif
+
+void* operator new(size_t size) {
+    if (counting) {
+        newCalls++;
+    }
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+static const int ROUNDS = 200;
+static const int POWER_ROUNDS = 50;     // each one waits for the press to finish
+
+struct Route {
+    WebRequestMethodComposite method;
+    const char* url;        // may carry a query string
+    const char* form;       // "name=value&..." POST fields, or nullptr
+    int code;
+};
+
+// The loop at its 10 ms tick, as on the device
+static void runFor(unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += 10) {
+        Hal.advance(10);
+        loop();
+    }
+}
+
+static const char* methodName(WebRequestMethodComposite method) {
+    switch (method) {
+        case HTTP_GET:    return "GET";
+        case HTTP_POST:   return "POST";
+        case HTTP_PUT:    return "PUT";
+        case HTTP_DELETE: return "DELETE";
+        default:          return "ANY";
+    }
+}
+
+static void addParams(AsyncWebServerRequest* request, const std::string& fields, bool post) {
+    size_t pos = 0;
+    while (pos < fields.size()) {
+        size_t amp = fields.find('&', pos);
+        std::string field = fields.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+        size_t eq = field.find('=');
+        request->setParam(field.substr(0, eq).c_str(), field.substr(eq + 1).c_str(), post);
+        pos = amp == std::string::npos ? fields.size() : amp + 1;
+    }
+}
+
+static std::shared_ptr<AsyncWebServerRequest> build(const Route& route) {
+    std::string url = route.url;
+    size_t query = url.find('?');
+    auto request = std::make_shared<AsyncWebServerRequest>(url.substr(0, query).c_str(), route.method);
+    if (query != std::string::npos) {
+        addParams(request.get(), url.substr(query + 1), false);
+    }
+    if (route.form != nullptr) {
+        addParams(request.get(), route.form, true);
+    }
+    return request;
+}
+
+// Runs one request of the route with the counters on; returns its time in ns
+static double serve(const Route& route) {
+    auto request = build(route);
+
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+    server.dispatch(request.get());
+    AsyncChunkedResponse* chunked = dynamic_cast<AsyncChunkedResponse*>(request->getResponse());
+    if (chunked != nullptr) {
+        chunked->drain(1460);
+    }
+    auto end = std::chrono::steady_clock::now();
+    counting = false;
+
+    char name[96];
+    snprintf(name, sizeof(name), "%s %s", methodName(route.method), route.url);
+    TEST_ASSERT_EQUAL_MESSAGE(route.code, request->getResponseCode(), name);
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+struct Figures {
+    double p50Ns;
+    double allocs;
+};
+
+// Reports one JSON line for rounds of step(), which returns its time in ns;
+// settleMs lets queued power commands finish between rounds so every round
+// takes the enqueue path rather than coalescing
+template <typename Step>
+static Figures bench(const char* route, const char* form, int rounds, unsigned long settleMs, Step step) {
+    std::vector<double> ns;
+    ns.reserve(rounds);
+
+    // Static buffers and first-use initialisation stay out of the figures
+    step();
+    runFor(settleMs);
+
+    heapBlocks = 0;
+    heapBytes = 0;
+    newCalls = 0;
+    for (int i = 0; i < rounds; i++) {
+        ns.push_back(step());
+        runFor(settleMs);
+    }
+
+    double total = 0;
+    for (double n : ns) {
+        total += n;
+    }
+    std::sort(ns.begin(), ns.end());
+
+    Figures figures = { ns[rounds / 2], (double)heapBlocks / rounds };
+    char msg[320];
+    snprintf(msg, sizeof(msg),
+             "{\"route\":\"%s\",\"form\":\"%s\",\"rounds\":%d,\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"mean_ns\":%.0f,"
+             "\"allocs\":%.1f,\"new\":%.1f,\"alloc_bytes\":%.0f}",
+             route, form, rounds, figures.p50Ns, ns[rounds * 99 / 100], total / rounds,
+             figures.allocs, (double)newCalls / rounds, (double)heapBytes / rounds);
+    TEST_MESSAGE(msg);
+    return figures;
+}
+
+static Figures bench(const Route& route, int rounds, unsigned long settleMs = 0) {
+    char name[96];
+    snprintf(name, sizeof(name), "%s %s", methodName(route.method), route.url);
+    return bench(name, route.form ? route.form : "", rounds, settleMs, [&route]() { return serve(route); });
+}
+
+// Delivers one binary message to the socket handler with the counters on and
+// checks the first reply is an ACK_OK; returns its time in ns
+static double sendFrame(AsyncWebSocketClient* client, const uint8_t* frame, size_t len) {
+    client->clearSent();
+
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+    ws.message(client, frame, len, true);
+    auto end = std::chrono::steady_clock::now();
+    counting = false;
+
+    TEST_ASSERT_EQUAL(1, client->getSent().size());
+    const std::string& reply = client->getSent()[0].data;
+    TEST_ASSERT_TRUE(reply.size() > WsProtoClass::HEADER_SIZE);
+    TEST_ASSERT_EQUAL(WsProtoClass::OP_ACK, (uint8_t)reply[0]);
+    TEST_ASSERT_EQUAL(WsProtoClass::ACK_OK, (uint8_t)reply[WsProtoClass::HEADER_SIZE]);
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// Two named channels, station credentials and a scan result, then the
+// firmware's own setup() and a connect
+static void boot() {
+    Hal.reset();
+    WiFi.reset();
+    LittleFS.format();
+    WiFi.addNetwork("home", -50, 6);
+
+    Filesys.initFS();
+    Config.set(ConfigClass::SSID, "home");
+    Config.set(ConfigClass::PASS, "secret");
+    Config.commit();
+    File channels = LittleFS.open("/channels.txt", "w");
+    channels.write((const uint8_t*)"5 500 5000 desk\n4 500 5000 nas\n", 31);
+    channels.close();
+
+    setup();
+    runFor(1000);
+    WiFi.gotIP();
+    runFor(1000);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_boot() {
+    TEST_ASSERT_TRUE(server.isStarted());
+    TEST_ASSERT_EQUAL(WL_CONNECTED, WiFi.status());
+    TEST_ASSERT_EQUAL(2, Power.getChannelCount());
+    TEST_ASSERT_EQUAL_STRING("nas", Power.getChannelName(1));
+}
+
+void test_read_routes() {
+    static const Route ROUTES[] = {
+        { HTTP_GET, "/", nullptr, 200 },
+        { HTTP_GET, "/api/firmware", nullptr, 200 },
+        { HTTP_GET, "/api/status", nullptr, 200 },
+        { HTTP_GET, "/metrics", nullptr, 200 },
+        { HTTP_GET, "/api/channels", nullptr, 200 },
+        { HTTP_GET, "/api/power", nullptr, 200 },
+        { HTTP_GET, "/api/schedule", nullptr, 200 },
+        { HTTP_GET, "/api/wol/targets", nullptr, 200 },
+        { HTTP_GET, "/api/wol/relay", nullptr, 200 },
+        { HTTP_GET, "/api/fleet", nullptr, 200 },
+        { HTTP_GET, "/console", nullptr, 200 },
+        { HTTP_GET, "/no/such/page", nullptr, 404 },
+    };
+    for (const Route& route : ROUTES) {
+        bench(route, ROUNDS);
+    }
+}
+
+void test_power_routes() {
+    static const Route ROUTES[] = {
+        { HTTP_PUT, "/api/state/ON", nullptr, 202 },
+        { HTTP_PUT, "/api/state/1/ON", nullptr, 202 },
+        { HTTP_PUT, "/api/state/nas/ON", nullptr, 202 },
+        { HTTP_PUT, "/api/state/9/ON", nullptr, 404 },
+        { HTTP_POST, "/api/power", "channel=1&pattern=200,300,200", 202 },
+        { HTTP_POST, "/api/power", "pattern=0", 400 },
+    };
+    unsigned long submitted = Power.getSubmitted();
+    for (const Route& route : ROUTES) {
+        bench(route, POWER_ROUNDS, 4000);
+    }
+
+    // Every accepted round was a new command, none coalesced
+    TEST_ASSERT_EQUAL(submitted + 4 * (POWER_ROUNDS + 1), Power.getSubmitted());
+    TEST_ASSERT_EQUAL(0, Power.getQueueDepth());
+}
+
+// The same short press on channel 0 from the REST route and as an OP_POWER
+// frame on an open socket, with that socket connected for both
+void test_http_vs_websocket() {
+    AsyncWebSocketClient* client = ws.connect();
+    runFor(100);
+
+    Figures http = bench({ HTTP_PUT, "/api/state/0/ON", nullptr, 202 }, POWER_ROUNDS, 4000);
+
+    // op, id, len (little endian), then channel 0 and a short press
+    static const uint8_t FRAME[] = { WsProtoClass::OP_POWER, 1, 0, 2, 0, 0, 0 };
+    Figures socket = bench("WS OP_POWER", "channel=0&action=0", POWER_ROUNDS, 4000,
+                           [client]() { return sendFrame(client, FRAME, sizeof(FRAME)); });
+
+    char msg[160];
+    snprintf(msg, sizeof(msg),
+             "{\"compare\":\"PUT /api/state/0/ON vs WS OP_POWER\",\"http_p50_ns\":%.0f,\"ws_p50_ns\":%.0f,"
+             "\"p50_ratio\":%.2f,\"http_allocs\":%.1f,\"ws_allocs\":%.1f}",
+             http.p50Ns, socket.p50Ns, http.p50Ns / socket.p50Ns, http.allocs, socket.allocs);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(0, Power.getQueueDepth());
+}
+
+// Status lookup of a command that finished
+void test_command_lookup() {
+    auto request = std::make_shared<AsyncWebServerRequest>("/api/state/ON", HTTP_PUT);
+    server.dispatch(request.get());
+    TEST_ASSERT_EQUAL(202, request->getResponseCode());
+    std::string location = request->getResponseHeader("Location");
+    runFor(4000);
+
+    bench({ HTTP_GET, location.c_str(), nullptr, 200 }, ROUNDS);
+}
+
+int main(int argc, char** argv) {
+#if defined(__SANITIZE_ADDRESS__)
+    __sanitizer_install_malloc_and_free_hooks(onMalloc, onFree);
+#endif
+    boot();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_boot);
+    RUN_TEST(test_read_routes);
+    RUN_TEST(test_power_routes);
+    RUN_TEST(test_http_vs_websocket);
+    RUN_TEST(test_command_lookup);
+    return UNITY_END();
+}
@@ -0,0 +1,152 @@
+#include <unity.h>
+#include <chrono>
+#include <Hal.h>
+#include <Power.h>
+
+// A full table of 32 channels, six on GPIO and the rest on a 74HC595 chain,
+// all pressed at once. The one timer interrupt serving every channel has to
+// give each its own exact width.
+
+static const char* TABLE =
+    "# pin short long name\n"
+    "595 0 2 15\r\n"
+    "4 100 5000 pc0\n"
+    "5 110 5000 pc1\n"
+    "12 120 5000 pc2\n"
+    "13 130 5000 pc3\n"
+    "14 140 5000 pc4\n"
+    "16 150 5000 pc5\n"
+    "3 500 70000 wraps\n"
+    "this line is ignored\n";
+
+static unsigned long shortWidth(uint8_t ch) {
+    return 100 + 10 * ch;
+}
+
+static void runFor(unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += 10) {
+        Hal.advance(10);
+        Power.handlePowerStateMachine();
+    }
+}
+
+void setUp() {
+    runFor(10000);
+    Hal.reset();
+}
+
+void tearDown() {
+}
+
+void test_table_loaded() {
+    TEST_ASSERT_EQUAL(PowerClass::MAX_CHANNELS, Power.getChannelCount());
+    TEST_ASSERT_EQUAL(5, Power.getChannelPin(1));
+    TEST_ASSERT_EQUAL(HalClass::EXPANDER_BASE, Power.getChannelPin(6));
+    TEST_ASSERT_EQUAL(HalClass::EXPANDER_BASE + 25, Power.getChannelPin(31));
+
+    TEST_ASSERT_EQUAL(3, Power.findChannel("PC3"));
+    TEST_ASSERT_EQUAL(31, Power.findChannel("31"));
+    TEST_ASSERT_EQUAL(-1, Power.findChannel("32"));
+    TEST_ASSERT_EQUAL(-1, Power.findChannel("nas"));
+    TEST_ASSERT_EQUAL(-1, Power.findChannel("wraps"));
+
+    // No bit left in the interrupt masks for a 33rd
+    TEST_ASSERT_EQUAL(-1, Power.addChannel("extra", 3));
+}
+
+// Every channel pressed in the same loop pass: the first edges land together,
+// each release lands on its own width
+void test_all_channels_simultaneous() {
+    uint32_t ids[PowerClass::MAX_CHANNELS];
+
+    // The queue holds half the table; the first half is dispatched before the
+    // rest is queued, all within the same millisecond
+    for (uint8_t ch = 0; ch < PowerClass::MAX_CHANNELS; ch++) {
+        if (ch == PowerClass::QUEUE_SIZE) {
+            Power.handlePowerStateMachine();
+        }
+        ids[ch] = Power.pressShort(ch, PowerClass::SRC_HTTP);
+        TEST_ASSERT_NOT_EQUAL(0, ids[ch]);
+    }
+    Power.handlePowerStateMachine();
+    unsigned long dispatchedAt = Hal.micros();
+    runFor(1000);
+
+    TEST_ASSERT_EQUAL(2 * PowerClass::MAX_CHANNELS, Hal.getEdgeCount());
+    for (uint8_t ch = 0; ch < PowerClass::MAX_CHANNELS; ch++) {
+        uint8_t pin = Power.getChannelPin(ch);
+        unsigned long pressed = 0;
+        unsigned long released = 0;
+        for (size_t i = 0; i < Hal.getEdgeCount(); i++) {
+            const HalClass::Edge& e = Hal.getEdge(i);
+            if (e.pin == pin) {
+                (e.level == HIGH ? pressed : released) = e.atMicros;
+            }
+        }
+        TEST_ASSERT_EQUAL_UINT32(dispatchedAt + PowerClass::PRE_PRESS_DELAY * 1000, pressed);
+        TEST_ASSERT_EQUAL_UINT32(shortWidth(ch) * 1000, released - pressed);
+        TEST_ASSERT_EQUAL(LOW, Hal.digitalRead(pin));
+
+        PowerClass::Command cmd;
+        TEST_ASSERT_TRUE(Power.getCommand(ids[ch], cmd));
+        TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, cmd.status);
+        TEST_ASSERT_EQUAL_UINT32(shortWidth(ch) * 1000, cmd.actualWidth);
+        TEST_ASSERT_EQUAL_UINT32(0, cmd.maxJitter);
+    }
+}
+
+// A long press on one channel does not hold up the others behind it
+void test_busy_channel_does_not_block_others() {
+    uint32_t longId = Power.pressLong(0, PowerClass::SRC_HTTP);
+    runFor(200);
+    uint32_t again = Power.submit(0, 300, PowerClass::SRC_HTTP);
+    uint32_t other = Power.pressShort(7, PowerClass::SRC_HTTP);
+    runFor(1000);
+
+    PowerClass::Command cmd;
+    TEST_ASSERT_TRUE(Power.getCommand(other, cmd));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, cmd.status);
+    TEST_ASSERT_TRUE(Power.getCommand(again, cmd));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_QUEUED, cmd.status);
+    TEST_ASSERT_EQUAL(PowerClass::HOLDING, Power.getState(0));
+
+    runFor(6000);
+    TEST_ASSERT_TRUE(Power.getCommand(longId, cmd));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, cmd.status);
+    TEST_ASSERT_TRUE(Power.getCommand(again, cmd));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, cmd.status);
+}
+
+// With nothing queued and nothing reported, a pass is a few mask reads
+// whatever the channel count
+void test_idle_pass_cost() {
+    static const int PASSES = 1000000;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < PASSES; i++) {
+        Power.handlePowerStateMachine();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / PASSES;
+
+    TEST_ASSERT_EQUAL(0, Hal.getEdgeCount());
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%.1f ns per idle pass with %u channels on the host", ns, Power.getChannelCount());
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    Power.initPower();
+    Power.loadChannels(TABLE);
+    for (uint8_t ch = Power.getChannelCount(); ch < PowerClass::MAX_CHANNELS; ch++) {
+        char name[8];
+        snprintf(name, sizeof(name), "pc%u", ch);
+        Power.addChannel(name, HalClass::EXPANDER_BASE + ch - 6, shortWidth(ch));
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_table_loaded);
+    RUN_TEST(test_all_channels_simultaneous);
+    RUN_TEST(test_busy_channel_does_not_block_others);
+    RUN_TEST(test_idle_pass_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,225 @@
+#include <unity.h>
+#include <Hal.h>
+#include <Config.h>
+
+// The packed config record on the in-memory LittleFS. reboot() drops the RAM
+// copy, mounts and loads again from "flash", as a power cycle would.
+
+static void reboot() {
+    Config = ConfigClass();
+    Filesys = FilesysClass();
+    Filesys.initFS();
+}
+
+// loopConfig() runs every pass of loop()
+static void runFor(unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += 10) {
+        Hal.advance(10);
+        Config.loopConfig();
+    }
+}
+
+void setUp() {
+    Hal.reset();
+    LittleFS.format();
+    reboot();
+}
+
+void tearDown() {
+}
+
+void test_fresh_flash_is_empty() {
+    TEST_ASSERT_EQUAL_STRING("", Config.get(ConfigClass::SSID));
+    TEST_ASSERT_FALSE(Config.isDirty());
+    TEST_ASSERT_EQUAL(0, LittleFS.getWriteCount());
+}
+
+// A burst of changes costs one flash write, WRITE_DELAY after the last one
+void test_changes_coalesce_into_one_write() {
+    Config.set(ConfigClass::SSID, "home");
+    runFor(500);
+    Config.set(ConfigClass::PASS, "secret");
+    Config.set(ConfigClass::DEV_NAME, "desk");
+    Config.set(ConfigClass::TIMEZONE, "CET-1CEST,M3.5.0,M10.5.0/3");
+    TEST_ASSERT_EQUAL(0, LittleFS.getWriteCount());
+
+    runFor(ConfigClass::WRITE_DELAY);
+    TEST_ASSERT_FALSE(Config.isDirty());
+    TEST_ASSERT_EQUAL(1, Config.getWriteCount());
+    TEST_ASSERT_EQUAL(1, LittleFS.getWriteCount());
+
+    runFor(10000);
+    TEST_ASSERT_EQUAL(1, Config.getWriteCount());
+
+    reboot();
+    TEST_ASSERT_EQUAL_STRING("home", Config.get(ConfigClass::SSID));
+    TEST_ASSERT_EQUAL_STRING("secret", Config.get(ConfigClass::PASS));
+    TEST_ASSERT_EQUAL_STRING("desk", Config.get(ConfigClass::DEV_NAME));
+    TEST_ASSERT_EQUAL_STRING("CET-1CEST,M3.5.0,M10.5.0/3", Config.get(ConfigClass::TIMEZONE));
+}
+
+// Changes keep pushing the write out until they stop
+void test_each_change_restarts_delay() {
+    for (int i = 0; i < 5; i++) {
+        Config.set(ConfigClass::DEV_NAME, i % 2 ? "desk" : "shelf");
+        runFor(ConfigClass::WRITE_DELAY - 500);
+    }
+    TEST_ASSERT_EQUAL(0, Config.getWriteCount());
+
+    runFor(500);
+    TEST_ASSERT_EQUAL(1, Config.getWriteCount());
+    TEST_ASSERT_FALSE(Config.isDirty());
+}
+
+// A failing write backs off up to MAX_RETRY_DELAY instead of retrying every pass
+void test_failed_write_backs_off() {
+    LittleFS.setFull(true);
+    Config.set(ConfigClass::SSID, "home");
+
+    // Attempts at 2, 6, 14, 30, 62, 122, 182 s
+    runFor(190000);
+    TEST_ASSERT_TRUE(Config.isDirty());
+    TEST_ASSERT_EQUAL(0, Config.getWriteCount());
+
+    LittleFS.setFull(false);
+    runFor(ConfigClass::MAX_RETRY_DELAY - 10000);
+    TEST_ASSERT_TRUE(Config.isDirty());
+    runFor(10000);
+    TEST_ASSERT_FALSE(Config.isDirty());
+    TEST_ASSERT_EQUAL(1, Config.getWriteCount());
+
+    // Back to the normal delay after a success
+    Config.set(ConfigClass::SSID, "office");
+    runFor(ConfigClass::WRITE_DELAY);
+    TEST_ASSERT_EQUAL(2, Config.getWriteCount());
+}
+
+// Without a mounted filesystem nothing is written and changes stay in RAM
+void test_unmounted_filesystem_not_written() {
+    LittleFS.setMountFails(true);
+    reboot();
+    TEST_ASSERT_FALSE(Filesys.isMounted());
+
+    Config.set(ConfigClass::SSID, "home");
+    TEST_ASSERT_FALSE(Config.commit());
+    runFor(ConfigClass::WRITE_DELAY * 4);
+    TEST_ASSERT_EQUAL(0, LittleFS.getWriteCount());
+    TEST_ASSERT_TRUE(Config.isDirty());
+    TEST_ASSERT_EQUAL_STRING("home", Config.get(ConfigClass::SSID));
+}
+
+void test_unchanged_value_does_not_dirty() {
+    Config.set(ConfigClass::SSID, "home");
+    TEST_ASSERT_TRUE(Config.commit());
+
+    Config.set(ConfigClass::SSID, "home");
+    TEST_ASSERT_FALSE(Config.isDirty());
+    runFor(ConfigClass::WRITE_DELAY * 2);
+    TEST_ASSERT_EQUAL(1, Config.getWriteCount());
+}
+
+void test_too_long_value_rejected() {
+    char longName[64];
+    memset(longName, 'x', sizeof(longName) - 1);
+    longName[sizeof(longName) - 1] = '\0';
+
+    TEST_ASSERT_FALSE(Config.set(ConfigClass::DEV_NAME, longName));
+    TEST_ASSERT_EQUAL_STRING("", Config.get(ConfigClass::DEV_NAME));
+    TEST_ASSERT_FALSE(Config.isDirty());
+}
+
+// The record is written to the temp file and renamed over the old one
+void test_commit_writes_temp_then_renames() {
+    Config.set(ConfigClass::SSID, "home");
+    TEST_ASSERT_TRUE(Config.commit());
+    TEST_ASSERT_EQUAL(1, LittleFS.getRenameCount());
+    TEST_ASSERT_TRUE(LittleFS.exists("/config.bin"));
+    TEST_ASSERT_FALSE(LittleFS.exists("/config.tmp"));
+}
+
+// Power lost after the temp file was written but before the rename: the old
+// record is still the one that loads
+void test_interrupted_write_keeps_old_record() {
+    Config.set(ConfigClass::SSID, "old");
+    Config.commit();
+
+    File partial = LittleFS.open("/config.tmp", "w");
+    partial.print("half a record");
+    partial.close();
+
+    reboot();
+    TEST_ASSERT_EQUAL_STRING("old", Config.get(ConfigClass::SSID));
+}
+
+void test_corrupted_record_rejected() {
+    Config.set(ConfigClass::SSID, "home");
+    Config.commit();
+
+    // Flip one byte of the body; the CRC no longer matches
+    File file = LittleFS.open("/config.bin", "r");
+    uint8_t buf[1024];
+    size_t size = file.read(buf, sizeof(buf));
+    file.close();
+    buf[size / 2] ^= 0x40;
+    file = LittleFS.open("/config.bin", "w");
+    file.write(buf, size);
+    file.close();
+
+    reboot();
+    TEST_ASSERT_EQUAL_STRING("", Config.get(ConfigClass::SSID));
+}
+
+void test_truncated_record_rejected() {
+    Config.set(ConfigClass::SSID, "home");
+    Config.commit();
+
+    File file = LittleFS.open("/config.bin", "r");
+    uint8_t buf[1024];
+    size_t size = file.read(buf, sizeof(buf));
+    file.close();
+    file = LittleFS.open("/config.bin", "w");
+    file.write(buf, size - 10);
+    file.close();
+
+    reboot();
+    TEST_ASSERT_EQUAL_STRING("", Config.get(ConfigClass::SSID));
+}
+
+// Per-setting text files from older firmware are imported once and removed
+void test_legacy_files_migrated() {
+    LittleFS.format();
+    File file = LittleFS.open("/ssid.txt", "w");
+    file.print("legacy-net\n");
+    file.close();
+    file = LittleFS.open("/pass.txt", "w");
+    file.print("legacy-pass\n");
+    file.close();
+
+    reboot();
+    TEST_ASSERT_EQUAL_STRING("legacy-net", Config.get(ConfigClass::SSID));
+    TEST_ASSERT_EQUAL_STRING("legacy-pass", Config.get(ConfigClass::PASS));
+    TEST_ASSERT_FALSE(LittleFS.exists("/ssid.txt"));
+    TEST_ASSERT_FALSE(LittleFS.exists("/pass.txt"));
+    TEST_ASSERT_TRUE(LittleFS.exists("/config.bin"));
+
+    reboot();
+    TEST_ASSERT_EQUAL_STRING("legacy-net", Config.get(ConfigClass::SSID));
+    TEST_ASSERT_EQUAL(0, Config.getWriteCount());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fresh_flash_is_empty);
+    RUN_TEST(test_changes_coalesce_into_one_write);
+    RUN_TEST(test_each_change_restarts_delay);
+    RUN_TEST(test_failed_write_backs_off);
+    RUN_TEST(test_unmounted_filesystem_not_written);
+    RUN_TEST(test_unchanged_value_does_not_dirty);
+    RUN_TEST(test_too_long_value_rejected);
+    RUN_TEST(test_commit_writes_temp_then_renames);
+    RUN_TEST(test_interrupted_write_keeps_old_record);
+    RUN_TEST(test_corrupted_record_rejected);
+    RUN_TEST(test_truncated_record_rejected);
+    RUN_TEST(test_legacy_files_migrated);
+    return UNITY_END();
+}
@@ -0,0 +1,296 @@
+#include <unity.h>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <Delta.h>
+
+// The streaming patch applier: a patch fed in upload-sized chunks must
+// rebuild the same image as one fed whole, go through the writer in full
+// windows, and reject headers, truncations and ops that do not fit. Patches
+// are built here from the format in Delta.h, against a generated image.
+
+typedef std::vector<uint8_t> Bytes;
+
+static void put32(Bytes& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(v >> (8 * i)));
+    }
+}
+
+// Records ops and the image they produce side by side
+struct Builder {
+    const Bytes& old;
+    Bytes image;
+    Bytes ops;
+
+    explicit Builder(const Bytes& old) : old(old) {}
+
+    void copy(uint32_t offset, uint32_t len) {
+        ops.push_back(0x01);
+        put32(ops, offset);
+        put32(ops, len);
+        image.insert(image.end(), old.begin() + offset, old.begin() + offset + len);
+    }
+
+    void insert(const Bytes& data) {
+        ops.push_back(0x02);
+        put32(ops, data.size());
+        ops.insert(ops.end(), data.begin(), data.end());
+        image.insert(image.end(), data.begin(), data.end());
+    }
+
+    Bytes finish(uint32_t newSize) {
+        Bytes patch = { 'W', 'W', 'D', '1' };
+        put32(patch, old.size());
+        for (size_t i = 0; i < DeltaPatch::MD5_SIZE; i++) {
+            patch.push_back(0xA0 + i);
+        }
+        put32(patch, newSize);
+        for (size_t i = 0; i < DeltaPatch::MD5_SIZE; i++) {
+            patch.push_back(0xB0 + i);
+        }
+        patch.insert(patch.end(), ops.begin(), ops.end());
+        patch.push_back(0x00);
+        return patch;
+    }
+    Bytes finish() { return finish(image.size()); }
+};
+
+static Bytes noise(size_t len, unsigned seed) {
+    srand(seed);
+    Bytes out(len);
+    for (uint8_t& b : out) {
+        b = (uint8_t)rand();
+    }
+    return out;
+}
+
+static Bytes oldImage;
+static Bytes output;
+static std::vector<size_t> writes;
+static int headers = 0;
+static bool acceptHeader = true;
+static bool writerFails = false;
+static DeltaPatch patcher;
+
+static void start() {
+    output.clear();
+    writes.clear();
+    headers = 0;
+    patcher.begin(
+        [](const DeltaPatch::Header&) {
+            headers++;
+            return acceptHeader;
+        },
+        [](uint32_t offset, uint8_t* out, size_t len) {
+            memcpy(out, oldImage.data() + offset, len);
+            return true;
+        },
+        [](const uint8_t* data, size_t len) {
+            writes.push_back(len);
+            output.insert(output.end(), data, data + len);
+            return !writerFails;
+        });
+}
+
+// Feeds in chunks; every result before the last must be DELTA_MORE
+static DeltaPatch::Result applyPatch(const Bytes& patch, size_t chunk) {
+    start();
+    DeltaPatch::Result result = DeltaPatch::DELTA_MORE;
+    for (size_t pos = 0; pos < patch.size(); pos += chunk) {
+        TEST_ASSERT_EQUAL(DeltaPatch::DELTA_MORE, result);
+        size_t n = patch.size() - pos < chunk ? patch.size() - pos : chunk;
+        result = patcher.feed(patch.data() + pos, n);
+    }
+    return result;
+}
+
+// A firmware-like edit: shifted code, a patched table, a new string section
+static Bytes typicalPatch(Bytes* image) {
+    Builder b(oldImage);
+    b.copy(0, 4096);
+    b.insert(noise(300, 2));
+    b.copy(4096 + 200, 20000);
+    b.insert(noise(3000, 3));
+    b.copy(30000, 1);
+    b.insert(Bytes());
+    b.copy(40000, 0);
+    b.copy(2048, 9000);
+    b.copy(oldImage.size() - 5000, 5000);
+    *image = b.image;
+    return b.finish();
+}
+
+void setUp() {
+    oldImage = noise(64 * 1024, 1);
+    acceptHeader = true;
+    writerFails = false;
+}
+
+void tearDown() {
+}
+
+void test_round_trip_chunk_sizes() {
+    Bytes expected;
+    Bytes patch = typicalPatch(&expected);
+    static const size_t CHUNKS[] = { 1, 7, 536, 1460, 65536 };
+
+    for (size_t chunk : CHUNKS) {
+        TEST_ASSERT_EQUAL(DeltaPatch::DELTA_DONE, applyPatch(patch, chunk));
+        TEST_ASSERT_EQUAL(expected.size(), patcher.getWritten());
+        TEST_ASSERT_EQUAL(expected.size(), output.size());
+        TEST_ASSERT_EQUAL_MEMORY(expected.data(), output.data(), expected.size());
+        TEST_ASSERT_EQUAL(1, headers);
+
+        // Full windows only, except the tail
+        for (size_t i = 0; i + 1 < writes.size(); i++) {
+            TEST_ASSERT_EQUAL(DeltaPatch::WINDOW_SIZE, writes[i]);
+        }
+        TEST_ASSERT_TRUE(writes.back() > 0 && writes.back() <= DeltaPatch::WINDOW_SIZE);
+    }
+}
+
+void test_header_fields() {
+    Builder b(oldImage);
+    b.copy(0, 100);
+    Bytes patch = b.finish();
+
+    start();
+    for (size_t i = 0; i + 1 < DeltaPatch::HEADER_SIZE; i++) {
+        patcher.feed(patch.data() + i, 1);
+    }
+    TEST_ASSERT_EQUAL(0, headers);
+    patcher.feed(patch.data() + DeltaPatch::HEADER_SIZE - 1, 1);
+    TEST_ASSERT_EQUAL(1, headers);
+
+    const DeltaPatch::Header& h = patcher.getHeader();
+    TEST_ASSERT_EQUAL(oldImage.size(), h.oldSize);
+    TEST_ASSERT_EQUAL(100, h.newSize);
+    TEST_ASSERT_EQUAL_HEX8(0xA0, h.oldMd5[0]);
+    TEST_ASSERT_EQUAL_HEX8(0xBF, h.newMd5[DeltaPatch::MD5_SIZE - 1]);
+}
+
+void test_header_rejected() {
+    Builder b(oldImage);
+    b.copy(0, 100);
+    Bytes patch = b.finish();
+
+    acceptHeader = false;
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, applyPatch(patch, patch.size()));
+    TEST_ASSERT_EQUAL_STRING("patch does not apply to the running image", patcher.getError());
+    TEST_ASSERT_EQUAL(0, output.size());
+
+    acceptHeader = true;
+    patch[3] = '2';
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, applyPatch(patch, patch.size()));
+    TEST_ASSERT_EQUAL_STRING("not a delta patch", patcher.getError());
+    TEST_ASSERT_EQUAL(0, headers);
+}
+
+// A patch cut anywhere never completes, and an early END is an error
+void test_truncated_patch() {
+    Bytes expected;
+    Bytes patch = typicalPatch(&expected);
+
+    for (size_t cut = 1; cut < patch.size(); cut += 97) {
+        Bytes part(patch.begin(), patch.begin() + cut);
+        TEST_ASSERT_EQUAL(DeltaPatch::DELTA_MORE, applyPatch(part, 536));
+    }
+
+    Builder b(oldImage);
+    b.copy(0, 100);
+    Bytes shortPatch = b.finish(101);
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, applyPatch(shortPatch, 7));
+    TEST_ASSERT_EQUAL_STRING("patch ended before the new image was complete", patcher.getError());
+}
+
+// Ops reaching outside either image fail before anything is read or written
+void test_ops_out_of_range() {
+    struct Case {
+        uint32_t offset;
+        uint32_t len;
+    };
+    const uint32_t size = oldImage.size();
+    const Case copies[] = {
+        { size, 1 },
+        { size - 10, 11 },
+        { size + 1, 0 },
+        { 1, 0xFFFFFFFF },
+        { 0, 201 },             // past the announced new size
+    };
+
+    for (const Case& c : copies) {
+        Builder b(oldImage);
+        Bytes patch = b.finish(200);
+        patch.pop_back();
+        patch.push_back(0x01);
+        put32(patch, c.offset);
+        put32(patch, c.len);
+        TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, applyPatch(patch, 5));
+        TEST_ASSERT_EQUAL_STRING("copy out of range or write failed", patcher.getError());
+        TEST_ASSERT_EQUAL(0, output.size());
+    }
+
+    Builder b(oldImage);
+    Bytes patch = b.finish(200);
+    patch.pop_back();
+    patch.push_back(0x02);
+    put32(patch, 201);
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, applyPatch(patch, patch.size()));
+    TEST_ASSERT_EQUAL_STRING("insert past the new image size", patcher.getError());
+
+    patch = b.finish(0);
+    patch.back() = 0x07;
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, applyPatch(patch, patch.size()));
+    TEST_ASSERT_EQUAL_STRING("unknown op", patcher.getError());
+}
+
+// Errors stick, and nothing may follow END
+void test_errors_are_final() {
+    Builder b(oldImage);
+    b.copy(0, 10);
+    Bytes patch = b.finish();
+
+    patch.push_back(0x00);
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, applyPatch(patch, patch.size()));
+    TEST_ASSERT_EQUAL_STRING("data after the end of the patch", patcher.getError());
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, patcher.feed(patch.data(), 1));
+
+    patch.pop_back();
+    writerFails = true;
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_ERROR, applyPatch(patch, patch.size()));
+    TEST_ASSERT_EQUAL_STRING("write failed", patcher.getError());
+}
+
+void test_throughput() {
+    oldImage = noise(1024 * 1024, 4);
+    Builder b(oldImage);
+    for (uint32_t offset = 0; offset < oldImage.size(); offset += 16384) {
+        b.copy(offset, 16000);
+        b.insert(noise(384, offset));
+    }
+    Bytes patch = b.finish();
+
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL(DeltaPatch::DELTA_DONE, applyPatch(patch, 1460));
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_EQUAL(b.image.size(), output.size());
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%.0f MB/s applied on the host, %u bytes of patcher state",
+             b.image.size() / s / 1e6, (unsigned)sizeof(DeltaPatch));
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_chunk_sizes);
+    RUN_TEST(test_header_fields);
+    RUN_TEST(test_header_rejected);
+    RUN_TEST(test_truncated_patch);
+    RUN_TEST(test_ops_out_of_range);
+    RUN_TEST(test_errors_are_final);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
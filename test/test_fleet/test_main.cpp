@@ -0,0 +1,320 @@
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include <Hal.h>
+#include <Power.h>
+#include <Fleet.h>
+
+// Heartbeats and commands on the fleet group: parsing, the bounded peer
+// table and its replacement of the stalest entry, command deduplication, and
+// the multicast socket path. Packets are built here from the wire format in
+// Fleet.h rather than with the class under test.
+
+static const uint16_t MAGIC = 0x5746;
+static const uint32_t PEER = 0x00A1B2C3;
+
+struct Capture : public Print {
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+};
+
+static int commands = 0;
+static uint8_t lastChannel = 0xFF;
+static bool lastOn = false;
+
+static size_t put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return 2;
+}
+
+static size_t put32(uint8_t* p, uint32_t v) {
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+    return 4;
+}
+
+static size_t header(uint8_t* out, uint8_t type, uint32_t chip) {
+    put16(out, MAGIC);
+    out[2] = 1;
+    out[3] = type;
+    return 4 + put32(out + 4, chip);
+}
+
+static size_t heartbeat(uint8_t* out, uint32_t chip, uint8_t pc = ProberClass::PC_ON,
+                        const char* version = "1.4.0", const char* name = "desk") {
+    size_t pos = header(out, FleetClass::PKT_HEARTBEAT, chip);
+    pos += put16(out + pos, 7);
+    pos += put32(out + pos, 3600);
+    out[pos++] = (uint8_t)-60;
+    out[pos++] = pc;
+    out[pos++] = 2;
+    pos += put32(out + pos, 0);
+    out[pos] = (uint8_t)strlen(version);
+    memcpy(out + pos + 1, version, strlen(version));
+    pos += 1 + strlen(version);
+    out[pos] = (uint8_t)strlen(name);
+    memcpy(out + pos + 1, name, strlen(name));
+    return pos + 1 + strlen(name);
+}
+
+static size_t command(uint8_t* out, uint32_t sender, uint16_t nonce, uint32_t target, uint8_t channel, bool on) {
+    size_t pos = header(out, FleetClass::PKT_COMMAND, sender);
+    pos += put16(out + pos, nonce);
+    pos += put32(out + pos, target);
+    out[pos++] = channel;
+    out[pos++] = on;
+    return pos;
+}
+
+static std::string json() {
+    Capture out;
+    Fleet.writeJson(out);
+    return out.text;
+}
+
+static bool contains(const std::string& s, const char* part) {
+    return s.find(part) != std::string::npos;
+}
+
+void setUp() {
+    Hal.reset();
+    Hal.advance(1000);
+    WiFiUDP::clearSent();
+    commands = 0;
+    lastChannel = 0xFF;
+    Fleet = FleetClass();
+    Fleet.initFleet("1.5.0", "rack", [](uint8_t channel, bool on) {
+        commands++;
+        lastChannel = channel;
+        lastOn = on;
+    });
+}
+
+void tearDown() {
+    Fleet.onWifiDown();
+}
+
+void test_heartbeat_parsed() {
+    uint8_t packet[FleetClass::PACKET_SIZE];
+    size_t len = heartbeat(packet, PEER, ProberClass::PC_ON, "1.4.0", "desk \"2\"");
+    TEST_ASSERT_TRUE(Fleet.handlePacket(packet, len, IPAddress(192, 168, 1, 31)));
+    TEST_ASSERT_EQUAL(1, Fleet.getPeerCount());
+    TEST_ASSERT_EQUAL(1, Fleet.getOnlineCount());
+    TEST_ASSERT_EQUAL(1, Fleet.getStats().heartbeats);
+
+    std::string out = json();
+    TEST_ASSERT_TRUE(contains(out, "\"chip\":\"a1b2c3\",\"self\":false,\"name\":\"desk \\\"2\\\"\""));
+    TEST_ASSERT_TRUE(contains(out, "\"version\":\"1.4.0\",\"ip\":\"192.168.1.31\",\"uptime\":3600,\"rssi\":-60"));
+    TEST_ASSERT_TRUE(contains(out, "\"pc\":\"ON\",\"channels\":2"));
+    TEST_ASSERT_TRUE(contains(out, "\"name\":\"rack\""));
+
+    // A newer heartbeat updates the entry in place
+    len = heartbeat(packet, PEER, ProberClass::PC_OFF);
+    Fleet.handlePacket(packet, len, IPAddress(192, 168, 1, 31));
+    TEST_ASSERT_EQUAL(1, Fleet.getPeerCount());
+    TEST_ASSERT_TRUE(contains(json(), "\"pc\":\"OFF\""));
+}
+
+void test_own_packets_ignored() {
+    uint8_t packet[FleetClass::PACKET_SIZE];
+    size_t len = heartbeat(packet, Fleet.getChipId());
+    TEST_ASSERT_FALSE(Fleet.handlePacket(packet, len, 0));
+    TEST_ASSERT_EQUAL(0, Fleet.getPeerCount());
+    TEST_ASSERT_EQUAL(0, Fleet.getStats().invalid);
+}
+
+// Every malformed packet is counted and none creates an entry
+void test_invalid_packets() {
+    uint8_t packet[FleetClass::PACKET_SIZE + 8];
+    size_t len = heartbeat(packet, PEER);
+    unsigned long invalid = 0;
+
+    TEST_ASSERT_FALSE(Fleet.handlePacket(packet, 7, 0));
+    TEST_ASSERT_EQUAL(++invalid, Fleet.getStats().invalid);
+
+    packet[0] ^= 0xFF;
+    TEST_ASSERT_FALSE(Fleet.handlePacket(packet, len, 0));
+    packet[0] ^= 0xFF;
+    packet[2] = 2;
+    TEST_ASSERT_FALSE(Fleet.handlePacket(packet, len, 0));
+    packet[2] = 1;
+    packet[3] = 9;
+    TEST_ASSERT_FALSE(Fleet.handlePacket(packet, len, 0));
+    packet[3] = FleetClass::PKT_HEARTBEAT;
+    invalid += 3;
+    TEST_ASSERT_EQUAL(invalid, Fleet.getStats().invalid);
+
+    // Cut anywhere inside the strings, or a string too long for its field
+    for (size_t cut = 8; cut < len; cut++) {
+        Fleet.handlePacket(packet, cut, 0);
+        TEST_ASSERT_EQUAL(++invalid, Fleet.getStats().invalid);
+    }
+    len = heartbeat(packet, PEER, ProberClass::PC_ON, "1.4.0-rc1+abc", "desk");
+    Fleet.handlePacket(packet, len, 0);
+    TEST_ASSERT_EQUAL(++invalid, Fleet.getStats().invalid);
+
+    len = command(packet, PEER, 1, 0, 0, true);
+    Fleet.handlePacket(packet, len - 1, 0);
+    TEST_ASSERT_EQUAL(++invalid, Fleet.getStats().invalid);
+
+    TEST_ASSERT_EQUAL(0, Fleet.getPeerCount());
+    TEST_ASSERT_EQUAL(0, commands);
+}
+
+// Repeats of one command run once; other nonces, senders and targets are told apart
+void test_command_dedupe() {
+    uint8_t packet[32];
+    size_t len = command(packet, PEER, 5, 0, 1, true);
+    for (int i = 0; i < FleetClass::COMMAND_REPEATS; i++) {
+        Fleet.handlePacket(packet, len, 0);
+    }
+    TEST_ASSERT_EQUAL(1, commands);
+    TEST_ASSERT_EQUAL(1, lastChannel);
+    TEST_ASSERT_TRUE(lastOn);
+    TEST_ASSERT_EQUAL(FleetClass::COMMAND_REPEATS - 1, Fleet.getStats().duplicates);
+
+    Fleet.handlePacket(packet, command(packet, PEER + 1, 5, 0, 0, false), 0);
+    TEST_ASSERT_EQUAL(2, commands);
+    Fleet.handlePacket(packet, command(packet, PEER, 6, Fleet.getChipId(), 0, false), 0);
+    TEST_ASSERT_EQUAL(3, commands);
+    TEST_ASSERT_FALSE(lastOn);
+
+    // Addressed to another board: not run and not remembered
+    Fleet.handlePacket(packet, command(packet, PEER, 7, PEER + 2, 0, true), 0);
+    TEST_ASSERT_EQUAL(3, commands);
+    TEST_ASSERT_EQUAL(3, Fleet.getStats().commands);
+}
+
+// A full table replaces the peer heard from longest ago
+void test_peer_table_bounded() {
+    uint8_t packet[FleetClass::PACKET_SIZE];
+    for (int i = 0; i < FleetClass::MAX_PEERS; i++) {
+        Fleet.handlePacket(packet, heartbeat(packet, PEER + i), 0);
+        Hal.advance(10);
+    }
+    TEST_ASSERT_EQUAL(FleetClass::MAX_PEERS, Fleet.getPeerCount());
+    TEST_ASSERT_EQUAL(0, Fleet.getStats().evicted);
+
+    Fleet.handlePacket(packet, heartbeat(packet, PEER + FleetClass::MAX_PEERS), 0);
+    TEST_ASSERT_EQUAL(1, Fleet.getStats().evicted);
+    TEST_ASSERT_EQUAL(FleetClass::MAX_PEERS, Fleet.getPeerCount());
+    TEST_ASSERT_FALSE(contains(json(), "\"chip\":\"a1b2c3\""));
+
+    // Still known, so no replacement; the evicted one needs a slot again
+    Fleet.handlePacket(packet, heartbeat(packet, PEER + 1), 0);
+    TEST_ASSERT_EQUAL(1, Fleet.getStats().evicted);
+    Fleet.handlePacket(packet, heartbeat(packet, PEER), 0);
+    TEST_ASSERT_EQUAL(2, Fleet.getStats().evicted);
+}
+
+// Silent peers go offline, then their entries are reused without eviction
+void test_peer_aging() {
+    uint8_t packet[FleetClass::PACKET_SIZE];
+    Fleet.handlePacket(packet, heartbeat(packet, PEER), 0);
+
+    Hal.advance(FleetClass::PEER_TIMEOUT + 1);
+    TEST_ASSERT_EQUAL(0, Fleet.getOnlineCount());
+    TEST_ASSERT_EQUAL(1, Fleet.getPeerCount());
+    TEST_ASSERT_TRUE(contains(json(), "\"online\":false"));
+
+    Hal.advance(FleetClass::PEER_EXPIRE);
+    TEST_ASSERT_EQUAL(0, Fleet.getPeerCount());
+    for (int i = 1; i <= FleetClass::MAX_PEERS; i++) {
+        Fleet.handlePacket(packet, heartbeat(packet, PEER + i), 0);
+    }
+    TEST_ASSERT_EQUAL(0, Fleet.getStats().evicted);
+}
+
+// Join, heartbeat, receive and a repeated command through the UDP double
+void test_socket_path() {
+    Hal.setWifiConnected(true);
+    Fleet.onWifiUp();
+    Fleet.loopFleet();
+    TEST_ASSERT_EQUAL(1, WiFiUDP::getSent().size());
+    TEST_ASSERT_EQUAL((uint32_t)FleetClass::GROUP, (uint32_t)WiFiUDP::getSent()[0].remote);
+    TEST_ASSERT_EQUAL(FleetClass::PORT, WiFiUDP::getSent()[0].port);
+
+    // Nothing changed: quiet until the keepalive
+    Hal.advance(FleetClass::MIN_INTERVAL);
+    Fleet.loopFleet();
+    TEST_ASSERT_EQUAL(1, WiFiUDP::getSent().size());
+    Hal.advance(FleetClass::KEEPALIVE);
+    Fleet.loopFleet();
+    TEST_ASSERT_EQUAL(2, WiFiUDP::getSent().size());
+
+    uint8_t packet[FleetClass::PACKET_SIZE + 8];
+    TEST_ASSERT_EQUAL(1, WiFiUDP::deliver(FleetClass::PORT, packet, heartbeat(packet, PEER), IPAddress(192, 168, 1, 40)));
+    memset(packet, 0, sizeof(packet));
+    WiFiUDP::deliver(FleetClass::PORT, packet, sizeof(packet));
+    Fleet.loopFleet();
+    TEST_ASSERT_EQUAL(1, Fleet.getPeerCount());
+    TEST_ASSERT_EQUAL(1, Fleet.getStats().invalid);
+    TEST_ASSERT_TRUE(contains(json(), "\"ip\":\"192.168.1.40\""));
+
+    WiFiUDP::clearSent();
+    TEST_ASSERT_TRUE(Fleet.sendCommand(PEER, 1, true));
+    TEST_ASSERT_FALSE(Fleet.sendCommand(PEER, 0, true));
+    for (int i = 0; i < 10; i++) {
+        Fleet.loopFleet();
+        Hal.advance(FleetClass::REPEAT_SPACING / 2);
+    }
+    TEST_ASSERT_EQUAL(FleetClass::COMMAND_REPEATS, WiFiUDP::getSent().size());
+    TEST_ASSERT_EQUAL(16, WiFiUDP::getSent()[0].data.size());
+    TEST_ASSERT_EQUAL(0, commands);
+
+    // Addressed to this board it runs here without going out
+    TEST_ASSERT_TRUE(Fleet.sendCommand(Fleet.getChipId(), 1, false));
+    TEST_ASSERT_EQUAL(1, commands);
+}
+
+// Hundreds of virtual peers heartbeating into the fixed table
+void test_many_peers() {
+    static const int PEERS = 500;
+    static const int ROUNDS = 40;
+
+    uint8_t packets[PEERS][FleetClass::PACKET_SIZE];
+    size_t lens[PEERS];
+    for (int i = 0; i < PEERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "board-%d", i);
+        lens[i] = heartbeat(packets[i], PEER + i, ProberClass::PC_ON, "1.4.0", name);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < PEERS; i++) {
+            Fleet.handlePacket(packets[i], lens[i], IPAddress(10, 0, i >> 8, i & 0xFF));
+        }
+        Hal.advance(1000);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (PEERS * ROUNDS);
+
+    TEST_ASSERT_EQUAL(PEERS * ROUNDS, Fleet.getStats().heartbeats);
+    TEST_ASSERT_EQUAL(FleetClass::MAX_PEERS, Fleet.getPeerCount());
+    TEST_ASSERT_EQUAL(0, Fleet.getStats().invalid);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%u bytes of fleet state, %.2f us per heartbeat on the host",
+             (unsigned)sizeof(FleetClass), us);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    Power.initPower();
+    Power.addChannel("Remote PC", 5);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_heartbeat_parsed);
+    RUN_TEST(test_own_packets_ignored);
+    RUN_TEST(test_invalid_packets);
+    RUN_TEST(test_command_dedupe);
+    RUN_TEST(test_peer_table_bounded);
+    RUN_TEST(test_peer_aging);
+    RUN_TEST(test_socket_path);
+    RUN_TEST(test_many_peers);
+    return UNITY_END();
+}
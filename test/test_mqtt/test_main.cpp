@@ -0,0 +1,479 @@
+#include <unity.h>
+#include <initializer_list>
+#include <string>
+#include <Hal.h>
+#include <Config.h>
+#include <Mqtt.h>
+
+// The MQTT client against the AsyncClient double: the bytes of each packet it
+// writes, reassembly of what the broker sends, the outbound queue, and the
+// reconnect and keepalive timers. Expected packets are built here from the
+// MQTT 3.1.1 layout rather than with the class under test.
+
+static AsyncClient* tcp = nullptr;
+static int messages = 0;
+static std::string lastTopic;
+static std::string lastPayload;
+static unsigned long handlerMicros = 0;
+
+static std::string bytes(std::initializer_list<int> list) {
+    std::string s;
+    for (int b : list) {
+        s += (char)b;
+    }
+    return s;
+}
+
+// Length-prefixed UTF-8 string
+static std::string utf(const std::string& text) {
+    return bytes({(int)(text.size() >> 8), (int)(text.size() & 0xFF)}) + text;
+}
+
+static std::string remainingLength(size_t len) {
+    std::string s;
+    do {
+        uint8_t b = len % 128;
+        len /= 128;
+        s += (char)(len > 0 ? b | 0x80 : b);
+    } while (len > 0);
+    return s;
+}
+
+static std::string packet(uint8_t type, const std::string& body) {
+    return std::string(1, (char)type) + remainingLength(body.size()) + body;
+}
+
+static std::string inbound(const std::string& topic, const std::string& payload, bool retain = false) {
+    return packet(0x30 | (retain ? 0x01 : 0x00), utf(topic) + payload);
+}
+
+static const std::string CONNACK = bytes({0x20, 2, 0, 0});
+static const std::string PINGRESP = bytes({0xD0, 0});
+
+static void configure(const char* broker, const char* topic, const char* user = "", const char* pass = "") {
+    Config.set(ConfigClass::MQTT_BROKER, broker);
+    Config.set(ConfigClass::MQTT_TOPIC, topic);
+    Config.set(ConfigClass::MQTT_USER, user);
+    Config.set(ConfigClass::MQTT_PASS, pass);
+}
+
+static void start() {
+    Mqtt.initMqtt([](const char* topic, const char* payload) {
+        messages++;
+        lastTopic = topic;
+        lastPayload = payload;
+        Hal.advanceMicros(handlerMicros);
+    });
+    Mqtt.subscribe("power/+/set");
+}
+
+// Dials, completes the TCP handshake and sends CONNECT
+static void dial() {
+    Mqtt.loopMqtt();
+    tcp = AsyncClient::lastDialed();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTING, Mqtt.getState());
+    tcp->fireConnect();
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_WAIT_CONNACK, Mqtt.getState());
+}
+
+// A full session up to the flushed "online" status, with the writes cleared
+static void connect() {
+    dial();
+    tcp->fireData(CONNACK);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTED, Mqtt.getState());
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(0, Mqtt.getQueueDepth());
+    tcp->clearWritten();
+}
+
+void setUp() {
+    Hal.reset();
+    Hal.advance(1000);
+    Hal.setWifiConnected(true);
+    LittleFS.format();
+    Config = ConfigClass();
+    Config.load();
+    configure("broker.lan:1884", "wow");
+    Mqtt = MqttClass();
+    messages = 0;
+    lastTopic.clear();
+    lastPayload.clear();
+    handlerMicros = 0;
+    start();
+}
+
+void tearDown() {
+}
+
+void test_connect_packet() {
+    dial();
+
+    std::string expected = packet(0x10, utf("MQTT") + bytes({4, 0x26, 0, MqttClass::KEEPALIVE}) +
+                                  utf("wow-c0ffee") + utf("wow/status") + utf("offline"));
+    TEST_ASSERT_EQUAL(expected.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), tcp->getWritten().data(), expected.size());
+}
+
+// User name and password flags, and a remaining length over 127
+void test_connect_packet_with_credentials() {
+    std::string user(32, 'u');
+    std::string pass(64, 'p');
+    configure("broker.lan", "wow", user.c_str(), pass.c_str());
+    Mqtt = MqttClass();
+    start();
+    dial();
+
+    std::string body = utf("MQTT") + bytes({4, 0xE6, 0, MqttClass::KEEPALIVE}) + utf("wow-c0ffee") +
+                       utf("wow/status") + utf("offline") + utf(user) + utf(pass);
+    TEST_ASSERT_EQUAL(143, body.size());
+    std::string expected = bytes({0x10, 0x8F, 0x01}) + body;
+    TEST_ASSERT_EQUAL(expected.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), tcp->getWritten().data(), expected.size());
+}
+
+// CONNACK brings the session up, subscribes, then queues the retained "online"
+void test_subscribe_and_online_status() {
+    dial();
+    tcp->clearWritten();
+    tcp->fireData(CONNACK);
+    Mqtt.loopMqtt();
+
+    std::string subscribe = packet(0x82, bytes({0, 1}) + utf("wow/power/+/set") + bytes({0}));
+    TEST_ASSERT_EQUAL(subscribe.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(subscribe.data(), tcp->getWritten().data(), subscribe.size());
+    TEST_ASSERT_EQUAL(1, Mqtt.getQueueDepth());
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().connects);
+
+    tcp->clearWritten();
+    Mqtt.loopMqtt();
+    std::string online = packet(0x31, utf("wow/status") + "online");
+    TEST_ASSERT_EQUAL(online.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(online.data(), tcp->getWritten().data(), online.size());
+}
+
+void test_refused_connection() {
+    dial();
+    tcp->fireData(bytes({0x20, 2, 0, 5}));
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().failures);
+}
+
+void test_publish_packet() {
+    connect();
+    TEST_ASSERT_TRUE(Mqtt.publish("pc", "OFF", false));
+    Mqtt.loopMqtt();
+
+    std::string expected = packet(0x30, utf("wow/pc") + "OFF");
+    TEST_ASSERT_EQUAL(expected.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), tcp->getWritten().data(), expected.size());
+}
+
+// Longest base, topic and payload: two length bytes
+void test_publish_remaining_length() {
+    std::string base(40, 'b');
+    configure("broker.lan", base.c_str());
+    Mqtt = MqttClass();
+    start();
+    connect();
+
+    std::string topic(MqttClass::TOPIC_SIZE - 1, 't');
+    std::string payload(MqttClass::PAYLOAD_SIZE - 1, 'p');
+    TEST_ASSERT_TRUE(Mqtt.publish(topic.c_str(), payload.c_str(), true));
+    TEST_ASSERT_FALSE(Mqtt.publish((topic + "t").c_str(), "1", false));
+    TEST_ASSERT_FALSE(Mqtt.publish("pc", (payload + "p").c_str(), false));
+    Mqtt.loopMqtt();
+
+    std::string expected = bytes({0x31, 0x89, 0x01}) + utf(base + "/" + topic) + payload;
+    TEST_ASSERT_EQUAL(3 + 137, expected.size());
+    TEST_ASSERT_EQUAL(expected.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), tcp->getWritten().data(), expected.size());
+}
+
+void test_command_dispatched() {
+    connect();
+    handlerMicros = 250;
+    tcp->fireData(inbound("wow/power/0/set", "ON"));
+    Mqtt.loopMqtt();
+
+    TEST_ASSERT_EQUAL(1, messages);
+    TEST_ASSERT_EQUAL_STRING("power/0/set", lastTopic.c_str());
+    TEST_ASSERT_EQUAL_STRING("ON", lastPayload.c_str());
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().received);
+    TEST_ASSERT_EQUAL(250, Mqtt.getStats().lastDispatchMicros);
+
+    // Other bases are not ours
+    tcp->fireData(inbound("other/power/0/set", "ON"));
+    tcp->fireData(inbound("wowx/power/0/set", "ON"));
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(1, messages);
+}
+
+// A retained command is counted but never run
+void test_retained_command_ignored() {
+    connect();
+    tcp->fireData(inbound("wow/power/0/set", "ON", true));
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(0, messages);
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().received);
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTED, Mqtt.getState());
+}
+
+// Packets split anywhere, including inside the length bytes, and several
+// packets in one segment
+void test_fragmented_packets() {
+    dial();
+    tcp->fireData(CONNACK.substr(0, 1));
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_WAIT_CONNACK, Mqtt.getState());
+    tcp->fireData(CONNACK.substr(1));
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTED, Mqtt.getState());
+
+    // Over 127 bytes, so the length takes two bytes; the payload is cut to fit
+    std::string big = inbound("wow/power/1/set", std::string(150, 'x'));
+    TEST_ASSERT_TRUE(big[1] & 0x80);
+    for (size_t split : {(size_t)1, (size_t)2, (size_t)3, big.size() - 1}) {
+        tcp->fireData(big.substr(0, split));
+        Mqtt.loopMqtt();
+        TEST_ASSERT_EQUAL_MESSAGE(0, messages, "delivered early");
+        tcp->fireData(big.substr(split));
+        Mqtt.loopMqtt();
+        TEST_ASSERT_EQUAL(1, messages);
+        TEST_ASSERT_EQUAL(MqttClass::PAYLOAD_SIZE - 1, lastPayload.size());
+        messages = 0;
+    }
+
+    tcp->fireData(inbound("wow/power/0/set", "ON") + PINGRESP + inbound("wow/power/1/set", "OFF"));
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(2, messages);
+    TEST_ASSERT_EQUAL_STRING("power/1/set", lastTopic.c_str());
+    TEST_ASSERT_EQUAL_STRING("OFF", lastPayload.c_str());
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTED, Mqtt.getState());
+}
+
+// A header announcing more than RX_SIZE drops the session before the body arrives
+void test_oversized_packet() {
+    connect();
+    tcp->fireData(bytes({0x30, 0xAC, 0x02}));
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().failures);
+    TEST_ASSERT_EQUAL(0, messages);
+}
+
+// More bytes than the receive buffer holds between two loops
+void test_receive_overflow() {
+    connect();
+    std::string msg = inbound("wow/power/0/set", std::string(100, 'x'));
+    tcp->fireData(msg);
+    tcp->fireData(msg);
+    tcp->fireData(msg);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+    TEST_ASSERT_EQUAL(0, messages);
+}
+
+// A topic that changes again before it goes out is sent once, with its last value
+void test_queue_coalesces_by_topic() {
+    TEST_ASSERT_TRUE(Mqtt.publish("pc", "ON", true));
+    TEST_ASSERT_TRUE(Mqtt.publish("power/0/status", "queued", true));
+    TEST_ASSERT_TRUE(Mqtt.publish("pc", "OFF", true));
+    TEST_ASSERT_EQUAL(2, Mqtt.getQueueDepth());
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().coalesced);
+
+    dial();
+    tcp->fireData(CONNACK);
+    Mqtt.loopMqtt();
+    tcp->clearWritten();
+    Mqtt.loopMqtt();
+
+    std::string expected = packet(0x31, utf("wow/pc") + "OFF") +
+                           packet(0x31, utf("wow/power/0/status") + "queued") +
+                           packet(0x31, utf("wow/status") + "online");
+    TEST_ASSERT_EQUAL(expected.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), tcp->getWritten().data(), expected.size());
+    TEST_ASSERT_EQUAL(3, tcp->getWriteCount());     // CONNECT, SUBSCRIBE, one batch
+    TEST_ASSERT_EQUAL(3, Mqtt.getStats().published);
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().batches);
+}
+
+void test_full_queue_drops() {
+    char topic[8];
+    for (int i = 0; i < MqttClass::QUEUE_SIZE; i++) {
+        snprintf(topic, sizeof(topic), "t%d", i);
+        TEST_ASSERT_TRUE(Mqtt.publish(topic, "1", false));
+    }
+    TEST_ASSERT_FALSE(Mqtt.publish("one-more", "1", false));
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().dropped);
+    TEST_ASSERT_EQUAL(MqttClass::QUEUE_SIZE, Mqtt.getQueueDepth());
+
+    // A topic already queued still takes the new value
+    TEST_ASSERT_TRUE(Mqtt.publish("t3", "2", false));
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().dropped);
+}
+
+void test_disabled_rejects_publish() {
+    configure("", "wow");
+    Mqtt = MqttClass();
+    start();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_DISABLED, Mqtt.getState());
+    TEST_ASSERT_FALSE(Mqtt.publish("pc", "ON", true));
+}
+
+// Only what fits the send window leaves the queue; the rest waits its turn
+void test_flush_keeps_unsent() {
+    connect();
+    Mqtt.publish("a", "1", false);
+    Mqtt.publish("b", "2", false);
+    Mqtt.publish("c", "3", false);
+
+    // One 10 byte message, plus the 4 length bytes assumed while packing
+    tcp->setSpace(13);
+    Mqtt.loopMqtt();
+    std::string a = packet(0x30, utf("wow/a") + "1");
+    TEST_ASSERT_EQUAL(10, a.size());
+    TEST_ASSERT_EQUAL(a.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(a.data(), tcp->getWritten().data(), a.size());
+    TEST_ASSERT_EQUAL(2, Mqtt.getQueueDepth());
+
+    tcp->setSpace(0);
+    tcp->clearWritten();
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(0, tcp->getWritten().size());
+    TEST_ASSERT_EQUAL(2, Mqtt.getQueueDepth());
+
+    // Too small for even one: nothing is written and nothing is lost
+    tcp->setSpace(12);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(0, tcp->getWritten().size());
+    TEST_ASSERT_EQUAL(2, Mqtt.getQueueDepth());
+
+    tcp->setSpace(25);
+    Mqtt.loopMqtt();
+    std::string rest = packet(0x30, utf("wow/b") + "2") + packet(0x30, utf("wow/c") + "3");
+    TEST_ASSERT_EQUAL(rest.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(rest.data(), tcp->getWritten().data(), rest.size());
+    TEST_ASSERT_EQUAL(0, Mqtt.getQueueDepth());
+}
+
+// Each failure doubles the wait up to RETRY_MAX; a session resets it
+void test_reconnect_backoff() {
+    unsigned long expected = MqttClass::RETRY_MIN;
+    for (int i = 0; i < 8; i++) {
+        Mqtt.loopMqtt();
+        tcp = AsyncClient::lastDialed();
+        TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTING, Mqtt.getState());
+        tcp->fireError(ERR_RST);
+        Mqtt.loopMqtt();
+        TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+
+        expected = expected * 2 < MqttClass::RETRY_MAX ? expected * 2 : MqttClass::RETRY_MAX;
+        Hal.advance(expected - 1);
+        Mqtt.loopMqtt();
+        TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+        Hal.advance(1);
+    }
+    TEST_ASSERT_EQUAL(MqttClass::RETRY_MAX, expected);
+    TEST_ASSERT_EQUAL(8, Mqtt.getStats().failures);
+
+    connect();
+    tcp->fireDisconnect();
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+    Hal.advance(MqttClass::RETRY_MIN * 2 - 1);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+    Hal.advance(1);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTING, Mqtt.getState());
+}
+
+void test_connect_timeout() {
+    Mqtt.loopMqtt();
+    Hal.advance(MqttClass::CONNECT_TIMEOUT - 1);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTING, Mqtt.getState());
+    Hal.advance(1);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+
+    // No CONNACK either
+    Hal.advance(MqttClass::RETRY_MAX);
+    dial();
+    Hal.advance(MqttClass::CONNECT_TIMEOUT);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+    TEST_ASSERT_EQUAL(2, Mqtt.getStats().failures);
+}
+
+// Pings every half keepalive; silence for 1.5 keepalives ends the session
+void test_keepalive() {
+    static const std::string PINGREQ = bytes({0xC0, 0});
+    connect();
+
+    Hal.advance(MqttClass::KEEPALIVE * 500UL - 1);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(0, tcp->getWritten().size());
+    Hal.advance(1);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL_STRING(PINGREQ.c_str(), tcp->getWritten().c_str());
+    TEST_ASSERT_EQUAL(PINGREQ.size(), tcp->getWritten().size());
+
+    // Publishing does not hold the next ping back
+    tcp->clearWritten();
+    Mqtt.publish("pc", "ON", true);
+    Mqtt.loopMqtt();
+    Hal.advance(MqttClass::KEEPALIVE * 500UL);
+    tcp->clearWritten();
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(PINGREQ.size(), tcp->getWritten().size());
+
+    // A PINGRESP at 30 s pushes the deadline to 75 s
+    tcp->fireData(PINGRESP);
+    Mqtt.loopMqtt();
+    Hal.advance(MqttClass::KEEPALIVE * 1500UL - 1);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_CONNECTED, Mqtt.getState());
+    Hal.advance(1);
+    Mqtt.loopMqtt();
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_IDLE, Mqtt.getState());
+    TEST_ASSERT_EQUAL(1, Mqtt.getStats().failures);
+}
+
+// A clean stop announces "offline" itself since the will is not sent
+void test_clean_disconnect() {
+    connect();
+    TEST_ASSERT_TRUE(Mqtt.setBroker("", nullptr, nullptr, "wow"));
+    std::string expected = packet(0x31, utf("wow/status") + "offline") + bytes({0xE0, 0});
+    TEST_ASSERT_EQUAL(expected.size(), tcp->getWritten().size());
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), tcp->getWritten().data(), expected.size());
+    TEST_ASSERT_EQUAL(MqttClass::MQTT_DISABLED, Mqtt.getState());
+    TEST_ASSERT_FALSE(Mqtt.setBroker("host:0", nullptr, nullptr, nullptr));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_connect_packet);
+    RUN_TEST(test_connect_packet_with_credentials);
+    RUN_TEST(test_subscribe_and_online_status);
+    RUN_TEST(test_refused_connection);
+    RUN_TEST(test_publish_packet);
+    RUN_TEST(test_publish_remaining_length);
+    RUN_TEST(test_command_dispatched);
+    RUN_TEST(test_retained_command_ignored);
+    RUN_TEST(test_fragmented_packets);
+    RUN_TEST(test_oversized_packet);
+    RUN_TEST(test_receive_overflow);
+    RUN_TEST(test_queue_coalesces_by_topic);
+    RUN_TEST(test_full_queue_drops);
+    RUN_TEST(test_disabled_rejects_publish);
+    RUN_TEST(test_flush_keeps_unsent);
+    RUN_TEST(test_reconnect_backoff);
+    RUN_TEST(test_connect_timeout);
+    RUN_TEST(test_keepalive);
+    RUN_TEST(test_clean_disconnect);
+    return UNITY_END();
+}
@@ -0,0 +1,127 @@
+#include <unity.h>
+#include <Hal.h>
+#include <Power.h>
+
+// Pulse timing of the power outputs against the simulated clock. Edges come
+// from the one-shot timer, which the simulation fires exactly at its
+// deadline, so widths and latencies must match to the microsecond however
+// slowly loop() runs.
+
+static const uint8_t PIN = 5;
+
+// Runs loop() every period ms for ms
+static void runFor(unsigned long ms, unsigned long period = 10) {
+    for (unsigned long t = 0; t < ms; t += period) {
+        Hal.advance(period);
+        Power.handlePowerStateMachine();
+    }
+}
+
+// Edges on PIN since the last Hal.reset()
+static size_t pinEdges(HalClass::Edge* out, size_t max) {
+    size_t n = 0;
+    for (size_t i = 0; i < Hal.getEdgeCount() && n < max; i++) {
+        if (Hal.getEdge(i).pin == PIN) {
+            out[n++] = Hal.getEdge(i);
+        }
+    }
+    return n;
+}
+
+void setUp() {
+    runFor(10000);
+    Hal.reset();
+}
+
+void tearDown() {
+}
+
+void test_short_press_width() {
+    uint32_t id = Power.pressShort(0, PowerClass::SRC_HTTP);
+    TEST_ASSERT_NOT_EQUAL(0, id);
+    runFor(1000);
+
+    HalClass::Edge edges[4];
+    TEST_ASSERT_EQUAL(2, pinEdges(edges, 4));
+    TEST_ASSERT_EQUAL(HIGH, edges[0].level);
+    TEST_ASSERT_EQUAL(LOW, edges[1].level);
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::SHORT_PRESS * 1000, edges[1].atMicros - edges[0].atMicros);
+
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::SHORT_PRESS * 1000, Power.getLastRequestedWidth());
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::SHORT_PRESS * 1000, Power.getLastActualWidth());
+    TEST_ASSERT_EQUAL_UINT32(0, Power.getLastMaxJitter());
+
+    PowerClass::Command cmd;
+    TEST_ASSERT_TRUE(Power.getCommand(id, cmd));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, cmd.status);
+}
+
+void test_long_press_width() {
+    Power.pressLong(0, PowerClass::SRC_HTTP);
+    runFor(6000);
+
+    HalClass::Edge edges[4];
+    TEST_ASSERT_EQUAL(2, pinEdges(edges, 4));
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::LONG_PRESS * 1000, edges[1].atMicros - edges[0].atMicros);
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::LONG_PRESS * 1000, Power.getLastActualWidth());
+}
+
+void test_press_latency_is_pre_press_delay() {
+    Power.pressShort(0, PowerClass::SRC_HTTP);
+    Hal.advance(3);
+    Power.handlePowerStateMachine();
+    unsigned long dispatchedAt = Hal.micros();
+    runFor(1000);
+
+    HalClass::Edge edges[4];
+    TEST_ASSERT_EQUAL(2, pinEdges(edges, 4));
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::PRE_PRESS_DELAY * 1000, edges[0].atMicros - dispatchedAt);
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::PRE_PRESS_DELAY * 1000, Power.getLastPressLatency());
+}
+
+// A loop() stalled for 70 ms at a time must not stretch the pulse
+void test_width_independent_of_loop_period() {
+    Power.pressShort(0, PowerClass::SRC_HTTP);
+    runFor(2000, 70);
+
+    HalClass::Edge edges[4];
+    TEST_ASSERT_EQUAL(2, pinEdges(edges, 4));
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::SHORT_PRESS * 1000, edges[1].atMicros - edges[0].atMicros);
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::PRE_PRESS_DELAY * 1000, Power.getLastPressLatency());
+}
+
+void test_pulse_sequence_edges() {
+    PowerClass::Pulse pulse;
+    TEST_ASSERT_TRUE(PowerClass::parsePulse("200,300,200", pulse));
+    Power.submitPulse(0, pulse, PowerClass::SRC_HTTP);
+    runFor(2000);
+
+    HalClass::Edge edges[8];
+    TEST_ASSERT_EQUAL(4, pinEdges(edges, 8));
+    TEST_ASSERT_EQUAL_UINT32(200000, edges[1].atMicros - edges[0].atMicros);
+    TEST_ASSERT_EQUAL_UINT32(300000, edges[2].atMicros - edges[1].atMicros);
+    TEST_ASSERT_EQUAL_UINT32(200000, edges[3].atMicros - edges[2].atMicros);
+    TEST_ASSERT_EQUAL_UINT32(400000, Power.getLastRequestedWidth());
+    TEST_ASSERT_EQUAL_UINT32(400000, Power.getLastActualWidth());
+}
+
+void test_idle_output_stays_low() {
+    runFor(5000);
+    TEST_ASSERT_EQUAL(0, Hal.getEdgeCount());
+    TEST_ASSERT_EQUAL(LOW, Hal.digitalRead(PIN));
+    TEST_ASSERT_EQUAL(PowerClass::IDLE, Power.getState(0));
+}
+
+int main(int argc, char** argv) {
+    Power.initPower();
+    Power.addChannel("Remote PC", PIN);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_short_press_width);
+    RUN_TEST(test_long_press_width);
+    RUN_TEST(test_press_latency_is_pre_press_delay);
+    RUN_TEST(test_width_independent_of_loop_period);
+    RUN_TEST(test_pulse_sequence_edges);
+    RUN_TEST(test_idle_output_stays_low);
+    return UNITY_END();
+}
@@ -0,0 +1,249 @@
+#include <unity.h>
+#include <map>
+#include <stdlib.h>
+#include <Hal.h>
+#include <Power.h>
+
+// The command queue in front of the power outputs: coalescing, force-off
+// supersede, the full-queue reject and a long randomized run in which every
+// accepted command has to end up done or superseded.
+
+static const uint8_t CHANNELS = 4;
+static const uint8_t FIRST_PIN = 12;
+
+// Last status reported through onUpdate, by command id
+static std::map<uint32_t, uint8_t> reported;
+static int runningOn[CHANNELS];
+static int overlaps = 0;
+
+static void onUpdate(const PowerClass::Command& cmd) {
+    uint8_t previous = reported.count(cmd.id) ? reported[cmd.id] : (uint8_t)PowerClass::CMD_QUEUED;
+    reported[cmd.id] = cmd.status;
+
+    if (cmd.status == PowerClass::CMD_RUNNING) {
+        if (runningOn[cmd.channel]++ > 0) {
+            overlaps++;
+        }
+    } else if (previous == PowerClass::CMD_RUNNING) {
+        runningOn[cmd.channel]--;
+    }
+}
+
+static void runFor(unsigned long ms, unsigned long period = 10) {
+    for (unsigned long t = 0; t < ms; t += period) {
+        Hal.advance(period);
+        Power.handlePowerStateMachine();
+    }
+}
+
+// Lets the previous test's commands finish and starts from a clean record
+void setUp() {
+    runFor(30000);
+    Hal.reset();
+    reported.clear();
+    memset(runningOn, 0, sizeof(runningOn));
+    overlaps = 0;
+}
+
+void tearDown() {
+}
+
+static uint8_t statusOf(uint32_t id) {
+    PowerClass::Command cmd;
+    return Power.getCommand(id, cmd) ? cmd.status : (uint8_t)PowerClass::CMD_NONE;
+}
+
+void test_repeat_press_coalesces() {
+    unsigned long coalesced = Power.getCoalesced();
+    uint32_t first = Power.pressShort(0, PowerClass::SRC_HTTP);
+    runFor(50);
+    TEST_ASSERT_EQUAL(first, Power.pressShort(0, PowerClass::SRC_ALEXA));
+
+    // Still coalesced while it runs, a fresh command once the window is over
+    runFor(300);
+    TEST_ASSERT_EQUAL(first, Power.pressShort(0, PowerClass::SRC_WS));
+    runFor(PowerClass::COALESCE_WINDOW);
+    uint32_t second = Power.pressShort(0, PowerClass::SRC_WS);
+    TEST_ASSERT_NOT_EQUAL(first, second);
+    TEST_ASSERT_EQUAL(coalesced + 2, Power.getCoalesced());
+
+    runFor(2000);
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, statusOf(first));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, statusOf(second));
+}
+
+void test_other_channel_not_coalesced() {
+    uint32_t a = Power.pressShort(0, PowerClass::SRC_HTTP);
+    uint32_t b = Power.pressShort(1, PowerClass::SRC_HTTP);
+    TEST_ASSERT_NOT_EQUAL(a, b);
+
+    // Both channels press at the same time
+    runFor(1000);
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, statusOf(a));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, statusOf(b));
+    TEST_ASSERT_EQUAL(0, overlaps);
+}
+
+// A force shutdown queued behind a short press makes the press pointless
+void test_force_off_supersedes_queued_press() {
+    uint32_t running = Power.pressShort(0, PowerClass::SRC_HTTP);
+    runFor(200);
+    uint32_t queuedShort = Power.submit(0, 300, PowerClass::SRC_HTTP);
+    uint32_t forceOff = Power.pressLong(0, PowerClass::SRC_HTTP);
+    runFor(8000);
+
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, statusOf(running));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_SUPERSEDED, statusOf(queuedShort));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, statusOf(forceOff));
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::LONG_PRESS * 1000, Power.getLastActualWidth());
+}
+
+// A short press still in its pre-press delay is dropped without an edge
+void test_force_off_cancels_press_before_first_edge() {
+    uint32_t press = Power.pressShort(0, PowerClass::SRC_HTTP);
+    runFor(20);
+    uint32_t forceOff = Power.pressLong(0, PowerClass::SRC_HTTP);
+    runFor(8000);
+
+    TEST_ASSERT_EQUAL(PowerClass::CMD_SUPERSEDED, statusOf(press));
+    TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, statusOf(forceOff));
+
+    // Only the long press reached the pin
+    TEST_ASSERT_EQUAL(2, Hal.getEdgeCount());
+    TEST_ASSERT_EQUAL_UINT32(PowerClass::LONG_PRESS * 1000, Hal.getEdge(1).atMicros - Hal.getEdge(0).atMicros);
+}
+
+void test_full_queue_rejects() {
+    unsigned long rejected = Power.getRejected();
+
+    // Distinct pulses so nothing coalesces; the channel is busy with the first
+    uint32_t ids[PowerClass::QUEUE_SIZE + 1];
+    for (uint8_t i = 0; i <= PowerClass::QUEUE_SIZE; i++) {
+        ids[i] = Power.submit(0, 100 + i, PowerClass::SRC_HTTP);
+        TEST_ASSERT_NOT_EQUAL(0, ids[i]);
+        if (i == 0) {
+            runFor(10);
+        }
+    }
+    TEST_ASSERT_EQUAL(PowerClass::QUEUE_SIZE, Power.getQueueDepth());
+    TEST_ASSERT_EQUAL(0, Power.submit(0, 999, PowerClass::SRC_HTTP));
+    TEST_ASSERT_EQUAL(rejected + 1, Power.getRejected());
+
+    runFor(20000);
+    TEST_ASSERT_EQUAL(0, Power.getQueueDepth());
+    for (uint8_t i = 0; i <= PowerClass::QUEUE_SIZE; i++) {
+        TEST_ASSERT_EQUAL(PowerClass::CMD_DONE, reported[ids[i]]);
+    }
+    TEST_ASSERT_EQUAL(0, overlaps);
+}
+
+void test_malformed_commands_rejected() {
+    PowerClass::Pulse pulse = {};
+    TEST_ASSERT_EQUAL(0, Power.submitPulse(0, pulse, PowerClass::SRC_HTTP));
+    TEST_ASSERT_FALSE(PowerClass::parsePulse("200,300", pulse));
+    TEST_ASSERT_EQUAL(0, Power.pressShort(CHANNELS, PowerClass::SRC_HTTP));
+    TEST_ASSERT_EQUAL(0, Power.pressLong(255, PowerClass::SRC_HTTP));
+
+    // Zero and over MAX_SEGMENT_MS are refused whatever the source
+    pulse.count = 3;
+    pulse.segments[0] = 200;
+    pulse.segments[1] = 0;
+    pulse.segments[2] = 200;
+    TEST_ASSERT_EQUAL(0, Power.submitPulse(0, pulse, PowerClass::SRC_MQTT));
+    pulse.segments[1] = PowerClass::MAX_SEGMENT_MS + 1;
+    TEST_ASSERT_EQUAL(0, Power.submitPulse(0, pulse, PowerClass::SRC_WS));
+    TEST_ASSERT_EQUAL(0, Power.submit(0, 0, PowerClass::SRC_HTTP));
+    TEST_ASSERT_FALSE(PowerClass::parsePulse("60001", pulse));
+
+    // Would wrap to a 464 ms press as a uint16_t
+    TEST_ASSERT_EQUAL(0, Power.submit(0, 66000, PowerClass::SRC_HTTP));
+    TEST_ASSERT_EQUAL(0, Power.getQueueDepth());
+}
+
+// Mixed short, long and sequence commands on all channels at random times.
+// Every accepted id reaches a final state exactly once, no channel ever runs
+// two commands and the outputs are all low afterwards.
+void test_random_submissions_all_finish() {
+    static const int SUBMISSIONS = 20000;
+    static const char* PULSES[] = {"300", "150,100,150", "60,40,60,40,60"};
+
+    srand(12345);
+    unsigned long submitted = Power.getSubmitted();
+    unsigned long coalesced = Power.getCoalesced();
+    unsigned long rejected = Power.getRejected();
+    int accepted = 0;
+
+    for (int i = 0; i < SUBMISSIONS; i++) {
+        uint8_t ch = rand() % CHANNELS;
+        uint8_t source = rand() % PowerClass::SOURCE_COUNT;
+        int kind = rand() % 40;
+
+        uint32_t id;
+        if (kind == 0) {
+            id = Power.pressLong(ch, (PowerClass::Source)source);
+        } else if (kind < 4) {
+            PowerClass::Pulse pulse;
+            PowerClass::parsePulse(PULSES[kind - 1], pulse);
+            id = Power.submitPulse(ch, pulse, (PowerClass::Source)source);
+        } else {
+            id = Power.submit(ch, 50 + rand() % 200, (PowerClass::Source)source);
+        }
+        if (id != 0) {
+            accepted++;
+            if (!reported.count(id)) {
+                reported[id] = PowerClass::CMD_QUEUED;
+            }
+        }
+
+        runFor(10 * (rand() % 30), 10);
+    }
+    runFor(60000);
+
+    unsigned long newCommands = Power.getSubmitted() - submitted;
+    TEST_ASSERT_EQUAL(SUBMISSIONS, newCommands + (Power.getCoalesced() - coalesced) + (Power.getRejected() - rejected));
+    TEST_ASSERT_EQUAL(accepted, newCommands + (Power.getCoalesced() - coalesced));
+    TEST_ASSERT_EQUAL(newCommands, reported.size());
+
+    int done = 0;
+    int superseded = 0;
+    for (const auto& entry : reported) {
+        if (entry.second == PowerClass::CMD_DONE) {
+            done++;
+        } else if (entry.second == PowerClass::CMD_SUPERSEDED) {
+            superseded++;
+        } else {
+            TEST_FAIL_MESSAGE("Command left unfinished");
+        }
+    }
+    TEST_ASSERT_EQUAL(newCommands, done + superseded);
+    TEST_ASSERT_EQUAL(0, overlaps);
+    TEST_ASSERT_EQUAL(0, Power.getQueueDepth());
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        TEST_ASSERT_EQUAL(PowerClass::IDLE, Power.getState(ch));
+        TEST_ASSERT_EQUAL(LOW, Hal.digitalRead(FIRST_PIN + ch));
+    }
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%d done, %d superseded, %lu coalesced, %lu rejected",
+             done, superseded, Power.getCoalesced() - coalesced, Power.getRejected() - rejected);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    Power.initPower(onUpdate);
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        char name[8];
+        snprintf(name, sizeof(name), "pc%u", ch);
+        Power.addChannel(name, FIRST_PIN + ch);
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_repeat_press_coalesces);
+    RUN_TEST(test_other_channel_not_coalesced);
+    RUN_TEST(test_force_off_supersedes_queued_press);
+    RUN_TEST(test_force_off_cancels_press_before_first_edge);
+    RUN_TEST(test_full_queue_rejects);
+    RUN_TEST(test_malformed_commands_rejected);
+    RUN_TEST(test_random_submissions_all_finish);
+    return UNITY_END();
+}
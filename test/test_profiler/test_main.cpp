@@ -0,0 +1,175 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <new>
+#include <string>
+#include <Hal.h>
+#include <Profiler.h>
+#include <ESPAsyncWebServer.h>
+
+// The Prometheus text for /metrics, written whole to a stream and a chunk at
+// a time for the chunked response: both must give the same text, chunks must
+// end on line boundaries and the chunked path must not touch the heap.
+
+static unsigned long allocations = 0;
+static bool counting = false;
+
+void* operator new(size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+struct Capture : public Print {
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+};
+
+static std::string whole() {
+    Capture out;
+    Profiler.writeMetrics(out);
+    return out.text;
+}
+
+static std::string chunked(size_t maxLen, std::vector<size_t>* chunks = nullptr) {
+    uint16_t line = 0;
+    AsyncChunkedResponse response("text/plain", [line](uint8_t* buffer, size_t len, size_t) mutable {
+        return Profiler.writeMetrics(buffer, len, line);
+    });
+    std::string body = response.drain(maxLen);
+    if (chunks != nullptr) {
+        *chunks = response.chunks;
+    }
+    return body;
+}
+
+static void sample(ProfilerClass::Stage stage, unsigned long us) {
+    Profiler.record(stage, us * HalClass::CPU_MHZ);
+}
+
+static bool contains(const std::string& s, const char* part) {
+    return s.find(part) != std::string::npos;
+}
+
+void setUp() {
+    Hal.reset();
+    Profiler = ProfilerClass();
+}
+
+void tearDown() {
+}
+
+void test_histogram_lines() {
+    sample(ProfilerClass::WIFI, 1);
+    sample(ProfilerClass::WIFI, 3);
+    sample(ProfilerClass::WIFI, 100000);
+
+    std::string text = whole();
+    TEST_ASSERT_TRUE(contains(text, "wow_loop_stage_seconds_bucket{stage=\"wifi\",le=\"0.000001\"} 1\n"));
+    TEST_ASSERT_TRUE(contains(text, "wow_loop_stage_seconds_bucket{stage=\"wifi\",le=\"0.000004\"} 2\n"));
+    TEST_ASSERT_TRUE(contains(text, "wow_loop_stage_seconds_bucket{stage=\"wifi\",le=\"0.032768\"} 2\n"));
+    TEST_ASSERT_TRUE(contains(text, "wow_loop_stage_seconds_bucket{stage=\"wifi\",le=\"+Inf\"} 3\n"));
+    TEST_ASSERT_TRUE(contains(text, "wow_loop_stage_seconds_sum{stage=\"wifi\"} 0.100004\n"));
+    TEST_ASSERT_TRUE(contains(text, "wow_loop_stage_seconds_count{stage=\"wifi\"} 3\n"));
+    TEST_ASSERT_TRUE(contains(text, "wow_loop_stage_max_seconds{stage=\"wifi\"} 0.100000\n"));
+    TEST_ASSERT_TRUE(contains(text, "# TYPE wow_uptime_seconds gauge\nwow_uptime_seconds 0\n"));
+}
+
+// Any buffer that holds the longest unit gives the same text in whole lines
+void test_chunked_matches_stream() {
+    for (int i = 0; i < 200; i++) {
+        sample((ProfilerClass::Stage)(i % ProfilerClass::STAGE_COUNT), 1 + i * 37);
+        Hal.advance(3);
+        Profiler.markLoop();
+    }
+    std::string expected = whole();
+
+    static const size_t SIZES[] = { ProfilerClass::LINE_SIZE, 256, 536, 1460, 4096, 65536 };
+    for (size_t maxLen : SIZES) {
+        std::vector<size_t> chunks;
+        std::string body = chunked(maxLen, &chunks);
+        TEST_ASSERT_EQUAL(expected.size(), body.size());
+        TEST_ASSERT_TRUE(expected == body);
+
+        size_t pos = 0;
+        for (size_t n : chunks) {
+            TEST_ASSERT_TRUE(n <= maxLen);
+            pos += n;
+            TEST_ASSERT_EQUAL('\n', body[pos - 1]);
+        }
+    }
+}
+
+// A buffer shorter than the next line is retried, not ended early
+void test_small_buffer_tries_again() {
+    uint8_t buffer[32];
+    uint16_t line = 0;
+    TEST_ASSERT_EQUAL(RESPONSE_TRY_AGAIN, Profiler.writeMetrics(buffer, sizeof(buffer), line));
+    TEST_ASSERT_EQUAL(0, line);
+
+    uint8_t big[ProfilerClass::LINE_SIZE];
+    TEST_ASSERT_TRUE(Profiler.writeMetrics(big, sizeof(big), line) > 0);
+    TEST_ASSERT_TRUE(line > 0);
+}
+
+// No allocation while filling chunks, and nothing left after the last one
+void test_chunks_without_heap() {
+    static uint8_t buffer[1460];
+    uint16_t line = 0;
+    size_t total = 0;
+    int chunks = 0;
+
+    allocations = 0;
+    counting = true;
+    size_t n;
+    while ((n = Profiler.writeMetrics(buffer, sizeof(buffer), line)) > 0) {
+        total += n;
+        chunks++;
+    }
+    counting = false;
+
+    TEST_ASSERT_EQUAL(0, allocations);
+    TEST_ASSERT_EQUAL(whole().size(), total);
+    TEST_ASSERT_EQUAL(0, Profiler.writeMetrics(buffer, sizeof(buffer), line));
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%u bytes of metrics in %d chunks of at most %u, no allocations",
+             (unsigned)total, chunks, (unsigned)sizeof(buffer));
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_histogram_lines);
+    RUN_TEST(test_chunked_matches_stream);
+    RUN_TEST(test_small_buffer_tries_again);
+    RUN_TEST(test_chunks_without_heap);
+    return UNITY_END();
+}
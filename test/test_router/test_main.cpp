@@ -0,0 +1,196 @@
+#include <unity.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <Hal.h>
+#include <Router.h>
+
+// The constexpr route table: each capture type, paths that must not match,
+// and the hand-over of one match from canHandle() to handleRequest() through
+// the request. The last test reports the cost of a match on the host.
+
+static int lastRoute = -1;
+static RouterClass::Params lastParams;
+static std::string lastText[RouterClass::MAX_SEGMENTS];
+
+template <int N>
+static void record(AsyncWebServerRequest* request, const RouterClass::Params& params) {
+    lastRoute = N;
+    lastParams = params;
+    for (uint8_t i = 0; i < params.count; i++) {
+        lastText[i] = params.text[i];
+    }
+    request->send(200);
+}
+
+static constexpr RouterClass::Route ROUTES[] = {
+    RouterClass::route(HTTP_PUT, record<0>, RouterClass::lit("api"), RouterClass::lit("state"),
+                       RouterClass::cap(RouterClass::CAP_SWITCH)),
+    RouterClass::route(HTTP_PUT, record<1>, RouterClass::lit("api"), RouterClass::lit("state"),
+                       RouterClass::cap(RouterClass::CAP_UINT), RouterClass::cap(RouterClass::CAP_SWITCH)),
+    RouterClass::route(HTTP_PUT, record<2>, RouterClass::lit("api"), RouterClass::lit("state"),
+                       RouterClass::cap(RouterClass::CAP_TEXT), RouterClass::cap(RouterClass::CAP_SWITCH)),
+    RouterClass::route(HTTP_GET | HTTP_POST, record<3>, RouterClass::lit("api"), RouterClass::lit("peers"),
+                       RouterClass::cap(RouterClass::CAP_TEXT), RouterClass::lit("channels"),
+                       RouterClass::cap(RouterClass::CAP_UINT), RouterClass::lit("log")),
+};
+
+static AsyncWebServer server(80);
+
+static std::shared_ptr<AsyncWebServerRequest> send(const char* url, WebRequestMethodComposite method = HTTP_PUT) {
+    auto request = std::make_shared<AsyncWebServerRequest>(url, method);
+    lastRoute = -1;
+    server.dispatch(request.get());
+    return request;
+}
+
+static int routeOf(const char* url, WebRequestMethodComposite method = HTTP_PUT) {
+    send(url, method);
+    return lastRoute;
+}
+
+void setUp() {
+    Hal.reset();
+    Router = RouterClass();
+    Router.initRouter(ROUTES, sizeof(ROUTES) / sizeof(ROUTES[0]));
+    server = AsyncWebServer(80);
+    server.addHandler(&Router);
+}
+
+void tearDown() {
+}
+
+void test_switch_capture() {
+    TEST_ASSERT_EQUAL(0, routeOf("/api/state/ON"));
+    TEST_ASSERT_EQUAL(1, lastParams.count);
+    TEST_ASSERT_EQUAL(1, lastParams.number[0]);
+    TEST_ASSERT_EQUAL_STRING("ON", lastText[0].c_str());
+
+    TEST_ASSERT_EQUAL(0, routeOf("/api/state/OFF"));
+    TEST_ASSERT_EQUAL(0, lastParams.number[0]);
+
+    // Case matters, as it did with the regex
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/state/on"));
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/state/ONN"));
+}
+
+// Digits go to the CAP_UINT route, anything else falls through to CAP_TEXT
+void test_uint_and_text_captures() {
+    TEST_ASSERT_EQUAL(1, routeOf("/api/state/12/ON"));
+    TEST_ASSERT_EQUAL(2, lastParams.count);
+    TEST_ASSERT_EQUAL(12, lastParams.number[0]);
+    TEST_ASSERT_EQUAL(1, lastParams.number[1]);
+
+    TEST_ASSERT_EQUAL(2, routeOf("/api/state/build-box/OFF"));
+    TEST_ASSERT_EQUAL_STRING("build-box", lastText[0].c_str());
+    TEST_ASSERT_EQUAL(0, lastParams.number[1]);
+
+    TEST_ASSERT_EQUAL(2, routeOf("/api/state/12a/ON"));
+    TEST_ASSERT_EQUAL_STRING("12a", lastText[0].c_str());
+    TEST_ASSERT_EQUAL(2, routeOf("/api/state/-1/ON"));
+    TEST_ASSERT_EQUAL(2, routeOf("/api/state/+1/ON"));
+    TEST_ASSERT_EQUAL(2, routeOf("/api/state/99999999999999999999999/ON"));
+}
+
+// Literals between captures, and a method set
+void test_mixed_route() {
+    TEST_ASSERT_EQUAL(3, routeOf("/api/peers/desk/channels/3/log", HTTP_GET));
+    TEST_ASSERT_EQUAL(2, lastParams.count);
+    TEST_ASSERT_EQUAL_STRING("desk", lastText[0].c_str());
+    TEST_ASSERT_EQUAL(3, lastParams.number[1]);
+
+    TEST_ASSERT_EQUAL(3, routeOf("/api/peers/desk/channels/3/log", HTTP_POST));
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/peers/desk/channels/3/log", HTTP_PUT));
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/peers/desk/channel/3/log", HTTP_GET));
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/peers/desk/channels/x/log", HTTP_GET));
+}
+
+// Unmatched requests are left for the next handler or onNotFound
+void test_non_matches() {
+    static const char* const URLS[] = {
+        "/", "", "api/state/ON", "/api", "/api/state", "/api/state/",
+        "/api/state//ON", "/api/status/ON", "/apix/state/ON", "/api/state/1/ON/extra",
+    };
+    for (const char* url : URLS) {
+        auto request = send(url);
+        TEST_ASSERT_EQUAL_MESSAGE(-1, lastRoute, url);
+        TEST_ASSERT_EQUAL_MESSAGE(404, request->getResponseCode(), url);
+        TEST_ASSERT_NULL(request->_tempObject);
+    }
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/state/ON", HTTP_GET));
+    TEST_ASSERT_EQUAL(0, Router.getDispatched());
+}
+
+// An empty last segment is not a capture
+void test_trailing_slash() {
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/state/ON/"));
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/state/1/ON/"));
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/peers/desk/channels/3/log/", HTTP_GET));
+}
+
+// More than MAX_SEGMENTS segments, or a path of MAX_PATH or more, never match
+void test_too_long() {
+    TEST_ASSERT_EQUAL(-1, routeOf("/api/peers/desk/channels/3/log/x", HTTP_GET));
+    TEST_ASSERT_EQUAL(-1, routeOf("/a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p"));
+
+    std::string name(RouterClass::MAX_PATH, 'x');
+    std::string url = "/api/state/" + name + "/ON";
+    TEST_ASSERT_EQUAL(-1, routeOf(url.c_str()));
+
+    // Just under the limit is fine
+    name.resize(RouterClass::MAX_PATH - strlen("/api/state//ON") - 1);
+    url = "/api/state/" + name + "/ON";
+    TEST_ASSERT_EQUAL(2, routeOf(url.c_str()));
+    TEST_ASSERT_EQUAL_STRING(name.c_str(), lastText[0].c_str());
+}
+
+// canHandle() matches once and leaves the result on the request
+void test_match_handed_over() {
+    auto request = std::make_shared<AsyncWebServerRequest>("/api/state/7/ON", HTTP_PUT);
+    TEST_ASSERT_TRUE(Router.canHandle(request.get()));
+    TEST_ASSERT_NOT_NULL(request->_tempObject);
+
+    Router.handleRequest(request.get());
+    TEST_ASSERT_EQUAL(1, lastRoute);
+    TEST_ASSERT_EQUAL(7, lastParams.number[0]);
+    TEST_ASSERT_EQUAL(1, Router.getDispatched());
+
+    // Another handler's scratch data is left alone
+    auto taken = std::make_shared<AsyncWebServerRequest>("/api/state/ON", HTTP_PUT);
+    taken->_tempObject = malloc(1);
+    TEST_ASSERT_FALSE(Router.canHandle(taken.get()));
+}
+
+void test_match_cost() {
+    static const int ROUNDS = 100000;
+    static const char* const URLS[] = {
+        "/api/state/ON", "/api/state/12/OFF", "/api/state/build-box/ON", "/api/unrelated/path",
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    int matched = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        AsyncWebServerRequest request(URLS[i % 4], HTTP_PUT);
+        matched += Router.canHandle(&request);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+    TEST_ASSERT_EQUAL(ROUNDS / 4 * 3, matched);
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%.0f ns per canHandle() on the host, %u byte match record",
+             ns, (unsigned)(sizeof(RouterClass::Params) + RouterClass::MAX_PATH + sizeof(int)));
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_switch_capture);
+    RUN_TEST(test_uint_and_text_captures);
+    RUN_TEST(test_mixed_route);
+    RUN_TEST(test_non_matches);
+    RUN_TEST(test_trailing_slash);
+    RUN_TEST(test_too_long);
+    RUN_TEST(test_match_handed_over);
+    RUN_TEST(test_match_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,214 @@
+#include <unity.h>
+#include <vector>
+#include <Hal.h>
+#include <Config.h>
+#include <Schedule.h>
+
+// Calendar rules against the simulated wall clock in Central European time,
+// across the 2026 DST changes (29 March 02:00 -> 03:00, 25 October
+// 03:00 -> 02:00).
+
+static const char* CET = "CET-1CEST,M3.5.0,M10.5.0/3";
+static const uint8_t DAILY = 0x7F;
+
+static std::vector<time_t> fired;
+
+static time_t localTime(int year, int month, int day, int hour, int minute) {
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    t.tm_year = year - 1900;
+    t.tm_mon = month - 1;
+    t.tm_mday = day;
+    t.tm_hour = hour;
+    t.tm_min = minute;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
+static void boot() {
+    Schedule = ScheduleClass();
+    Schedule.initSchedule([](uint8_t channel, ScheduleClass::Action action) {
+        (void)channel;
+        (void)action;
+        fired.push_back(Hal.epoch());
+    });
+}
+
+// loopSchedule() once a second
+static void runFor(unsigned long seconds) {
+    for (unsigned long s = 0; s < seconds; s++) {
+        Hal.advance(1000);
+        Schedule.loopSchedule();
+    }
+}
+
+static struct tm localOf(time_t t) {
+    struct tm out;
+    localtime_r(&t, &out);
+    return out;
+}
+
+void setUp() {
+    Hal.reset();
+    LittleFS.format();
+    Config = ConfigClass();
+    Config.load();
+    Config.set(ConfigClass::TIMEZONE, CET);
+    fired.clear();
+    boot();
+}
+
+void tearDown() {
+}
+
+void test_next_fire_plain_day() {
+    Hal.setEpoch(localTime(2026, 6, 10, 12, 0));
+    int id = Schedule.addRule(0, DAILY, 18, 30, ScheduleClass::ACTION_ON, true);
+    Schedule.loopSchedule();
+    TEST_ASSERT_EQUAL(localTime(2026, 6, 10, 18, 30), Schedule.getNextFire(id));
+}
+
+// A daily rule keeps its local time across spring-forward: 23 h between fires
+void test_next_fire_across_spring_forward() {
+    Hal.setEpoch(localTime(2026, 3, 27, 8, 0));
+    int id = Schedule.addRule(0, DAILY, 7, 0, ScheduleClass::ACTION_ON, true);
+    Schedule.loopSchedule();
+    time_t first = Schedule.getNextFire(id);
+    TEST_ASSERT_EQUAL(localTime(2026, 3, 28, 7, 0), first);
+    TEST_ASSERT_EQUAL(0, localOf(first).tm_isdst);
+
+    Hal.setEpoch(first);
+    Schedule.loopSchedule();
+    time_t second = Schedule.getNextFire(id);
+    TEST_ASSERT_EQUAL(localTime(2026, 3, 29, 7, 0), second);
+    TEST_ASSERT_EQUAL(23 * 3600, second - first);
+    TEST_ASSERT_EQUAL(1, localOf(second).tm_isdst);
+}
+
+// 02:30 does not exist on 29 March; the rule still fires once that day, at
+// the first valid local time after the gap
+void test_skipped_time_fires_once() {
+    Hal.setEpoch(localTime(2026, 3, 28, 12, 0));
+    Schedule.addRule(0, DAILY, 2, 30, ScheduleClass::ACTION_OFF, true);
+    runFor(3 * 86400);
+
+    TEST_ASSERT_EQUAL(3, fired.size());
+    struct tm gapDay = localOf(fired[0]);
+    TEST_ASSERT_EQUAL(29, gapDay.tm_mday);
+    TEST_ASSERT_EQUAL(1, gapDay.tm_isdst);
+    TEST_ASSERT_EQUAL(3, gapDay.tm_hour);
+    TEST_ASSERT_EQUAL(30, gapDay.tm_min);
+    TEST_ASSERT_EQUAL(30, localOf(fired[1]).tm_mday);
+    TEST_ASSERT_EQUAL(31, localOf(fired[2]).tm_mday);
+}
+
+// 02:30 happens twice on 25 October; the rule fires only the first time
+void test_repeated_hour_fires_once() {
+    Hal.setEpoch(localTime(2026, 10, 24, 12, 0));
+    Schedule.addRule(0, DAILY, 2, 30, ScheduleClass::ACTION_OFF, true);
+    runFor(3 * 86400);
+
+    TEST_ASSERT_EQUAL(3, fired.size());
+    TEST_ASSERT_EQUAL(25, localOf(fired[0]).tm_mday);
+    TEST_ASSERT_EQUAL(1, localOf(fired[0]).tm_isdst);
+    TEST_ASSERT_EQUAL(26, localOf(fired[1]).tm_mday);
+    TEST_ASSERT_EQUAL(25 * 3600, fired[1] - fired[0]);
+    TEST_ASSERT_EQUAL(27, localOf(fired[2]).tm_mday);
+}
+
+void test_weekday_mask() {
+    uint8_t days;
+    TEST_ASSERT_TRUE(ScheduleClass::parseDays("mon,wed,fri", days));
+    TEST_ASSERT_EQUAL_HEX8(0x2A, days);
+    TEST_ASSERT_FALSE(ScheduleClass::parseDays("mon,funday", days));
+
+    // Saturday 10 October 2026; the next Monday is the 12th
+    Hal.setEpoch(localTime(2026, 10, 10, 9, 0));
+    Schedule.addRule(0, 0x2A, 8, 0, ScheduleClass::ACTION_ON, true);
+    runFor(7 * 86400);
+
+    TEST_ASSERT_EQUAL(3, fired.size());
+    TEST_ASSERT_EQUAL(12, localOf(fired[0]).tm_mday);
+    TEST_ASSERT_EQUAL(14, localOf(fired[1]).tm_mday);
+    TEST_ASSERT_EQUAL(16, localOf(fired[2]).tm_mday);
+}
+
+// Nothing fires before SNTP has set the clock
+void test_waits_for_clock_sync() {
+    Schedule.addRule(0, DAILY, 0, 0, ScheduleClass::ACTION_ON, true);
+    runFor(3600);
+    TEST_ASSERT_FALSE(Schedule.isSynced());
+    TEST_ASSERT_EQUAL(0, fired.size());
+}
+
+// A step past a fire by more than MISSED_GRACE drops it; stepping back
+// does not repeat a fire already done
+void test_clock_jumps() {
+    Hal.setEpoch(localTime(2026, 6, 10, 6, 59));
+    Schedule.addRule(0, DAILY, 7, 0, ScheduleClass::ACTION_ON, true);
+    runFor(120);
+    TEST_ASSERT_EQUAL(1, fired.size());
+
+    Hal.setEpoch(localTime(2026, 6, 10, 6, 50));
+    runFor(1200);
+    TEST_ASSERT_EQUAL(1, fired.size());
+
+    Hal.setEpoch(localTime(2026, 6, 11, 8, 0));
+    runFor(5);
+    TEST_ASSERT_EQUAL(1, fired.size());
+    TEST_ASSERT_EQUAL(localTime(2026, 6, 12, 7, 0), Schedule.getNextFire(1));
+
+    // A late fire inside the grace period still runs
+    Hal.setEpoch(localTime(2026, 6, 12, 7, 2));
+    runFor(5);
+    TEST_ASSERT_EQUAL(2, fired.size());
+}
+
+// Rules firing together share one deferred write of lastFired
+void test_fires_share_one_write() {
+    Hal.setEpoch(localTime(2026, 6, 10, 6, 59));
+    Schedule.addRule(0, DAILY, 7, 0, ScheduleClass::ACTION_ON, true);
+    Schedule.addRule(1, DAILY, 7, 0, ScheduleClass::ACTION_ON, true);
+    Schedule.addRule(2, DAILY, 7, 0, ScheduleClass::ACTION_OFF, true);
+    unsigned long writes = LittleFS.getWriteCount();
+
+    runFor(61);
+    TEST_ASSERT_EQUAL(3, fired.size());
+    TEST_ASSERT_TRUE(Schedule.isDirty());
+    TEST_ASSERT_EQUAL(writes, LittleFS.getWriteCount());
+
+    runFor(ScheduleClass::WRITE_DELAY / 1000);
+    TEST_ASSERT_FALSE(Schedule.isDirty());
+    TEST_ASSERT_EQUAL(writes + 1, LittleFS.getWriteCount());
+
+    runFor(3600);
+    TEST_ASSERT_EQUAL(writes + 1, LittleFS.getWriteCount());
+}
+
+// lastFired survives a reboot inside the grace period, so the fire is not repeated
+void test_reboot_does_not_refire() {
+    Hal.setEpoch(localTime(2026, 6, 10, 6, 59));
+    Schedule.addRule(0, DAILY, 7, 0, ScheduleClass::ACTION_ON, true);
+    runFor(62);
+    TEST_ASSERT_EQUAL(1, fired.size());
+    TEST_ASSERT_TRUE(Schedule.commit());
+
+    boot();
+    runFor(60);
+    TEST_ASSERT_EQUAL(1, fired.size());
+    TEST_ASSERT_EQUAL(localTime(2026, 6, 11, 7, 0), Schedule.getNextFire(1));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_next_fire_plain_day);
+    RUN_TEST(test_next_fire_across_spring_forward);
+    RUN_TEST(test_skipped_time_fires_once);
+    RUN_TEST(test_repeated_hour_fires_once);
+    RUN_TEST(test_weekday_mask);
+    RUN_TEST(test_waits_for_clock_sync);
+    RUN_TEST(test_clock_jumps);
+    RUN_TEST(test_fires_share_one_write);
+    RUN_TEST(test_reboot_does_not_refire);
+    return UNITY_END();
+}
@@ -0,0 +1,256 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <new>
+#include <Hal.h>
+#include <Status.h>
+
+// /api/status against the request double: the document, the ETag and 304
+// path, parked long-polls and the heap use of a request, counted by
+// replacing the global operator new.
+
+static unsigned long allocations = 0;
+static bool counting = false;
+
+void* operator new(size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+// Channels in the document, as the real filler lists power outputs
+static int entries = 4;
+
+static void fill(JsonObject doc) {
+    doc["name"] = "desk";
+    doc["uptime"] = Hal.millis() / 1000;
+
+    JsonArray channels = doc["channels"].to<JsonArray>();
+    for (int i = 0; i < entries; i++) {
+        char name[24];
+        snprintf(name, sizeof(name), "channel-%d", i);
+        JsonObject ch = channels.add<JsonObject>();
+        ch["name"] = name;          // copied into the arena
+        ch["state"] = "IDLE";
+        ch["queued"] = i;
+    }
+}
+
+typedef std::shared_ptr<AsyncWebServerRequest> Request;
+
+static Request get(const char* ifNoneMatch = nullptr, const char* wait = nullptr) {
+    Request request = std::make_shared<AsyncWebServerRequest>();
+    if (ifNoneMatch) {
+        request->setHeader("If-None-Match", ifNoneMatch);
+    }
+    if (wait) {
+        request->setParam("wait", wait);
+    }
+    Status.handleRequest(request.get());
+    return request;
+}
+
+static void runFor(unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += 50) {
+        Hal.advance(50);
+        Status.loopStatus();
+    }
+}
+
+void setUp() {
+    Hal.reset();
+    Status = StatusClass();
+    Status.initStatus(fill);
+    entries = 4;
+}
+
+void tearDown() {
+}
+
+void test_document_and_etag() {
+    Request r = get();
+    TEST_ASSERT_EQUAL(200, r->getResponseCode());
+    TEST_ASSERT_EQUAL_STRING("application/json", r->getResponse()->contentType.c_str());
+    TEST_ASSERT_EQUAL_STRING("no-cache", r->getResponseHeader("Cache-Control").c_str());
+
+    std::string body = r->getResponseBody();
+    TEST_ASSERT_EQUAL('{', body.front());
+    TEST_ASSERT_EQUAL('}', body.back());
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, body.find("\"name\":\"desk\""));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, body.find("{\"name\":\"channel-3\",\"state\":\"IDLE\",\"queued\":3}"));
+
+    std::string etag = r->getResponseHeader("ETag");
+    TEST_ASSERT_EQUAL_STRING("W/\"", etag.substr(0, 3).c_str());
+    TEST_ASSERT_EQUAL('"', etag.back());
+}
+
+void test_matching_etag_gets_304() {
+    std::string etag = get()->getResponseHeader("ETag");
+
+    Request r = get(etag.c_str());
+    TEST_ASSERT_EQUAL(304, r->getResponseCode());
+    TEST_ASSERT_EQUAL_STRING(etag.c_str(), r->getResponseHeader("ETag").c_str());
+    TEST_ASSERT_EQUAL(1, Status.getNotModified());
+
+    // A proxy dropping the weak prefix still matches
+    TEST_ASSERT_EQUAL(304, get(etag.substr(2).c_str())->getResponseCode());
+
+    Status.touch();
+    Request changed = get(etag.c_str());
+    TEST_ASSERT_EQUAL(200, changed->getResponseCode());
+    TEST_ASSERT_NOT_EQUAL(etag, changed->getResponseHeader("ETag"));
+}
+
+// The boot id keeps a tag from before a reboot from matching
+void test_etag_differs_across_boots() {
+    std::string etag = get()->getResponseHeader("ETag");
+    Status = StatusClass();
+    Status.initStatus(fill);
+    TEST_ASSERT_EQUAL(200, get(etag.c_str())->getResponseCode());
+}
+
+void test_long_poll_answered_on_change() {
+    std::string etag = get()->getResponseHeader("ETag");
+
+    Request r = get(etag.c_str(), "20");
+    TEST_ASSERT_TRUE(r->isPaused());
+    TEST_ASSERT_EQUAL(0, r->getSendCount());
+    TEST_ASSERT_EQUAL(1, Status.getLongPolls());
+
+    runFor(5000);
+    TEST_ASSERT_EQUAL(0, r->getSendCount());
+
+    Status.touch();
+    runFor(50);
+    TEST_ASSERT_EQUAL(1, r->getSendCount());
+    TEST_ASSERT_EQUAL(200, r->getResponseCode());
+
+    // Answered once only
+    Status.touch();
+    runFor(1000);
+    TEST_ASSERT_EQUAL(1, r->getSendCount());
+}
+
+void test_long_poll_times_out_with_304() {
+    std::string etag = get()->getResponseHeader("ETag");
+
+    Request r = get(etag.c_str(), "5");
+    runFor(4900);
+    TEST_ASSERT_EQUAL(0, r->getSendCount());
+    runFor(200);
+    TEST_ASSERT_EQUAL(304, r->getResponseCode());
+
+    // ?wait= is capped at MAX_WAIT
+    Request capped = get(etag.c_str(), "600");
+    runFor(StatusClass::MAX_WAIT + 100);
+    TEST_ASSERT_EQUAL(304, capped->getResponseCode());
+}
+
+// Past MAX_WAITERS a poller gets an immediate 304; a client going away frees its slot
+void test_waiter_slots() {
+    std::string etag = get()->getResponseHeader("ETag");
+
+    Request parked[StatusClass::MAX_WAITERS];
+    for (int i = 0; i < StatusClass::MAX_WAITERS; i++) {
+        parked[i] = get(etag.c_str(), "20");
+        TEST_ASSERT_EQUAL(0, parked[i]->getSendCount());
+    }
+    TEST_ASSERT_EQUAL(304, get(etag.c_str(), "20")->getResponseCode());
+
+    parked[0].reset();
+    Request next = get(etag.c_str(), "20");
+    TEST_ASSERT_EQUAL(0, next->getSendCount());
+
+    Status.touch();
+    runFor(50);
+    TEST_ASSERT_EQUAL(200, next->getResponseCode());
+    for (int i = 1; i < StatusClass::MAX_WAITERS; i++) {
+        TEST_ASSERT_EQUAL(200, parked[i]->getResponseCode());
+    }
+}
+
+// The document lives in the arena and the stream is sized up front, so a
+// request makes the same allocations however large the document is
+void test_heap_use_independent_of_document_size() {
+    unsigned long small;
+    unsigned long large;
+
+    entries = 1;
+    {
+        Request r = std::make_shared<AsyncWebServerRequest>();
+        allocations = 0;
+        counting = true;
+        Status.handleRequest(r.get());
+        counting = false;
+        small = allocations;
+        TEST_ASSERT_EQUAL(200, r->getResponseCode());
+    }
+
+    entries = 20;
+    {
+        Request r = std::make_shared<AsyncWebServerRequest>();
+        allocations = 0;
+        counting = true;
+        Status.handleRequest(r.get());
+        counting = false;
+        large = allocations;
+        TEST_ASSERT_EQUAL(200, r->getResponseCode());
+        TEST_ASSERT_GREATER_THAN(800, r->getResponseBody().size());
+    }
+
+    TEST_ASSERT_EQUAL(small, large);
+    TEST_ASSERT_LESS_OR_EQUAL(StatusClass::ARENA_SIZE, Status.getArenaPeak());
+
+    char msg[80];
+    snprintf(msg, sizeof(msg), "%lu heap allocations per request, arena peak %u bytes",
+             large, (unsigned)Status.getArenaPeak());
+    TEST_MESSAGE(msg);
+}
+
+void test_arena_overflow_answers_500() {
+    entries = 1000;
+    Request r = get();
+    TEST_ASSERT_EQUAL(500, r->getResponseCode());
+    TEST_ASSERT_EQUAL(1, Status.getOverflows());
+
+    // The arena is cleared per document, so the next normal one is fine
+    entries = 4;
+    TEST_ASSERT_EQUAL(200, get()->getResponseCode());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_document_and_etag);
+    RUN_TEST(test_matching_etag_gets_304);
+    RUN_TEST(test_etag_differs_across_boots);
+    RUN_TEST(test_long_poll_answered_on_change);
+    RUN_TEST(test_long_poll_times_out_with_304);
+    RUN_TEST(test_waiter_slots);
+    RUN_TEST(test_heap_use_independent_of_document_size);
+    RUN_TEST(test_arena_overflow_answers_500);
+    return UNITY_END();
+}
@@ -0,0 +1,208 @@
+#include <unity.h>
+#include <array>
+#include <chrono>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+#include <Hal.h>
+#include <Tasks.h>
+
+// The deadline heap behind the main loop: tasks run in deadline order at
+// their deadline, a long run of random at() calls leaves the heap consistent,
+// late tasks count overruns without running back to back, and the table
+// refuses a task past MAX_TASKS.
+
+struct Run {
+    int id;
+    unsigned long at;
+};
+
+static std::vector<Run> trace;
+static unsigned long busyMicros = 0;
+
+template <int ID>
+static void record() {
+    trace.push_back({ID, Hal.millis()});
+    Hal.advanceMicros(busyMicros);
+}
+
+template <size_t... I>
+static std::array<TasksClass::TaskFunc, sizeof...(I)> makeFuncs(std::index_sequence<I...>) {
+    return {{ record<I>... }};
+}
+
+static const std::array<TasksClass::TaskFunc, TasksClass::MAX_TASKS> FUNCS =
+    makeFuncs(std::make_index_sequence<TasksClass::MAX_TASKS>());
+
+static void runUntil(unsigned long ms) {
+    while (Hal.millis() < ms) {
+        Tasks.loopTasks();
+    }
+    Tasks.loopTasks();
+}
+
+static int count(int id) {
+    int n = 0;
+    for (const Run& r : trace) {
+        n += r.id == id;
+    }
+    return n;
+}
+
+void setUp() {
+    Hal.reset();
+    Tasks = TasksClass();
+    trace.clear();
+    busyMicros = 0;
+}
+
+void tearDown() {
+}
+
+// Each periodic task runs on its own period, never early and never late
+void test_periods() {
+    Tasks.add("a", FUNCS[0], 30);
+    Tasks.add("b", FUNCS[1], 10);
+    Tasks.add("c", FUNCS[2], 20);
+
+    runUntil(60);
+    TEST_ASSERT_EQUAL(2, count(0));
+    TEST_ASSERT_EQUAL(6, count(1));
+    TEST_ASSERT_EQUAL(3, count(2));
+    for (const Run& r : trace) {
+        TEST_ASSERT_EQUAL(0, r.at % Tasks.getTask(r.id).period);
+    }
+    for (int id = 0; id < 3; id++) {
+        TEST_ASSERT_EQUAL(0, Tasks.getTask(id).maxLate);
+        TEST_ASSERT_EQUAL(0, Tasks.getTask(id).overruns);
+    }
+}
+
+// One-shot tasks wait for a deadline and run once; a later at() replaces it
+void test_one_shot() {
+    int id = Tasks.add("once", FUNCS[0], 0);
+    runUntil(500);
+    TEST_ASSERT_EQUAL(0, trace.size());
+
+    unsigned long now = Hal.millis();
+    Tasks.after(id, 50);
+    Tasks.after(id, 20);
+    runUntil(now + 500);
+    TEST_ASSERT_EQUAL(1, trace.size());
+    TEST_ASSERT_EQUAL(now + 20, trace[0].at);
+
+    Tasks.wake(id);
+    Tasks.loopTasks();
+    TEST_ASSERT_EQUAL(2, trace.size());
+}
+
+// 100k random reschedules of a full table; every round the tasks must run
+// exactly at their last deadline and in deadline order
+void test_random_reschedules() {
+    for (int i = 0; i < TasksClass::MAX_TASKS; i++) {
+        Tasks.add("shot", FUNCS[i], 0);
+    }
+
+    srand(23);
+    for (int round = 0; round < 100; round++) {
+        unsigned long deadlines[TasksClass::MAX_TASKS];
+        unsigned long now = Hal.millis();
+        for (int i = 0; i < TasksClass::MAX_TASKS; i++) {
+            deadlines[i] = now + 1 + rand() % 5000;
+            Tasks.at(i, deadlines[i]);
+        }
+        for (int i = TasksClass::MAX_TASKS; i < 1000; i++) {
+            int id = rand() % TasksClass::MAX_TASKS;
+            deadlines[id] = now + 1 + rand() % 5000;
+            Tasks.at(id, deadlines[id]);
+        }
+
+        trace.clear();
+        runUntil(now + 5001);
+        TEST_ASSERT_EQUAL(TasksClass::MAX_TASKS, trace.size());
+        for (size_t i = 0; i < trace.size(); i++) {
+            TEST_ASSERT_EQUAL(deadlines[trace[i].id], trace[i].at);
+            if (i > 0) {
+                TEST_ASSERT_TRUE(trace[i - 1].at <= trace[i].at);
+            }
+        }
+    }
+}
+
+// A pass that comes in a period late counts one overrun and skips the missed
+// slots instead of catching up back to back
+void test_overrun() {
+    int id = Tasks.add("tick", FUNCS[0], 10);
+    runUntil(30);
+    TEST_ASSERT_EQUAL(3, count(id));
+
+    Hal.advance(35);
+    Tasks.loopTasks();
+    TEST_ASSERT_EQUAL(4, count(id));
+    TEST_ASSERT_EQUAL(1, Tasks.getTask(id).overruns);
+    TEST_ASSERT_EQUAL(35, Tasks.getTask(id).maxLate);
+
+    unsigned long resumed = Hal.millis();
+    Tasks.loopTasks();
+    TEST_ASSERT_EQUAL(5, count(id));
+    TEST_ASSERT_EQUAL(resumed, trace.back().at);
+    TEST_ASSERT_EQUAL(1, Tasks.getTask(id).overruns);
+}
+
+void test_table_full() {
+    for (int i = 0; i < TasksClass::MAX_TASKS; i++) {
+        TEST_ASSERT_EQUAL(i, Tasks.add("t", FUNCS[i], 1000));
+    }
+    TEST_ASSERT_EQUAL(-1, Tasks.add("extra", FUNCS[0], 10));
+    TEST_ASSERT_EQUAL(TasksClass::MAX_TASKS, Tasks.getTaskCount());
+
+    // Unknown ids are ignored
+    Tasks.at(-1, 0);
+    Tasks.at(TasksClass::MAX_TASKS, 0);
+    Tasks.loopTasks();
+    TEST_ASSERT_EQUAL(0, trace.size());
+}
+
+// Run time is charged to the task, the sleep to idle
+void test_cpu_share() {
+    int id = Tasks.add("busy", FUNCS[0], 10);
+    busyMicros = 1000;
+    runUntil(10000);
+
+    TEST_ASSERT_UINT_WITHIN(5, 100, Tasks.getCpuPermille(id));
+    TEST_ASSERT_UINT_WITHIN(5, 900, Tasks.getIdlePermille());
+    TEST_ASSERT_EQUAL(1000, Tasks.getTask(id).maxMicros);
+}
+
+// Passes per simulated second and idle share for a loop-like task set,
+// against the free-running loop's one pass per iteration
+void test_pass_rate() {
+    static const unsigned long PERIODS[] = { 10, 10, 50, 100, 250, 1000, 1000, 5000 };
+    for (unsigned long period : PERIODS) {
+        Tasks.add("t", FUNCS[Tasks.getTaskCount()], period);
+    }
+    busyMicros = 50;
+
+    auto start = std::chrono::steady_clock::now();
+    runUntil(60000);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / Tasks.getPasses();
+
+    TEST_ASSERT_TRUE(Tasks.getIdlePermille() > 900);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%.0f passes/s simulated, idle %u permille, %.0f ns per pass on the host",
+             Tasks.getPasses() / 60.0, Tasks.getIdlePermille(), ns);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_periods);
+    RUN_TEST(test_one_shot);
+    RUN_TEST(test_random_reschedules);
+    RUN_TEST(test_overrun);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_cpu_share);
+    RUN_TEST(test_pass_rate);
+    return UNITY_END();
+}
@@ -0,0 +1,231 @@
+#include <unity.h>
+#include <Hal.h>
+#include <Config.h>
+#include <Wifi.h>
+
+// Reconnect cycles of WifiClass against the simulated station. The scan
+// table and link events come from the ESP8266WiFi double; Hal counts the
+// WiFi.begin() calls, i.e. association attempts.
+
+// RECONNECT_DELAY plus a couple of task periods
+static const unsigned long RECONNECT_WAIT_MS = 10100;
+
+static int connects = 0;
+static int disconnects = 0;
+
+// The wifi task runs every 50 ms
+static void runFor(unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += 50) {
+        Hal.advance(50);
+        Wifi.handleWiFiReconnection();
+    }
+}
+
+static void boot() {
+    Wifi = WifiClass();
+    Wifi.initWiFi([]() { connects++; }, []() { disconnects++; });
+}
+
+void setUp() {
+    Hal.reset();
+    WiFi.reset();
+    LittleFS.format();
+    ESP.clearRtc();
+    Config.load();
+    Config.set(ConfigClass::SSID, "home");
+    Config.set(ConfigClass::PASS, "secret");
+    connects = 0;
+    disconnects = 0;
+}
+
+void tearDown() {
+}
+
+void test_strongest_ap_on_first_attempt() {
+    WiFi.addNetwork("home", -70, 1);
+    WiFi.addNetwork("neighbour", -40, 6);
+    WiFi.addNetwork("home", -50, 11);
+    boot();
+    runFor(100);
+
+    TEST_ASSERT_EQUAL(1, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(1, Hal.getWifiBeginCount());
+    TEST_ASSERT_EQUAL(11, Hal.getWifiBeginChannel());
+
+    WiFi.gotIP();
+    TEST_ASSERT_EQUAL(1, connects);
+    TEST_ASSERT_EQUAL(1, Wifi.getLastCycleAttempts());
+    TEST_ASSERT_EQUAL_STRING("scan", Wifi.getBootPath());
+    TEST_ASSERT_EQUAL(WIFI_NONE_SLEEP, WiFi.getSleepMode());
+}
+
+// Each failed scan waits RECONNECT_DELAY; after MAX_WIFI_ATTEMPTS the AP comes up
+void test_no_network_gives_up_after_ten_attempts() {
+    boot();
+    runFor(5000);
+    TEST_ASSERT_EQUAL(1, WiFi.getScanCount());
+    runFor(10000);
+    TEST_ASSERT_EQUAL(2, WiFi.getScanCount());
+
+    runFor(120000);
+    TEST_ASSERT_EQUAL(10, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(0, Hal.getWifiBeginCount());
+    TEST_ASSERT_EQUAL(WIFI_AP, WiFi.getMode());
+
+    // No more attempts once the AP is up
+    runFor(300000);
+    TEST_ASSERT_EQUAL(10, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(0, connects);
+}
+
+void test_ap_appearing_mid_cycle() {
+    boot();
+    runFor(25000);
+    TEST_ASSERT_EQUAL(3, WiFi.getScanCount());
+
+    WiFi.addNetwork("home", -60, 6);
+    runFor(10000);
+    TEST_ASSERT_EQUAL(4, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(1, Hal.getWifiBeginCount());
+
+    WiFi.gotIP();
+    TEST_ASSERT_EQUAL(4, Wifi.getLastCycleAttempts());
+    TEST_ASSERT_EQUAL(WIFI_STA, WiFi.getMode());
+}
+
+// A connect that never gets an IP times out after WIFI_TIMEOUT and counts as an attempt
+void test_association_timeout_retries() {
+    WiFi.addNetwork("home", -60, 6);
+    boot();
+    runFor(30000);
+    TEST_ASSERT_EQUAL(1, Hal.getWifiBeginCount());
+
+    runFor(15000);
+    TEST_ASSERT_EQUAL(2, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(2, Hal.getWifiBeginCount());
+
+    WiFi.gotIP();
+    TEST_ASSERT_EQUAL(2, Wifi.getLastCycleAttempts());
+}
+
+// After a link loss the cached BSSID is tried first, without a scan
+void test_reconnect_uses_cached_ap() {
+    WiFi.addNetwork("home", -60, 6);
+    boot();
+    runFor(100);
+    WiFi.gotIP();
+    runFor(1000);
+
+    WiFi.linkLost();
+    TEST_ASSERT_EQUAL(1, disconnects);
+    runFor(RECONNECT_WAIT_MS);
+    TEST_ASSERT_EQUAL(1, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(2, Hal.getWifiBeginCount());
+
+    WiFi.gotIP();
+    TEST_ASSERT_EQUAL(2, connects);
+    TEST_ASSERT_EQUAL(0, Wifi.getLastCycleAttempts());
+    TEST_ASSERT_UINT32_WITHIN(100, RECONNECT_WAIT_MS, Wifi.getLastCycleDuration());
+}
+
+void test_cached_ap_gone_falls_back_to_scan() {
+    WiFi.addNetwork("home", -60, 6);
+    boot();
+    runFor(100);
+    WiFi.gotIP();
+
+    WiFi.linkLost();
+    runFor(RECONNECT_WAIT_MS);
+    TEST_ASSERT_EQUAL(2, Hal.getWifiBeginCount());
+
+    // The fast attempt gets FAST_CONNECT_TIMEOUT, then a normal scan attempt follows
+    runFor(5100);
+    TEST_ASSERT_EQUAL(2, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(3, Hal.getWifiBeginCount());
+
+    WiFi.gotIP();
+    TEST_ASSERT_EQUAL(1, Wifi.getLastCycleAttempts());
+}
+
+// The lease cached in RTC memory survives a reboot and skips the boot scan
+void test_boot_from_rtc_cache() {
+    WiFi.addNetwork("home", -60, 6);
+    boot();
+    runFor(100);
+    WiFi.gotIP();
+
+    Hal.reset();
+    WiFi.reset();
+    connects = 0;
+    boot();
+    TEST_ASSERT_EQUAL(0, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(1, Hal.getWifiBeginCount());
+
+    runFor(300);
+    WiFi.gotIP();
+    TEST_ASSERT_EQUAL(1, connects);
+    TEST_ASSERT_EQUAL_STRING("cache", Wifi.getBootPath());
+}
+
+// New credentials ignore the AP and lease cached for the old ones
+void test_cache_ignored_after_credentials_change() {
+    Config.set(ConfigClass::STATIC_IP, "auto");
+    WiFi.addNetwork("home", -60, 6);
+    WiFi.addNetwork("office", -50, 11);
+    boot();
+    runFor(100);
+    WiFi.gotIP();
+
+    Hal.reset();
+    WiFi.reset();
+    WiFi.addNetwork("home", -60, 6);
+    WiFi.addNetwork("office", -50, 11);
+    Config.set(ConfigClass::SSID, "office");
+    boot();
+    TEST_ASSERT_EQUAL(1, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(0, (uint32_t)WiFi.getStaticIp());
+
+    runFor(100);
+    TEST_ASSERT_EQUAL(11, Hal.getWifiBeginChannel());
+    WiFi.gotIP();
+    TEST_ASSERT_EQUAL_STRING("scan", Wifi.getBootPath());
+
+    // Same SSID, new password: still a different network as far as the cache goes
+    Hal.reset();
+    WiFi.reset();
+    WiFi.addNetwork("office", -50, 11);
+    Config.set(ConfigClass::PASS, "changed");
+    boot();
+    TEST_ASSERT_EQUAL(1, WiFi.getScanCount());
+
+    // And back to the credentials the cache was saved with
+    Hal.reset();
+    WiFi.reset();
+    Config.set(ConfigClass::PASS, "secret");
+    boot();
+    TEST_ASSERT_EQUAL(0, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL_STRING("192.168.1.50", WiFi.getStaticIp().toString().c_str());
+}
+
+void test_no_credentials_starts_ap() {
+    Config.set(ConfigClass::SSID, "");
+    boot();
+    runFor(2000);
+    TEST_ASSERT_EQUAL(WIFI_AP, WiFi.getMode());
+    TEST_ASSERT_EQUAL(0, WiFi.getScanCount());
+    TEST_ASSERT_EQUAL(0, Hal.getWifiBeginCount());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_strongest_ap_on_first_attempt);
+    RUN_TEST(test_no_network_gives_up_after_ten_attempts);
+    RUN_TEST(test_ap_appearing_mid_cycle);
+    RUN_TEST(test_association_timeout_retries);
+    RUN_TEST(test_reconnect_uses_cached_ap);
+    RUN_TEST(test_cached_ap_gone_falls_back_to_scan);
+    RUN_TEST(test_boot_from_rtc_cache);
+    RUN_TEST(test_cache_ignored_after_credentials_change);
+    RUN_TEST(test_no_credentials_starts_ap);
+    return UNITY_END();
+}
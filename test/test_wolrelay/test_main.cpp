@@ -0,0 +1,201 @@
+#include <unity.h>
+#include <chrono>
+#include <Hal.h>
+#include <Wol.h>
+#include <WolRelay.h>
+
+// Magic packet parsing and relaying. Datagrams go through the UDP double, so
+// loopWolRelay() drains real socket queues on ports 7 and 9.
+
+static const uint8_t KNOWN[WolClass::MAC_SIZE] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+static const uint8_t OTHER[WolClass::MAC_SIZE] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+
+static int wakes = 0;
+static uint8_t lastWoken[WolClass::MAC_SIZE];
+
+void setUp() {
+    Hal.reset();
+    Hal.advance(1000);
+    LittleFS.format();
+    WolRelay = WolRelayClass();
+    WolRelay.initWolRelay([](const uint8_t* mac) {
+        wakes++;
+        memcpy(lastWoken, mac, sizeof(lastWoken));
+    });
+    WolRelay.saveMacs("00:11:22:33:44:55");
+    wakes = 0;
+}
+
+void tearDown() {
+}
+
+void test_parse_valid_packet() {
+    uint8_t packet[WolClass::MAGIC_PACKET_SIZE];
+    TEST_ASSERT_EQUAL(WolClass::MAGIC_PACKET_SIZE, WolClass::buildMagicPacket(packet, KNOWN, nullptr));
+
+    const uint8_t* mac = WolRelayClass::parseMagicPacket(packet, sizeof(packet));
+    TEST_ASSERT_EQUAL_PTR(packet + WolClass::MAC_SIZE, mac);
+    TEST_ASSERT_EQUAL_MEMORY(KNOWN, mac, WolClass::MAC_SIZE);
+}
+
+void test_parse_secureon_packet() {
+    static const uint8_t password[WolClass::SECUREON_SIZE] = {1, 2, 3, 4, 5, 6};
+    uint8_t packet[WolClass::MAGIC_PACKET_SIZE + WolClass::SECUREON_SIZE];
+    size_t len = WolClass::buildMagicPacket(packet, KNOWN, password);
+    TEST_ASSERT_EQUAL(sizeof(packet), len);
+    TEST_ASSERT_NOT_NULL(WolRelayClass::parseMagicPacket(packet, len));
+}
+
+void test_parse_rejects_short_packet() {
+    uint8_t packet[WolClass::MAGIC_PACKET_SIZE];
+    WolClass::buildMagicPacket(packet, KNOWN, nullptr);
+    TEST_ASSERT_NULL(WolRelayClass::parseMagicPacket(packet, sizeof(packet) - 1));
+    TEST_ASSERT_NULL(WolRelayClass::parseMagicPacket(packet, 0));
+}
+
+// Any single damaged byte, in the sync stream or any repetition, is caught
+void test_parse_rejects_every_corrupted_byte() {
+    uint8_t packet[WolClass::MAGIC_PACKET_SIZE];
+    WolClass::buildMagicPacket(packet, KNOWN, nullptr);
+
+    for (size_t i = 0; i < sizeof(packet); i++) {
+        uint8_t damaged[sizeof(packet)];
+        memcpy(damaged, packet, sizeof(packet));
+        damaged[i] ^= 0x01;
+        TEST_ASSERT_NULL(WolRelayClass::parseMagicPacket(damaged, sizeof(damaged)));
+    }
+}
+
+// The 32-bit compares must not depend on the buffer being word aligned
+void test_parse_unaligned_buffer() {
+    uint8_t buffer[WolClass::MAGIC_PACKET_SIZE + 3];
+    for (size_t offset = 0; offset < 4; offset++) {
+        uint8_t* packet = buffer + offset;
+        WolClass::buildMagicPacket(packet, OTHER, nullptr);
+        const uint8_t* mac = WolRelayClass::parseMagicPacket(packet, WolClass::MAGIC_PACKET_SIZE);
+        TEST_ASSERT_NOT_NULL(mac);
+        TEST_ASSERT_EQUAL_MEMORY(OTHER, mac, WolClass::MAC_SIZE);
+    }
+}
+
+void test_known_mac_relayed_once_per_burst() {
+    uint8_t packet[WolClass::MAGIC_PACKET_SIZE];
+    WolClass::buildMagicPacket(packet, KNOWN, nullptr);
+
+    // etherwake and router pages send a few copies back to back
+    TEST_ASSERT_TRUE(WolRelay.handlePacket(packet, sizeof(packet)));
+    for (int i = 0; i < 4; i++) {
+        Hal.advance(100);
+        TEST_ASSERT_FALSE(WolRelay.handlePacket(packet, sizeof(packet)));
+    }
+    TEST_ASSERT_EQUAL(1, wakes);
+    TEST_ASSERT_EQUAL_MEMORY(KNOWN, lastWoken, WolClass::MAC_SIZE);
+
+    Hal.advance(WolRelayClass::DUPLICATE_WINDOW);
+    TEST_ASSERT_TRUE(WolRelay.handlePacket(packet, sizeof(packet)));
+    TEST_ASSERT_EQUAL(2, wakes);
+
+    const WolRelayClass::Stats& st = WolRelay.getStats();
+    TEST_ASSERT_EQUAL(6, st.received);
+    TEST_ASSERT_EQUAL(4, st.suppressed);
+    TEST_ASSERT_EQUAL(2, st.relayed);
+}
+
+void test_unknown_mac_and_garbage_counted() {
+    uint8_t packet[WolClass::MAGIC_PACKET_SIZE];
+    WolClass::buildMagicPacket(packet, OTHER, nullptr);
+    TEST_ASSERT_FALSE(WolRelay.handlePacket(packet, sizeof(packet)));
+
+    uint8_t garbage[64];
+    memset(garbage, 0xFF, sizeof(garbage));
+    TEST_ASSERT_FALSE(WolRelay.handlePacket(garbage, sizeof(garbage)));
+
+    TEST_ASSERT_EQUAL(0, wakes);
+    TEST_ASSERT_EQUAL(1, WolRelay.getStats().unknownMac);
+    TEST_ASSERT_EQUAL(1, WolRelay.getStats().invalid);
+}
+
+// What Wol sends on port 9 is what the relay wakes on, on both ports
+// A list with any bad token leaves the table and the file as they were
+void test_save_rejects_invalid_list() {
+    TEST_ASSERT_FALSE(WolRelay.saveMacs("AA:BB:CC:DD:EE:FF, not-a-mac"));
+    TEST_ASSERT_FALSE(WolRelay.saveMacs("AA:BB:CC:DD:EE:F"));
+    TEST_ASSERT_FALSE(WolRelay.saveMacs(
+        "00:00:00:00:00:01 00:00:00:00:00:02 00:00:00:00:00:03 00:00:00:00:00:04 00:00:00:00:00:05 "
+        "00:00:00:00:00:06 00:00:00:00:00:07 00:00:00:00:00:08 00:00:00:00:00:09"));
+    TEST_ASSERT_EQUAL(1, WolRelay.getMacCount());
+    TEST_ASSERT_EQUAL_MEMORY(KNOWN, WolRelay.getMac(0), WolClass::MAC_SIZE);
+    TEST_ASSERT_EQUAL_STRING("00:11:22:33:44:55\n", Filesys.readEntireFile("/wol_relay.txt").c_str());
+
+    TEST_ASSERT_TRUE(WolRelay.saveMacs("aa-bb-cc-dd-ee-ff,00:11:22:33:44:55"));
+    TEST_ASSERT_EQUAL(2, WolRelay.getMacCount());
+
+    // An empty list turns the relay off
+    TEST_ASSERT_TRUE(WolRelay.saveMacs(""));
+    TEST_ASSERT_EQUAL(0, WolRelay.getMacCount());
+}
+
+void test_sockets_round_trip() {
+    WiFiUDP::clearSent();
+    Wol.wake(KNOWN);
+    TEST_ASSERT_EQUAL(1, WiFiUDP::getSent().size());
+    const WiFiUDP::Datagram& d = WiFiUDP::getSent()[0];
+    TEST_ASSERT_EQUAL(WolClass::WOL_PORT, d.port);
+
+    TEST_ASSERT_EQUAL(1, WiFiUDP::deliver(WolClass::WOL_PORT, d.data.data(), d.data.size()));
+    WolRelay.loopWolRelay();
+    TEST_ASSERT_EQUAL(1, wakes);
+
+    Hal.advance(WolRelayClass::DUPLICATE_WINDOW);
+    TEST_ASSERT_EQUAL(1, WiFiUDP::deliver(7, d.data.data(), d.data.size()));
+    WolRelay.loopWolRelay();
+    TEST_ASSERT_EQUAL(2, wakes);
+}
+
+// Datagrams larger than the receive buffer are drained and counted, not parsed
+void test_oversized_datagram_drained() {
+    uint8_t big[WolRelayClass::MAX_PACKET_SIZE + 50];
+    WolClass::buildMagicPacket(big, KNOWN, nullptr);
+    WiFiUDP::deliver(WolClass::WOL_PORT, big, sizeof(big));
+    WiFiUDP::deliver(WolClass::WOL_PORT, big, WolClass::MAGIC_PACKET_SIZE);
+    WolRelay.loopWolRelay();
+
+    TEST_ASSERT_EQUAL(2, WolRelay.getStats().received);
+    TEST_ASSERT_EQUAL(1, WolRelay.getStats().invalid);
+    TEST_ASSERT_EQUAL(1, wakes);
+}
+
+void test_parse_throughput() {
+    static const int PACKETS = 200000;
+    uint8_t packet[WolClass::MAGIC_PACKET_SIZE];
+    WolClass::buildMagicPacket(packet, KNOWN, nullptr);
+
+    int valid = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < PACKETS; i++) {
+        packet[WolClass::MAGIC_PACKET_SIZE - 1] = (uint8_t)(i & 1 ? 0x55 : 0x56);
+        valid += WolRelayClass::parseMagicPacket(packet, sizeof(packet)) != nullptr;
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_EQUAL(PACKETS / 2, valid);
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%.0f packets/s parsed on the host", PACKETS / s);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_valid_packet);
+    RUN_TEST(test_parse_secureon_packet);
+    RUN_TEST(test_parse_rejects_short_packet);
+    RUN_TEST(test_parse_rejects_every_corrupted_byte);
+    RUN_TEST(test_parse_unaligned_buffer);
+    RUN_TEST(test_known_mac_relayed_once_per_burst);
+    RUN_TEST(test_unknown_mac_and_garbage_counted);
+    RUN_TEST(test_save_rejects_invalid_list);
+    RUN_TEST(test_sockets_round_trip);
+    RUN_TEST(test_oversized_datagram_drained);
+    RUN_TEST(test_parse_throughput);
+    return UNITY_END();
+}
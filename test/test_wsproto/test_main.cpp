@@ -0,0 +1,336 @@
+#include <unity.h>
+#include <string>
+#include <Hal.h>
+#include <Power.h>
+#include <WsProto.h>
+
+// Frame parsing on /ws and the per-client send budget: a slow consumer gets
+// at most CLIENT_BUDGET messages queued, withheld state collapses into one
+// resync, withheld log lines into one marker, and a client that never drains
+// is disconnected after STALL_TIMEOUT.
+
+static AsyncWebSocket ws("/ws");
+static int resyncs = 0;
+static bool resyncBinary = false;
+
+static AsyncWebSocketClient* connect(bool slow = false) {
+    AsyncWebSocketClient* client = ws.addClient(slow);
+    WsProto.onConnect(client);
+    return client;
+}
+
+static const WsProtoClass::Client& entry(AsyncWebSocketClient* client) {
+    for (int i = 0; i < WsProtoClass::MAX_CLIENTS; i++) {
+        if (WsProto.getClient(i).id == client->id()) {
+            return WsProto.getClient(i);
+        }
+    }
+    TEST_FAIL_MESSAGE("client not tracked");
+    return WsProto.getClient(0);
+}
+
+static size_t request(uint8_t* out, uint8_t op, uint16_t id, const uint8_t* payload = nullptr, uint16_t len = 0) {
+    return WsProtoClass::putFrame(out, WsProtoClass::HEADER_SIZE + len, op, id, payload, len);
+}
+
+// Any frame makes the client binary; its reply is drained and forgotten
+static AsyncWebSocketClient* connectBinary(bool slow = false) {
+    AsyncWebSocketClient* client = connect(slow);
+    uint8_t frame[WsProtoClass::HEADER_SIZE];
+    WsProto.handleMessage(client, frame, request(frame, WsProtoClass::OP_STATUS, 1));
+    client->drain();
+    client->clearSent();
+    return client;
+}
+
+static void fill(AsyncWebSocketClient* client) {
+    while (client->queueLen() < WsProtoClass::CLIENT_BUDGET) {
+        client->text("filler");
+    }
+    client->clearSent();
+}
+
+static void broadcastPc(uint8_t state) {
+    WsProto.broadcast(state ? "{\"pc\":1}" : "{\"pc\":0}", WsProtoClass::OP_PC, &state, 1);
+}
+
+void setUp() {
+    Hal.reset();
+    ws = AsyncWebSocket("/ws");
+    resyncs = 0;
+    resyncBinary = false;
+    WsProto = WsProtoClass();
+    WsProto.initWsProto(&ws, [](AsyncWebSocketClient*, bool binary) {
+        resyncs++;
+        resyncBinary = binary;
+    });
+}
+
+void tearDown() {
+}
+
+// Several frames in one message get their replies in one message, in order
+void test_pipelined_frames() {
+    uint8_t message[64];
+    const uint8_t ping[] = { 0, 'a', 'b', 'c' };
+    size_t len = request(message, WsProtoClass::OP_STATUS, 7);
+    len += request(message + len, WsProtoClass::OP_PING, 8, ping, sizeof(ping));
+
+    AsyncWebSocketClient* client = connect();
+    WsProto.handleMessage(client, message, len);
+    TEST_ASSERT_EQUAL(2, WsProto.getFrames());
+    TEST_ASSERT_EQUAL(0, WsProto.getMalformed());
+    TEST_ASSERT_TRUE(entry(client).binary);
+
+    TEST_ASSERT_EQUAL(1, client->getSent().size());
+    const std::string& reply = client->getSent()[0].data;
+    TEST_ASSERT_TRUE(client->getSent()[0].binary);
+
+    size_t statusLen = 3 + Power.getChannelCount();
+    TEST_ASSERT_EQUAL(2 * WsProtoClass::HEADER_SIZE + statusLen + sizeof(ping), reply.size());
+    TEST_ASSERT_EQUAL(WsProtoClass::OP_STATUS, (uint8_t)reply[0]);
+    TEST_ASSERT_EQUAL(7, (uint8_t)reply[1]);
+    TEST_ASSERT_EQUAL(statusLen, (uint8_t)reply[3]);
+    TEST_ASSERT_EQUAL(Power.getChannelCount(), (uint8_t)reply[WsProtoClass::HEADER_SIZE + 2]);
+
+    const char* echo = reply.data() + WsProtoClass::HEADER_SIZE + statusLen;
+    TEST_ASSERT_EQUAL(WsProtoClass::OP_PING, (uint8_t)echo[0]);
+    TEST_ASSERT_EQUAL(8, (uint8_t)echo[1]);
+    TEST_ASSERT_EQUAL_MEMORY(ping, echo + WsProtoClass::HEADER_SIZE, sizeof(ping));
+}
+
+// A trailing partial frame is dropped and counted; the complete ones are answered
+void test_truncated_frame() {
+    uint8_t message[32];
+    const uint8_t power[] = { 99, 0 };
+    size_t len = request(message, WsProtoClass::OP_POWER, 1, power, sizeof(power));
+    len += request(message + len, 0x7F, 2);
+    message[len++] = WsProtoClass::OP_STATUS;
+    message[len++] = 3;
+    message[len++] = 0;
+
+    AsyncWebSocketClient* client = connect();
+    WsProto.handleMessage(client, message, len);
+    TEST_ASSERT_EQUAL(2, WsProto.getFrames());
+    TEST_ASSERT_EQUAL(1, WsProto.getMalformed());
+
+    const std::string& reply = client->getSent()[0].data;
+    TEST_ASSERT_EQUAL(2 * (WsProtoClass::HEADER_SIZE + 1), reply.size());
+    TEST_ASSERT_EQUAL(WsProtoClass::OP_ACK, (uint8_t)reply[0]);
+    TEST_ASSERT_EQUAL(WsProtoClass::ACK_BAD_REQUEST, (uint8_t)reply[WsProtoClass::HEADER_SIZE]);
+    TEST_ASSERT_EQUAL(WsProtoClass::ACK_UNKNOWN_OP, (uint8_t)reply[2 * WsProtoClass::HEADER_SIZE + 1]);
+
+    // A length running past the message yields nothing but the count
+    const uint8_t lying[] = { WsProtoClass::OP_STATUS, 4, 0, 200, 0 };
+    WsProto.handleMessage(client, lying, sizeof(lying));
+    TEST_ASSERT_EQUAL(2, WsProto.getMalformed());
+    TEST_ASSERT_EQUAL(1, client->getSent().size());
+}
+
+// Replies past REPLY_SIZE go out in more messages; every frame is answered
+void test_replies_over_reply_size() {
+    static const int FRAMES = 60;
+    uint8_t message[FRAMES * WsProtoClass::HEADER_SIZE];
+    size_t len = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        len += request(message + len, WsProtoClass::OP_STATUS, 100 + i);
+    }
+
+    AsyncWebSocketClient* client = connect();
+    WsProto.handleMessage(client, message, len);
+    TEST_ASSERT_EQUAL(FRAMES, WsProto.getFrames());
+    TEST_ASSERT_TRUE(client->getSent().size() > 1);
+
+    int id = 100;
+    for (const auto& sent : client->getSent()) {
+        TEST_ASSERT_TRUE(sent.data.size() <= WsProtoClass::REPLY_SIZE);
+        for (size_t pos = 0; pos < sent.data.size(); id++) {
+            TEST_ASSERT_EQUAL(WsProtoClass::OP_STATUS, (uint8_t)sent.data[pos]);
+            TEST_ASSERT_EQUAL(id, (uint8_t)sent.data[pos + 1]);
+            pos += WsProtoClass::HEADER_SIZE + (uint8_t)sent.data[pos + 3];
+        }
+    }
+    TEST_ASSERT_EQUAL(100 + FRAMES, id);
+}
+
+// Every pulse that runs is acknowledged with its command id, and segments
+// out of range are refused without reaching the queue
+void test_pulses_acknowledged() {
+    static const int FRAMES = 80;
+    uint8_t message[FRAMES * (WsProtoClass::HEADER_SIZE + 7)];
+    size_t len = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        uint16_t press = 100 + i;
+        uint16_t gap = i == 0 ? 0 : 50;
+        const uint8_t pulse[] = { (uint8_t)(i % 2), (uint8_t)press, (uint8_t)(press >> 8),
+                                  (uint8_t)gap, (uint8_t)(gap >> 8), (uint8_t)press, (uint8_t)(press >> 8) };
+        len += request(message + len, WsProtoClass::OP_PULSE, i, pulse, sizeof(pulse));
+    }
+
+    unsigned long submitted = Power.getSubmitted();
+    AsyncWebSocketClient* client = connect();
+    WsProto.handleMessage(client, message, len);
+
+    int acks = 0;
+    int ok = 0;
+    int bad = 0;
+    for (const auto& sent : client->getSent()) {
+        for (size_t pos = 0; pos < sent.data.size(); acks++) {
+            TEST_ASSERT_EQUAL(WsProtoClass::OP_ACK, (uint8_t)sent.data[pos]);
+            TEST_ASSERT_EQUAL(acks, (uint8_t)sent.data[pos + 1]);
+            uint8_t status = sent.data[pos + WsProtoClass::HEADER_SIZE];
+            ok += status == WsProtoClass::ACK_OK;
+            bad += status == WsProtoClass::ACK_BAD_REQUEST;
+            pos += WsProtoClass::HEADER_SIZE + (uint8_t)sent.data[pos + 3];
+        }
+    }
+    TEST_ASSERT_EQUAL(FRAMES, acks);
+    TEST_ASSERT_EQUAL(1, bad);
+    TEST_ASSERT_EQUAL(Power.getSubmitted() - submitted, ok);
+
+    for (int i = 0; i < 600; i++) {
+        Hal.advance(100);
+        Power.handlePowerStateMachine();
+    }
+}
+
+// Events over budget are not queued; the slow client is marked for one resync
+void test_budget_coalesces_state() {
+    AsyncWebSocketClient* slow = connectBinary(true);
+    AsyncWebSocketClient* text = connect();
+
+    for (int i = 0; i < 10; i++) {
+        broadcastPc(i & 1);
+    }
+    TEST_ASSERT_EQUAL(WsProtoClass::CLIENT_BUDGET, slow->getSent().size());
+    TEST_ASSERT_EQUAL(WsProtoClass::CLIENT_BUDGET, slow->queueLen());
+    TEST_ASSERT_EQUAL(10, text->getSent().size());
+    TEST_ASSERT_FALSE(text->getSent()[0].binary);
+    TEST_ASSERT_EQUAL(10 - WsProtoClass::CLIENT_BUDGET, WsProto.getCoalesced());
+    TEST_ASSERT_TRUE(entry(slow).resync);
+    TEST_ASSERT_EQUAL(0, resyncs);
+
+    // Once drained, one OP_STATUS snapshot replaces everything it missed
+    slow->drain();
+    slow->clearSent();
+    WsProto.loopWsProto();
+    TEST_ASSERT_EQUAL(1, slow->getSent().size());
+    TEST_ASSERT_EQUAL(WsProtoClass::OP_STATUS, (uint8_t)slow->getSent()[0].data[0]);
+    TEST_ASSERT_EQUAL(0, (uint8_t)slow->getSent()[0].data[1]);
+    TEST_ASSERT_EQUAL(1, resyncs);
+    TEST_ASSERT_TRUE(resyncBinary);
+    TEST_ASSERT_FALSE(entry(slow).resync);
+
+    WsProto.loopWsProto();
+    TEST_ASSERT_EQUAL(1, resyncs);
+}
+
+// A text client gets no frame, only the resync callback
+void test_text_client_resync() {
+    AsyncWebSocketClient* slow = connect(true);
+    fill(slow);
+    broadcastPc(1);
+    TEST_ASSERT_EQUAL(0, slow->getSent().size());
+
+    slow->drain();
+    broadcastPc(0);
+    TEST_ASSERT_EQUAL(1, resyncs);
+    TEST_ASSERT_FALSE(resyncBinary);
+    TEST_ASSERT_EQUAL(1, slow->getSent().size());
+    TEST_ASSERT_EQUAL_STRING("{\"pc\":0}", slow->getSent()[0].data.c_str());
+}
+
+// Withheld log batches are counted by line and announced before the next one
+void test_skipped_lines_marker() {
+    AsyncWebSocketClient* slow = connect(true);
+    AsyncWebSocketClient* quiet = connectBinary();
+    fill(slow);
+
+    WsProto.sendLogs("one\n", 4);
+    WsProto.sendLogs("two\nthree\nfour", 14);
+    TEST_ASSERT_EQUAL(4, WsProto.getSkippedLines());
+    TEST_ASSERT_EQUAL(4, entry(slow).skippedLines);
+    TEST_ASSERT_EQUAL(0, slow->getSent().size());
+
+    slow->drain();
+    WsProto.sendLogs("five\n", 5);
+    TEST_ASSERT_EQUAL(2, slow->getSent().size());
+    TEST_ASSERT_EQUAL_STRING("[4 log lines skipped]", slow->getSent()[0].data.c_str());
+    TEST_ASSERT_EQUAL_STRING("five\n", slow->getSent()[1].data.c_str());
+    TEST_ASSERT_EQUAL(0, entry(slow).skippedLines);
+
+    // Binary clients that did not subscribe get no log at all
+    TEST_ASSERT_EQUAL(0, quiet->getSent().size());
+}
+
+// Over budget for longer than STALL_TIMEOUT gets the client closed
+void test_stalled_client_evicted() {
+    AsyncWebSocketClient* slow = connect(true);
+    AsyncWebSocketClient* recovering = connect(true);
+    fill(slow);
+    fill(recovering);
+    broadcastPc(1);
+
+    Hal.advance(WsProtoClass::STALL_TIMEOUT - 10);
+    WsProto.loopWsProto();
+    TEST_ASSERT_EQUAL(0, WsProto.getEvicted());
+
+    // Draining in time resets the clock
+    recovering->drain();
+    WsProto.loopWsProto();
+    fill(recovering);
+
+    Hal.advance(20);
+    WsProto.loopWsProto();
+    TEST_ASSERT_EQUAL(1, WsProto.getEvicted());
+    TEST_ASSERT_EQUAL(WS_DISCONNECTED, slow->status());
+    TEST_ASSERT_EQUAL(WS_CONNECTED, recovering->status());
+    TEST_ASSERT_EQUAL(1, ws.count());
+}
+
+// Fanout pings go through the budget like any other event
+void test_ping_fanout_admit() {
+    AsyncWebSocketClient* sender = connectBinary();
+    AsyncWebSocketClient* fast = connectBinary();
+    AsyncWebSocketClient* slow = connectBinary(true);
+    AsyncWebSocketClient* text = connect();
+    fill(slow);
+
+    uint8_t message[WsProtoClass::HEADER_SIZE + WsProtoClass::PING_SIZE];
+    const uint8_t ping[] = { 1, 0xAA, 0x55 };
+    WsProto.handleMessage(sender, message, request(message, WsProtoClass::OP_PING, 42, ping, sizeof(ping)));
+
+    TEST_ASSERT_EQUAL(1, sender->getSent().size());
+    TEST_ASSERT_EQUAL(1, fast->getSent().size());
+    TEST_ASSERT_EQUAL(WsProtoClass::OP_PING, (uint8_t)fast->getSent()[0].data[0]);
+    TEST_ASSERT_EQUAL(42, (uint8_t)fast->getSent()[0].data[1]);
+    TEST_ASSERT_EQUAL(0, slow->getSent().size());
+    TEST_ASSERT_EQUAL(1, entry(slow).dropped);
+    TEST_ASSERT_EQUAL(0, text->getSent().size());
+
+    // Oversized ping data is rejected to the sender only
+    uint8_t big[WsProtoClass::PING_SIZE + 1] = { 1 };
+    uint8_t oversized[WsProtoClass::HEADER_SIZE + sizeof(big)];
+    WsProto.handleMessage(sender, oversized, request(oversized, WsProtoClass::OP_PING, 43, big, sizeof(big)));
+    TEST_ASSERT_EQUAL(2, sender->getSent().size());
+    TEST_ASSERT_EQUAL(WsProtoClass::OP_ACK, (uint8_t)sender->getSent()[1].data[0]);
+    TEST_ASSERT_EQUAL(1, fast->getSent().size());
+}
+
+int main(int argc, char** argv) {
+    Power.initPower();
+    Power.addChannel("Remote PC", 5);
+    Power.addChannel("NAS", 4);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pipelined_frames);
+    RUN_TEST(test_truncated_frame);
+    RUN_TEST(test_replies_over_reply_size);
+    RUN_TEST(test_pulses_acknowledged);
+    RUN_TEST(test_budget_coalesces_state);
+    RUN_TEST(test_text_client_resync);
+    RUN_TEST(test_skipped_lines_marker);
+    RUN_TEST(test_stalled_client_evicted);
+    RUN_TEST(test_ping_fanout_admit);
+    return UNITY_END();
+}